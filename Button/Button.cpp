@@ -1,7 +1,7 @@
 /*
 ||
 || @file Button.cpp
-|| @version 1.6
+|| @version 1.7
 || @author Alexander Brevig
 || @contact alexanderbrevig@gmail.com
 ||
@@ -19,6 +19,26 @@
 
 //include the class definition
 #include "Button.h"
+#include <avr/interrupt.h>
+
+static Button *buttons[BUTTON_MAX];
+static uint8_t buttonCount = 0;
+static volatile uint8_t buttonPending = 0;
+static uint8_t buttonHeld = 0;
+
+static ButtonEvent eventQueue[BUTTON_QUEUE_SIZE];
+static uint8_t eventHead = 0;
+static uint8_t eventTail = 0;
+
+static void pushEvent(uint8_t type, uint8_t buttons){
+    uint8_t next = (eventHead + 1) % BUTTON_QUEUE_SIZE;
+    if (next == eventTail){
+        return; //full, drop it
+    }
+    eventQueue[eventHead].type = type;
+    eventQueue[eventHead].buttons = buttons;
+    eventHead = next;
+}
 
 /*
 || <<constructor>>
@@ -92,8 +112,144 @@ bool Button::uniquePress(void){
     return (isPressed() && stateChanged());
 }
 
+/*
+|| Capture the changes of the pin with a pin change interrupt,
+|| the events are then made by update()
+|| @return false if there are already BUTTON_MAX buttons attached
+*/
+bool Button::attach(void){
+    if (buttonCount >= BUTTON_MAX){
+        return false;
+    }
+    id = buttonCount;
+    bitmask = digitalPinToBitMask(pin);
+    input = portInputRegister(digitalPinToPort(pin));
+    raw = ((*input & bitmask) ? HIGH : LOW) != mode;
+    stable = raw;
+    handled = true;
+    changed = millis();
+
+    uint8_t oldSREG = SREG;
+    cli();
+    buttons[buttonCount++] = this;
+    *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+    *digitalPinToPCICR(pin) |= _BV(digitalPinToPCICRbit(pin));
+    SREG = oldSREG;
+    return true;
+}
+
+/*
+|| Return the bit of this button in ButtonEvent.buttons
+*/
+uint8_t Button::mask(void){
+    return 1 << id;
+}
+
+/*
+|| Called from the pin change interrupt, only notes the time of
+|| each change so the debounce can be done outside the interrupt
+*/
+void Button::handleInterrupt(void){
+    for (uint8_t i = 0; i < buttonCount; i++){
+        Button *b = buttons[i];
+        uint8_t pressed = ((*b->input & b->bitmask) ? HIGH : LOW) != b->mode;
+        if (pressed != b->raw){
+            b->raw = pressed;
+            b->changed = millis();
+            buttonPending = true;
+        }
+    }
+}
+
+/*
+|| Turn the pin changes into events, a change counts once the pin
+|| has been stable for BUTTON_DEBOUNCE_MS
+|| Returns right away when no pin has changed and nothing is held
+|| A press always gives a PRESS event, and then one of:
+||   LONG when held for BUTTON_LONG_MS
+||   CHORD when pressed together with other buttons, with all of them
+||   RELEASE when released, if it did not give LONG or CHORD
+*/
+void Button::update(void){
+    if (!buttonPending && !buttonHeld){
+        return;
+    }
+    buttonPending = false;
+    unsigned long now = millis();
+
+    for (uint8_t i = 0; i < buttonCount; i++){
+        Button *b = buttons[i];
+
+        uint8_t oldSREG = SREG;
+        cli();
+        uint8_t pressed = b->raw;
+        unsigned long changed = b->changed;
+        SREG = oldSREG;
+
+        if (pressed != b->stable){
+            if ((now - changed) < BUTTON_DEBOUNCE_MS){
+                buttonPending = true; //look again later
+                continue;
+            }
+            b->stable = pressed;
+            if (pressed){
+                b->pressedAt = now;
+                b->handled = false;
+                pushEvent(BUTTON_EVENT_PRESS, b->mask());
+                buttonHeld |= b->mask();
+                if (buttonHeld & ~b->mask()){
+                    pushEvent(BUTTON_EVENT_CHORD, buttonHeld);
+                    for (uint8_t j = 0; j < buttonCount; j++){
+                        if (buttonHeld & buttons[j]->mask()){
+                            buttons[j]->handled = true;
+                        }
+                    }
+                }
+            } else {
+                buttonHeld &= ~b->mask();
+                if (!b->handled){
+                    pushEvent(BUTTON_EVENT_RELEASE, b->mask());
+                }
+                b->handled = true;
+            }
+        } else if (pressed && !b->handled && (now - b->pressedAt) >= BUTTON_LONG_MS){
+            b->handled = true;
+            pushEvent(BUTTON_EVENT_LONG, b->mask());
+        }
+    }
+}
+
+/*
+|| Get the oldest event
+|| @return false if there are no events
+*/
+bool Button::getEvent(ButtonEvent *event){
+    if (eventHead == eventTail){
+        return false;
+    }
+    *event = eventQueue[eventTail];
+    eventTail = (eventTail + 1) % BUTTON_QUEUE_SIZE;
+    return true;
+}
+
+#ifndef BUTTON_NO_PCINT_ISR
+ISR(PCINT0_vect){
+    Button::handleInterrupt();
+}
+
+ISR(PCINT1_vect){
+    Button::handleInterrupt();
+}
+
+ISR(PCINT2_vect){
+    Button::handleInterrupt();
+}
+#endif
+
 /*
 || @changelog
+|| | 2026-10-19 - pannan : Added attach(), mask(), update(), getEvent()
+|| |                       and the pin change interrupts
 || | 2009-05-05 - Alexander Brevig : Added uniquePress()
 || | 2009-04-24 - Alexander Brevig : Added wasPressed()
 || | 2009-04-12 - Alexander Brevig : Added constructor
@@ -1,7 +1,7 @@
 /*
 ||
 || @file Button.h
-|| @version 1.6
+|| @version 1.7
 || @author Alexander Brevig
 || @contact alexanderbrevig@gmail.com
 ||
@@ -29,6 +29,24 @@
 #define PREVIOUS 1
 #define CHANGED 2
 
+/*
+|| Event engine, see attach(), update() and getEvent()
+*/
+#define BUTTON_MAX 4
+#define BUTTON_QUEUE_SIZE 8
+#define BUTTON_DEBOUNCE_MS 30
+#define BUTTON_LONG_MS 800
+
+#define BUTTON_EVENT_PRESS 1
+#define BUTTON_EVENT_RELEASE 2
+#define BUTTON_EVENT_LONG 3
+#define BUTTON_EVENT_CHORD 4
+
+typedef struct ButtonEvent{
+    uint8_t type;
+    uint8_t buttons;    // mask() of each button in the event
+} ButtonEvent;
+
 class Button{
   public:
     Button(uint8_t buttonPin, uint8_t buttonMode=PULLDOWN);
@@ -38,16 +56,30 @@ class Button{
     bool wasPressed();
     bool stateChanged();
 	bool uniquePress();
+    bool attach();
+    uint8_t mask();
+    static void update();
+    static bool getEvent(ButtonEvent *event);
+    static void handleInterrupt();
   private: 
     uint8_t pin;
     uint8_t mode;
     uint8_t state;
+    uint8_t id;
+    uint8_t bitmask;
+    volatile uint8_t *input;
+    volatile uint8_t raw;
+    volatile unsigned long changed;
+    uint8_t stable;
+    uint8_t handled;
+    unsigned long pressedAt;
 };
 
 #endif
 
 /*
 || @changelog
+|| | 1.7 2026-10-19 - pannan : Added pin change interrupt capture, debounce and an event queue with press, release, long press and chord events
 || | 1.6 2009-05-05 - Alexander Brevig : Added uniquePress, it returns true if the state has changed AND the button is pressed
 || | 1.5 2009-04-24 - Alexander Brevig : Added stateChanged, @contribution http://www.arduino.cc/cgi-bin/yabb2/YaBB.pl?action=viewprofile;username=klickadiklick
 || | 1.4 2009-04-24 - Alexander Brevig : Added wasPressed, @contribution http://www.arduino.cc/cgi-bin/yabb2/YaBB.pl?action=viewprofile;username=klickadiklick
@@ -0,0 +1,268 @@
+
+//
+// Microbenchmarks of the formatting, lookup and conversion functions
+// that run for every sensor in every request and sweep. Built both for
+// the board, to run under simavr, and for the host, see the README.
+//
+// The results are printed on the serial port as JSON, one result per
+// line so that cmake/bench_report.cmake can pick them out of the output
+// of the simulator:
+//
+//   {"name": "int2buf", "sensors": 0, "calls": 64, "cycles": 301, "ns": 18812},
+//
+// cycles and ns are per call, minus the cost of the loop around it.
+// For the functions that scale with the number of sensors one call
+// covers all of them, like a /json request does. On the board cycles
+// are counted with Timer1 and ns follow from F_CPU. On the host ns come
+// from the monotonic clock, and there are no cycles.
+//
+#include <Arduino.h>
+
+#include "pannan.h"
+#include "names.h"
+#include "json.h"
+#include "fmt.h"
+#include "thermo.h"
+
+#ifdef __AVR__
+#include <avr/sleep.h>
+#define BENCH_CALLS 64
+#define BENCH_RUNS 1  // The simulator gives the same count every time.
+#else
+#include <stdlib.h>
+#include <time.h>
+#define BENCH_CALLS 20000
+#define BENCH_RUNS 5  // The fastest run is the one least disturbed.
+#endif
+
+static TempSensor temps[MAX_TEMP_SENSORS];
+static char buf[SENSOR_BUF_SIZE];
+static volatile char sink;
+static uint32_t overhead;
+static uint8_t first = 1;
+
+#ifdef __AVR__
+
+static volatile uint16_t overflows;
+
+ISR(TIMER1_OVF_vect)
+{
+    overflows++;
+}
+
+// Timer1 counts every cycle, the overflows make it 32 bits.
+static void bench_timer_start()
+{
+    TCCR1A = 0;
+    TCCR1B = _BV(CS10);
+    TCNT1 = 0;
+    TIFR1 = _BV(TOV1);
+    TIMSK1 = _BV(TOIE1);
+
+    // The millis() interrupt would be counted as part of whatever
+    // it happens to interrupt.
+    TIMSK0 &= ~_BV(TOIE0);
+}
+
+static uint32_t bench_now()
+{
+    uint8_t sreg = SREG;
+    uint16_t ovf;
+    uint16_t t;
+
+    cli();
+    t = TCNT1;
+    ovf = overflows;
+
+    // Overflowed after interrupts were turned off.
+    if ((TIFR1 & _BV(TOV1)) && (t < 0x8000))
+        ovf++;
+
+    SREG = sreg;
+
+    return ((uint32_t)ovf << 16) | t;
+}
+
+#else
+
+static void bench_timer_start()
+{
+}
+
+static uint32_t bench_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+#endif // __AVR__
+
+static void bench_report(const char *name, int sensors, uint16_t calls,
+                         uint32_t elapsed)
+{
+    uint32_t per_call = elapsed / calls;
+
+    per_call = (per_call > overhead) ? (per_call - overhead) : 0;
+
+    if (!first)
+        Serial.println(',');
+    first = 0;
+
+    Serial.print(F("{\"name\": \""));
+    Serial.print((const __FlashStringHelper *)name);
+    Serial.print(F("\", \"sensors\": "));
+    Serial.print(sensors);
+    Serial.print(F(", \"calls\": "));
+    Serial.print(calls);
+    #ifdef __AVR__
+    Serial.print(F(", \"cycles\": "));
+    Serial.print(per_call);
+    Serial.print(F(", \"ns\": "));
+    Serial.print(per_call * 1000UL / (F_CPU / 1000000UL));
+    #else
+    Serial.print(F(", \"ns\": "));
+    Serial.print(per_call);
+    #endif
+    Serial.print('}');
+
+    // Sent before the next measurement starts.
+    Serial.flush();
+}
+
+#define BENCH(name, sensors, calls, body)                       \
+    do                                                          \
+    {                                                           \
+        uint32_t best = 0xffffffff;                             \
+        for (uint8_t run = 0; run < BENCH_RUNS; run++)          \
+        {                                                       \
+            uint32_t start = bench_now();                       \
+            for (uint16_t k = 0; k < (calls); k++)              \
+            {                                                   \
+                body;                                           \
+            }                                                   \
+            uint32_t elapsed = bench_now() - start;             \
+            if (elapsed < best)                                 \
+                best = elapsed;                                 \
+        }                                                       \
+        bench_report(PSTR(name), sensors, calls, best);         \
+    } while (0)
+
+//
+// A bus like the furnace: mostly DS18B20, every seventh a DS2762 with
+// a thermocouple, one that is disconnected and names of varying length.
+//
+static void bench_make_sensors()
+{
+    for (int i = 0; i < MAX_TEMP_SENSORS; i++)
+    {
+        TempSensor *s = &temps[i];
+
+        memset(s, 0, sizeof(*s));
+        s->addr[0] = 0x28;
+        s->addr[1] = 0xff;
+        s->addr[2] = i;
+        s->addr[3] = 0x6b;
+        s->addr[4] = 0x16;
+        s->addr[7] = 0x75 ^ i;
+
+        strcpy(s->name, "temp");
+        int2buf(&s->name[4], NULL, i);
+
+        s->temp = (i == 5) ? DEVICE_DISCONNECTED_C : 20.0 + i * 3.0625;
+        s->type = SENSOR_DS18B20;
+
+        #ifdef PANNAN_DS2762
+        if ((i % 7) == 6)
+        {
+            s->addr[0] = 0x30;
+            s->type = SENSOR_DS2762;
+            s->microvolts = 9850.0;
+            s->ambient_temp = 23.5;
+            s->temp = thermo_convert(9850, 23500) / 1000.0;
+        }
+        #endif // PANNAN_DS2762
+    }
+
+    strcpy(temps[0].name, "flue");
+}
+
+static void bench_scaling(int n)
+{
+    uint16_t calls = BENCH_CALLS / 8;
+
+    BENCH("get_sensor_json", n, calls,
+        for (int i = 0; i < n; i++)
+            sink = get_sensor_json(buf, i, &temps[i])[0]);
+
+    // The last one is the worst case, all of them are compared.
+    BENCH("eeprom_find_address", n, calls,
+        sink = eeprom_find_address(temps, n, temps[n - 1].addr,
+                                   buf, NAME_SIZE));
+}
+
+void setup()
+{
+    static const int ints[] = { 0, 7, -42, 1234, -32768, 32767, 100, -1 };
+    static const long centis[] = { 0, 2150, -1006, 8500, 123456, -5, 99, 2400 };
+    static const float floats[] = { 21.5, -10.0625, 85.0, 1234.56,
+                                    0.0, -0.5, 47.1875, 3.14159 };
+    static const long uvs[] = { 0, 1000, 4096, 9850, 12209, 20644, 33275, -1500 };
+    static const int counts[] = { 1, 4, 8, 14, 32, 64 };
+
+    Serial.begin(115200);
+    Serial.println(F("{\"results\": ["));
+
+    bench_make_sensors();
+    bench_timer_start();
+
+    // The cost of the loop itself, taken off all the others.
+    {
+        uint32_t start = bench_now();
+        for (uint16_t k = 0; k < BENCH_CALLS; k++)
+        {
+            sink = k;
+        }
+        overhead = (bench_now() - start) / BENCH_CALLS;
+    }
+
+    BENCH("hex2buf", 0, BENCH_CALLS,
+        sink = hex2buf(buf, k)[0]);
+    BENCH("int2buf", 0, BENCH_CALLS,
+        sink = int2buf(buf, NULL, ints[k & 7])[0]);
+    BENCH("centi2buf", 0, BENCH_CALLS,
+        sink = centi2buf(buf, NULL, centis[k & 7])[0]);
+
+    // dtostrf() was replaced by this.
+    BENCH("temp2buf", 0, BENCH_CALLS,
+        sink = temp2buf(buf, NULL, floats[k & 7])[0]);
+    BENCH("get_address_str", 0, BENCH_CALLS,
+        sink = get_address_str(buf, temps[k % MAX_TEMP_SENSORS].addr)[0]);
+
+    // And thermocoupleConvertWithCJCompensation() by this.
+    BENCH("thermo_convert", 0, BENCH_CALLS,
+        sink = thermo_convert(uvs[k & 7], 23500));
+
+    for (uint8_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+    {
+        if (counts[i] <= MAX_TEMP_SENSORS)
+            bench_scaling(counts[i]);
+    }
+
+    Serial.println();
+    Serial.println(F("]}"));
+    Serial.flush();
+}
+
+void loop()
+{
+    #ifdef __AVR__
+    // Sleeping with interrupts off ends the simulation.
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    cli();
+    sleep_enable();
+    sleep_cpu();
+    #else
+    exit(0);
+    #endif
+}
@@ -0,0 +1,106 @@
+#
+# Runs the benchmarks and compares them to the saved baseline of the
+# same target and configuration. Fails if a result got more than SLACK
+# percent, and at least MIN_SLACK, slower, or only warns with
+# -DWARN_ONLY=1. With -DUPDATE=1 the baseline is saved instead.
+#
+#   cmake -DSIMAVR=simavr -DELF=bench.elf
+#         -DBASELINE=bench/avr-pannan-client-server-ds2762.json
+#         -P bench_report.cmake
+#
+# Or -DHOST=bench to run the host build of them instead. The cycles from
+# the simulator are exact and are compared, the host only has ns.
+#
+if (HOST)
+    set(RUN ${HOST})
+    set(METRIC ns)
+else()
+    if (NOT SIMAVR)
+        find_program(SIMAVR simavr)
+    endif()
+    set(RUN ${SIMAVR} -m atmega328p -f 16000000 ${ELF})
+    set(METRIC cycles)
+endif()
+
+if (NOT SLACK)
+    set(SLACK 2)
+endif()
+
+if (NOT MIN_SLACK)
+    set(MIN_SLACK 0)
+endif()
+
+execute_process(COMMAND ${RUN}
+    OUTPUT_VARIABLE OUTPUT
+    RESULT_VARIABLE RESULT)
+
+if (NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "Failed to run ${RUN}")
+endif()
+
+# simavr prints the serial port a line at a time, among its own output.
+string(REGEX MATCHALL "{\"name\": [^}]*}" LINES "${OUTPUT}")
+
+if (NOT LINES)
+    message(FATAL_ERROR "No results in the output of ${RUN}: ${OUTPUT}")
+endif()
+
+set(JSON "{\"results\": [\n")
+set(SEP "")
+foreach(LINE ${LINES})
+    set(JSON "${JSON}${SEP}${LINE}")
+    set(SEP ",\n")
+endforeach()
+set(JSON "${JSON}\n]}\n")
+
+if (UPDATE)
+    file(WRITE ${BASELINE} "${JSON}")
+    message("Saved ${BASELINE}")
+    return()
+endif()
+
+if (EXISTS ${BASELINE})
+    file(READ ${BASELINE} SAVED)
+else()
+    message("No baseline in ${BASELINE}, run 'make bench-baseline' to save one")
+endif()
+
+set(FAILED 0)
+
+foreach(LINE ${LINES})
+    string(REGEX MATCH "\"name\": \"([a-z0-9_]+)\", \"sensors\": ([0-9]+)" KEY "${LINE}")
+    set(NAME ${CMAKE_MATCH_1})
+    set(SENSORS ${CMAKE_MATCH_2})
+    string(REGEX MATCH "\"${METRIC}\": ([0-9]+)" VALUE "${LINE}")
+    set(VALUE ${CMAKE_MATCH_1})
+
+    set(REPORT "${NAME} (${SENSORS} sensors): ${VALUE} ${METRIC}")
+
+    if (SAVED MATCHES "\"name\": \"${NAME}\", \"sensors\": ${SENSORS},[^}]*\"${METRIC}\": ([0-9]+)")
+        set(BASE ${CMAKE_MATCH_1})
+        math(EXPR DIFF "${VALUE} - ${BASE}")
+        set(REPORT "${REPORT}, ${DIFF} compared to the baseline")
+
+        # Percent, without going through floating point.
+        math(EXPR LIMIT "(${BASE} * ${SLACK}) / 100")
+        if (LIMIT LESS MIN_SLACK)
+            set(LIMIT ${MIN_SLACK})
+        endif()
+        math(EXPR LIMIT "${BASE} + ${LIMIT}")
+        if (VALUE GREATER LIMIT)
+            set(REPORT "${REPORT}, more than ${SLACK}% slower")
+            set(FAILED 1)
+        endif()
+    endif()
+
+    message("${REPORT}")
+endforeach()
+
+if (FAILED)
+    message("Run 'make bench-baseline' if that is expected")
+    if (WARN_ONLY)
+        message(WARNING "Benchmarks got slower")
+    else()
+        message(FATAL_ERROR "Benchmarks got slower")
+    endif()
+endif()
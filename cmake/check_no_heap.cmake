@@ -0,0 +1,19 @@
+#
+# Fails if the firmware links malloc, run with:
+#   cmake -DNM=avr-nm -DELF=pannan.elf -P check_no_heap.cmake
+#
+if (NOT NM)
+    find_program(NM avr-nm)
+endif()
+
+execute_process(COMMAND ${NM} ${ELF}
+    OUTPUT_VARIABLE SYMBOLS
+    RESULT_VARIABLE RESULT)
+
+if (NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "Failed to list the symbols of ${ELF}")
+endif()
+
+if (SYMBOLS MATCHES " [Tt] (malloc|calloc|realloc|free)\n")
+    message(FATAL_ERROR "${ELF} links ${CMAKE_MATCH_1}(), the firmware must not use the heap")
+endif()
@@ -0,0 +1,84 @@
+#
+# Prints the flash and RAM use of a firmware and fails if it does not
+# fit, or if it grew more than SLACK bytes over the saved baseline of
+# the same configuration. With -DUPDATE=1 the baseline is saved instead,
+# and without BASELINE it only checks that the firmware fits.
+#
+#   cmake -DSIZE=avr-size -DELF=pannan.elf -DCONFIG=client-server
+#         -DBASELINE=size/client-server.txt -P size_report.cmake
+#
+if (NOT SIZE)
+    find_program(SIZE avr-size)
+endif()
+
+if (NOT FLASH_MAX)
+    set(FLASH_MAX 32256) # 32 KB minus the bootloader.
+endif()
+
+if (NOT RAM_MAX)
+    set(RAM_MAX 1792) # 2 KB, minus room for the stack.
+endif()
+
+if (NOT SLACK)
+    set(SLACK 32)
+endif()
+
+execute_process(COMMAND ${SIZE} ${ELF}
+    OUTPUT_VARIABLE OUTPUT
+    RESULT_VARIABLE RESULT)
+
+if (NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "Failed to get the size of ${ELF}")
+endif()
+
+# Berkeley format: text data bss dec hex filename
+if (NOT OUTPUT MATCHES "\n *([0-9]+)[ \t]+([0-9]+)[ \t]+([0-9]+)")
+    message(FATAL_ERROR "Unexpected output from ${SIZE}: ${OUTPUT}")
+endif()
+
+math(EXPR FLASH "${CMAKE_MATCH_1} + ${CMAKE_MATCH_2}")
+math(EXPR RAM "${CMAKE_MATCH_2} + ${CMAKE_MATCH_3}")
+
+message("${CONFIG}: flash ${FLASH} of ${FLASH_MAX} bytes, ram ${RAM} of ${RAM_MAX} bytes")
+
+if (UPDATE)
+    file(WRITE ${BASELINE} "${FLASH} ${RAM}\n")
+    message("Saved ${BASELINE}")
+    return()
+endif()
+
+set(FAILED 0)
+
+if (FLASH GREATER FLASH_MAX)
+    message("Flash is ${FLASH} bytes, more than the ${FLASH_MAX} available")
+    set(FAILED 1)
+endif()
+
+if (RAM GREATER RAM_MAX)
+    message("Static RAM is ${RAM} bytes, more than the ${RAM_MAX} allowed")
+    set(FAILED 1)
+endif()
+
+if (NOT BASELINE)
+    # Only the fit check.
+elseif (EXISTS ${BASELINE})
+    file(READ ${BASELINE} SAVED)
+    string(REGEX MATCH "([0-9]+) ([0-9]+)" SAVED "${SAVED}")
+    set(FLASH_BASE ${CMAKE_MATCH_1})
+    set(RAM_BASE ${CMAKE_MATCH_2})
+
+    math(EXPR FLASH_DIFF "${FLASH} - ${FLASH_BASE}")
+    math(EXPR RAM_DIFF "${RAM} - ${RAM_BASE}")
+    message("Compared to ${BASELINE}: flash ${FLASH_DIFF}, ram ${RAM_DIFF} bytes")
+
+    if ((FLASH_DIFF GREATER SLACK) OR (RAM_DIFF GREATER SLACK))
+        message("Grew more than ${SLACK} bytes, run 'make size-baseline' if that is expected")
+        set(FAILED 1)
+    endif()
+else()
+    message("No baseline in ${BASELINE}, run 'make size-baseline' to save one")
+endif()
+
+if (FAILED)
+    message(FATAL_ERROR "Size check of ${CONFIG} failed")
+endif()
@@ -0,0 +1,99 @@
+#include <Arduino.h>
+
+#include "fmt.h"
+
+// Utility function to convert nibbles (4 bit values)
+// into a hex character representation.
+static char nibble_to_char(uint8_t nibble)
+{
+    return (nibble < 10) ? ('0' + nibble) : ('A' + nibble - 10);
+}
+
+char *hex2buf(char *buf, uint8_t b)
+{
+    buf[0] = nibble_to_char(b >> 4);
+    buf[1] = nibble_to_char(b & 0x0f);
+    buf[2] = 0;
+    return buf;
+}
+
+char *ulong2buf(char *buf, int *i, unsigned long val)
+{
+    char tmp[11];
+    int len = 0;
+
+    do
+    {
+        tmp[len++] = (val % 10) + '0';
+        val /= 10;
+    }
+    while (val);
+
+    for (int j = 0; j < len; j++)
+    {
+        buf[j] = tmp[len - (j + 1)];
+    }
+
+    buf[len] = 0;
+
+    if (i)
+        (*i) += len;
+
+    return buf;
+}
+
+static char *long2buf(char *buf, int *i, long val)
+{
+    int len = 0;
+
+    if (val < 0)
+    {
+        buf[len++] = '-';
+        val = -val;
+    }
+
+    ulong2buf(&buf[len], &len, val);
+
+    if (i)
+        (*i) += len;
+
+    return buf;
+}
+
+char *int2buf(char *buf, int *i, int val)
+{
+    return long2buf(buf, i, val);
+}
+
+char *centi2buf(char *buf, int *i, long centi)
+{
+    int len = 0;
+
+    if (centi < 0)
+    {
+        buf[len++] = '-';
+        centi = -centi;
+    }
+
+    ulong2buf(&buf[len], &len, centi / 100);
+    buf[len++] = '.';
+    buf[len++] = '0' + (centi / 10) % 10;
+    buf[len++] = '0' + centi % 10;
+    buf[len] = 0;
+
+    if (i)
+        (*i) += len;
+
+    return buf;
+}
+
+char *temp2buf(char *buf, int *i, float t)
+{
+    return centi2buf(buf, i, (long)(t * 100 + ((t < 0) ? -0.5f : 0.5f)));
+}
+
+void print_temp(Print &c, float t)
+{
+    char buf[TEMP_STR_SIZE];
+    c.print(temp2buf(buf, NULL, t));
+}
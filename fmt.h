@@ -0,0 +1,28 @@
+
+#ifndef __FMT_H__
+#define __FMT_H__
+
+#include <Arduino.h>
+
+//
+// Number formatting shared by all output, instead of sprintf(),
+// dtostrf() and Print::print(double) which each add a lot of flash.
+// The *2buf functions write into buf, add the length written to *i
+// unless it is NULL, and return buf.
+//
+
+// Fits "-1234.56".
+#define TEMP_STR_SIZE 9
+
+char *hex2buf(char *buf, uint8_t b);
+char *int2buf(char *buf, int *i, int val);
+char *ulong2buf(char *buf, int *i, unsigned long val);
+
+// A value in hundredths with two decimals.
+char *centi2buf(char *buf, int *i, long centi);
+
+// A temperature rounded to two decimals.
+char *temp2buf(char *buf, int *i, float t);
+void print_temp(Print &c, float t);
+
+#endif // __FMT_H__
@@ -0,0 +1,438 @@
+#include "pannan.h"
+#include "history.h"
+#ifdef PANNAN_SNTP
+#include "sntp.h"
+#endif
+
+#ifdef PANNAN_HISTORY
+
+//
+// Per sensor history of temperatures, compressed using delta-of-delta
+// encoding. Since the temperatures change slowly and are sampled at a
+// fixed interval most samples take a single bit. Each sample is the
+// average of the sweeps in the interval, which takes out most of the
+// noise of the readings that would otherwise cost a few bits each.
+//
+// The history of each sensor is a ring of fixed size blocks. Each block
+// starts with an uncompressed sample followed by a bit stream of
+// delta-of-delta codes:
+//
+//   0                      dod = 0, or still missing after a gap
+//   10    + 2 bits         dod = -2 to 1
+//   110   + 5 bits         dod = -16 to 15
+//   1110  + 10 bits        dod = -512 to 511
+//   11110                  missing sample, the sensor is disconnected
+//   11111 + 16 bits        any other dod
+//
+// After a gap the delta starts over from 0, from the last value before
+// it. The first sample that is back always takes one of the longer
+// codes, even when its dod is 0.
+//
+// Only the newest block has its used bits counted, in the ring. The rest
+// of a block that is full is padded with ones, which never make a whole
+// code since the code that didn't fit is at most 21 bits. Neither is the
+// sequence number kept, it is counted back from the latest sample. So
+// all but the first sample of a block go to the codes.
+//
+// When the ring is full the oldest block is dropped.
+//
+
+#define HISTORY_BLOCK_SIZE 16
+#define HISTORY_DATA_SIZE (HISTORY_BLOCK_SIZE - sizeof(temp_fixed_t))
+#define HISTORY_BLOCK_BITS (HISTORY_DATA_SIZE * 8)
+#define HISTORY_BLOCK_COUNT (HISTORY_BYTES / HISTORY_BLOCK_SIZE)
+
+// How a disconnected sensor is stored, and the first sample of a block
+// that starts in a gap.
+#define HISTORY_GAP temp_to_fixed(DEVICE_DISCONNECTED_C)
+
+#define HISTORY_END 0
+#define HISTORY_SAME 1          // The single 0 bit.
+#define HISTORY_DOD 2
+#define HISTORY_MISSING 3
+
+typedef struct HistoryBlock
+{
+    temp_fixed_t first; // First sample, uncompressed.
+    uint8_t data[HISTORY_DATA_SIZE];
+} HistoryBlock;
+
+typedef struct HistoryRing
+{
+    uint8_t head;       // Oldest block.
+    uint8_t used;       // Number of blocks in use.
+    uint8_t bits;       // Number of used bits in the newest block.
+} HistoryRing;
+
+typedef struct HistoryCursor
+{
+    temp_fixed_t value;
+    int16_t delta;
+    uint8_t pos;
+    uint8_t missing;    // In a gap, value is the last one before it.
+} HistoryCursor;
+
+static HistoryBlock history_blocks[HISTORY_BLOCK_COUNT];
+static HistoryRing history_rings[MAX_TEMP_SENSORS];
+static uint8_t history_per_sensor;
+static uint8_t history_count;
+static unsigned long history_period;
+
+// Sum and number of the readings of each sensor since the last sample.
+static int32_t history_sum[MAX_TEMP_SENSORS];
+static uint8_t history_readings[MAX_TEMP_SENSORS];
+static uint8_t history_sweeps;
+
+// Sequence number of the latest sample, the first sample is 1.
+static uint32_t history_seq;
+static unsigned long history_time;    // millis() of the latest sample.
+
+static void history_put_bits(HistoryBlock *b, uint8_t *bits, uint16_t v, uint8_t n)
+{
+    while (n--)
+    {
+        if (v & (1u << n))
+            b->data[*bits >> 3] |= (0x80 >> (*bits & 7));
+        (*bits)++;
+    }
+}
+
+static uint16_t history_get_bits(const HistoryBlock *b, uint8_t *pos, uint8_t n)
+{
+    uint16_t v = 0;
+
+    while (n--)
+    {
+        v <<= 1;
+        if (b->data[*pos >> 3] & (0x80 >> (*pos & 7)))
+            v |= 1;
+        (*pos)++;
+    }
+
+    return v;
+}
+
+static int16_t sign_extend(uint16_t v, uint8_t bits)
+{
+    if (v & (1u << (bits - 1)))
+        v |= ~((1u << bits) - 1);
+    return (int16_t)v;
+}
+
+// Adds the code of v after the sample at the cursor, returns 0 if it
+// doesn't fit in the block.
+static int history_put_sample(HistoryBlock *b, uint8_t *bits,
+                              const HistoryCursor *cur, temp_fixed_t v)
+{
+    int16_t dod = (v - cur->value) - cur->delta;
+    uint8_t n;
+
+    if (v == HISTORY_GAP)
+        n = cur->missing ? 1 : 5;
+    else if ((dod == 0) && !cur->missing)
+        n = 1;
+    else if ((dod >= -2) && (dod < 2))
+        n = 2 + 2;
+    else if ((dod >= -16) && (dod < 16))
+        n = 3 + 5;
+    else if ((dod >= -512) && (dod < 512))
+        n = 4 + 10;
+    else
+        n = 5 + 16;
+
+    if ((*bits + n) > HISTORY_BLOCK_BITS)
+        return 0;
+
+    switch (n)
+    {
+        case 1:
+            history_put_bits(b, bits, 0x0, 1);
+            break;
+        case 5:
+            history_put_bits(b, bits, 0x1e, 5);
+            break;
+        case 2 + 2:
+            history_put_bits(b, bits, 0x2, 2);
+            history_put_bits(b, bits, dod & 0x3, 2);
+            break;
+        case 3 + 5:
+            history_put_bits(b, bits, 0x6, 3);
+            history_put_bits(b, bits, dod & 0x1f, 5);
+            break;
+        case 4 + 10:
+            history_put_bits(b, bits, 0xe, 4);
+            history_put_bits(b, bits, dod & 0x3ff, 10);
+            break;
+        default:
+            history_put_bits(b, bits, 0x1f, 5);
+            history_put_bits(b, bits, dod, 16);
+            break;
+    }
+
+    return 1;
+}
+
+// Reads the next code before limit, returns HISTORY_END when there is
+// not a whole one left.
+static uint8_t history_get_code(const HistoryBlock *b, uint8_t *pos,
+                                uint8_t limit, int16_t *dod)
+{
+    uint8_t ones = 0;
+    uint8_t width;
+
+    while (ones < 5)
+    {
+        if (*pos >= limit)
+            return HISTORY_END;
+        if (!history_get_bits(b, pos, 1))
+            break;
+        ones++;
+    }
+
+    switch (ones)
+    {
+        case 0: return HISTORY_SAME;
+        case 1: width = 2; break;
+        case 2: width = 5; break;
+        case 3: width = 10; break;
+        case 4: return HISTORY_MISSING;
+        default: width = 16; break;
+    }
+
+    if ((*pos + width) > limit)
+        return HISTORY_END;
+
+    if (width == 16)
+        *dod = (int16_t)history_get_bits(b, pos, 16);
+    else
+        *dod = sign_extend(history_get_bits(b, pos, width), width);
+
+    return HISTORY_DOD;
+}
+
+static void history_cursor_init(const HistoryBlock *b, HistoryCursor *cur)
+{
+    cur->missing = (b->first == HISTORY_GAP);
+    cur->value = cur->missing ? 0 : b->first;
+    cur->delta = 0;
+    cur->pos = 0;
+}
+
+// Moves the cursor to the next sample in the block, returns 0 at the end.
+static int history_cursor_next(const HistoryBlock *b, HistoryCursor *cur,
+                               uint8_t limit)
+{
+    int16_t dod;
+
+    switch (history_get_code(b, &cur->pos, limit, &dod))
+    {
+        case HISTORY_END:
+            return 0;
+        case HISTORY_SAME:
+            if (!cur->missing)
+                cur->value += cur->delta;
+            break;
+        case HISTORY_MISSING:
+            cur->missing = 1;
+            cur->delta = 0;
+            break;
+        default:
+            cur->missing = 0;
+            cur->delta += dod;
+            cur->value += cur->delta;
+            break;
+    }
+
+    return 1;
+}
+
+static HistoryBlock *history_block(int sensor, uint8_t n)
+{
+    HistoryRing *r = &history_rings[sensor];
+    return &history_blocks[sensor * history_per_sensor
+                           + (r->head + n) % history_per_sensor];
+}
+
+// Bits to decode in block n of a sensor.
+static uint8_t history_block_limit(int sensor, uint8_t n)
+{
+    HistoryRing *r = &history_rings[sensor];
+    return (n == (r->used - 1)) ? r->bits : HISTORY_BLOCK_BITS;
+}
+
+static void history_append(int sensor, temp_fixed_t v)
+{
+    HistoryRing *r = &history_rings[sensor];
+    HistoryBlock *b;
+
+    if (r->used)
+    {
+        HistoryCursor cur;
+        b = history_block(sensor, r->used - 1);
+
+        // Find the previous value and delta at the end of the block.
+        history_cursor_init(b, &cur);
+        while (history_cursor_next(b, &cur, r->bits));
+
+        if (history_put_sample(b, &r->bits, &cur, v))
+            return;
+
+        while (r->bits < HISTORY_BLOCK_BITS)
+            history_put_bits(b, &r->bits, 1, 1);
+    }
+
+    if (r->used == history_per_sensor)
+    {
+        r->head = (r->head + 1) % history_per_sensor;
+        r->used--;
+    }
+
+    b = history_block(sensor, r->used);
+    r->used++;
+    r->bits = 0;
+
+    memset(b, 0, sizeof(*b));
+    b->first = v;
+}
+
+void history_init(int count, unsigned long period)
+{
+    memset(history_rings, 0, sizeof(history_rings));
+    history_per_sensor = count ? (HISTORY_BLOCK_COUNT / count) : 0;
+    history_count = history_per_sensor ? count : 0;
+    history_period = period * HISTORY_SWEEPS;
+    history_sweeps = 0;
+    history_seq = 0;
+    memset(history_sum, 0, sizeof(history_sum));
+    memset(history_readings, 0, sizeof(history_readings));
+}
+
+// Rounded to the nearest, a sensor without readings is a gap.
+static temp_fixed_t history_average(int sensor)
+{
+    int32_t sum = history_sum[sensor];
+    uint8_t n = history_readings[sensor];
+
+    if (!n)
+        return HISTORY_GAP;
+
+    return (sum + ((sum < 0) ? -(n / 2) : (n / 2))) / n;
+}
+
+void history_record(TempSensor *temps, int count, unsigned long time)
+{
+    if (!history_count)
+        return;
+
+    for (int i = 0; i < history_count; i++)
+    {
+        if (temps[i].temp != DEVICE_DISCONNECTED_C)
+        {
+            history_sum[i] += temp_to_fixed(temps[i].temp);
+            history_readings[i]++;
+        }
+    }
+
+    if (++history_sweeps < HISTORY_SWEEPS)
+        return;
+
+    history_sweeps = 0;
+    history_seq++;
+    history_time = time;
+
+    for (int i = 0; i < history_count; i++)
+    {
+        history_append(i, history_average(i));
+        history_sum[i] = 0;
+        history_readings[i] = 0;
+    }
+}
+
+static void history_print_sensor_json(Print &c, int sensor, uint32_t since)
+{
+    HistoryRing *r = &history_rings[sensor];
+    HistoryCursor cur;
+    const char *sep = "";
+    uint32_t start = since + 1;
+    uint32_t seq = history_seq + 1;
+    uint8_t n;
+
+    // Count back from the latest sample to the first in the ring.
+    for (n = 0; n < r->used; n++)
+    {
+        HistoryBlock *b = history_block(sensor, n);
+        uint8_t limit = history_block_limit(sensor, n);
+
+        history_cursor_init(b, &cur);
+
+        do
+        {
+            seq--;
+        }
+        while (history_cursor_next(b, &cur, limit));
+    }
+
+    if (start < seq)
+        start = seq;
+
+    c.print(F("    {\"index\": "));
+    c.print(sensor);
+    c.print(F(", \"start\": "));
+    c.print(start);
+    c.print(F(", \"temps\": ["));
+
+    for (n = 0; n < r->used; n++)
+    {
+        HistoryBlock *b = history_block(sensor, n);
+        uint8_t limit = history_block_limit(sensor, n);
+
+        history_cursor_init(b, &cur);
+
+        do
+        {
+            if (seq >= start)
+            {
+                c.print(sep);
+                if (cur.missing)
+                    c.print(F("null"));
+                else
+                    c.print(cur.value);
+                sep = ",";
+            }
+            seq++;
+        }
+        while (history_cursor_next(b, &cur, limit));
+    }
+
+    c.print(F("]}"));
+}
+
+void history_print_json(Print &c, uint32_t since)
+{
+    c.print(F("{\n  \"seq\": "));
+    c.print(history_seq);
+    #ifdef PANNAN_SNTP
+    if (sntp_synced() && history_seq)
+    {
+        c.print(F(",\n  \"time\": "));
+        sntp_print(c, history_time);
+    }
+    #endif // PANNAN_SNTP
+    c.print(F(",\n  \"period\": "));
+    c.print(history_period);
+    c.print(F(",\n  \"scale\": "));
+    c.print(TEMP_FIXED_SCALE);
+    c.println(F(",\n  \"sensors\":\n  ["));
+
+    for (int i = 0; i < history_count; i++)
+    {
+        if (i)
+            c.println(',');
+
+        history_print_sensor_json(c, i, since);
+    }
+
+    c.println(F("\n  ]\n}"));
+}
+
+#endif // PANNAN_HISTORY
@@ -0,0 +1,31 @@
+
+#ifndef __HISTORY_H__
+#define __HISTORY_H__
+
+#include "pannan.h"
+
+//
+// Total number of bytes used for the history of all sensors, it is
+// split evenly between the sensors found at boot in 16 byte blocks.
+// A block holds 113 samples of a temperature that is steady or changes
+// at a steady rate, and fewer the more the change varies. The oldest
+// block is dropped to make room. With 8 sensors and a sample a minute
+// 768 bytes (6 blocks each) keeps about 11 hours of a steady
+// temperature, 7 of a slow ramp with 0.1 C of noise, 3 of a swing of
+// 10 C over two hours and less than one of faster swings.
+//
+#ifndef HISTORY_BYTES
+#define HISTORY_BYTES 768
+#endif
+
+// A sample is the average of this many sweeps, a minute at one sweep
+// every 5 s.
+#ifndef HISTORY_SWEEPS
+#define HISTORY_SWEEPS 12
+#endif
+
+void history_init(int count, unsigned long period);
+void history_record(TempSensor *temps, int count, unsigned long time);
+void history_print_json(Print &c, uint32_t since);
+
+#endif // __HISTORY_H__
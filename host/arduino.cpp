@@ -0,0 +1,262 @@
+#include <Arduino.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "host.h"
+
+volatile uint8_t MCUSR;
+volatile uint8_t SREG;
+volatile uint16_t SP;
+
+// Nothing drives the pins, the pull-ups keep them high.
+volatile uint8_t PINB = 0xff, PINC = 0xff, PIND = 0xff;
+volatile uint8_t PORTB, PORTC, PORTD;
+volatile uint8_t DDRB, DDRC, DDRD;
+
+volatile uint8_t PCICR, PCMSK0, PCMSK1, PCMSK2;
+
+volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, OCR2B, TIMSK2, TIFR2;
+
+HardwareSerial Serial;
+
+static uint64_t host_start_us;
+static uint64_t host_skew_us;
+
+uint8_t host_virtual_delay;
+
+static uint64_t host_clock_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void host_time_init()
+{
+    host_start_us = host_clock_us();
+}
+
+unsigned long micros(void)
+{
+    return host_clock_us() - host_start_us + host_skew_us;
+}
+
+unsigned long millis(void)
+{
+    return micros() / 1000;
+}
+
+static void host_sleep_us(unsigned long us)
+{
+    struct timespec ts;
+
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+
+    while (nanosleep(&ts, &ts) && (errno == EINTR) && !host_stopping)
+        ;
+}
+
+void host_time_advance(unsigned long us)
+{
+    host_skew_us += us;
+}
+
+void delay(unsigned long ms)
+{
+    if (host_virtual_delay)
+        host_time_advance(ms * 1000);
+    else
+        host_sleep_us(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    if (host_virtual_delay)
+        host_time_advance(us);
+    else
+        host_sleep_us(us);
+}
+
+static volatile uint8_t *host_pin_reg(uint8_t pin, volatile uint8_t *d,
+                                      volatile uint8_t *b, volatile uint8_t *c)
+{
+    if (pin < 8)
+        return d;
+    if (pin < 14)
+        return b;
+    if (pin < 20)
+        return c;
+    return NULL;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    volatile uint8_t *ddr = host_pin_reg(pin, &DDRD, &DDRB, &DDRC);
+    volatile uint8_t *port = host_pin_reg(pin, &PORTD, &PORTB, &PORTC);
+    uint8_t mask = digitalPinToBitMask(pin);
+
+    if (!ddr)
+        return;
+
+    if (mode == OUTPUT)
+    {
+        *ddr |= mask;
+    }
+    else
+    {
+        *ddr &= ~mask;
+
+        if (mode == INPUT_PULLUP)
+            *port |= mask;
+        else
+            *port &= ~mask;
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    volatile uint8_t *port = host_pin_reg(pin, &PORTD, &PORTB, &PORTC);
+    uint8_t mask = digitalPinToBitMask(pin);
+
+    if (!port)
+        return;
+
+    if (val == LOW)
+        *port &= ~mask;
+    else
+        *port |= mask;
+}
+
+int digitalRead(uint8_t pin)
+{
+    volatile uint8_t *in = host_pin_reg(pin, &PIND, &PINB, &PINC);
+
+    if (!in)
+        return LOW;
+
+    return (*in & digitalPinToBitMask(pin)) ? HIGH : LOW;
+}
+
+//
+// Serial is stdout and stdin. The transmit buffer drains at the baud
+// rate like the UART does, so a firmware that writes faster than that
+// blocks in write() just like on the board.
+//
+HardwareSerial::HardwareSerial()
+    : baud(0), drained_us(0), tx_used(0), rx_head(0), rx_tail(0)
+{
+}
+
+void HardwareSerial::begin(unsigned long b)
+{
+    baud = b;
+    drained_us = micros();
+}
+
+void HardwareSerial::drain()
+{
+    unsigned long now = micros();
+    unsigned long byte_us;
+    unsigned long sent;
+
+    if (!baud || !tx_used)
+    {
+        drained_us = now;
+        return;
+    }
+
+    // Start bit, 8 data bits and a stop bit.
+    byte_us = 10000000UL / baud;
+    sent = (now - drained_us) / byte_us;
+
+    if (sent >= (unsigned long)tx_used)
+    {
+        tx_used = 0;
+        drained_us = now;
+    }
+    else
+    {
+        tx_used -= sent;
+        drained_us += sent * byte_us;
+    }
+}
+
+void HardwareSerial::fill()
+{
+    static uint8_t eof;
+    struct pollfd pfd;
+    uint8_t c;
+
+    if (eof)
+        return;
+
+    pfd.fd = STDIN_FILENO;
+    pfd.events = POLLIN;
+
+    while ((((rx_head + 1) % SERIAL_RX_BUFFER_SIZE) != rx_tail)
+        && (poll(&pfd, 1, 0) == 1))
+    {
+        if (::read(STDIN_FILENO, &c, 1) != 1)
+        {
+            eof = 1;
+            return;
+        }
+
+        rx[rx_head] = c;
+        rx_head = (rx_head + 1) % SERIAL_RX_BUFFER_SIZE;
+    }
+}
+
+int HardwareSerial::available()
+{
+    fill();
+    return (SERIAL_RX_BUFFER_SIZE + rx_head - rx_tail) % SERIAL_RX_BUFFER_SIZE;
+}
+
+int HardwareSerial::peek()
+{
+    if (!available())
+        return -1;
+
+    return rx[rx_tail];
+}
+
+int HardwareSerial::read()
+{
+    int c = peek();
+
+    if (c >= 0)
+        rx_tail = (rx_tail + 1) % SERIAL_RX_BUFFER_SIZE;
+
+    return c;
+}
+
+int HardwareSerial::availableForWrite()
+{
+    drain();
+    return SERIAL_TX_BUFFER_SIZE - 1 - tx_used;
+}
+
+void HardwareSerial::flush()
+{
+    while (availableForWrite() < SERIAL_TX_BUFFER_SIZE - 1)
+        delayMicroseconds(100);
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    while (availableForWrite() == 0)
+        delayMicroseconds(100);
+
+    if (baud)
+        tx_used++;
+
+    ::write(STDOUT_FILENO, &c, 1);
+
+    return 1;
+}
@@ -0,0 +1,664 @@
+#include <Arduino.h>
+#include <OneWire.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "thermo.h"
+#include "host.h"
+
+//
+// A simulated 1-Wire bus with DS18B20 and DS2762 devices, driven one
+// time slot at a time like the real bus. Each device runs its own state
+// machine on the bits the master writes, and a read slot gives the
+// wired-AND of what the devices put on the bus. That way ROM search,
+// Match ROM and Skip ROM work with any number of devices, and the
+// firmware and the libraries run unchanged on top.
+//
+// The devices and their temperatures come from a scenario file, one
+// device per line:
+//
+//   <type> <address|auto> <curve> [options]
+//
+//   type     ds18b20 or ds2762
+//   curve    const T
+//            ramp T0 T1 SECONDS    T0 to T1 and then stays at T1
+//            sine MEAN AMPLITUDE PERIOD
+//            step T0 T1 SECONDS    T0 until then, T1 after
+//   options  xN        N devices like this one, with auto addresses
+//            noise=T   Random noise of up to +-T added to each reading
+//            res=BITS  Resolution at power on, 9 to 12 (ds18b20)
+//            ambient=T Cold junction temperature (ds2762)
+//            crc=P     Chance that a read has a flipped bit
+//            absent=P  Chance that there is no presence pulse
+//            slow=F    Conversions take F times as long (ds18b20)
+//
+// The curve of a DS2762 is the temperature of the thermocouple hot
+// junction. "seed N" on a line of its own seeds the random faults.
+//
+// Each time slot moves the clock forward by as long as it takes on the
+// real bus, so the sweep time is the one of the board.
+//
+#define BUS_MAX_DEVICES 256
+
+#define BUS_RESET_US 960
+#define BUS_WRITE0_US 70
+#define BUS_WRITE1_US 65
+#define BUS_READ_US 66
+
+#define FAMILY_DS18B20 0x28
+#define FAMILY_DS2762 0x30
+
+// ROM commands.
+#define ROM_SEARCH 0xF0
+#define ROM_ALARM_SEARCH 0xEC
+#define ROM_READ 0x33
+#define ROM_MATCH 0x55
+#define ROM_SKIP 0xCC
+
+// DS18B20 function commands.
+#define DS18B20_CONVERT 0x44
+#define DS18B20_READ_SCRATCH 0xBE
+#define DS18B20_WRITE_SCRATCH 0x4E
+#define DS18B20_COPY_SCRATCH 0x48
+#define DS18B20_RECALL 0xB8
+#define DS18B20_READ_POWER 0xB4
+
+// DS2762 function commands and registers.
+#define DS2762_READ_DATA 0x69
+#define DS2762_CURRENT 0x0E
+#define DS2762_TEMP 0x18
+#define DS2762_REGS 0x20
+
+#define DS18B20_POWER_ON_RAW (85 * 16)
+
+typedef enum bus_state_e
+{
+    BUS_IDLE,       // Not selected, waits for the next reset.
+    BUS_ROM_CMD,
+    BUS_SEARCH,
+    BUS_MATCH,
+    BUS_FUNC_CMD,
+    BUS_RECV,
+    BUS_SEND,
+    BUS_CONVERT,
+    BUS_POWER
+} bus_state_t;
+
+typedef enum curve_type_e
+{
+    CURVE_CONST,
+    CURVE_RAMP,
+    CURVE_SINE,
+    CURVE_STEP
+} curve_type_t;
+
+typedef struct BusDevice
+{
+    uint8_t rom[8];
+
+    curve_type_t curve;
+    float arg[3];
+    float noise;
+    float ambient;
+    float crc_fault;
+    float absent_fault;
+    float slow;
+
+    bus_state_t state;
+    uint8_t in_byte;
+    uint8_t in_bits;
+    uint8_t bit_index;
+    uint8_t search_step;
+    uint8_t recv_count;
+
+    uint8_t out[DS2762_REGS];
+    uint8_t out_len;
+    uint16_t out_bit;
+
+    // DS18B20
+    int16_t temp_raw;
+    uint8_t th;
+    uint8_t tl;
+    uint8_t config;
+    uint8_t converting;
+    unsigned long conv_start;
+    unsigned long conv_us;
+} BusDevice;
+
+static BusDevice bus_devices[BUS_MAX_DEVICES];
+static int bus_count;
+static unsigned long bus_serial = 1;
+
+static struct
+{
+    unsigned long resets;
+    unsigned long slots;
+    unsigned long conversions;
+    unsigned long crc_faults;
+    unsigned long absent_faults;
+} bus_stats;
+
+static float bus_random()
+{
+    return drand48();
+}
+
+static float bus_curve(BusDevice *d, unsigned long us)
+{
+    float t = us / 1000000.0;
+    float v;
+
+    switch (d->curve)
+    {
+        case CURVE_RAMP:
+            v = (t >= d->arg[2]) ? d->arg[1]
+              : d->arg[0] + (d->arg[1] - d->arg[0]) * t / d->arg[2];
+            break;
+        case CURVE_SINE:
+            v = d->arg[0] + d->arg[1] * sin(2 * M_PI * t / d->arg[2]);
+            break;
+        case CURVE_STEP:
+            v = (t < d->arg[2]) ? d->arg[0] : d->arg[1];
+            break;
+        default:
+            v = d->arg[0];
+            break;
+    }
+
+    if (d->noise > 0)
+        v += (bus_random() * 2 - 1) * d->noise;
+
+    return v;
+}
+
+static uint8_t bus_resolution(BusDevice *d)
+{
+    return 9 + ((d->config >> 5) & 3);
+}
+
+// Takes the result of a conversion that has finished into use.
+static void bus_update(BusDevice *d)
+{
+    unsigned long now = micros();
+    uint8_t res;
+    float t;
+
+    if (!d->converting || ((now - d->conv_start) < d->conv_us))
+        return;
+
+    d->converting = 0;
+    res = bus_resolution(d);
+    t = constrain(bus_curve(d, d->conv_start + d->conv_us), -55.0, 125.0);
+
+    // The bits below the resolution are undefined, they read as 0 here.
+    d->temp_raw = (int16_t)lround(t * 16) & ~((1 << (12 - res)) - 1);
+}
+
+static void bus_send(BusDevice *d, const uint8_t *buf, uint8_t len)
+{
+    memcpy(d->out, buf, len);
+    d->out_len = len;
+    d->out_bit = 0;
+    d->state = BUS_SEND;
+
+    if ((d->crc_fault > 0) && (bus_random() < d->crc_fault))
+    {
+        d->out[(int)(bus_random() * len)] ^= 1 << (int)(bus_random() * 8);
+        bus_stats.crc_faults++;
+    }
+}
+
+static void bus_send_scratchpad(BusDevice *d)
+{
+    uint8_t sp[9];
+
+    bus_update(d);
+
+    sp[0] = d->temp_raw & 0xff;
+    sp[1] = d->temp_raw >> 8;
+    sp[2] = d->th;
+    sp[3] = d->tl;
+    sp[4] = d->config;
+    sp[5] = 0xff;
+    sp[6] = 0x0c;
+    sp[7] = 0x10;
+    sp[8] = OneWire::crc8(sp, 8);
+
+    bus_send(d, sp, sizeof(sp));
+}
+
+static void bus_send_ds2762(BusDevice *d, uint8_t addr)
+{
+    uint8_t regs[DS2762_REGS];
+    unsigned long now = micros();
+    long uv;
+    long current;
+    int16_t temp;
+
+    memset(regs, 0, sizeof(regs));
+
+    // Voltage of the thermocouple, in 15.625 uV units in bits 15-3.
+    uv = thermo_mc_to_uv(lround(bus_curve(d, now) * 1000))
+       - thermo_mc_to_uv(lround(d->ambient * 1000));
+    current = constrain(lround(uv * 8 / 125.0), -4096L, 4095L) << 3;
+    regs[DS2762_CURRENT] = (current >> 8) & 0xff;
+    regs[DS2762_CURRENT + 1] = current & 0xff;
+
+    // Cold junction, in 0.125 C units in bits 15-5.
+    temp = (int16_t)lround(d->ambient * 8) << 5;
+    regs[DS2762_TEMP] = (temp >> 8) & 0xff;
+    regs[DS2762_TEMP + 1] = temp & 0xff;
+
+    addr = min(addr, DS2762_REGS - 1);
+    bus_send(d, regs + addr, DS2762_REGS - addr);
+}
+
+static void bus_func_cmd(BusDevice *d, uint8_t cmd)
+{
+    if (d->rom[0] == FAMILY_DS2762)
+    {
+        if (cmd == DS2762_READ_DATA)
+        {
+            d->state = BUS_RECV;
+            d->recv_count = 0;
+        }
+        else
+        {
+            d->state = BUS_IDLE;
+        }
+        return;
+    }
+
+    switch (cmd)
+    {
+        case DS18B20_CONVERT:
+            bus_update(d);
+            d->converting = 1;
+            d->conv_start = micros();
+            d->conv_us = (93750UL << (bus_resolution(d) - 9)) * d->slow;
+            d->state = BUS_CONVERT;
+            bus_stats.conversions++;
+            break;
+        case DS18B20_READ_SCRATCH:
+            bus_send_scratchpad(d);
+            break;
+        case DS18B20_WRITE_SCRATCH:
+            d->state = BUS_RECV;
+            d->recv_count = 0;
+            break;
+        case DS18B20_READ_POWER:
+            d->state = BUS_POWER;
+            break;
+        default:
+            // Copy and recall have nothing to do, the EEPROM is not kept.
+            d->state = BUS_IDLE;
+            break;
+    }
+}
+
+static void bus_recv(BusDevice *d, uint8_t v)
+{
+    if (d->rom[0] == FAMILY_DS2762)
+    {
+        bus_send_ds2762(d, v);
+        return;
+    }
+
+    switch (d->recv_count++)
+    {
+        case 0: d->th = v; break;
+        case 1: d->tl = v; break;
+        default:
+            d->config = (v & 0x60) | 0x1f;
+            d->state = BUS_IDLE;
+            break;
+    }
+}
+
+// A whole byte in the ROM or function command state, or received data.
+static void bus_byte(BusDevice *d, uint8_t v)
+{
+    switch (d->state)
+    {
+        case BUS_ROM_CMD:
+            switch (v)
+            {
+                case ROM_SEARCH:
+                    d->state = BUS_SEARCH;
+                    d->bit_index = 0;
+                    d->search_step = 0;
+                    break;
+                case ROM_MATCH:
+                    d->state = BUS_MATCH;
+                    d->bit_index = 0;
+                    break;
+                case ROM_SKIP:
+                    d->state = BUS_FUNC_CMD;
+                    break;
+                case ROM_READ:
+                    bus_send(d, d->rom, sizeof(d->rom));
+                    break;
+                default:
+                    // No alarms are ever set, so no alarm search either.
+                    d->state = BUS_IDLE;
+                    break;
+            }
+            break;
+        case BUS_FUNC_CMD:
+            bus_func_cmd(d, v);
+            break;
+        case BUS_RECV:
+            bus_recv(d, v);
+            break;
+        default:
+            break;
+    }
+}
+
+static uint8_t bus_rom_bit(BusDevice *d)
+{
+    return (d->rom[d->bit_index / 8] >> (d->bit_index % 8)) & 1;
+}
+
+static void bus_write_bit(BusDevice *d, uint8_t v)
+{
+    switch (d->state)
+    {
+        case BUS_ROM_CMD:
+        case BUS_FUNC_CMD:
+        case BUS_RECV:
+            d->in_byte |= v << d->in_bits;
+
+            if (++d->in_bits == 8)
+            {
+                uint8_t b = d->in_byte;
+                d->in_byte = 0;
+                d->in_bits = 0;
+                bus_byte(d, b);
+            }
+            break;
+        case BUS_SEARCH:
+            // Devices that do not match the direction drop out.
+            if ((d->search_step != 2) || (v != bus_rom_bit(d)))
+            {
+                d->state = BUS_IDLE;
+                break;
+            }
+
+            d->search_step = 0;
+
+            if (++d->bit_index == 64)
+                d->state = BUS_FUNC_CMD;
+            break;
+        case BUS_MATCH:
+            if (v != bus_rom_bit(d))
+            {
+                d->state = BUS_IDLE;
+                break;
+            }
+
+            if (++d->bit_index == 64)
+                d->state = BUS_FUNC_CMD;
+            break;
+        default:
+            break;
+    }
+}
+
+static uint8_t bus_read_bit(BusDevice *d)
+{
+    uint8_t v = 1;
+
+    switch (d->state)
+    {
+        case BUS_SEARCH:
+            if (d->search_step == 0)
+                v = bus_rom_bit(d);
+            else if (d->search_step == 1)
+                v = !bus_rom_bit(d);
+
+            if (d->search_step < 2)
+                d->search_step++;
+            break;
+        case BUS_SEND:
+            // After the last byte the bus is left high.
+            if (d->out_bit < d->out_len * 8)
+                v = (d->out[d->out_bit / 8] >> (d->out_bit % 8)) & 1;
+            d->out_bit++;
+            break;
+        case BUS_CONVERT:
+            bus_update(d);
+            v = !d->converting;
+            break;
+        case BUS_POWER:
+            // Not parasite powered.
+            v = 1;
+            break;
+        default:
+            break;
+    }
+
+    return v;
+}
+
+uint8_t onewire_bus_reset(uint8_t)
+{
+    uint8_t presence = 0;
+
+    host_time_advance(BUS_RESET_US);
+    bus_stats.resets++;
+
+    for (int i = 0; i < bus_count; i++)
+    {
+        BusDevice *d = &bus_devices[i];
+
+        d->in_byte = 0;
+        d->in_bits = 0;
+
+        if ((d->absent_fault > 0) && (bus_random() < d->absent_fault))
+        {
+            d->state = BUS_IDLE;
+            bus_stats.absent_faults++;
+            continue;
+        }
+
+        d->state = BUS_ROM_CMD;
+        presence = 1;
+    }
+
+    return presence;
+}
+
+void onewire_bus_write_bit(uint8_t, uint8_t v)
+{
+    host_time_advance(v ? BUS_WRITE1_US : BUS_WRITE0_US);
+    bus_stats.slots++;
+
+    for (int i = 0; i < bus_count; i++)
+        bus_write_bit(&bus_devices[i], v);
+}
+
+uint8_t onewire_bus_read_bit(uint8_t)
+{
+    uint8_t v = 1;
+
+    host_time_advance(BUS_READ_US);
+    bus_stats.slots++;
+
+    // Every device must take part in the slot, so no early exit.
+    for (int i = 0; i < bus_count; i++)
+        v &= bus_read_bit(&bus_devices[i]);
+
+    return v;
+}
+
+static int bus_parse_hex(const char *s, uint8_t *rom)
+{
+    char byte[3] = { 0, 0, 0 };
+
+    if (strlen(s) != 16)
+        return -1;
+
+    for (int i = 0; i < 8; i++)
+    {
+        byte[0] = s[i * 2];
+        byte[1] = s[i * 2 + 1];
+
+        if (!isxdigit(byte[0]) || !isxdigit(byte[1]))
+            return -1;
+
+        rom[i] = strtoul(byte, NULL, 16);
+    }
+
+    return 0;
+}
+
+static void bus_auto_rom(BusDevice *d, uint8_t family)
+{
+    d->rom[0] = family;
+
+    for (int i = 1; i < 7; i++)
+        d->rom[i] = (bus_serial >> ((i - 1) * 8)) & 0xff;
+
+    d->rom[7] = OneWire::crc8(d->rom, 7);
+    bus_serial++;
+}
+
+static int bus_parse_line(char *line, const char *path, int lineno)
+{
+    BusDevice d;
+    const char *type = strtok(line, " \t\r\n");
+    const char *addr = strtok(NULL, " \t\r\n");
+    const char *curve = strtok(NULL, " \t\r\n");
+    const char *tok;
+    uint8_t family;
+    int args = 1;
+    int count = 1;
+    int res = 12;
+
+    if (!type || (type[0] == '#'))
+        return 0;
+
+    if (!strcmp(type, "seed") && addr)
+    {
+        srand48(atol(addr));
+        return 0;
+    }
+
+    memset(&d, 0, sizeof(d));
+    d.ambient = 25;
+    d.slow = 1;
+
+    if (!strcmp(type, "ds18b20"))
+        family = FAMILY_DS18B20;
+    else if (!strcmp(type, "ds2762"))
+        family = FAMILY_DS2762;
+    else
+        goto fail;
+
+    if (!addr || !curve)
+        goto fail;
+
+    if (!strcmp(curve, "const")) { d.curve = CURVE_CONST; args = 1; }
+    else if (!strcmp(curve, "ramp")) { d.curve = CURVE_RAMP; args = 3; }
+    else if (!strcmp(curve, "sine")) { d.curve = CURVE_SINE; args = 3; }
+    else if (!strcmp(curve, "step")) { d.curve = CURVE_STEP; args = 3; }
+    else goto fail;
+
+    for (int i = 0; i < args; i++)
+    {
+        if (!(tok = strtok(NULL, " \t\r\n")))
+            goto fail;
+
+        d.arg[i] = atof(tok);
+    }
+
+    if ((args == 3) && (d.arg[2] <= 0) && (d.curve != CURVE_STEP))
+        goto fail;
+
+    while ((tok = strtok(NULL, " \t\r\n")) && (tok[0] != '#'))
+    {
+        if (tok[0] == 'x') count = atoi(tok + 1);
+        else if (!strncmp(tok, "noise=", 6)) d.noise = atof(tok + 6);
+        else if (!strncmp(tok, "res=", 4)) res = atoi(tok + 4);
+        else if (!strncmp(tok, "ambient=", 8)) d.ambient = atof(tok + 8);
+        else if (!strncmp(tok, "crc=", 4)) d.crc_fault = atof(tok + 4);
+        else if (!strncmp(tok, "absent=", 7)) d.absent_fault = atof(tok + 7);
+        else if (!strncmp(tok, "slow=", 5)) d.slow = atof(tok + 5);
+        else goto fail;
+    }
+
+    if ((res < 9) || (res > 12) || (count < 1))
+        goto fail;
+
+    d.config = ((res - 9) << 5) | 0x1f;
+    d.temp_raw = DS18B20_POWER_ON_RAW;
+    d.th = 0x4b;
+    d.tl = 0x46;
+
+    if (strcmp(addr, "auto") && ((count > 1) || bus_parse_hex(addr, d.rom)))
+        goto fail;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (bus_count == BUS_MAX_DEVICES)
+        {
+            fprintf(stderr, "%s:%d: more than %d devices\n",
+                    path, lineno, BUS_MAX_DEVICES);
+            return -1;
+        }
+
+        if (!strcmp(addr, "auto"))
+            bus_auto_rom(&d, family);
+
+        bus_devices[bus_count++] = d;
+    }
+
+    return 0;
+fail:
+    fprintf(stderr, "%s:%d: bad device\n", path, lineno);
+    return -1;
+}
+
+int host_bus_load(const char *path)
+{
+    char line[256];
+    int lineno = 0;
+    FILE *f;
+
+    srand48(1);
+
+    if (!(f = fopen(path, "r")))
+    {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f))
+    {
+        if (bus_parse_line(line, path, ++lineno))
+        {
+            fclose(f);
+            return -1;
+        }
+    }
+
+    fclose(f);
+
+    fprintf(stderr, "host: %d devices on the 1-Wire bus\n", bus_count);
+
+    return 0;
+}
+
+void host_bus_report()
+{
+    if (!bus_count)
+        return;
+
+    fprintf(stderr,
+        "host: 1-Wire %lu resets, %lu slots, %lu conversions, "
+        "%lu crc faults, %lu missing presence\n",
+        bus_stats.resets, bus_stats.slots, bus_stats.conversions,
+        bus_stats.crc_faults, bus_stats.absent_faults);
+}
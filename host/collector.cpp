@@ -0,0 +1,1187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+//
+// Stand-in for the collector the HTTP client uploads to, see the README.
+// Each PUT is checked the way a strict server would: the request line
+// and headers, the chunked framing byte by byte, so that a chunk length
+// that does not match its data is caught where it happens, and the body
+// as JSON with the sensors array (and the readings of a batch).
+//
+// The response can be held back (-l, -j), and a share of the uploads
+// can get an error status (-e) or have the connection reset instead
+// (-x), to see the backoff and the queue at work. The seed (-s) makes
+// the faults repeat from run to run.
+//
+// At the end it reports the uploads per second and bytes per second,
+// how long the node took to send each upload, and the gaps between the
+// starts of the uploads, which is what the delay setting aims at.
+//
+#define COLL_MAX_CONNS 8
+#define COLL_HEAD_SIZE 1024
+#define COLL_BODY_SIZE 65536
+#define COLL_POLL_MS 5
+#define COLL_JSON_DEPTH 8
+
+typedef enum coll_state_e
+{
+    COLL_HEAD,
+    COLL_BODY,
+    COLL_RESPOND        // Body done, the response waits for the latency.
+} coll_state_t;
+
+typedef enum coll_body_e
+{
+    BODY_LENGTH,
+    BODY_CHUNK_SIZE,
+    BODY_CHUNK_DATA,
+    BODY_CHUNK_END,     // CRLF after the data of a chunk.
+    BODY_TRAILER
+} coll_body_t;
+
+typedef enum coll_fault_e
+{
+    FAULT_NONE,
+    FAULT_STATUS,
+    FAULT_RESET
+} coll_fault_t;
+
+typedef struct Conn
+{
+    int fd;
+    coll_state_t state;
+    struct sockaddr_in peer;
+    unsigned long uploads;      // Made on this connection.
+    uint64_t start_us;          // First byte of the request.
+    uint64_t respond_us;
+    char head[COLL_HEAD_SIZE];
+    int head_len;
+    char *body;
+    long body_len;
+    coll_body_t framing;
+    long left;                  // Of the body or the current chunk.
+    int line_len;               // Of the chunk size line so far.
+    long chunk_size;
+    int chunks;
+    int close;
+    coll_fault_t fault;
+} Conn;
+
+typedef struct JsonShape
+{
+    const char *start;
+    const char *error;
+    const char *at;
+    long sensors;               // Elements, -1 when missing.
+    long readings;
+} JsonShape;
+
+static Conn conns[COLL_MAX_CONNS];
+static int listen_fd = -1;
+static int verbose;
+static int close_after;
+static unsigned long latency_ms;
+static unsigned long jitter_ms;
+static double error_pct;
+static double reset_pct;
+static int error_status = 500;
+
+static uint64_t first_us;
+static uint64_t last_start_us;
+static unsigned long uploads;
+static unsigned long invalid;
+static unsigned long injected_status;
+static unsigned long injected_reset;
+static unsigned long connections;
+static unsigned long readings;
+static unsigned long long body_bytes;
+static uint32_t *recv_times;        // First byte to end of body, us.
+static uint32_t *gaps;              // Between upload starts, us.
+static unsigned long recv_count;
+static unsigned long gap_count;
+static unsigned long stats_size;
+
+static volatile sig_atomic_t stopping;
+
+static void stop(int)
+{
+    stopping = 1;
+}
+
+static uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [-p port] [-l ms] [-j ms] [-e percent] [-E status] [-x percent]\n"
+        "          [-c] [-s seed] [-t seconds] [-o results.json] [-v]\n"
+        "  -p  Port to listen on (default 9000)\n"
+        "  -l  ms to hold back each response\n"
+        "  -j  Up to this many ms more, at random\n"
+        "  -e  Percent of the uploads answered with an error status\n"
+        "  -E  The error status (default 500)\n"
+        "  -x  Percent of the uploads answered by resetting the connection\n"
+        "  -c  Close the connection after each response\n"
+        "  -s  Seed for the faults and the jitter\n"
+        "  -t  Seconds to run, until Ctrl-C without\n"
+        "  -o  Save the results as JSON\n"
+        "  -v  Print each upload\n",
+        prog);
+}
+
+static void add_stat(uint32_t **arr, unsigned long *count, uint32_t v)
+{
+    if (*count >= stats_size)
+    {
+        unsigned long size = stats_size ? stats_size * 2 : 1024;
+
+        recv_times = (uint32_t *)realloc(recv_times, size * sizeof(uint32_t));
+        gaps = (uint32_t *)realloc(gaps, size * sizeof(uint32_t));
+        if (!recv_times || !gaps)
+        {
+            perror("realloc");
+            exit(1);
+        }
+        stats_size = size;
+    }
+
+    (*arr)[(*count)++] = v;
+}
+
+//
+// JSON validation, strict RFC 8259 without any extensions. The shape
+// of the top level object is kept: how many sensors and readings.
+//
+static const char *json_value(JsonShape *js, const char *p, const char *end,
+                              int depth, long *elements);
+
+static const char *json_fail(JsonShape *js, const char *p, const char *error)
+{
+    if (!js->error)
+    {
+        js->error = error;
+        js->at = p;
+    }
+    return NULL;
+}
+
+static const char *json_ws(const char *p, const char *end)
+{
+    while ((p < end) && ((*p == ' ') || (*p == '\t') || (*p == '\n') || (*p == '\r')))
+        p++;
+    return p;
+}
+
+static const char *json_string(JsonShape *js, const char *p, const char *end)
+{
+    p++;
+
+    while (p < end)
+    {
+        unsigned char c = *p++;
+
+        if (c == '"')
+            return p;
+
+        if (c < 0x20)
+            return json_fail(js, p - 1, "control character in string");
+
+        if (c == '\\')
+        {
+            if (p >= end)
+                break;
+
+            c = *p++;
+
+            if (c == 'u')
+            {
+                for (int i = 0; i < 4; i++, p++)
+                {
+                    if ((p >= end) || !isxdigit((unsigned char)*p))
+                        return json_fail(js, p, "bad \\u escape");
+                }
+            }
+            else if (!strchr("\"\\/bfnrt", c) || !c)
+            {
+                return json_fail(js, p - 1, "bad escape");
+            }
+        }
+    }
+
+    return json_fail(js, p, "string not ended");
+}
+
+static const char *json_number(JsonShape *js, const char *p, const char *end)
+{
+    const char *start = p;
+
+    if ((p < end) && (*p == '-'))
+        p++;
+
+    if ((p < end) && (*p == '0'))
+    {
+        p++;
+    }
+    else
+    {
+        if ((p >= end) || !isdigit((unsigned char)*p))
+            return json_fail(js, start, "bad number");
+        while ((p < end) && isdigit((unsigned char)*p))
+            p++;
+    }
+
+    if ((p < end) && (*p == '.'))
+    {
+        p++;
+        if ((p >= end) || !isdigit((unsigned char)*p))
+            return json_fail(js, start, "bad fraction");
+        while ((p < end) && isdigit((unsigned char)*p))
+            p++;
+    }
+
+    if ((p < end) && ((*p == 'e') || (*p == 'E')))
+    {
+        p++;
+        if ((p < end) && ((*p == '+') || (*p == '-')))
+            p++;
+        if ((p >= end) || !isdigit((unsigned char)*p))
+            return json_fail(js, start, "bad exponent");
+        while ((p < end) && isdigit((unsigned char)*p))
+            p++;
+    }
+
+    return p;
+}
+
+static const char *json_object(JsonShape *js, const char *p, const char *end,
+                               int depth)
+{
+    p = json_ws(p + 1, end);
+
+    if ((p < end) && (*p == '}'))
+        return p + 1;
+
+    for (;;)
+    {
+        const char *key;
+        const char *key_end;
+        long elements = -1;
+
+        if ((p >= end) || (*p != '"'))
+            return json_fail(js, p, "expected a key");
+
+        key = p + 1;
+        if (!(p = json_string(js, p, end)))
+            return NULL;
+        key_end = p - 1;
+
+        p = json_ws(p, end);
+        if ((p >= end) || (*p != ':'))
+            return json_fail(js, p, "expected ':'");
+
+        if (!(p = json_value(js, p + 1, end, depth + 1, &elements)))
+            return NULL;
+
+        if (!depth)
+        {
+            size_t len = key_end - key;
+
+            if ((len == 7) && !memcmp(key, "sensors", 7))
+                js->sensors = elements;
+            else if ((len == 8) && !memcmp(key, "readings", 8))
+                js->readings = elements;
+        }
+
+        p = json_ws(p, end);
+
+        if ((p < end) && (*p == ','))
+        {
+            p = json_ws(p + 1, end);
+            continue;
+        }
+
+        if ((p < end) && (*p == '}'))
+            return p + 1;
+
+        return json_fail(js, p, "expected ',' or '}'");
+    }
+}
+
+static const char *json_array(JsonShape *js, const char *p, const char *end,
+                              int depth, long *elements)
+{
+    long n = 0;
+
+    p = json_ws(p + 1, end);
+
+    if ((p < end) && (*p == ']'))
+    {
+        *elements = 0;
+        return p + 1;
+    }
+
+    for (;;)
+    {
+        if (!(p = json_value(js, p, end, depth + 1, NULL)))
+            return NULL;
+
+        n++;
+        p = json_ws(p, end);
+
+        if ((p < end) && (*p == ','))
+        {
+            p++;
+            continue;
+        }
+
+        if ((p < end) && (*p == ']'))
+        {
+            *elements = n;
+            return p + 1;
+        }
+
+        return json_fail(js, p, "expected ',' or ']'");
+    }
+}
+
+static const char *json_literal(JsonShape *js, const char *p, const char *end,
+                                const char *word)
+{
+    size_t len = strlen(word);
+
+    if (((size_t)(end - p) < len) || memcmp(p, word, len))
+        return json_fail(js, p, "bad literal");
+
+    return p + len;
+}
+
+static const char *json_value(JsonShape *js, const char *p, const char *end,
+                              int depth, long *elements)
+{
+    long n = -1;
+
+    if (depth > COLL_JSON_DEPTH)
+        return json_fail(js, p, "nested too deep");
+
+    p = json_ws(p, end);
+
+    if (p >= end)
+        return json_fail(js, p, "expected a value");
+
+    switch (*p)
+    {
+        case '{':
+            p = json_object(js, p, end, depth);
+            break;
+        case '[':
+            p = json_array(js, p, end, depth, &n);
+            break;
+        case '"':
+            p = json_string(js, p, end);
+            break;
+        case 't':
+            p = json_literal(js, p, end, "true");
+            break;
+        case 'f':
+            p = json_literal(js, p, end, "false");
+            break;
+        case 'n':
+            p = json_literal(js, p, end, "null");
+            break;
+        default:
+            if ((*p != '-') && !isdigit((unsigned char)*p))
+                return json_fail(js, p, "expected a value");
+            p = json_number(js, p, end);
+            break;
+    }
+
+    if (elements)
+        *elements = n;
+
+    return p;
+}
+
+// Returns NULL when the upload is valid, the reason otherwise.
+static const char *json_check(JsonShape *js, const char *body, long len)
+{
+    const char *end = body + len;
+    const char *p;
+
+    memset(js, 0, sizeof(*js));
+    js->start = body;
+    js->sensors = -1;
+    js->readings = -1;
+
+    p = json_ws(body, end);
+
+    if ((p >= end) || (*p != '{'))
+        return json_fail(js, p, "not an object"), js->error;
+
+    if (!(p = json_value(js, p, end, 0, NULL)))
+        return js->error;
+
+    if (json_ws(p, end) != end)
+        return json_fail(js, p, "data after the object"), js->error;
+
+    if (js->sensors < 0)
+        return json_fail(js, body, "no sensors array"), js->error;
+
+    return NULL;
+}
+
+//
+// Connections.
+//
+static void conn_close(Conn *c, int reset)
+{
+    if (reset)
+    {
+        // Sends a RST instead of a FIN.
+        struct linger lg = { 1, 0 };
+        setsockopt(c->fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    }
+
+    close(c->fd);
+    c->fd = -1;
+}
+
+static void conn_reset(Conn *c)
+{
+    c->state = COLL_HEAD;
+    c->head_len = 0;
+    c->body_len = 0;
+    c->chunks = 0;
+    c->close = close_after;
+    c->fault = FAULT_NONE;
+}
+
+static void conn_send(Conn *c, int status, const char *reason)
+{
+    char buf[256];
+    int len = snprintf(buf, sizeof(buf),
+                       "HTTP/1.1 %d %s\r\n"
+                       "Content-Length: 0\r\n"
+                       "%s"
+                       "\r\n",
+                       status, reason, c->close ? "Connection: close\r\n" : "");
+
+    // Small enough to always fit in the socket buffer.
+    if (send(c->fd, buf, len, MSG_NOSIGNAL) != len)
+        c->close = 1;
+}
+
+// The body is the raw chunked one while it is received, and only the
+// JSON once it is all there, at says where in it the fault is.
+static void conn_reject(Conn *c, const char *why, long at)
+{
+    invalid++;
+
+    fprintf(stderr, "%s:%d upload %lu invalid: %s",
+            inet_ntoa(c->peer.sin_addr), ntohs(c->peer.sin_port),
+            c->uploads + 1, why);
+    if ((at >= 0) && (c->state == COLL_BODY))
+        fprintf(stderr, " at body byte %ld, chunk %d", at, c->chunks);
+    else if (at >= 0)
+        fprintf(stderr, " at JSON byte %ld", at);
+    fprintf(stderr, "\n");
+
+    if (at >= 0)
+    {
+        long from = (at > 40) ? (at - 40) : 0;
+        long to = (at + 40 < c->body_len) ? (at + 40) : c->body_len;
+
+        fprintf(stderr, "  ");
+        for (long i = from; i < to; i++)
+        {
+            char ch = c->body[i];
+            if (ch == '\r')
+                fprintf(stderr, "\\r");
+            else if (ch == '\n')
+                fprintf(stderr, "\\n");
+            else
+                fputc(isprint((unsigned char)ch) ? ch : '?', stderr);
+        }
+        fprintf(stderr, "\n");
+    }
+
+    c->close = 1;
+    conn_send(c, 400, "Bad Request");
+    conn_close(c, 0);
+}
+
+static int header_has(const char *head, const char *line)
+{
+    const char *p = head;
+    size_t len = strlen(line);
+
+    while ((p = strstr(p, "\r\n")))
+    {
+        p += 2;
+        if (!strncasecmp(p, line, len))
+            return 1;
+    }
+
+    return 0;
+}
+
+static long header_long(const char *head, const char *name)
+{
+    const char *p = head;
+    size_t len = strlen(name);
+
+    while ((p = strstr(p, "\r\n")))
+    {
+        p += 2;
+        if (!strncasecmp(p, name, len))
+            return atol(p + len);
+    }
+
+    return -1;
+}
+
+static int conn_head_done(Conn *c)
+{
+    c->head[c->head_len] = 0;
+
+    if (strncmp(c->head, "PUT / HTTP/1.1\r\n", 16))
+    {
+        conn_reject(c, "not PUT / HTTP/1.1", -1);
+        return -1;
+    }
+
+    if (!header_has(c->head, "Host: "))
+    {
+        conn_reject(c, "no Host header", -1);
+        return -1;
+    }
+
+    if (!header_has(c->head, "Content-Type: application/json\r\n"))
+    {
+        conn_reject(c, "Content-Type is not application/json", -1);
+        return -1;
+    }
+
+    if (header_has(c->head, "Transfer-Encoding: chunked\r\n"))
+    {
+        c->framing = BODY_CHUNK_SIZE;
+        c->line_len = 0;
+        c->chunk_size = 0;
+    }
+    else if ((c->left = header_long(c->head, "Content-Length:")) >= 0)
+    {
+        if (c->left > COLL_BODY_SIZE)
+        {
+            conn_reject(c, "body too large", -1);
+            return -1;
+        }
+        c->framing = BODY_LENGTH;
+    }
+    else
+    {
+        conn_reject(c, "neither chunked nor a Content-Length", -1);
+        return -1;
+    }
+
+    if (header_has(c->head, "Connection: close"))
+        c->close = 1;
+
+    c->state = COLL_BODY;
+    return 0;
+}
+
+static double random_pct()
+{
+    return 100.0 * rand() / ((double)RAND_MAX + 1);
+}
+
+static void conn_body_done(Conn *c, uint64_t now)
+{
+    JsonShape js;
+    const char *why = json_check(&js, c->body, c->body_len);
+
+    c->state = COLL_RESPOND;
+
+    if (why)
+    {
+        conn_reject(c, why, js.at - c->body);
+        return;
+    }
+
+    uploads++;
+    c->uploads++;
+    body_bytes += c->body_len;
+    if (js.readings > 0)
+        readings += js.readings;
+    else
+        readings++;
+
+    add_stat(&recv_times, &recv_count, now - c->start_us);
+    if (last_start_us)
+        add_stat(&gaps, &gap_count, c->start_us - last_start_us);
+    else
+        first_us = c->start_us;
+    last_start_us = c->start_us;
+
+    if (random_pct() < reset_pct)
+        c->fault = FAULT_RESET;
+    else if (random_pct() < error_pct)
+        c->fault = FAULT_STATUS;
+
+    if (verbose)
+    {
+        printf("%s:%d upload %lu: %ld bytes in %d chunks, %ld sensors",
+               inet_ntoa(c->peer.sin_addr), ntohs(c->peer.sin_port),
+               c->uploads, c->body_len, c->chunks, js.sensors);
+        if (js.readings >= 0)
+            printf(", %ld readings", js.readings);
+        printf(", %.1f ms", (now - c->start_us) / 1000.0);
+        if (gap_count)
+            printf(", %.0f ms since the last", gaps[gap_count - 1] / 1000.0);
+        if (c->fault == FAULT_RESET)
+            printf(", reset");
+        else if (c->fault == FAULT_STATUS)
+            printf(", status %d", error_status);
+        printf("\n");
+        fflush(stdout);
+    }
+
+    c->respond_us = now + latency_ms * 1000
+                  + (jitter_ms ? (rand() % (jitter_ms + 1)) * 1000 : 0);
+}
+
+static void conn_respond(Conn *c)
+{
+    switch (c->fault)
+    {
+        case FAULT_RESET:
+            injected_reset++;
+            conn_close(c, 1);
+            return;
+        case FAULT_STATUS:
+            injected_status++;
+            conn_send(c, error_status, "Injected Error");
+            break;
+        case FAULT_NONE:
+            conn_send(c, 200, "OK");
+            break;
+    }
+
+    if (c->close)
+    {
+        conn_close(c, 0);
+        return;
+    }
+
+    conn_reset(c);
+}
+
+// Returns -1 when the byte made the upload invalid.
+static int conn_body_byte(Conn *c, char ch)
+{
+    long at = c->body_len;
+
+    if (c->body_len >= COLL_BODY_SIZE)
+    {
+        conn_reject(c, "body too large", -1);
+        return -1;
+    }
+
+    c->body[c->body_len++] = ch;
+
+    switch (c->framing)
+    {
+        case BODY_LENGTH:
+            c->left--;
+            break;
+        case BODY_CHUNK_SIZE:
+            // Only hex digits and CRLF, no chunk extensions are sent.
+            if (ch == '\r')
+            {
+                if (!c->line_len)
+                {
+                    conn_reject(c, "empty chunk size", at);
+                    return -1;
+                }
+                c->line_len = -1;
+            }
+            else if (c->line_len < 0)
+            {
+                if (ch != '\n')
+                {
+                    conn_reject(c, "chunk size not ended by CRLF", at);
+                    return -1;
+                }
+                if (c->chunk_size > (COLL_BODY_SIZE - c->body_len))
+                {
+                    conn_reject(c, "chunk size larger than the body could be", at);
+                    return -1;
+                }
+                c->left = c->chunk_size;
+                c->framing = c->chunk_size ? BODY_CHUNK_DATA : BODY_TRAILER;
+                c->line_len = 0;
+                c->chunks++;
+            }
+            else if (isxdigit((unsigned char)ch) && (c->line_len < 8))
+            {
+                c->chunk_size = c->chunk_size * 16
+                    + (isdigit((unsigned char)ch) ? (ch - '0')
+                                                  : ((ch | 0x20) - 'a' + 10));
+                c->line_len++;
+            }
+            else
+            {
+                conn_reject(c, "bad chunk size", at);
+                return -1;
+            }
+            break;
+        case BODY_CHUNK_DATA:
+            if (!--c->left)
+            {
+                c->framing = BODY_CHUNK_END;
+                c->line_len = 0;
+            }
+            break;
+        case BODY_CHUNK_END:
+            // The data must end exactly where the size said it would.
+            if (ch != "\r\n"[c->line_len])
+            {
+                conn_reject(c, "chunk data longer than its size", at);
+                return -1;
+            }
+            if (++c->line_len == 2)
+            {
+                c->framing = BODY_CHUNK_SIZE;
+                c->line_len = 0;
+                c->chunk_size = 0;
+            }
+            break;
+        case BODY_TRAILER:
+            if (ch != "\r\n"[c->line_len])
+            {
+                conn_reject(c, "trailer after the last chunk", at);
+                return -1;
+            }
+            c->line_len++;
+            break;
+    }
+
+    return 0;
+}
+
+static int conn_body_complete(Conn *c)
+{
+    return ((c->framing == BODY_LENGTH) && !c->left)
+        || ((c->framing == BODY_TRAILER) && (c->line_len == 2));
+}
+
+// Drops the framing from the body so that only the JSON is left.
+static void conn_unchunk(Conn *c)
+{
+    long in = 0;
+    long out = 0;
+
+    if (c->framing != BODY_TRAILER)
+        return;
+
+    for (;;)
+    {
+        long size = strtol(&c->body[in], NULL, 16);
+
+        in = (strstr(&c->body[in], "\r\n") - c->body) + 2;
+        if (!size)
+            break;
+
+        memmove(&c->body[out], &c->body[in], size);
+        out += size;
+        in += size + 2;
+    }
+
+    c->body_len = out;
+}
+
+static void conn_receive(Conn *c, uint64_t now)
+{
+    char buf[4096];
+    int len = recv(c->fd, buf, sizeof(buf), 0);
+
+    if (len < 0)
+    {
+        if ((errno == EAGAIN) || (errno == EINTR))
+            return;
+        if (c->head_len || c->body_len)
+        {
+            invalid++;
+            fprintf(stderr, "%s:%d upload %lu cut short: %s\n",
+                    inet_ntoa(c->peer.sin_addr), ntohs(c->peer.sin_port),
+                    c->uploads + 1, strerror(errno));
+        }
+        conn_close(c, 0);
+        return;
+    }
+
+    if (!len)
+    {
+        if (c->head_len || c->body_len)
+        {
+            invalid++;
+            fprintf(stderr, "%s:%d upload %lu cut short, closed after %d header "
+                    "and %ld body bytes\n",
+                    inet_ntoa(c->peer.sin_addr), ntohs(c->peer.sin_port),
+                    c->uploads + 1, c->head_len, c->body_len);
+        }
+        conn_close(c, 0);
+        return;
+    }
+
+    for (int i = 0; i < len; i++)
+    {
+        if (c->state == COLL_RESPOND)
+        {
+            conn_reject(c, "data before the response", -1);
+            return;
+        }
+
+        if (c->state == COLL_HEAD)
+        {
+            if (!c->head_len)
+                c->start_us = now;
+
+            if (c->head_len >= (COLL_HEAD_SIZE - 1))
+            {
+                conn_reject(c, "header too long", -1);
+                return;
+            }
+
+            c->head[c->head_len++] = buf[i];
+
+            if ((c->head_len < 4) || memcmp(&c->head[c->head_len - 4], "\r\n\r\n", 4))
+                continue;
+
+            if (conn_head_done(c))
+                return;
+
+            if ((c->framing == BODY_LENGTH) && !c->left)
+            {
+                conn_body_done(c, now);
+                if (c->fd < 0)
+                    return;
+            }
+            continue;
+        }
+
+        if (conn_body_byte(c, buf[i]))
+            return;
+
+        if (conn_body_complete(c))
+        {
+            conn_unchunk(c);
+            conn_body_done(c, now);
+            if (c->fd < 0)
+                return;
+        }
+    }
+}
+
+static void accept_conn()
+{
+    struct sockaddr_in peer;
+    socklen_t len = sizeof(peer);
+    int fd = accept(listen_fd, (struct sockaddr *)&peer, &len);
+
+    if (fd < 0)
+        return;
+
+    for (int i = 0; i < COLL_MAX_CONNS; i++)
+    {
+        Conn *c = &conns[i];
+
+        if (c->fd >= 0)
+            continue;
+
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        c->fd = fd;
+        c->peer = peer;
+        c->uploads = 0;
+        conn_reset(c);
+        connections++;
+        return;
+    }
+
+    fprintf(stderr, "More than %d connections, closing\n", COLL_MAX_CONNS);
+    close(fd);
+}
+
+//
+// Statistics.
+//
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct Summary
+{
+    double min;
+    double avg;
+    double p50;
+    double p99;
+    double max;
+    double stddev;
+} Summary;
+
+// In ms, the percentiles by the nearest rank.
+static Summary summarize(uint32_t *v, unsigned long n)
+{
+    Summary s;
+    double sum = 0;
+    double sq = 0;
+
+    memset(&s, 0, sizeof(s));
+
+    if (!n)
+        return s;
+
+    qsort(v, n, sizeof(*v), compare_u32);
+
+    for (unsigned long i = 0; i < n; i++)
+        sum += v[i];
+    s.avg = sum / n / 1000.0;
+
+    for (unsigned long i = 0; i < n; i++)
+    {
+        double d = v[i] / 1000.0 - s.avg;
+        sq += d * d;
+    }
+    s.stddev = sqrt(sq / n);
+
+    s.min = v[0] / 1000.0;
+    s.p50 = v[(n - 1) / 2] / 1000.0;
+    s.p99 = v[(unsigned long)ceil(0.99 * n) - 1] / 1000.0;
+    s.max = v[n - 1] / 1000.0;
+
+    return s;
+}
+
+static void print_summary_json(FILE *f, const char *name, Summary *s, int last)
+{
+    fprintf(f, "  \"%s\": {\"min\": %.3f, \"avg\": %.3f, \"p50\": %.3f, "
+               "\"p99\": %.3f, \"max\": %.3f, \"stddev\": %.3f}%s\n",
+            name, s->min, s->avg, s->p50, s->p99, s->max, s->stddev,
+            last ? "" : ",");
+}
+
+int main(int argc, char **argv)
+{
+    const char *json_path = NULL;
+    unsigned long run_s = 0;
+    unsigned int seed = 1;
+    int port = 9000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:l:j:e:E:x:cs:t:o:vh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'l':
+                latency_ms = strtoul(optarg, NULL, 10);
+                break;
+            case 'j':
+                jitter_ms = strtoul(optarg, NULL, 10);
+                break;
+            case 'e':
+                error_pct = atof(optarg);
+                break;
+            case 'E':
+                error_status = atoi(optarg);
+                break;
+            case 'x':
+                reset_pct = atof(optarg);
+                break;
+            case 'c':
+                close_after = 1;
+                break;
+            case 's':
+                seed = strtoul(optarg, NULL, 10);
+                break;
+            case 't':
+                run_s = strtoul(optarg, NULL, 10);
+                break;
+            case 'o':
+                json_path = optarg;
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return (opt == 'h') ? 0 : 1;
+        }
+    }
+
+    srand(seed);
+
+    for (int i = 0; i < COLL_MAX_CONNS; i++)
+    {
+        conns[i].fd = -1;
+        if (!(conns[i].body = (char *)malloc(COLL_BODY_SIZE)))
+        {
+            perror("malloc");
+            return 1;
+        }
+    }
+
+    struct sockaddr_in addr;
+    int one = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if (((listen_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+        || setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one))
+        || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr))
+        || listen(listen_fd, 4))
+    {
+        perror("listen");
+        return 1;
+    }
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "Collecting on port %d\n", port);
+
+    uint64_t start = now_us();
+
+    while (!stopping && (!run_s || ((now_us() - start) < run_s * 1000000)))
+    {
+        struct pollfd fds[COLL_MAX_CONNS + 1];
+        int n = 0;
+
+        fds[n].fd = listen_fd;
+        fds[n].events = POLLIN;
+        n++;
+
+        for (int i = 0; i < COLL_MAX_CONNS; i++)
+        {
+            if (conns[i].fd < 0)
+                continue;
+            fds[n].fd = conns[i].fd;
+            fds[n].events = POLLIN;
+            n++;
+        }
+
+        if (poll(fds, n, COLL_POLL_MS) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            return 1;
+        }
+
+        uint64_t now = now_us();
+
+        if (fds[0].revents & POLLIN)
+            accept_conn();
+
+        for (int i = 0; i < COLL_MAX_CONNS; i++)
+        {
+            Conn *c = &conns[i];
+
+            if (c->fd < 0)
+                continue;
+
+            if ((c->state == COLL_RESPOND) && (now >= c->respond_us))
+                conn_respond(c);
+
+            if ((c->fd >= 0) && (c->state != COLL_RESPOND))
+            {
+                for (int k = 1; k < n; k++)
+                {
+                    if ((fds[k].fd == c->fd)
+                        && (fds[k].revents & (POLLIN | POLLERR | POLLHUP)))
+                    {
+                        conn_receive(c, now);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    double seconds = (last_start_us > first_us) ? ((last_start_us - first_us) / 1e6) : 0;
+    Summary recv_s = summarize(recv_times, recv_count);
+    Summary gap_s = summarize(gaps, gap_count);
+
+    printf("Uploads %lu, %lu invalid, %lu readings, over %lu connections, "
+           "%lu error statuses and %lu resets injected\n",
+           uploads, invalid, readings, connections, injected_status, injected_reset);
+
+    if (seconds > 0)
+    {
+        printf("Throughput: %.3f uploads/s, %.1f bytes/s, %.0f bytes per upload\n",
+               (uploads - 1) / seconds, body_bytes / seconds,
+               (double)body_bytes / uploads);
+    }
+
+    if (recv_count)
+    {
+        printf("Receive ms: min %.1f avg %.1f p50 %.1f p99 %.1f max %.1f\n",
+               recv_s.min, recv_s.avg, recv_s.p50, recv_s.p99, recv_s.max);
+    }
+
+    if (gap_count)
+    {
+        printf("Gap ms: min %.0f avg %.0f p50 %.0f p99 %.0f max %.0f stddev %.1f\n",
+               gap_s.min, gap_s.avg, gap_s.p50, gap_s.p99, gap_s.max, gap_s.stddev);
+    }
+
+    if (json_path)
+    {
+        FILE *f = fopen(json_path, "w");
+
+        if (!f)
+        {
+            perror(json_path);
+            return 1;
+        }
+
+        fprintf(f, "{\n  \"uploads\": %lu,\n  \"invalid\": %lu,\n"
+                   "  \"readings\": %lu,\n  \"connections\": %lu,\n"
+                   "  \"injected_status\": %lu,\n  \"injected_reset\": %lu,\n"
+                   "  \"bytes\": %llu,\n  \"seconds\": %.3f,\n",
+                uploads, invalid, readings, connections,
+                injected_status, injected_reset, body_bytes, seconds);
+        print_summary_json(f, "receive_ms", &recv_s, 0);
+        print_summary_json(f, "gap_ms", &gap_s, 1);
+        fprintf(f, "}\n");
+        fclose(f);
+    }
+
+    return invalid ? 2 : 0;
+}
@@ -0,0 +1,283 @@
+#include <Arduino.h>
+#include <DallasTemperature.h>
+
+//
+// The DallasTemperature library functions the firmware uses, with the
+// same bus traffic as the library.
+//
+#define STARTCONVO 0x44
+#define COPYSCRATCH 0x48
+#define READSCRATCH 0xBE
+#define WRITESCRATCH 0x4E
+
+// Scratchpad locations.
+#define TEMP_LSB 0
+#define TEMP_MSB 1
+#define HIGH_ALARM_TEMP 2
+#define LOW_ALARM_TEMP 3
+#define CONFIGURATION 4
+#define COUNT_REMAIN 6
+#define COUNT_PER_C 7
+#define SCRATCHPAD_CRC 8
+
+#define TEMP_9_BIT 0x1F
+#define TEMP_10_BIT 0x3F
+#define TEMP_11_BIT 0x5F
+#define TEMP_12_BIT 0x7F
+
+#define MAX_CONVERSION_TIMEOUT 750
+
+DallasTemperature::DallasTemperature(OneWire *wire)
+    : _wire(wire), devices(0), bitResolution(9),
+      waitForConversion(true), checkForConversion(true)
+{
+}
+
+void DallasTemperature::begin(void)
+{
+    DeviceAddress deviceAddress;
+
+    _wire->reset_search();
+    devices = 0;
+
+    while (_wire->search(deviceAddress))
+    {
+        if (validAddress(deviceAddress))
+        {
+            bitResolution = max(bitResolution, getResolution(deviceAddress));
+            devices++;
+        }
+    }
+}
+
+bool DallasTemperature::validAddress(const uint8_t *addr)
+{
+    return OneWire::crc8(addr, 7) == addr[7];
+}
+
+bool DallasTemperature::validFamily(const uint8_t *addr)
+{
+    switch (addr[0])
+    {
+        case DS18S20MODEL:
+        case DS18B20MODEL:
+        case DS1822MODEL:
+        case DS1825MODEL:
+        case DS28EA00MODEL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool DallasTemperature::getAddress(uint8_t *addr, uint8_t index)
+{
+    uint8_t depth = 0;
+
+    _wire->reset_search();
+
+    while ((depth <= index) && _wire->search(addr))
+    {
+        if ((depth == index) && validAddress(addr))
+            return true;
+        depth++;
+    }
+
+    return false;
+}
+
+bool DallasTemperature::isConnected(const uint8_t *addr)
+{
+    ScratchPad scratchPad;
+    return isConnected(addr, scratchPad);
+}
+
+bool DallasTemperature::isConnected(const uint8_t *addr, uint8_t *scratchPad)
+{
+    bool b = readScratchPad(addr, scratchPad);
+    return b && (OneWire::crc8(scratchPad, 8) == scratchPad[SCRATCHPAD_CRC]);
+}
+
+bool DallasTemperature::readScratchPad(const uint8_t *addr, uint8_t *scratchPad)
+{
+    // Without a presence pulse there is no device.
+    if (!_wire->reset())
+        return false;
+
+    _wire->select(addr);
+    _wire->write(READSCRATCH);
+
+    for (uint8_t i = 0; i < 9; i++)
+        scratchPad[i] = _wire->read();
+
+    return _wire->reset() == 1;
+}
+
+void DallasTemperature::writeScratchPad(const uint8_t *addr,
+                                        const uint8_t *scratchPad)
+{
+    _wire->reset();
+    _wire->select(addr);
+    _wire->write(WRITESCRATCH);
+    _wire->write(scratchPad[HIGH_ALARM_TEMP]);
+    _wire->write(scratchPad[LOW_ALARM_TEMP]);
+
+    // DS1820 and DS18S20 have no configuration register.
+    if (addr[0] != DS18S20MODEL)
+        _wire->write(scratchPad[CONFIGURATION]);
+
+    _wire->reset();
+
+    // Save the newly written values to the EEPROM.
+    _wire->select(addr);
+    _wire->write(COPYSCRATCH);
+    delay(20);
+    _wire->reset();
+}
+
+uint8_t DallasTemperature::getResolution(const uint8_t *addr)
+{
+    ScratchPad scratchPad;
+
+    // DS1820 and DS18S20 have no resolution configuration register.
+    if (addr[0] == DS18S20MODEL)
+        return 12;
+
+    if (isConnected(addr, scratchPad))
+    {
+        switch (scratchPad[CONFIGURATION])
+        {
+            case TEMP_12_BIT: return 12;
+            case TEMP_11_BIT: return 11;
+            case TEMP_10_BIT: return 10;
+            case TEMP_9_BIT: return 9;
+        }
+    }
+
+    return 0;
+}
+
+bool DallasTemperature::setResolution(const uint8_t *addr, uint8_t newResolution)
+{
+    ScratchPad scratchPad;
+
+    newResolution = constrain(newResolution, 9, 12);
+
+    if (!isConnected(addr, scratchPad))
+        return false;
+
+    // DS1820 and DS18S20 have no resolution configuration register.
+    if (addr[0] != DS18S20MODEL)
+    {
+        switch (newResolution)
+        {
+            case 12: scratchPad[CONFIGURATION] = TEMP_12_BIT; break;
+            case 11: scratchPad[CONFIGURATION] = TEMP_11_BIT; break;
+            case 10: scratchPad[CONFIGURATION] = TEMP_10_BIT; break;
+            default: scratchPad[CONFIGURATION] = TEMP_9_BIT; break;
+        }
+
+        writeScratchPad(addr, scratchPad);
+    }
+
+    return true;
+}
+
+bool DallasTemperature::isConversionComplete()
+{
+    return _wire->read_bit() == 1;
+}
+
+void DallasTemperature::blockTillConversionComplete(uint8_t bitResolution)
+{
+    unsigned long start = millis();
+
+    if (checkForConversion)
+    {
+        while (!isConversionComplete()
+            && ((millis() - start) < MAX_CONVERSION_TIMEOUT))
+            ;
+    }
+    else
+    {
+        switch (bitResolution)
+        {
+            case 9: delay(94); break;
+            case 10: delay(188); break;
+            case 11: delay(375); break;
+            default: delay(750); break;
+        }
+    }
+}
+
+void DallasTemperature::requestTemperatures()
+{
+    _wire->reset();
+    _wire->skip();
+    _wire->write(STARTCONVO);
+
+    if (!waitForConversion)
+        return;
+
+    blockTillConversionComplete(bitResolution);
+}
+
+bool DallasTemperature::requestTemperaturesByAddress(const uint8_t *addr)
+{
+    uint8_t res = getResolution(addr);
+
+    if (res == 0)
+        return false;
+
+    _wire->reset();
+    _wire->select(addr);
+    _wire->write(STARTCONVO);
+
+    if (!waitForConversion)
+        return true;
+
+    blockTillConversionComplete(res);
+
+    return true;
+}
+
+int16_t DallasTemperature::calculateTemperature(const uint8_t *addr,
+                                                uint8_t *scratchPad)
+{
+    // In 1/128 C, like the library.
+    int16_t fpTemperature = (((int16_t)scratchPad[TEMP_MSB]) << 11)
+                          | (((int16_t)scratchPad[TEMP_LSB]) << 3);
+
+    if ((addr[0] == DS18S20MODEL) && scratchPad[COUNT_PER_C])
+    {
+        fpTemperature = ((fpTemperature & 0xfff0) << 3) - 16
+            + (((scratchPad[COUNT_PER_C] - scratchPad[COUNT_REMAIN]) << 7)
+               / scratchPad[COUNT_PER_C]);
+    }
+
+    return fpTemperature;
+}
+
+int16_t DallasTemperature::getTemp(const uint8_t *addr)
+{
+    ScratchPad scratchPad;
+
+    if (isConnected(addr, scratchPad))
+        return calculateTemperature(addr, scratchPad);
+
+    return DEVICE_DISCONNECTED_RAW;
+}
+
+float DallasTemperature::getTempC(const uint8_t *addr)
+{
+    return rawToCelsius(getTemp(addr));
+}
+
+float DallasTemperature::rawToCelsius(int16_t raw)
+{
+    if (raw <= DEVICE_DISCONNECTED_RAW)
+        return DEVICE_DISCONNECTED_C;
+
+    // C = RAW/128
+    return (float)raw * 0.0078125;
+}
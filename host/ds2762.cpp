@@ -0,0 +1,36 @@
+#include <Arduino.h>
+#include <DS2762.h>
+
+#define DS2762_READ_DATA 0x69
+#define DS2762_CURRENT 0x0E
+#define DS2762_TEMP 0x18
+
+DS2762::DS2762(OneWire *wire, uint8_t *addr) : _wire(wire), _addr(addr)
+{
+}
+
+// Registers are big endian, the value is in the upper bits.
+int16_t DS2762::readRegister16(uint8_t reg)
+{
+    uint8_t msb;
+    uint8_t lsb;
+
+    _wire->reset();
+    _wire->select(_addr);
+    _wire->write(DS2762_READ_DATA);
+    _wire->write(reg);
+    msb = _wire->read();
+    lsb = _wire->read();
+
+    return (int16_t)((msb << 8) | lsb);
+}
+
+int16_t DS2762::readCurrentRaw()
+{
+    return readRegister16(DS2762_CURRENT) >> 3;
+}
+
+int16_t DS2762::readTempRaw()
+{
+    return readRegister16(DS2762_TEMP) >> 5;
+}
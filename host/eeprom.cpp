@@ -0,0 +1,81 @@
+#include <EEPROM.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+
+EEPROMClass EEPROM;
+
+static uint8_t eeprom[E2END + 1];
+static int eeprom_fd = -1;
+static uint8_t eeprom_loaded;
+
+static void eeprom_load()
+{
+    if (!eeprom_loaded)
+    {
+        memset(eeprom, 0xff, sizeof(eeprom));
+        eeprom_loaded = 1;
+    }
+}
+
+int host_eeprom_open(const char *path)
+{
+    ssize_t n;
+
+    eeprom_load();
+
+    if ((eeprom_fd = open(path, O_RDWR | O_CREAT, 0644)) < 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    // A new or short file is padded out with erased bytes.
+    n = pread(eeprom_fd, eeprom, sizeof(eeprom), 0);
+
+    if (n < 0)
+        n = 0;
+
+    if ((size_t)n < sizeof(eeprom))
+    {
+        memset(eeprom + n, 0xff, sizeof(eeprom) - n);
+
+        if (pwrite(eeprom_fd, eeprom + n, sizeof(eeprom) - n, n) < 0)
+        {
+            perror(path);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+uint8_t EEPROMClass::read(int idx)
+{
+    eeprom_load();
+
+    if ((idx < 0) || (idx > E2END))
+        return 0xff;
+
+    return eeprom[idx];
+}
+
+void EEPROMClass::write(int idx, uint8_t val)
+{
+    eeprom_load();
+
+    if ((idx < 0) || (idx > E2END))
+        return;
+
+    eeprom[idx] = val;
+
+    if ((eeprom_fd >= 0) && (pwrite(eeprom_fd, &val, 1, idx) != 1))
+        perror("eeprom");
+}
+
+void EEPROMClass::update(int idx, uint8_t val)
+{
+    if (read(idx) != val)
+        write(idx, val);
+}
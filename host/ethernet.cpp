@@ -0,0 +1,688 @@
+#include <Arduino.h>
+#include <Ethernet.h>
+#include <EthernetUdp.h>
+#include <Dhcp.h>
+#include <utility/w5100.h>
+#include <utility/socket.h>
+
+#include <stdio.h>
+#include <arpa/inet.h>
+
+#include "host.h"
+
+//
+// The Ethernet library classes, the same code as Ethernet 1.1.x on top
+// of the socket API in w5100.cpp.
+//
+EthernetClass Ethernet;
+
+uint8_t EthernetClass::_state[MAX_SOCK_NUM] = { 0, };
+uint16_t EthernetClass::_server_port[MAX_SOCK_NUM] = { 0, };
+
+// Static so that the host build does not need the heap either.
+static DhcpClass ethernet_dhcp;
+
+int EthernetClass::begin(uint8_t *mac_address, unsigned long timeout,
+                         unsigned long responseTimeout)
+{
+    int ret;
+
+    _dhcp = &ethernet_dhcp;
+
+    W5100.init();
+    W5100.setMACAddress(mac_address);
+
+    ret = _dhcp->beginWithDHCP(mac_address, timeout, responseTimeout);
+
+    if (ret == 1)
+    {
+        W5100.setIPAddress(_dhcp->getLocalIp().raw_address());
+        W5100.setGatewayIp(_dhcp->getGatewayIp().raw_address());
+        W5100.setSubnetMask(_dhcp->getSubnetMask().raw_address());
+        _dnsServerAddress = _dhcp->getDnsServerIp();
+    }
+
+    return ret;
+}
+
+void EthernetClass::begin(uint8_t *mac_address, IPAddress local_ip)
+{
+    IPAddress dns_server = local_ip;
+    dns_server[3] = 1;
+    begin(mac_address, local_ip, dns_server);
+}
+
+void EthernetClass::begin(uint8_t *mac_address, IPAddress local_ip,
+                          IPAddress dns_server)
+{
+    IPAddress gateway = local_ip;
+    gateway[3] = 1;
+    begin(mac_address, local_ip, dns_server, gateway);
+}
+
+void EthernetClass::begin(uint8_t *mac_address, IPAddress local_ip,
+                          IPAddress dns_server, IPAddress gateway)
+{
+    IPAddress subnet(255, 255, 255, 0);
+    begin(mac_address, local_ip, dns_server, gateway, subnet);
+}
+
+void EthernetClass::begin(uint8_t *mac, IPAddress local_ip,
+                          IPAddress dns_server, IPAddress gateway,
+                          IPAddress subnet)
+{
+    W5100.init();
+    W5100.setMACAddress(mac);
+    W5100.setIPAddress(local_ip.raw_address());
+    W5100.setGatewayIp(gateway.raw_address());
+    W5100.setSubnetMask(subnet.raw_address());
+    _dnsServerAddress = dns_server;
+}
+
+int EthernetClass::maintain()
+{
+    int rc = DHCP_CHECK_NONE;
+
+    if (_dhcp != NULL)
+    {
+        rc = _dhcp->checkLease();
+
+        if ((rc == DHCP_CHECK_RENEW_OK) || (rc == DHCP_CHECK_REBIND_OK))
+        {
+            W5100.setIPAddress(_dhcp->getLocalIp().raw_address());
+            W5100.setGatewayIp(_dhcp->getGatewayIp().raw_address());
+            W5100.setSubnetMask(_dhcp->getSubnetMask().raw_address());
+            _dnsServerAddress = _dhcp->getDnsServerIp();
+        }
+    }
+
+    return rc;
+}
+
+IPAddress EthernetClass::localIP()
+{
+    IPAddress ret;
+    W5100.getIPAddress(ret.raw_address());
+    return ret;
+}
+
+IPAddress EthernetClass::subnetMask()
+{
+    IPAddress ret;
+    W5100.getSubnetMask(ret.raw_address());
+    return ret;
+}
+
+IPAddress EthernetClass::gatewayIP()
+{
+    IPAddress ret;
+    W5100.getGatewayIp(ret.raw_address());
+    return ret;
+}
+
+IPAddress EthernetClass::dnsServerIP()
+{
+    return _dnsServerAddress;
+}
+
+//
+// Client.
+//
+uint16_t EthernetClient::_srcport = 49152;
+
+EthernetClient::EthernetClient() : _sock(MAX_SOCK_NUM)
+{
+}
+
+EthernetClient::EthernetClient(uint8_t sock) : _sock(sock)
+{
+}
+
+int EthernetClient::connect(const char *, uint16_t)
+{
+    // The firmware resolves names itself, see net.cpp.
+    return 0;
+}
+
+int EthernetClient::connect(IPAddress ip, uint16_t port)
+{
+    if (_sock != MAX_SOCK_NUM)
+        return 0;
+
+    for (int i = 0; i < MAX_SOCK_NUM; i++)
+    {
+        uint8_t s = socketStatus(i);
+
+        if ((s == SnSR::CLOSED) || (s == SnSR::FIN_WAIT)
+         || (s == SnSR::CLOSE_WAIT))
+        {
+            _sock = i;
+            break;
+        }
+    }
+
+    if (_sock == MAX_SOCK_NUM)
+        return 0;
+
+    _srcport++;
+    if (_srcport == 0)
+        _srcport = 49152;
+
+    socket(_sock, SnMR::TCP, _srcport, 0);
+
+    if (!::connect(_sock, rawIPAddress(ip), port))
+    {
+        _sock = MAX_SOCK_NUM;
+        return 0;
+    }
+
+    while (status() != SnSR::ESTABLISHED)
+    {
+        delay(1);
+
+        if (status() == SnSR::CLOSED)
+        {
+            _sock = MAX_SOCK_NUM;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+size_t EthernetClient::write(uint8_t b)
+{
+    return write(&b, 1);
+}
+
+size_t EthernetClient::write(const uint8_t *buf, size_t size)
+{
+    if (_sock == MAX_SOCK_NUM)
+    {
+        setWriteError();
+        return 0;
+    }
+
+    if (!send(_sock, buf, size))
+    {
+        setWriteError();
+        return 0;
+    }
+
+    return size;
+}
+
+int EthernetClient::available()
+{
+    if (_sock != MAX_SOCK_NUM)
+        return recvAvailable(_sock);
+
+    return 0;
+}
+
+int EthernetClient::read()
+{
+    uint8_t b;
+
+    if (recv(_sock, &b, 1) > 0)
+        return b;
+
+    return -1;
+}
+
+int EthernetClient::read(uint8_t *buf, size_t size)
+{
+    return recv(_sock, buf, size);
+}
+
+int EthernetClient::peek()
+{
+    uint8_t b;
+
+    // Unlike recv, peek doesn't check to see if there's any data available.
+    if (!available())
+        return -1;
+
+    ::peek(_sock, &b);
+
+    return b;
+}
+
+void EthernetClient::flush()
+{
+    ::flush(_sock);
+}
+
+void EthernetClient::stop()
+{
+    if (_sock == MAX_SOCK_NUM)
+        return;
+
+    // Attempt to close the connection gracefully (send a FIN to the
+    // other side).
+    disconnect(_sock);
+    unsigned long start = millis();
+
+    // Wait up to a second for the connection to close.
+    while ((status() != SnSR::CLOSED) && (millis() - start < 1000))
+        delay(1);
+
+    // If it hasn't closed, close it forcefully.
+    if (status() != SnSR::CLOSED)
+        close(_sock);
+
+    EthernetClass::_server_port[_sock] = 0;
+    _sock = MAX_SOCK_NUM;
+}
+
+uint8_t EthernetClient::connected()
+{
+    if (_sock == MAX_SOCK_NUM)
+        return 0;
+
+    uint8_t s = status();
+
+    return !((s == SnSR::LISTEN) || (s == SnSR::CLOSED)
+          || (s == SnSR::FIN_WAIT)
+          || ((s == SnSR::CLOSE_WAIT) && !available()));
+}
+
+uint8_t EthernetClient::status()
+{
+    if (_sock == MAX_SOCK_NUM)
+        return SnSR::CLOSED;
+
+    return socketStatus(_sock);
+}
+
+EthernetClient::operator bool()
+{
+    return _sock != MAX_SOCK_NUM;
+}
+
+bool EthernetClient::operator==(const EthernetClient &rhs)
+{
+    return (_sock == rhs._sock) && (_sock != MAX_SOCK_NUM)
+        && (rhs._sock != MAX_SOCK_NUM);
+}
+
+uint8_t EthernetClient::getSocketNumber()
+{
+    return _sock;
+}
+
+//
+// Server.
+//
+EthernetServer::EthernetServer(uint16_t port) : _port(port)
+{
+}
+
+void EthernetServer::begin()
+{
+    for (int sock = 0; sock < MAX_SOCK_NUM; sock++)
+    {
+        EthernetClient client(sock);
+
+        if (client.status() == SnSR::CLOSED)
+        {
+            socket(sock, SnMR::TCP, _port, 0);
+            listen(sock);
+            EthernetClass::_server_port[sock] = _port;
+            break;
+        }
+    }
+}
+
+void EthernetServer::accept()
+{
+    int listening = 0;
+
+    for (int sock = 0; sock < MAX_SOCK_NUM; sock++)
+    {
+        EthernetClient client(sock);
+
+        if (EthernetClass::_server_port[sock] == _port)
+        {
+            if (client.status() == SnSR::LISTEN)
+            {
+                listening = 1;
+            }
+            else if ((client.status() == SnSR::CLOSE_WAIT)
+                  && !client.available())
+            {
+                client.stop();
+            }
+        }
+    }
+
+    if (!listening)
+        begin();
+}
+
+EthernetClient EthernetServer::available()
+{
+    accept();
+
+    for (int sock = 0; sock < MAX_SOCK_NUM; sock++)
+    {
+        EthernetClient client(sock);
+
+        if (EthernetClass::_server_port[sock] == _port)
+        {
+            uint8_t s = client.status();
+
+            if (((s == SnSR::ESTABLISHED) || (s == SnSR::CLOSE_WAIT))
+             && client.available())
+            {
+                return client;
+            }
+        }
+    }
+
+    return EthernetClient(MAX_SOCK_NUM);
+}
+
+size_t EthernetServer::write(uint8_t b)
+{
+    return write(&b, 1);
+}
+
+size_t EthernetServer::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+
+    accept();
+
+    for (int sock = 0; sock < MAX_SOCK_NUM; sock++)
+    {
+        EthernetClient client(sock);
+
+        if ((EthernetClass::_server_port[sock] == _port)
+         && (client.status() == SnSR::ESTABLISHED))
+        {
+            n += client.write(buffer, size);
+        }
+    }
+
+    return n;
+}
+
+//
+// UDP.
+//
+EthernetUDP::EthernetUDP() : _sock(MAX_SOCK_NUM)
+{
+}
+
+uint8_t EthernetUDP::begin(uint16_t port)
+{
+    if (_sock != MAX_SOCK_NUM)
+        return 0;
+
+    for (int i = 0; i < MAX_SOCK_NUM; i++)
+    {
+        uint8_t s = socketStatus(i);
+
+        if ((s == SnSR::CLOSED) || (s == SnSR::FIN_WAIT))
+        {
+            _sock = i;
+            break;
+        }
+    }
+
+    if (_sock == MAX_SOCK_NUM)
+        return 0;
+
+    _port = port;
+    _remaining = 0;
+    socket(_sock, SnMR::UDP, _port, 0);
+
+    return 1;
+}
+
+uint8_t EthernetUDP::beginMulticast(IPAddress ip, uint16_t port)
+{
+    if (_sock != MAX_SOCK_NUM)
+        return 0;
+
+    for (int i = 0; i < MAX_SOCK_NUM; i++)
+    {
+        uint8_t s = socketStatus(i);
+
+        if ((s == SnSR::CLOSED) || (s == SnSR::FIN_WAIT))
+        {
+            _sock = i;
+            break;
+        }
+    }
+
+    if (_sock == MAX_SOCK_NUM)
+        return 0;
+
+    // Calculate MAC address from Multicast IP Address.
+    uint8_t mac[] = { 0x01, 0x00, 0x5E, 0x00, 0x00, 0x00 };
+
+    mac[3] = ip[1] & 0x7F;
+    mac[4] = ip[2];
+    mac[5] = ip[3];
+
+    W5100.writeSnDIPR(_sock, rawIPAddress(ip));
+    W5100.writeSnDPORT(_sock, port);
+    W5100.writeSnDHAR(_sock, mac);
+
+    _remaining = 0;
+    socket(_sock, SnMR::UDP, port, SnMR::MULTI);
+
+    return 1;
+}
+
+void EthernetUDP::stop()
+{
+    if (_sock == MAX_SOCK_NUM)
+        return;
+
+    close(_sock);
+
+    EthernetClass::_server_port[_sock] = 0;
+    _sock = MAX_SOCK_NUM;
+}
+
+int EthernetUDP::beginPacket(const char *, uint16_t)
+{
+    // The firmware resolves names itself, see net.cpp.
+    return 0;
+}
+
+int EthernetUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+    _offset = 0;
+    return startUDP(_sock, rawIPAddress(ip), port);
+}
+
+int EthernetUDP::endPacket()
+{
+    return sendUDP(_sock);
+}
+
+size_t EthernetUDP::write(uint8_t byte)
+{
+    return write(&byte, 1);
+}
+
+size_t EthernetUDP::write(const uint8_t *buffer, size_t size)
+{
+    uint16_t bytes_written = bufferData(_sock, _offset, buffer, size);
+    _offset += bytes_written;
+    return bytes_written;
+}
+
+int EthernetUDP::parsePacket()
+{
+    // Discard any remaining bytes in the last packet.
+    flush();
+
+    if (recvAvailable(_sock) > 0)
+    {
+        // HACK - hand-parse the UDP packet using TCP recv method.
+        uint8_t tmpBuf[8];
+        int ret = recv(_sock, tmpBuf, 8);
+
+        if (ret > 0)
+        {
+            _remoteIP = tmpBuf;
+            _remotePort = tmpBuf[4];
+            _remotePort = (_remotePort << 8) + tmpBuf[5];
+            _remaining = tmpBuf[6];
+            _remaining = (_remaining << 8) + tmpBuf[7];
+
+            // When we get here, any remaining bytes are the data.
+            ret = _remaining;
+        }
+
+        return ret;
+    }
+
+    // There aren't any packets available.
+    return 0;
+}
+
+int EthernetUDP::available()
+{
+    return _remaining;
+}
+
+int EthernetUDP::read()
+{
+    uint8_t byte;
+
+    if ((_remaining > 0) && (recv(_sock, &byte, 1) > 0))
+    {
+        _remaining--;
+        return byte;
+    }
+
+    // If we get here, there's no data available.
+    return -1;
+}
+
+int EthernetUDP::read(unsigned char *buffer, size_t len)
+{
+    if (_remaining > 0)
+    {
+        int got;
+
+        if (_remaining <= len)
+            got = recv(_sock, buffer, _remaining);
+        else
+            got = recv(_sock, buffer, len);
+
+        if (got > 0)
+        {
+            _remaining -= got;
+            return got;
+        }
+    }
+
+    // If we get here, there's no data available or recv failed.
+    return -1;
+}
+
+int EthernetUDP::peek()
+{
+    uint8_t b;
+
+    // Unlike recv, peek doesn't check to see if there's any data
+    // available, so we must.
+    if (!_remaining)
+        return -1;
+
+    ::peek(_sock, &b);
+
+    return b;
+}
+
+void EthernetUDP::flush()
+{
+    while (_remaining)
+    {
+        read();
+    }
+}
+
+//
+// DHCP, made up from the environment. The firmware asks for it with
+// its own DHCP client, which host_dhcp_reply() in w5100.cpp answers.
+//
+static void dhcp_parse(const char *s, uint8_t *ip)
+{
+    struct in_addr a;
+
+    if (s && inet_aton(s, &a))
+        memcpy(ip, &a, 4);
+}
+
+static void dhcp_resolv_conf(uint8_t *ip)
+{
+    char line[128];
+    char addr[64];
+    FILE *f;
+
+    if (!(f = fopen("/etc/resolv.conf", "r")))
+        return;
+
+    while (fgets(line, sizeof(line), f))
+    {
+        if (sscanf(line, " nameserver %63s", addr) == 1)
+        {
+            dhcp_parse(addr, ip);
+            break;
+        }
+    }
+
+    fclose(f);
+}
+
+void host_lease(uint8_t *ip, uint8_t *subnet, uint8_t *gateway, uint8_t *dns)
+{
+    const char *dns_env = getenv("PANNAN_DNS");
+
+    ip[0] = 127;
+    ip[1] = 0;
+    ip[2] = 0;
+    ip[3] = 1;
+    dhcp_parse(getenv("PANNAN_HOST_IP"), ip);
+
+    memcpy(gateway, ip, 4);
+    gateway[3] = 1;
+
+    subnet[0] = 255;
+    subnet[1] = (ip[0] == 127) ? 0 : 255;
+    subnet[2] = (ip[0] == 127) ? 0 : 255;
+    subnet[3] = 0;
+
+    memcpy(dns, gateway, 4);
+
+    if (dns_env)
+        dhcp_parse(dns_env, dns);
+    else
+        dhcp_resolv_conf(dns);
+}
+
+int DhcpClass::beginWithDHCP(uint8_t *, unsigned long, unsigned long)
+{
+    host_lease(_localIp, _subnetMask, _gatewayIp, _dnsServerIp);
+    return 1;
+}
+
+int DhcpClass::checkLease()
+{
+    // The made up lease never runs out.
+    return DHCP_CHECK_NONE;
+}
+
+IPAddress DhcpClass::getLocalIp() { return IPAddress(_localIp); }
+IPAddress DhcpClass::getSubnetMask() { return IPAddress(_subnetMask); }
+IPAddress DhcpClass::getGatewayIp() { return IPAddress(_gatewayIp); }
+IPAddress DhcpClass::getDhcpServerIp() { return IPAddress(_gatewayIp); }
+IPAddress DhcpClass::getDnsServerIp() { return IPAddress(_dnsServerIp); }
@@ -0,0 +1,40 @@
+
+#ifndef __HOST_H__
+#define __HOST_H__
+
+#include <signal.h>
+#include <stdint.h>
+
+// Set by SIGINT and SIGTERM, main() returns after the current loop().
+extern volatile sig_atomic_t host_stopping;
+
+void host_time_init();
+
+//
+// The clock is the real time plus time that was only simulated, like
+// the time slots on the 1-Wire bus. With host_virtual_delay set delay()
+// also only moves the clock, so a sweep takes as long as on the board
+// without having to wait for it.
+//
+extern uint8_t host_virtual_delay;
+void host_time_advance(unsigned long us);
+
+// Added to the local ports below 1024, so the server can run unprivileged.
+extern uint16_t host_port_offset;
+
+// Accepts and polls the emulated W5100 sockets, called before each loop().
+void host_net_poll();
+
+//
+// There is no DHCP server to talk to on the host, the lease is made up
+// from the environment: PANNAN_HOST_IP (default 127.0.0.1) and the DNS
+// server from PANNAN_DNS or /etc/resolv.conf. PANNAN_HOST_LEASE is the
+// lease time in seconds (default a day).
+//
+void host_lease(uint8_t *ip, uint8_t *subnet, uint8_t *gateway, uint8_t *dns);
+
+// Devices on the simulated 1-Wire bus, see bus.cpp.
+int host_bus_load(const char *path);
+void host_bus_report();
+
+#endif // __HOST_H__
@@ -0,0 +1,939 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+//
+// Load generator for the webserver of the host build, see the README.
+// A fixed number of clients make requests back to back, or at a fixed
+// total rate with -R, to the routes given in turn. Slow clients take up
+// sockets by sending their request a byte at a time and never finishing
+// it. Responses are checked to be complete: the length in the header,
+// strict chunked framing, or up to the close without either.
+//
+// The sweep cadence comes from /metrics (-DPANNAN_METRICS=ON), read once
+// the warmup is over and again at the end: how often the sensors task
+// ran, and how late it started at most in between.
+//
+#define LOAD_MAX_CLIENTS 256
+#define LOAD_MAX_ROUTES 16
+#define LOAD_HEAD_SIZE 1024
+#define LOAD_REQUEST_SIZE 256
+#define LOAD_POLL_MS 5
+#define LOAD_RETRY_MS 10        // After a failed connection, like a browser.
+
+typedef enum load_state_e
+{
+    LOAD_IDLE,          // Waiting for the rate, or to reconnect.
+    LOAD_CONNECTING,
+    LOAD_SENDING,
+    LOAD_HEAD,
+    LOAD_BODY
+} load_state_t;
+
+typedef enum load_body_e
+{
+    BODY_CLOSE,         // Up to the close of the connection.
+    BODY_LENGTH,
+    BODY_CHUNK_SIZE,
+    BODY_CHUNK_DATA,
+    BODY_CHUNK_END,     // CRLF after the data of a chunk.
+    BODY_TRAILER
+} load_body_t;
+
+typedef enum load_error_e
+{
+    ERR_CONNECT,
+    ERR_TIMEOUT,
+    ERR_STATUS,
+    ERR_PROTOCOL,
+    ERR_COUNT
+} load_error_t;
+
+static const char *error_names[ERR_COUNT] =
+{
+    "connect",
+    "timeout",
+    "status",
+    "protocol"
+};
+
+typedef struct LoadClient
+{
+    int fd;
+    load_state_t state;
+    uint8_t slow;
+    uint8_t connected;      // Kept alive from the last request.
+    uint64_t start_us;      // Of the request, including any connect.
+    uint64_t last_us;       // Of the last progress, for the timeout.
+    uint64_t retry_us;      // Not before this after a failure.
+    char req[LOAD_REQUEST_SIZE];
+    int req_len;
+    int req_off;
+    char head[LOAD_HEAD_SIZE];
+    int head_len;
+    int status;
+    int close;              // The server says it closes after this.
+    load_body_t body;
+    long left;              // Of the body or the current chunk.
+    int line_len;           // Of the chunk size line so far.
+    long chunk_size;
+} LoadClient;
+
+typedef struct LoadMetrics
+{
+    int ok;
+    double uptime_ms;
+    double runs;
+    double max_late_ms;
+    double missed;
+    double loop_max_us;
+} LoadMetrics;
+
+static struct sockaddr_in addr;
+static LoadClient clients[LOAD_MAX_CLIENTS];
+static int client_count = 4;
+static int slow_count;
+static int keep_alive;
+static const char *routes[LOAD_MAX_ROUTES];
+static int route_count;
+static unsigned long next_route;
+static double rate;
+static uint64_t next_start_us;
+static unsigned long timeout_ms = 5000;
+static unsigned long slow_interval_ms = 1000;
+static int verbose;
+
+static uint64_t record_from_us;
+static uint32_t *latencies;
+static unsigned long latency_count;
+static unsigned long latency_size;
+static unsigned long errors[ERR_COUNT];
+static unsigned long slow_closed;
+static unsigned long kept_closed;
+static unsigned long bytes;
+
+static volatile sig_atomic_t stopping;
+
+static void stop(int)
+{
+    stopping = 1;
+}
+
+static uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [-c clients] [-k] [-r route]... [-R rate] [-S slow] [-i ms]\n"
+        "          [-d seconds] [-w seconds] [-T ms] [-o results.json] [-v] [host[:port]]\n"
+        "  -c  Clients making requests (default 4), 0 to only read the cadence\n"
+        "  -k  Keep the connections alive between requests\n"
+        "  -r  Route to request, in turn if more than one (default /json)\n"
+        "  -R  Requests per second in all, as fast as they are answered without\n"
+        "  -S  Slow clients that never finish their request\n"
+        "  -i  ms between the bytes the slow clients send (default 1000)\n"
+        "  -d  Seconds to measure (default 10)\n"
+        "  -w  Seconds of load before measuring (default 2)\n"
+        "  -T  ms without progress before a request times out (default 5000)\n"
+        "  -o  Save the results as JSON\n"
+        "  -v  Print each error\n"
+        "The default host is 127.0.0.1:8080.\n",
+        prog);
+}
+
+static void record(uint64_t us)
+{
+    if (now_us() < record_from_us)
+        return;
+
+    if (latency_count == latency_size)
+    {
+        latency_size = latency_size ? latency_size * 2 : 4096;
+        latencies = (uint32_t *)realloc(latencies, latency_size * sizeof(*latencies));
+        if (!latencies)
+        {
+            perror("realloc");
+            exit(1);
+        }
+    }
+
+    latencies[latency_count++] = us;
+}
+
+static void fail(LoadClient *c, load_error_t e, const char *why)
+{
+    if (now_us() >= record_from_us)
+        errors[e]++;
+
+    if (verbose)
+    {
+        fprintf(stderr, "Client %d: %s error, %s%s%s\n", (int)(c - clients),
+                error_names[e], why, (e == ERR_CONNECT) ? ": " : "",
+                (e == ERR_CONNECT) ? strerror(errno) : "");
+    }
+
+    close(c->fd);
+    c->fd = -1;
+    c->connected = 0;
+    c->state = LOAD_IDLE;
+    c->retry_us = now_us() + LOAD_RETRY_MS * 1000;
+}
+
+static void start_request(LoadClient *c, uint64_t now)
+{
+    if (c->slow)
+    {
+        // The request line, and then headers that never end.
+        c->req_len = snprintf(c->req, sizeof(c->req),
+                              "GET / HTTP/1.1\r\nX-Slow: 1\r\n");
+    }
+    else
+    {
+        const char *route = routes[next_route++ % route_count];
+
+        c->req_len = snprintf(c->req, sizeof(c->req),
+                              "GET %s HTTP/1.1\r\n"
+                              "Host: %s\r\n"
+                              "Connection: %s\r\n"
+                              "\r\n",
+                              route, inet_ntoa(addr.sin_addr),
+                              keep_alive ? "keep-alive" : "close");
+    }
+
+    c->req_off = 0;
+    c->head_len = 0;
+    c->status = 0;
+    c->close = !keep_alive;
+    c->start_us = now;
+    c->last_us = now;
+
+    if (c->connected)
+    {
+        c->state = LOAD_SENDING;
+        return;
+    }
+
+    if ((c->fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    {
+        perror("socket");
+        exit(1);
+    }
+
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(c->fd, F_SETFL, O_NONBLOCK);
+
+    if (!connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)))
+        c->state = LOAD_SENDING;
+    else if (errno == EINPROGRESS)
+        c->state = LOAD_CONNECTING;
+    else
+        fail(c, ERR_CONNECT, "connect");
+}
+
+static void done(LoadClient *c, uint64_t now)
+{
+    if ((c->status >= 200) && (c->status < 300))
+        record(now - c->start_us);
+    else if (now >= record_from_us)
+        errors[ERR_STATUS]++;
+
+    c->state = LOAD_IDLE;
+
+    if (c->close || (c->body == BODY_CLOSE))
+    {
+        close(c->fd);
+        c->fd = -1;
+        c->connected = 0;
+    }
+    else
+    {
+        c->connected = 1;
+    }
+}
+
+static int parse_head(LoadClient *c)
+{
+    char *p;
+
+    c->head[c->head_len] = 0;
+
+    if (strncmp(c->head, "HTTP/1.", 7) || !(p = strchr(c->head, ' ')))
+        return -1;
+
+    c->status = atoi(p + 1);
+    c->body = BODY_CLOSE;
+
+    for (p = strstr(c->head, "\r\n"); p && (p[2] != '\r'); p = strstr(p + 2, "\r\n"))
+    {
+        char *line = p + 2;
+
+        if (!strncasecmp(line, "Content-Length:", 15))
+        {
+            c->body = BODY_LENGTH;
+            c->left = atol(line + 15);
+        }
+        else if (!strncasecmp(line, "Transfer-Encoding: chunked", 26))
+        {
+            c->body = BODY_CHUNK_SIZE;
+            c->line_len = 0;
+            c->chunk_size = 0;
+        }
+        else if (!strncasecmp(line, "Connection: close", 17))
+        {
+            c->close = 1;
+        }
+    }
+
+    return 0;
+}
+
+// Returns 1 when the response is complete, -1 when it is malformed.
+static int parse_body(LoadClient *c, const char *buf, int len)
+{
+    for (int i = 0; i < len; i++)
+    {
+        char ch = buf[i];
+
+        switch (c->body)
+        {
+            case BODY_CLOSE:
+                return 0;
+            case BODY_LENGTH:
+                if (--c->left < 0)
+                    return -1;
+                break;
+            case BODY_CHUNK_SIZE:
+                if (ch == '\n')
+                {
+                    if (!c->line_len)
+                        return -1;
+                    c->left = c->chunk_size;
+                    c->body = c->chunk_size ? BODY_CHUNK_DATA : BODY_TRAILER;
+                    c->line_len = 0;
+                }
+                else if (ch == '\r')
+                {
+                }
+                else if (isxdigit((unsigned char)ch) && (c->line_len < 7))
+                {
+                    c->chunk_size = c->chunk_size * 16
+                        + (isdigit((unsigned char)ch) ? (ch - '0')
+                                                      : ((ch | 0x20) - 'a' + 10));
+                    c->line_len++;
+                }
+                else
+                {
+                    return -1;
+                }
+                break;
+            case BODY_CHUNK_DATA:
+                if (!--c->left)
+                {
+                    c->body = BODY_CHUNK_END;
+                    c->line_len = 0;
+                }
+                break;
+            case BODY_CHUNK_END:
+                // Exactly CRLF, anything else means the size was wrong.
+                if (ch != "\r\n"[c->line_len])
+                    return -1;
+                if (++c->line_len == 2)
+                {
+                    c->body = BODY_CHUNK_SIZE;
+                    c->line_len = 0;
+                    c->chunk_size = 0;
+                }
+                break;
+            case BODY_TRAILER:
+                // No trailers are sent, only the CRLF ending the body.
+                if (ch != "\r\n"[c->line_len])
+                    return -1;
+                if (++c->line_len == 2)
+                    return (i == (len - 1)) ? 1 : -1;
+                break;
+        }
+    }
+
+    return ((c->body == BODY_LENGTH) && !c->left) ? 1 : 0;
+}
+
+// A connection kept alive that the server closed before it answered
+// anything is not an error, the request is made again on a new one.
+static int reconnect(LoadClient *c)
+{
+    if (!c->connected || c->head_len)
+        return 0;
+
+    if (now_us() >= record_from_us)
+        kept_closed++;
+
+    close(c->fd);
+    c->fd = -1;
+    c->connected = 0;
+    start_request(c, c->start_us);
+
+    return 1;
+}
+
+static void receive(LoadClient *c, uint64_t now)
+{
+    char buf[2048];
+    int len = recv(c->fd, buf, sizeof(buf), 0);
+
+    if (len < 0)
+    {
+        if ((errno != EAGAIN) && (errno != EINTR) && !reconnect(c))
+            fail(c, ERR_CONNECT, "recv");
+        return;
+    }
+
+    if (!len)
+    {
+        if (c->slow)
+        {
+            // The server gave up on it, which is what it should do.
+            slow_closed++;
+            close(c->fd);
+            c->fd = -1;
+            c->state = LOAD_IDLE;
+        }
+        else if ((c->state == LOAD_BODY) && (c->body == BODY_CLOSE))
+        {
+            done(c, now);
+        }
+        else if (!reconnect(c))
+        {
+            if (c->head_len)
+                fail(c, ERR_PROTOCOL, "closed early");
+            else
+                fail(c, ERR_CONNECT, "closed without an answer");
+        }
+        return;
+    }
+
+    bytes += len;
+    c->last_us = now;
+
+    if (c->slow)
+        return;
+
+    int off = 0;
+
+    if (c->state == LOAD_HEAD)
+    {
+        while ((off < len) && (c->state == LOAD_HEAD))
+        {
+            if (c->head_len >= (LOAD_HEAD_SIZE - 1))
+            {
+                fail(c, ERR_PROTOCOL, "header too long");
+                return;
+            }
+
+            c->head[c->head_len++] = buf[off++];
+
+            if ((c->head_len >= 4)
+                && !memcmp(&c->head[c->head_len - 4], "\r\n\r\n", 4))
+            {
+                if (parse_head(c))
+                {
+                    fail(c, ERR_PROTOCOL, "bad status line");
+                    return;
+                }
+                c->state = LOAD_BODY;
+            }
+        }
+
+        if (c->state == LOAD_HEAD)
+            return;
+
+        if ((c->body == BODY_LENGTH) && !c->left && (off == len))
+        {
+            done(c, now);
+            return;
+        }
+    }
+
+    switch (parse_body(c, &buf[off], len - off))
+    {
+        case 1:
+            done(c, now);
+            break;
+        case -1:
+            fail(c, ERR_PROTOCOL, "bad body framing");
+            break;
+    }
+}
+
+static void send_more(LoadClient *c, uint64_t now)
+{
+    int len;
+
+    if (c->slow)
+    {
+        // One byte at a time, the headers of a slow client never end.
+        if ((now - c->last_us) < (slow_interval_ms * 1000) && c->req_off)
+            return;
+
+        if (c->req_off >= c->req_len)
+            c->req_off = 16;    // After the request line, X-Slow again.
+
+        len = send(c->fd, &c->req[c->req_off], 1, MSG_NOSIGNAL);
+    }
+    else
+    {
+        len = send(c->fd, &c->req[c->req_off], c->req_len - c->req_off,
+                   MSG_NOSIGNAL);
+    }
+
+    if (len < 0)
+    {
+        if ((errno != EAGAIN) && (errno != EINTR))
+        {
+            if (c->slow)
+            {
+                slow_closed++;
+                close(c->fd);
+                c->fd = -1;
+                c->state = LOAD_IDLE;
+            }
+            else if (!reconnect(c))
+            {
+                fail(c, ERR_CONNECT, "send");
+            }
+        }
+        return;
+    }
+
+    c->req_off += len;
+    c->last_us = now;
+
+    if (!c->slow && (c->req_off == c->req_len))
+        c->state = LOAD_HEAD;
+}
+
+static void connected(LoadClient *c)
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+
+    if (err)
+    {
+        errno = err;
+        fail(c, ERR_CONNECT, "connect");
+    }
+    else
+    {
+        c->state = LOAD_SENDING;
+    }
+}
+
+static void run_clients(uint64_t until_us)
+{
+    struct pollfd fds[LOAD_MAX_CLIENTS];
+    int total = client_count + slow_count;
+
+    while (!stopping && (now_us() < until_us))
+    {
+        uint64_t now = now_us();
+        int n = 0;
+
+        for (int i = 0; i < total; i++)
+        {
+            LoadClient *c = &clients[i];
+
+            if ((c->state == LOAD_IDLE) && (now >= c->retry_us))
+            {
+                if (!c->slow && rate)
+                {
+                    if (now < next_start_us)
+                        continue;
+                    next_start_us += 1000000 / rate;
+                }
+                start_request(c, now);
+            }
+
+            if ((c->state != LOAD_IDLE) && !c->slow
+                && ((now - c->last_us) > (timeout_ms * 1000)))
+            {
+                fail(c, ERR_TIMEOUT, "no progress");
+            }
+
+            if (c->fd < 0)
+                continue;
+
+            fds[n].fd = c->fd;
+            fds[n].events = POLLIN;
+            if ((c->state == LOAD_CONNECTING)
+                || ((c->state == LOAD_SENDING) && !c->slow))
+                fds[n].events |= POLLOUT;
+            fds[n].revents = 0;
+            n++;
+        }
+
+        if (poll(fds, n, LOAD_POLL_MS) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            exit(1);
+        }
+
+        now = now_us();
+        n = 0;
+
+        for (int i = 0; i < total; i++)
+        {
+            LoadClient *c = &clients[i];
+            short revents;
+
+            if (c->fd < 0)
+                continue;
+
+            // The fds were added in the same order.
+            while (fds[n].fd != c->fd)
+                n++;
+            revents = fds[n++].revents;
+
+            if (c->state == LOAD_CONNECTING)
+            {
+                if (revents & (POLLOUT | POLLERR | POLLHUP))
+                    connected(c);
+                continue;
+            }
+
+            if ((c->state == LOAD_SENDING) && (c->slow || (revents & POLLOUT)))
+                send_more(c, now);
+
+            if ((c->fd >= 0) && (revents & (POLLIN | POLLERR | POLLHUP)))
+                receive(c, now);
+        }
+    }
+}
+
+//
+// Reads /metrics on a connection of its own.
+//
+static double metric_value(const char *text, const char *name)
+{
+    const char *p = text;
+    size_t len = strlen(name);
+
+    while ((p = strstr(p, name)))
+    {
+        if (((p == text) || (p[-1] == '\n')) && (p[len] == ' '))
+            return strtod(&p[len + 1], NULL);
+        p += len;
+    }
+
+    return -1;
+}
+
+static LoadMetrics read_metrics_once()
+{
+    static char buf[65536];
+    struct timeval tv = { (time_t)(timeout_ms / 1000),
+                          (suseconds_t)((timeout_ms % 1000) * 1000) };
+    LoadMetrics m;
+    int len = 0;
+    int fd;
+
+    memset(&m, 0, sizeof(m));
+
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+        return m;
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+    {
+        close(fd);
+        return m;
+    }
+
+    const char req[] = "GET /metrics HTTP/1.1\r\nConnection: close\r\n\r\n";
+    if (send(fd, req, sizeof(req) - 1, MSG_NOSIGNAL) < 0)
+    {
+        close(fd);
+        return m;
+    }
+
+    for (;;)
+    {
+        int n = recv(fd, &buf[len], sizeof(buf) - 1 - len, 0);
+        if (n <= 0)
+            break;
+        len += n;
+    }
+
+    close(fd);
+    buf[len] = 0;
+
+    m.uptime_ms = metric_value(buf, "pannan_uptime_milliseconds");
+    m.runs = metric_value(buf, "pannan_task_runs_total{task=\"sensors\"}");
+    m.max_late_ms = metric_value(buf, "pannan_task_max_late_milliseconds{task=\"sensors\"}");
+    m.missed = metric_value(buf, "pannan_task_missed_total{task=\"sensors\"}");
+    m.loop_max_us = metric_value(buf, "pannan_loop_max_microseconds");
+    m.ok = (m.uptime_ms >= 0) && (m.runs >= 0);
+
+    return m;
+}
+
+// The server resets connections while all its sockets are busy with the
+// clients, so try again until it gets a turn.
+static LoadMetrics read_metrics()
+{
+    uint64_t until = now_us() + timeout_ms * 1000;
+    LoadMetrics m;
+
+    while (!(m = read_metrics_once()).ok && (now_us() < until))
+        usleep(LOAD_RETRY_MS * 1000);
+
+    return m;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Latency in ms at a quantile, the nearest rank.
+static double quantile(double q)
+{
+    if (!latency_count)
+        return 0;
+
+    unsigned long i = (unsigned long)(q * latency_count + 0.999999);
+    if (i)
+        i--;
+    if (i >= latency_count)
+        i = latency_count - 1;
+
+    return latencies[i] / 1000.0;
+}
+
+static int parse_address(const char *s)
+{
+    char host[64];
+    const char *colon = strchr(s, ':');
+    size_t len = colon ? (size_t)(colon - s) : strlen(s);
+
+    if (len >= sizeof(host))
+        return -1;
+
+    memcpy(host, s, len);
+    host[len] = 0;
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(colon ? atoi(colon + 1) : 8080);
+
+    return inet_aton(host, &addr.sin_addr) ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    const char *json_path = NULL;
+    unsigned long duration_s = 10;
+    unsigned long warmup_s = 2;
+    unsigned long total_errors = 0;
+    LoadMetrics before;
+    LoadMetrics after;
+    uint64_t start;
+    double seconds;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:kr:R:S:i:d:w:T:o:vh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c':
+                client_count = atoi(optarg);
+                break;
+            case 'k':
+                keep_alive = 1;
+                break;
+            case 'r':
+                if (route_count >= LOAD_MAX_ROUTES)
+                {
+                    fprintf(stderr, "At most %d routes\n", LOAD_MAX_ROUTES);
+                    return 1;
+                }
+                routes[route_count++] = optarg;
+                break;
+            case 'R':
+                rate = atof(optarg);
+                break;
+            case 'S':
+                slow_count = atoi(optarg);
+                break;
+            case 'i':
+                slow_interval_ms = strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                duration_s = strtoul(optarg, NULL, 10);
+                break;
+            case 'w':
+                warmup_s = strtoul(optarg, NULL, 10);
+                break;
+            case 'T':
+                timeout_ms = strtoul(optarg, NULL, 10);
+                break;
+            case 'o':
+                json_path = optarg;
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return (opt == 'h') ? 0 : 1;
+        }
+    }
+
+    if (parse_address((optind < argc) ? argv[optind] : "127.0.0.1:8080"))
+    {
+        fprintf(stderr, "Bad address, only IPv4 addresses are taken\n");
+        return 1;
+    }
+
+    if ((client_count < 0) || (slow_count < 0)
+        || ((client_count + slow_count) > LOAD_MAX_CLIENTS))
+    {
+        fprintf(stderr, "At most %d clients in all\n", LOAD_MAX_CLIENTS);
+        return 1;
+    }
+
+    if (!route_count)
+        routes[route_count++] = "/json";
+
+    for (int i = 0; i < LOAD_MAX_CLIENTS; i++)
+    {
+        clients[i].fd = -1;
+        clients[i].slow = (i >= client_count);
+    }
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    start = now_us();
+    next_start_us = start;
+    record_from_us = start + warmup_s * 1000000;
+
+    run_clients(record_from_us);
+    before = read_metrics();
+    record_from_us = now_us();
+    run_clients(record_from_us + duration_s * 1000000);
+    seconds = (now_us() - record_from_us) / 1e6;
+    after = read_metrics();
+
+    qsort(latencies, latency_count, sizeof(*latencies), compare_u32);
+
+    for (int i = 0; i < ERR_COUNT; i++)
+        total_errors += errors[i];
+
+    printf("%s:%d, %d clients, keep-alive %s, %d slow clients, %.1f s after %lu s warmup\n",
+           inet_ntoa(addr.sin_addr), ntohs(addr.sin_port), client_count,
+           keep_alive ? "on" : "off", slow_count, seconds, warmup_s);
+    printf("Requests %lu (%.1f/s, %.1f KB/s), errors %lu (%.2f%%):",
+           latency_count, latency_count / seconds, bytes / 1024.0 / seconds,
+           total_errors,
+           (latency_count + total_errors)
+               ? (100.0 * total_errors / (latency_count + total_errors)) : 0.0);
+    for (int i = 0; i < ERR_COUNT; i++)
+        printf(" %lu %s", errors[i], error_names[i]);
+    printf("\n");
+
+    if (latency_count)
+    {
+        printf("Latency ms: p50 %.2f p99 %.2f p999 %.2f max %.2f\n",
+               quantile(0.5), quantile(0.99), quantile(0.999),
+               latencies[latency_count - 1] / 1000.0);
+    }
+
+    if (keep_alive)
+        printf("Kept alive connections closed by the server: %lu\n", kept_closed);
+    if (slow_count)
+        printf("Slow clients closed by the server: %lu\n", slow_closed);
+
+    double sweeps = after.runs - before.runs;
+    double sweep_ms = (sweeps > 0) ? ((after.uptime_ms - before.uptime_ms) / sweeps) : 0;
+
+    if (before.ok && after.ok)
+    {
+        printf("Sweeps: %.0f, every %.0f ms, started up to %.0f ms late, "
+               "%.0f missed, longest loop %.0f ms\n",
+               sweeps, sweep_ms, after.max_late_ms,
+               after.missed - before.missed, after.loop_max_us / 1000.0);
+    }
+    else
+    {
+        printf("Sweeps: no /metrics, build with -DPANNAN_METRICS=ON\n");
+    }
+
+    if (json_path)
+    {
+        FILE *f = fopen(json_path, "w");
+
+        if (!f)
+        {
+            perror(json_path);
+            return 1;
+        }
+
+        fprintf(f, "{\n  \"clients\": %d,\n  \"keep_alive\": %d,\n"
+                   "  \"slow_clients\": %d,\n  \"rate\": %.1f,\n"
+                   "  \"seconds\": %.1f,\n  \"routes\": [",
+                client_count, keep_alive, slow_count, rate, seconds);
+        for (int i = 0; i < route_count; i++)
+            fprintf(f, "%s\"%s\"", i ? ", " : "", routes[i]);
+        fprintf(f, "],\n  \"requests\": %lu,\n  \"per_second\": %.1f,\n"
+                   "  \"errors\": {",
+                latency_count, latency_count / seconds);
+        for (int i = 0; i < ERR_COUNT; i++)
+            fprintf(f, "%s\"%s\": %lu", i ? ", " : "", error_names[i], errors[i]);
+        fprintf(f, "},\n  \"latency_ms\": {\"p50\": %.3f, \"p99\": %.3f, "
+                   "\"p999\": %.3f, \"max\": %.3f},\n",
+                quantile(0.5), quantile(0.99), quantile(0.999),
+                latency_count ? (latencies[latency_count - 1] / 1000.0) : 0.0);
+        fprintf(f, "  \"kept_closed\": %lu,\n  \"slow_closed\": %lu,\n",
+                kept_closed, slow_closed);
+        if (before.ok && after.ok)
+        {
+            fprintf(f, "  \"sweeps\": {\"count\": %.0f, \"every_ms\": %.0f, "
+                       "\"max_late_ms\": %.0f, \"missed\": %.0f, "
+                       "\"loop_max_ms\": %.1f}\n",
+                    sweeps, sweep_ms, after.max_late_ms,
+                    after.missed - before.missed, after.loop_max_us / 1000.0);
+        }
+        else
+        {
+            fprintf(f, "  \"sweeps\": null\n");
+        }
+        fprintf(f, "}\n");
+        fclose(f);
+    }
+
+    return 0;
+}
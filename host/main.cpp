@@ -0,0 +1,93 @@
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "host.h"
+
+volatile sig_atomic_t host_stopping;
+
+// The LCD is sent by a timer interrupt on the board, setnames has no LCD.
+extern "C" void TIMER2_COMPB_vect(void) __attribute__((weak));
+
+static void host_stop(int)
+{
+    host_stopping = 1;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [-e eeprom] [-s scenario] [-V] [-p offset] [-t seconds] [-n loops]\n"
+        "  -e  File backing the EEPROM, kept in memory without it\n"
+        "  -s  Devices on the 1-Wire bus, see host/bus.cpp\n"
+        "  -V  Virtual time, delay() moves the clock instead of sleeping\n"
+        "  -p  Added to local ports below 1024 (default %u)\n"
+        "  -t  Stop after this many seconds on the clock of the firmware\n"
+        "  -n  Stop after this many calls to loop()\n",
+        prog, host_port_offset);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long run_ms = 0;
+    unsigned long loops = 0;
+    unsigned long n;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "e:s:Vp:t:n:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'e':
+                if (host_eeprom_open(optarg))
+                    return 1;
+                break;
+            case 's':
+                if (host_bus_load(optarg))
+                    return 1;
+                break;
+            case 'V':
+                host_virtual_delay = 1;
+                break;
+            case 'p':
+                host_port_offset = atoi(optarg);
+                break;
+            case 't':
+                run_ms = strtoul(optarg, NULL, 10) * 1000;
+                break;
+            case 'n':
+                loops = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                usage(argv[0]);
+                return (opt == 'h') ? 0 : 1;
+        }
+    }
+
+    signal(SIGINT, host_stop);
+    signal(SIGTERM, host_stop);
+    signal(SIGPIPE, SIG_IGN);
+
+    host_time_init();
+
+    setup();
+
+    for (n = 0; !host_stopping; n++)
+    {
+        if ((loops && (n >= loops)) || (run_ms && (millis() >= run_ms)))
+            break;
+
+        host_net_poll();
+        loop();
+
+        while (TIMSK2 & _BV(OCIE2B))
+            TIMER2_COMPB_vect();
+    }
+
+    host_bus_report();
+
+    return 0;
+}
@@ -0,0 +1,255 @@
+#include <Arduino.h>
+#include <OneWire.h>
+
+//
+// The OneWire library on top of the bus time slots, the search is the
+// one from Maxim application note 187 like in the library.
+//
+OneWire::OneWire(uint8_t p) : pin(p)
+{
+    reset_search();
+}
+
+uint8_t OneWire::reset(void)
+{
+    return onewire_bus_reset(pin);
+}
+
+void OneWire::write_bit(uint8_t v)
+{
+    onewire_bus_write_bit(pin, v & 1);
+}
+
+uint8_t OneWire::read_bit(void)
+{
+    return onewire_bus_read_bit(pin);
+}
+
+void OneWire::write(uint8_t v, uint8_t)
+{
+    for (uint8_t mask = 0x01; mask; mask <<= 1)
+    {
+        write_bit((mask & v) ? 1 : 0);
+    }
+}
+
+void OneWire::write_bytes(const uint8_t *buf, uint16_t count, bool)
+{
+    for (uint16_t i = 0; i < count; i++)
+        write(buf[i]);
+}
+
+uint8_t OneWire::read()
+{
+    uint8_t r = 0;
+
+    for (uint8_t mask = 0x01; mask; mask <<= 1)
+    {
+        if (read_bit())
+            r |= mask;
+    }
+
+    return r;
+}
+
+void OneWire::read_bytes(uint8_t *buf, uint16_t count)
+{
+    for (uint16_t i = 0; i < count; i++)
+        buf[i] = read();
+}
+
+void OneWire::select(const uint8_t rom[8])
+{
+    write(0x55);    // Match ROM.
+
+    for (uint8_t i = 0; i < 8; i++)
+        write(rom[i]);
+}
+
+void OneWire::skip()
+{
+    write(0xCC);    // Skip ROM.
+}
+
+void OneWire::reset_search()
+{
+    LastDiscrepancy = 0;
+    LastDeviceFlag = false;
+    LastFamilyDiscrepancy = 0;
+
+    for (int i = 7; ; i--)
+    {
+        ROM_NO[i] = 0;
+        if (i == 0)
+            break;
+    }
+}
+
+void OneWire::target_search(uint8_t family_code)
+{
+    ROM_NO[0] = family_code;
+
+    for (uint8_t i = 1; i < 8; i++)
+        ROM_NO[i] = 0;
+
+    LastDiscrepancy = 64;
+    LastFamilyDiscrepancy = 0;
+    LastDeviceFlag = false;
+}
+
+uint8_t OneWire::search(uint8_t *newAddr, bool search_mode)
+{
+    uint8_t id_bit_number = 1;
+    uint8_t last_zero = 0;
+    uint8_t rom_byte_number = 0;
+    uint8_t search_result = false;
+    uint8_t id_bit, cmp_id_bit;
+    unsigned char rom_byte_mask = 1, search_direction;
+
+    // If the last call was not the last one.
+    if (!LastDeviceFlag)
+    {
+        if (!reset())
+        {
+            LastDiscrepancy = 0;
+            LastDeviceFlag = false;
+            LastFamilyDiscrepancy = 0;
+            return false;
+        }
+
+        // Normal search or conditional (alarm) search.
+        write(search_mode ? 0xF0 : 0xEC);
+
+        do
+        {
+            id_bit = read_bit();
+            cmp_id_bit = read_bit();
+
+            // No devices on the bus.
+            if ((id_bit == 1) && (cmp_id_bit == 1))
+                break;
+
+            if (id_bit != cmp_id_bit)
+            {
+                // All devices coupled have 0 or 1.
+                search_direction = id_bit;
+            }
+            else
+            {
+                // If this discrepancy is before the last one on a
+                // previous next, pick the same as last time.
+                if (id_bit_number < LastDiscrepancy)
+                    search_direction = ((ROM_NO[rom_byte_number] & rom_byte_mask) > 0);
+                else
+                    search_direction = (id_bit_number == LastDiscrepancy);
+
+                // If 0 was picked then record its position.
+                if (search_direction == 0)
+                {
+                    last_zero = id_bit_number;
+
+                    if (last_zero < 9)
+                        LastFamilyDiscrepancy = last_zero;
+                }
+            }
+
+            if (search_direction == 1)
+                ROM_NO[rom_byte_number] |= rom_byte_mask;
+            else
+                ROM_NO[rom_byte_number] &= ~rom_byte_mask;
+
+            write_bit(search_direction);
+
+            id_bit_number++;
+            rom_byte_mask <<= 1;
+
+            if (rom_byte_mask == 0)
+            {
+                rom_byte_number++;
+                rom_byte_mask = 1;
+            }
+        } while (rom_byte_number < 8);
+
+        // The search was successful if all 64 bits were read.
+        if (!(id_bit_number < 65))
+        {
+            LastDiscrepancy = last_zero;
+
+            if (LastDiscrepancy == 0)
+                LastDeviceFlag = true;
+
+            search_result = true;
+        }
+    }
+
+    // No device found, reset so the next search is like a first one.
+    if (!search_result || !ROM_NO[0])
+    {
+        LastDiscrepancy = 0;
+        LastDeviceFlag = false;
+        LastFamilyDiscrepancy = 0;
+        search_result = false;
+    }
+    else
+    {
+        for (int i = 0; i < 8; i++)
+            newAddr[i] = ROM_NO[i];
+    }
+
+    return search_result;
+}
+
+// Dallas 8 bit CRC, x^8 + x^5 + x^4 + 1.
+uint8_t OneWire::crc8(const uint8_t *addr, uint8_t len)
+{
+    uint8_t crc = 0;
+
+    while (len--)
+    {
+        uint8_t inbyte = *addr++;
+
+        for (uint8_t i = 8; i; i--)
+        {
+            uint8_t mix = (crc ^ inbyte) & 0x01;
+            crc >>= 1;
+            if (mix)
+                crc ^= 0x8C;
+            inbyte >>= 1;
+        }
+    }
+
+    return crc;
+}
+
+bool OneWire::check_crc16(const uint8_t *input, uint16_t len,
+                          const uint8_t *inverted_crc, uint16_t crc)
+{
+    crc = ~crc16(input, len, crc);
+    return ((crc & 0xFF) == inverted_crc[0])
+        && ((crc >> 8) == inverted_crc[1]);
+}
+
+uint16_t OneWire::crc16(const uint8_t *input, uint16_t len, uint16_t crc)
+{
+    static const uint8_t oddparity[16] =
+        { 0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0 };
+
+    for (uint16_t i = 0; i < len; i++)
+    {
+        // Even though we're just copying a byte from the input, we'll
+        // be doing 16-bit computation with it.
+        uint16_t cdata = input[i];
+        cdata = (cdata ^ crc) & 0xff;
+        crc >>= 8;
+
+        if (oddparity[cdata & 0x0F] ^ oddparity[cdata >> 4])
+            crc ^= 0xC001;
+
+        cdata <<= 6;
+        crc ^= cdata;
+        cdata <<= 1;
+        crc ^= cdata;
+    }
+
+    return crc;
+}
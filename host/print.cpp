@@ -0,0 +1,298 @@
+#include <Arduino.h>
+#include <IPAddress.h>
+
+//
+// Print and Stream like in the Arduino core, so that the number of
+// write() calls the firmware makes is the same as on the board.
+//
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+
+    while (size--)
+    {
+        if (write(*buffer++))
+            n++;
+        else
+            break;
+    }
+
+    return n;
+}
+
+size_t Print::print(const __FlashStringHelper *ifsh)
+{
+    const char *p = (const char *)ifsh;
+    size_t n = 0;
+
+    while (1)
+    {
+        unsigned char c = pgm_read_byte(p++);
+
+        if (c == 0)
+            break;
+
+        if (write(c))
+            n++;
+        else
+            break;
+    }
+
+    return n;
+}
+
+size_t Print::print(const char str[])
+{
+    return write(str);
+}
+
+size_t Print::print(char c)
+{
+    return write(c);
+}
+
+size_t Print::print(unsigned char b, int base)
+{
+    return print((unsigned long)b, base);
+}
+
+size_t Print::print(int n, int base)
+{
+    return print((long)n, base);
+}
+
+size_t Print::print(unsigned int n, int base)
+{
+    return print((unsigned long)n, base);
+}
+
+size_t Print::print(long n, int base)
+{
+    if (base == 0)
+    {
+        return write(n);
+    }
+    else if (base == 10)
+    {
+        if (n < 0)
+        {
+            int t = print('-');
+            n = -n;
+            return printNumber(n, 10) + t;
+        }
+        return printNumber(n, 10);
+    }
+
+    return printNumber(n, base);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+    if (base == 0)
+        return write(n);
+
+    return printNumber(n, base);
+}
+
+size_t Print::print(double n, int digits)
+{
+    return printFloat(n, digits);
+}
+
+size_t Print::print(const Printable &x)
+{
+    return x.printTo(*this);
+}
+
+size_t Print::println(void)
+{
+    return write("\r\n");
+}
+
+size_t Print::println(const __FlashStringHelper *ifsh)
+{
+    size_t n = print(ifsh);
+    return n + println();
+}
+
+size_t Print::println(const char c[])
+{
+    size_t n = print(c);
+    return n + println();
+}
+
+size_t Print::println(char c)
+{
+    size_t n = print(c);
+    return n + println();
+}
+
+size_t Print::println(unsigned char b, int base)
+{
+    size_t n = print(b, base);
+    return n + println();
+}
+
+size_t Print::println(int num, int base)
+{
+    size_t n = print(num, base);
+    return n + println();
+}
+
+size_t Print::println(unsigned int num, int base)
+{
+    size_t n = print(num, base);
+    return n + println();
+}
+
+size_t Print::println(long num, int base)
+{
+    size_t n = print(num, base);
+    return n + println();
+}
+
+size_t Print::println(unsigned long num, int base)
+{
+    size_t n = print(num, base);
+    return n + println();
+}
+
+size_t Print::println(double num, int digits)
+{
+    size_t n = print(num, digits);
+    return n + println();
+}
+
+size_t Print::println(const Printable &x)
+{
+    size_t n = print(x);
+    return n + println();
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base)
+{
+    // The board has 32 bit longs.
+    char buf[8 * sizeof(uint32_t) + 1];
+    char *str = &buf[sizeof(buf) - 1];
+
+    *str = '\0';
+    n = (uint32_t)n;
+
+    if (base < 2)
+        base = 10;
+
+    do
+    {
+        char c = n % base;
+        n /= base;
+
+        *--str = c < 10 ? c + '0' : c + 'A' - 10;
+    } while (n);
+
+    return write(str);
+}
+
+size_t Print::printFloat(double number, uint8_t digits)
+{
+    size_t n = 0;
+
+    if (isnan(number)) return print("nan");
+    if (isinf(number)) return print("inf");
+    if (number > 4294967040.0) return print("ovf");
+    if (number < -4294967040.0) return print("ovf");
+
+    if (number < 0.0)
+    {
+        n += print('-');
+        number = -number;
+    }
+
+    double rounding = 0.5;
+    for (uint8_t i = 0; i < digits; ++i)
+        rounding /= 10.0;
+
+    number += rounding;
+
+    unsigned long int_part = (unsigned long)number;
+    double remainder = number - (double)int_part;
+    n += print(int_part);
+
+    if (digits > 0)
+        n += print('.');
+
+    while (digits-- > 0)
+    {
+        remainder *= 10.0;
+        unsigned int toPrint = (unsigned int)remainder;
+        n += print(toPrint);
+        remainder -= toPrint;
+    }
+
+    return n;
+}
+
+int Stream::timedRead()
+{
+    int c;
+    unsigned long start = millis();
+
+    do
+    {
+        c = read();
+        if (c >= 0)
+            return c;
+    } while ((millis() - start) < _timeout);
+
+    return -1;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length)
+{
+    size_t count = 0;
+
+    while (count < length)
+    {
+        int c = timedRead();
+
+        if (c < 0)
+            break;
+
+        *buffer++ = (char)c;
+        count++;
+    }
+
+    return count;
+}
+
+size_t Stream::readBytesUntil(char terminator, char *buffer, size_t length)
+{
+    size_t index = 0;
+
+    while (index < length)
+    {
+        int c = timedRead();
+
+        if ((c < 0) || (c == terminator))
+            break;
+
+        *buffer++ = (char)c;
+        index++;
+    }
+
+    return index;
+}
+
+size_t IPAddress::printTo(Print &p) const
+{
+    size_t n = 0;
+
+    for (int i = 0; i < 3; i++)
+    {
+        n += p.print(_address.bytes[i], DEC);
+        n += p.print('.');
+    }
+    n += p.print(_address.bytes[3], DEC);
+
+    return n;
+}
@@ -0,0 +1,93 @@
+
+#ifndef __HOST_ARDUINO_H__
+#define __HOST_ARDUINO_H__
+
+//
+// The parts of the Arduino core that the firmware uses, for building
+// it as a Linux process, see "Host build" in the README.
+//
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+
+#include <avr/pgmspace.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef unsigned int word;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define F_CPU 16000000UL
+#define clockCyclesPerMicrosecond() (F_CPU / 1000000L)
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define constrain(amt, low, high) \
+    ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) \
+    ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+#define bit(b) (1UL << (b))
+
+#define interrupts() sei()
+#define noInterrupts() cli()
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+//
+// Pins map to ports and pin change interrupts like on the ATmega328,
+// 0-7 is port D, 8-13 port B and 14-19 (A0-A5) port C.
+//
+#define NOT_A_PIN 0
+#define PB 2
+#define PC 3
+#define PD 4
+
+#define digitalPinToPort(p) \
+    (((p) < 8) ? PD : (((p) < 14) ? PB : (((p) < 20) ? PC : NOT_A_PIN)))
+#define digitalPinToBitMask(p) \
+    (1 << (((p) < 8) ? (p) : (((p) < 14) ? ((p) - 8) : ((p) - 14))))
+#define portInputRegister(port) \
+    (((port) == PD) ? &PIND : (((port) == PB) ? &PINB : &PINC))
+#define portOutputRegister(port) \
+    (((port) == PD) ? &PORTD : (((port) == PB) ? &PORTB : &PORTC))
+
+#define digitalPinToPCICR(p) (((p) < 20) ? &PCICR : (uint8_t *)0)
+#define digitalPinToPCICRbit(p) (((p) < 8) ? 2 : (((p) < 14) ? 0 : 1))
+#define digitalPinToPCMSK(p) \
+    (((p) < 8) ? &PCMSK2 : (((p) < 14) ? &PCMSK0 : &PCMSK1))
+#define digitalPinToPCMSKbit(p) \
+    (((p) < 8) ? (p) : (((p) < 14) ? ((p) - 8) : ((p) - 14)))
+
+#include "Print.h"
+#include "Stream.h"
+#include "HardwareSerial.h"
+
+void setup(void);
+void loop(void);
+
+#endif // __HOST_ARDUINO_H__
@@ -0,0 +1,26 @@
+
+#ifndef __HOST_DS2762_H__
+#define __HOST_DS2762_H__
+
+#include <OneWire.h>
+
+// The parts of the DS2762 library the firmware uses.
+class DS2762
+{
+    private:
+        OneWire *_wire;
+        uint8_t *_addr;
+
+        int16_t readRegister16(uint8_t reg);
+
+    public:
+        DS2762(OneWire *wire, uint8_t *addr);
+
+        // Current register, 15.625 uV per unit over the sense resistor.
+        int16_t readCurrentRaw();
+
+        // Temperature register, 0.125 C per unit.
+        int16_t readTempRaw();
+};
+
+#endif // __HOST_DS2762_H__
@@ -0,0 +1,62 @@
+
+#ifndef __HOST_DALLAS_TEMPERATURE_H__
+#define __HOST_DALLAS_TEMPERATURE_H__
+
+#include <inttypes.h>
+#include <OneWire.h>
+
+#define DS18S20MODEL 0x10
+#define DS18B20MODEL 0x28
+#define DS1822MODEL  0x22
+#define DS1825MODEL  0x3B
+#define DS28EA00MODEL 0x42
+
+#define DEVICE_DISCONNECTED_C -127
+#define DEVICE_DISCONNECTED_F -196.6
+#define DEVICE_DISCONNECTED_RAW -7040
+
+typedef uint8_t DeviceAddress[8];
+typedef uint8_t ScratchPad[9];
+
+// The parts of the DallasTemperature library the firmware uses.
+class DallasTemperature
+{
+    private:
+        OneWire *_wire;
+        uint8_t devices;
+        uint8_t bitResolution;
+        bool waitForConversion;
+        bool checkForConversion;
+
+        bool readScratchPad(const uint8_t *addr, uint8_t *scratchPad);
+        void writeScratchPad(const uint8_t *addr, const uint8_t *scratchPad);
+        void blockTillConversionComplete(uint8_t bitResolution);
+        int16_t calculateTemperature(const uint8_t *addr, uint8_t *scratchPad);
+
+    public:
+        DallasTemperature(OneWire *wire);
+
+        void begin(void);
+        uint8_t getDeviceCount(void) { return devices; }
+        bool validAddress(const uint8_t *addr);
+        bool validFamily(const uint8_t *addr);
+        bool getAddress(uint8_t *addr, uint8_t index);
+        bool isConnected(const uint8_t *addr);
+        bool isConnected(const uint8_t *addr, uint8_t *scratchPad);
+
+        uint8_t getResolution(const uint8_t *addr);
+        bool setResolution(const uint8_t *addr, uint8_t newResolution);
+
+        void setWaitForConversion(bool flag) { waitForConversion = flag; }
+        bool isConversionComplete(void);
+
+        void requestTemperatures(void);
+        bool requestTemperaturesByAddress(const uint8_t *addr);
+
+        int16_t getTemp(const uint8_t *addr);
+        float getTempC(const uint8_t *addr);
+
+        static float rawToCelsius(int16_t raw);
+};
+
+#endif // __HOST_DALLAS_TEMPERATURE_H__
@@ -0,0 +1,39 @@
+
+#ifndef __HOST_DHCP_H__
+#define __HOST_DHCP_H__
+
+#include "IPAddress.h"
+
+// Return values of DhcpClass::checkLease() and Ethernet.maintain().
+#define DHCP_CHECK_NONE         (0)
+#define DHCP_CHECK_RENEW_FAIL   (1)
+#define DHCP_CHECK_RENEW_OK     (2)
+#define DHCP_CHECK_REBIND_FAIL  (3)
+#define DHCP_CHECK_REBIND_OK    (4)
+
+//
+// There is no DHCP server to talk to on the host, the lease is made up
+// from the environment: PANNAN_HOST_IP (default 127.0.0.1) and the DNS
+// server from PANNAN_DNS or /etc/resolv.conf.
+//
+class DhcpClass
+{
+    private:
+        uint8_t _localIp[4];
+        uint8_t _subnetMask[4];
+        uint8_t _gatewayIp[4];
+        uint8_t _dnsServerIp[4];
+
+    public:
+        IPAddress getLocalIp();
+        IPAddress getSubnetMask();
+        IPAddress getGatewayIp();
+        IPAddress getDhcpServerIp();
+        IPAddress getDnsServerIp();
+
+        int beginWithDHCP(uint8_t *, unsigned long timeout = 60000,
+                          unsigned long responseTimeout = 4000);
+        int checkLease();
+};
+
+#endif // __HOST_DHCP_H__
@@ -0,0 +1,46 @@
+
+#ifndef __HOST_EEPROM_H__
+#define __HOST_EEPROM_H__
+
+#include <stdint.h>
+#include <avr/io.h>
+
+//
+// EEPROM backed by a file, so that the names and the lease survive a
+// restart like on the board. An erased EEPROM reads 0xff.
+//
+class EEPROMClass
+{
+    public:
+        uint8_t read(int idx);
+        void write(int idx, uint8_t val);
+        void update(int idx, uint8_t val);
+        uint16_t length() { return E2END + 1; }
+
+        template <typename T> T &get(int idx, T &t)
+        {
+            uint8_t *p = (uint8_t *)&t;
+
+            for (unsigned i = 0; i < sizeof(T); i++)
+                p[i] = read(idx + i);
+
+            return t;
+        }
+
+        template <typename T> const T &put(int idx, const T &t)
+        {
+            const uint8_t *p = (const uint8_t *)&t;
+
+            for (unsigned i = 0; i < sizeof(T); i++)
+                update(idx + i, p[i]);
+
+            return t;
+        }
+};
+
+extern EEPROMClass EEPROM;
+
+// Opens or creates the backing file, without it the EEPROM is in memory.
+int host_eeprom_open(const char *path);
+
+#endif // __HOST_EEPROM_H__
@@ -0,0 +1,47 @@
+
+#ifndef __HOST_ETHERNET_H__
+#define __HOST_ETHERNET_H__
+
+#include <inttypes.h>
+#include "IPAddress.h"
+#include "EthernetClient.h"
+#include "EthernetServer.h"
+#include "Dhcp.h"
+
+#define MAX_SOCK_NUM 4
+
+class EthernetClass
+{
+    private:
+        IPAddress _dnsServerAddress;
+        DhcpClass *_dhcp;
+
+    public:
+        static uint8_t _state[MAX_SOCK_NUM];
+        static uint16_t _server_port[MAX_SOCK_NUM];
+
+        int begin(uint8_t *mac_address,
+                  unsigned long timeout = 60000,
+                  unsigned long responseTimeout = 4000);
+        void begin(uint8_t *mac_address, IPAddress local_ip);
+        void begin(uint8_t *mac_address, IPAddress local_ip,
+                   IPAddress dns_server);
+        void begin(uint8_t *mac_address, IPAddress local_ip,
+                   IPAddress dns_server, IPAddress gateway);
+        void begin(uint8_t *mac_address, IPAddress local_ip,
+                   IPAddress dns_server, IPAddress gateway,
+                   IPAddress subnet);
+        int maintain();
+
+        IPAddress localIP();
+        IPAddress subnetMask();
+        IPAddress gatewayIP();
+        IPAddress dnsServerIP();
+
+        friend class EthernetClient;
+        friend class EthernetServer;
+};
+
+extern EthernetClass Ethernet;
+
+#endif // __HOST_ETHERNET_H__
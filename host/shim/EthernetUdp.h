@@ -0,0 +1,50 @@
+
+#ifndef __HOST_ETHERNET_UDP_H__
+#define __HOST_ETHERNET_UDP_H__
+
+#include <Udp.h>
+
+#define UDP_TX_PACKET_MAX_SIZE 24
+
+class EthernetUDP : public UDP
+{
+    private:
+        uint8_t _sock;
+        uint16_t _port;
+        IPAddress _remoteIP;
+        uint16_t _remotePort;
+        uint16_t _offset;
+
+    protected:
+        uint16_t _remaining;
+
+    public:
+        EthernetUDP();
+
+        virtual uint8_t begin(uint16_t);
+        virtual uint8_t beginMulticast(IPAddress, uint16_t);
+        virtual void stop();
+
+        virtual int beginPacket(IPAddress ip, uint16_t port);
+        virtual int beginPacket(const char *host, uint16_t port);
+        virtual int endPacket();
+        virtual size_t write(uint8_t);
+        virtual size_t write(const uint8_t *buffer, size_t size);
+        using Print::write;
+
+        virtual int parsePacket();
+        virtual int available();
+        virtual int read();
+        virtual int read(unsigned char *buffer, size_t len);
+        virtual int read(char *buffer, size_t len)
+        {
+            return read((unsigned char *)buffer, len);
+        }
+        virtual int peek();
+        virtual void flush();
+
+        virtual IPAddress remoteIP() { return _remoteIP; }
+        virtual uint16_t remotePort() { return _remotePort; }
+};
+
+#endif // __HOST_ETHERNET_UDP_H__
@@ -0,0 +1,47 @@
+
+#ifndef __HOST_HARDWARE_SERIAL_H__
+#define __HOST_HARDWARE_SERIAL_H__
+
+#include "Stream.h"
+
+#define SERIAL_TX_BUFFER_SIZE 64
+#define SERIAL_RX_BUFFER_SIZE 64
+
+//
+// Serial is stdout and stdin of the process. Like the real port it
+// only takes SERIAL_TX_BUFFER_SIZE - 1 bytes at a time without waiting,
+// the buffer drains at the baud rate.
+//
+class HardwareSerial : public Stream
+{
+    private:
+        unsigned long baud;
+        unsigned long drained_us;
+        int tx_used;
+        uint8_t rx[SERIAL_RX_BUFFER_SIZE];
+        int rx_head;
+        int rx_tail;
+
+        void drain();
+        void fill();
+
+    public:
+        HardwareSerial();
+
+        void begin(unsigned long baud);
+        void end() {}
+
+        virtual int available();
+        virtual int read();
+        virtual int peek();
+        virtual int availableForWrite();
+        virtual void flush();
+        virtual size_t write(uint8_t c);
+        using Print::write;
+
+        operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif // __HOST_HARDWARE_SERIAL_H__
@@ -0,0 +1,73 @@
+
+#ifndef __HOST_IPADDRESS_H__
+#define __HOST_IPADDRESS_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#include "Printable.h"
+
+class IPAddress : public Printable
+{
+    private:
+        union
+        {
+            uint8_t bytes[4];
+            uint32_t dword;
+        } _address;
+
+        // Private like in the core, the firmware must copy the bytes.
+        uint8_t *raw_address() { return _address.bytes; }
+
+    public:
+        IPAddress() { _address.dword = 0; }
+        IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        {
+            _address.bytes[0] = a;
+            _address.bytes[1] = b;
+            _address.bytes[2] = c;
+            _address.bytes[3] = d;
+        }
+        IPAddress(uint32_t address) { _address.dword = address; }
+        IPAddress(const uint8_t *address)
+        {
+            memcpy(_address.bytes, address, sizeof(_address.bytes));
+        }
+
+        operator uint32_t() const { return _address.dword; }
+        bool operator==(const IPAddress &addr) const
+        {
+            return _address.dword == addr._address.dword;
+        }
+        bool operator==(const uint8_t *addr) const
+        {
+            return memcmp(addr, _address.bytes, sizeof(_address.bytes)) == 0;
+        }
+
+        uint8_t operator[](int index) const { return _address.bytes[index]; }
+        uint8_t &operator[](int index) { return _address.bytes[index]; }
+
+        IPAddress &operator=(const uint8_t *address)
+        {
+            memcpy(_address.bytes, address, sizeof(_address.bytes));
+            return *this;
+        }
+        IPAddress &operator=(uint32_t address)
+        {
+            _address.dword = address;
+            return *this;
+        }
+
+        virtual size_t printTo(Print &p) const;
+
+        friend class EthernetClass;
+        friend class UDP;
+        friend class Client;
+        friend class Server;
+        friend class DhcpClass;
+        friend class DNSClient;
+};
+
+const IPAddress INADDR_NONE(0, 0, 0, 0);
+
+#endif // __HOST_IPADDRESS_H__
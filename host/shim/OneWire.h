@@ -0,0 +1,58 @@
+
+#ifndef __HOST_ONEWIRE_H__
+#define __HOST_ONEWIRE_H__
+
+#include <stdint.h>
+#include "Arduino.h"
+
+#define ONEWIRE_SEARCH 1
+#define ONEWIRE_CRC 1
+#define ONEWIRE_CRC16 1
+
+//
+// The time slots of the bus, implemented by host/bus.cpp. Reset returns
+// 1 when some device answered with a presence pulse, and a read slot
+// returns the wired-AND of what the devices put on the bus.
+//
+uint8_t onewire_bus_reset(uint8_t pin);
+void onewire_bus_write_bit(uint8_t pin, uint8_t v);
+uint8_t onewire_bus_read_bit(uint8_t pin);
+
+// Same API as the OneWire library, on top of the bus above.
+class OneWire
+{
+    private:
+        uint8_t pin;
+
+        unsigned char ROM_NO[8];
+        uint8_t LastDiscrepancy;
+        uint8_t LastFamilyDiscrepancy;
+        uint8_t LastDeviceFlag;
+
+    public:
+        OneWire(uint8_t pin);
+
+        uint8_t reset(void);
+        void select(const uint8_t rom[8]);
+        void skip(void);
+        void write(uint8_t v, uint8_t power = 0);
+        void write_bytes(const uint8_t *buf, uint16_t count, bool power = 0);
+        uint8_t read(void);
+        void read_bytes(uint8_t *buf, uint16_t count);
+        void write_bit(uint8_t v);
+        uint8_t read_bit(void);
+        void depower(void) {}
+
+        void reset_search();
+        void target_search(uint8_t family_code);
+        uint8_t search(uint8_t *newAddr, bool search_mode = true);
+
+        static uint8_t crc8(const uint8_t *addr, uint8_t len);
+        static bool check_crc16(const uint8_t *input, uint16_t len,
+                                const uint8_t *inverted_crc,
+                                uint16_t crc = 0);
+        static uint16_t crc16(const uint8_t *input, uint16_t len,
+                              uint16_t crc = 0);
+};
+
+#endif // __HOST_ONEWIRE_H__
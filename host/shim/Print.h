@@ -0,0 +1,82 @@
+
+#ifndef __HOST_PRINT_H__
+#define __HOST_PRINT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "Printable.h"
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(PSTR(s)))
+
+//
+// Same as the Arduino core, flash strings are written one byte at a
+// time, which on the real board means one W5100 send per byte.
+//
+class Print
+{
+    private:
+        int write_error;
+        size_t printNumber(unsigned long n, uint8_t base);
+        size_t printFloat(double number, uint8_t digits);
+
+    protected:
+        void setWriteError(int err = 1) { write_error = err; }
+
+    public:
+        Print() : write_error(0) {}
+        virtual ~Print() {}
+
+        int getWriteError() { return write_error; }
+        void clearWriteError() { setWriteError(0); }
+
+        virtual size_t write(uint8_t) = 0;
+        virtual size_t write(const uint8_t *buffer, size_t size);
+
+        size_t write(const char *str)
+        {
+            if (str == NULL)
+                return 0;
+            return write((const uint8_t *)str, strlen(str));
+        }
+
+        size_t write(const char *buffer, size_t size)
+        {
+            return write((const uint8_t *)buffer, size);
+        }
+
+        virtual int availableForWrite() { return 0; }
+        virtual void flush() {}
+
+        size_t print(const __FlashStringHelper *);
+        size_t print(const char[]);
+        size_t print(char);
+        size_t print(unsigned char, int = DEC);
+        size_t print(int, int = DEC);
+        size_t print(unsigned int, int = DEC);
+        size_t print(long, int = DEC);
+        size_t print(unsigned long, int = DEC);
+        size_t print(double, int = 2);
+        size_t print(const Printable &);
+
+        size_t println(const __FlashStringHelper *);
+        size_t println(const char[]);
+        size_t println(char);
+        size_t println(unsigned char, int = DEC);
+        size_t println(int, int = DEC);
+        size_t println(unsigned int, int = DEC);
+        size_t println(long, int = DEC);
+        size_t println(unsigned long, int = DEC);
+        size_t println(double, int = 2);
+        size_t println(const Printable &);
+        size_t println(void);
+};
+
+#endif // __HOST_PRINT_H__
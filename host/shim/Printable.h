@@ -0,0 +1,16 @@
+
+#ifndef __HOST_PRINTABLE_H__
+#define __HOST_PRINTABLE_H__
+
+#include <stddef.h>
+
+class Print;
+
+class Printable
+{
+    public:
+        virtual ~Printable() {}
+        virtual size_t printTo(Print &p) const = 0;
+};
+
+#endif // __HOST_PRINTABLE_H__
@@ -0,0 +1,13 @@
+
+#ifndef __HOST_SERVER_H__
+#define __HOST_SERVER_H__
+
+#include "Print.h"
+
+class Server : public Print
+{
+    public:
+        virtual void begin() = 0;
+};
+
+#endif // __HOST_SERVER_H__
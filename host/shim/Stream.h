@@ -0,0 +1,25 @@
+
+#ifndef __HOST_STREAM_H__
+#define __HOST_STREAM_H__
+
+#include "Print.h"
+
+class Stream : public Print
+{
+    protected:
+        unsigned long _timeout;
+        int timedRead();
+
+    public:
+        Stream() : _timeout(1000) {}
+
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() = 0;
+
+        void setTimeout(unsigned long timeout) { _timeout = timeout; }
+        size_t readBytes(char *buffer, size_t length);
+        size_t readBytesUntil(char terminator, char *buffer, size_t length);
+};
+
+#endif // __HOST_STREAM_H__
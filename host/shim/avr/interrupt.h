@@ -0,0 +1,15 @@
+
+#ifndef __HOST_AVR_INTERRUPT_H__
+#define __HOST_AVR_INTERRUPT_H__
+
+#include <avr/io.h>
+
+// Interrupt handlers are compiled but never called on the host.
+#define ISR(vector, ...)                \
+    extern "C" void vector(void);       \
+    void vector(void)
+
+static inline void cli(void) {}
+static inline void sei(void) {}
+
+#endif // __HOST_AVR_INTERRUPT_H__
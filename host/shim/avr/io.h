@@ -0,0 +1,47 @@
+
+#ifndef __HOST_AVR_IO_H__
+#define __HOST_AVR_IO_H__
+
+#include <stdint.h>
+
+//
+// The registers the firmware touches, as plain variables. Nothing is
+// connected to them, except that the pin input registers read as
+// pulled up so the buttons are not pressed.
+//
+extern volatile uint8_t MCUSR;
+extern volatile uint8_t SREG;
+extern volatile uint16_t SP;
+
+extern volatile uint8_t PINB, PINC, PIND;
+extern volatile uint8_t PORTB, PORTC, PORTD;
+extern volatile uint8_t DDRB, DDRC, DDRD;
+
+extern volatile uint8_t PCICR, PCMSK0, PCMSK1, PCMSK2;
+
+extern volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, OCR2B, TIMSK2, TIFR2;
+
+#define WGM20 0
+#define WGM21 1
+#define COM2B0 4
+#define COM2B1 5
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define FOC2B 6
+#define OCIE2A 1
+#define OCIE2B 2
+#define OCF2A 1
+#define OCF2B 2
+
+#define PCIE0 0
+#define PCIE1 1
+#define PCIE2 2
+
+#ifndef E2END
+#define E2END 1023
+#endif
+
+#define _BV(bit) (1 << (bit))
+
+#endif // __HOST_AVR_IO_H__
@@ -0,0 +1,29 @@
+
+#ifndef __HOST_AVR_PGMSPACE_H__
+#define __HOST_AVR_PGMSPACE_H__
+
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+
+//
+// On the host flash and RAM are the same address space.
+//
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define pgm_read_ptr(p) (*(void * const *)(p))
+
+#define memcpy_P memcpy
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcasecmp_P strcasecmp
+
+#endif // __HOST_AVR_PGMSPACE_H__
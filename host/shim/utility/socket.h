@@ -0,0 +1,25 @@
+
+#ifndef __HOST_SOCKET_H__
+#define __HOST_SOCKET_H__
+
+#include "utility/w5100.h"
+
+// Same API as the Ethernet library, over POSIX sockets.
+extern uint8_t socket(SOCKET s, uint8_t protocol, uint16_t port, uint8_t flag);
+extern uint8_t socketStatus(SOCKET s);
+extern void close(SOCKET s);
+extern uint8_t connect(SOCKET s, uint8_t *addr, uint16_t port);
+extern void disconnect(SOCKET s);
+extern uint8_t listen(SOCKET s);
+extern uint16_t send(SOCKET s, const uint8_t *buf, uint16_t len);
+extern int16_t recv(SOCKET s, uint8_t *buf, int16_t len);
+extern int16_t recvAvailable(SOCKET s);
+extern uint16_t peek(SOCKET s, uint8_t *buf);
+extern void flush(SOCKET s);
+
+extern int startUDP(SOCKET s, uint8_t *addr, uint16_t port);
+extern uint16_t bufferData(SOCKET s, uint16_t offset,
+                           const uint8_t *buf, uint16_t len);
+extern int sendUDP(SOCKET s);
+
+#endif // __HOST_SOCKET_H__
@@ -0,0 +1,80 @@
+
+#ifndef __HOST_W5100_H__
+#define __HOST_W5100_H__
+
+#include <stdint.h>
+
+typedef uint8_t SOCKET;
+
+class SnMR
+{
+    public:
+        static const uint8_t CLOSE  = 0x00;
+        static const uint8_t TCP    = 0x01;
+        static const uint8_t UDP    = 0x02;
+        static const uint8_t IPRAW  = 0x03;
+        static const uint8_t MACRAW = 0x04;
+        static const uint8_t PPPOE  = 0x05;
+        static const uint8_t ND     = 0x20;
+        static const uint8_t MULTI  = 0x80;
+};
+
+class SnSR
+{
+    public:
+        static const uint8_t CLOSED      = 0x00;
+        static const uint8_t INIT        = 0x13;
+        static const uint8_t LISTEN      = 0x14;
+        static const uint8_t SYNSENT     = 0x15;
+        static const uint8_t SYNRECV     = 0x16;
+        static const uint8_t ESTABLISHED = 0x17;
+        static const uint8_t FIN_WAIT    = 0x18;
+        static const uint8_t CLOSING     = 0x1A;
+        static const uint8_t TIME_WAIT   = 0x1B;
+        static const uint8_t CLOSE_WAIT  = 0x1C;
+        static const uint8_t LAST_ACK    = 0x1D;
+        static const uint8_t UDP         = 0x22;
+        static const uint8_t IPRAW       = 0x32;
+        static const uint8_t MACRAW      = 0x42;
+        static const uint8_t PPPOE       = 0x5F;
+};
+
+//
+// The chip registers that the firmware and the Ethernet classes use,
+// the sockets themselves are emulated in host/w5100.cpp.
+//
+class W5100Class
+{
+    private:
+        uint8_t mac[6];
+        uint8_t ip[4];
+        uint8_t subnet[4];
+        uint8_t gateway[4];
+
+    public:
+        static const uint16_t SSIZE = 2048;
+        static const uint16_t RSIZE = 2048;
+
+        void init();
+
+        void setMACAddress(const uint8_t *addr);
+        void getMACAddress(uint8_t *addr);
+        void setIPAddress(const uint8_t *addr);
+        void getIPAddress(uint8_t *addr);
+        void setSubnetMask(const uint8_t *addr);
+        void getSubnetMask(uint8_t *addr);
+        void setGatewayIp(const uint8_t *addr);
+        void getGatewayIp(uint8_t *addr);
+
+        // Destination of a socket, only used to join multicast groups.
+        void writeSnDIPR(SOCKET s, const uint8_t *addr);
+        void writeSnDPORT(SOCKET s, uint16_t port);
+        void writeSnDHAR(SOCKET, const uint8_t *) {}
+
+        void setRetransmissionTime(uint16_t) {}
+        void setRetransmissionCount(uint8_t) {}
+};
+
+extern W5100Class W5100;
+
+#endif // __HOST_W5100_H__
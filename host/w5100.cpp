@@ -0,0 +1,712 @@
+#include <Arduino.h>
+#include <Ethernet.h>
+#include <utility/w5100.h>
+#include <utility/socket.h>
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "host.h"
+
+//
+// The four W5100 sockets, on top of POSIX sockets. The states and the
+// return values are the ones the Ethernet library sees from the chip,
+// so the firmware and the library code on top run unchanged:
+//
+//  - A socket in LISTEN takes the next connection from a shared POSIX
+//    listener for its port. Connections that come in while no socket
+//    listens are reset, like the chip does.
+//  - Received data is moved into a 2 KB receive buffer per socket, UDP
+//    datagrams with the same 8 byte header the chip puts before them.
+//  - send() blocks until the data is written, like it waits for free
+//    space in the transmit buffer on the chip.
+//  - Datagrams to the DHCP server port are answered right away with the
+//    lease from host_lease().
+//
+uint16_t host_port_offset = 8000;
+
+W5100Class W5100;
+
+typedef struct HostSocket
+{
+    int fd;
+    uint8_t mode;
+    uint8_t status;
+    uint16_t port;
+    uint8_t dest_ip[4];
+    uint16_t dest_port;
+
+    uint8_t rx[W5100Class::RSIZE];
+    uint16_t rx_head;
+    uint16_t rx_len;
+
+    uint8_t tx[W5100Class::SSIZE];
+    uint16_t tx_len;
+} HostSocket;
+
+typedef struct HostListener
+{
+    uint16_t port;
+    int fd;
+} HostListener;
+
+static HostSocket host_sockets[MAX_SOCK_NUM] =
+{
+    { -1 }, { -1 }, { -1 }, { -1 }
+};
+
+static HostListener host_listeners[MAX_SOCK_NUM] =
+{
+    { 0, -1 }, { 0, -1 }, { 0, -1 }, { 0, -1 }
+};
+
+static uint16_t host_local_port(uint16_t port)
+{
+    return (port < 1024) ? port + host_port_offset : port;
+}
+
+static void host_addr(struct sockaddr_in *sa, const uint8_t *ip, uint16_t port)
+{
+    memset(sa, 0, sizeof(*sa));
+    sa->sin_family = AF_INET;
+    sa->sin_port = htons(port);
+
+    if (ip)
+        memcpy(&sa->sin_addr, ip, 4);
+    else
+        sa->sin_addr.s_addr = htonl(INADDR_ANY);
+}
+
+static void host_close_fd(HostSocket *hs)
+{
+    if (hs->fd >= 0)
+        ::close(hs->fd);
+
+    hs->fd = -1;
+    hs->status = SnSR::CLOSED;
+    hs->rx_head = 0;
+    hs->rx_len = 0;
+    hs->tx_len = 0;
+}
+
+static int host_listener(uint16_t port)
+{
+    struct sockaddr_in sa;
+    int one = 1;
+    int i;
+    int fd;
+
+    for (i = 0; i < MAX_SOCK_NUM; i++)
+    {
+        if ((host_listeners[i].fd >= 0) && (host_listeners[i].port == port))
+            return host_listeners[i].fd;
+    }
+
+    for (i = 0; (i < MAX_SOCK_NUM) && (host_listeners[i].fd >= 0); i++)
+        ;
+
+    if (i == MAX_SOCK_NUM)
+        return -1;
+
+    if ((fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0)
+        return -1;
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    host_addr(&sa, NULL, host_local_port(port));
+
+    if (::bind(fd, (struct sockaddr *)&sa, sizeof(sa))
+     || ::listen(fd, 8))
+    {
+        fprintf(stderr, "host: listen on port %u: %s\n",
+                host_local_port(port), strerror(errno));
+        ::close(fd);
+        return -1;
+    }
+
+    if (host_local_port(port) != port)
+    {
+        fprintf(stderr, "host: port %u is on %u\n",
+                port, host_local_port(port));
+    }
+
+    host_listeners[i].port = port;
+    host_listeners[i].fd = fd;
+
+    return fd;
+}
+
+static uint16_t host_rx_free(HostSocket *hs)
+{
+    return sizeof(hs->rx) - hs->rx_len;
+}
+
+static void host_rx_put(HostSocket *hs, const uint8_t *buf, uint16_t len)
+{
+    for (uint16_t i = 0; i < len; i++)
+    {
+        hs->rx[(hs->rx_head + hs->rx_len) % sizeof(hs->rx)] = buf[i];
+        hs->rx_len++;
+    }
+}
+
+static void host_poll_tcp(HostSocket *hs)
+{
+    uint8_t buf[W5100Class::RSIZE];
+    ssize_t n;
+
+    while (host_rx_free(hs) > 0)
+    {
+        n = ::recv(hs->fd, buf, host_rx_free(hs), MSG_DONTWAIT);
+
+        if (n > 0)
+        {
+            host_rx_put(hs, buf, n);
+            continue;
+        }
+
+        if (n == 0)
+        {
+            // The peer sent FIN.
+            if (hs->status == SnSR::FIN_WAIT)
+            {
+                ::close(hs->fd);
+                hs->fd = -1;
+                hs->status = SnSR::CLOSED;
+            }
+            else
+            {
+                hs->status = SnSR::CLOSE_WAIT;
+            }
+        }
+        else if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+        {
+            host_close_fd(hs);
+        }
+
+        return;
+    }
+}
+
+static void host_poll_udp(HostSocket *hs)
+{
+    uint8_t buf[W5100Class::RSIZE];
+    uint8_t header[8];
+    struct sockaddr_in sa;
+    socklen_t salen;
+    int size;
+    ssize_t n;
+
+    // FIONREAD gives the size of the next datagram, it stays queued
+    // until there is room for all of it.
+    while ((ioctl(hs->fd, FIONREAD, &size) == 0)
+        && (size + sizeof(header) <= host_rx_free(hs)))
+    {
+        salen = sizeof(sa);
+        n = ::recvfrom(hs->fd, buf, sizeof(buf), MSG_DONTWAIT,
+                       (struct sockaddr *)&sa, &salen);
+
+        if (n < 0)
+            return;
+
+        memcpy(header, &sa.sin_addr, 4);
+        header[4] = ntohs(sa.sin_port) >> 8;
+        header[5] = ntohs(sa.sin_port) & 0xff;
+        header[6] = n >> 8;
+        header[7] = n & 0xff;
+
+        host_rx_put(hs, header, sizeof(header));
+        host_rx_put(hs, buf, n);
+    }
+}
+
+static void host_poll(SOCKET s)
+{
+    HostSocket *hs = &host_sockets[s];
+    struct pollfd pfd;
+    int err;
+    socklen_t len;
+    int one = 1;
+    int fd;
+
+    switch (hs->status)
+    {
+        case SnSR::LISTEN:
+        {
+            if ((fd = host_listener(hs->port)) < 0)
+                return;
+
+            if ((fd = ::accept4(fd, NULL, NULL, SOCK_NONBLOCK)) < 0)
+                return;
+
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            hs->fd = fd;
+            hs->status = SnSR::ESTABLISHED;
+            host_poll_tcp(hs);
+            break;
+        }
+        case SnSR::SYNSENT:
+        {
+            pfd.fd = hs->fd;
+            pfd.events = POLLOUT;
+
+            if (poll(&pfd, 1, 0) != 1)
+                return;
+
+            len = sizeof(err);
+
+            if (getsockopt(hs->fd, SOL_SOCKET, SO_ERROR, &err, &len) || err)
+            {
+                host_close_fd(hs);
+                return;
+            }
+
+            hs->status = SnSR::ESTABLISHED;
+            host_poll_tcp(hs);
+            break;
+        }
+        case SnSR::ESTABLISHED:
+        case SnSR::FIN_WAIT:
+        case SnSR::CLOSE_WAIT:
+            host_poll_tcp(hs);
+            break;
+        case SnSR::UDP:
+            host_poll_udp(hs);
+            break;
+    }
+}
+
+void host_net_poll()
+{
+    struct linger lin;
+    SOCKET s;
+    int i;
+    int fd;
+
+    for (s = 0; s < MAX_SOCK_NUM; s++)
+    {
+        host_poll(s);
+    }
+
+    // Nobody listens on the chip, so the connection is refused.
+    lin.l_onoff = 1;
+    lin.l_linger = 0;
+
+    for (i = 0; i < MAX_SOCK_NUM; i++)
+    {
+        if (host_listeners[i].fd < 0)
+            continue;
+
+        for (s = 0; s < MAX_SOCK_NUM; s++)
+        {
+            if ((host_sockets[s].status == SnSR::LISTEN)
+             && (host_sockets[s].port == host_listeners[i].port))
+                break;
+        }
+
+        if (s < MAX_SOCK_NUM)
+            continue;
+
+        while ((fd = ::accept(host_listeners[i].fd, NULL, NULL)) >= 0)
+        {
+            setsockopt(fd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+            ::close(fd);
+        }
+    }
+}
+
+void W5100Class::init()
+{
+    memset(ip, 0, sizeof(ip));
+    memset(subnet, 0, sizeof(subnet));
+    memset(gateway, 0, sizeof(gateway));
+}
+
+void W5100Class::setMACAddress(const uint8_t *addr) { memcpy(mac, addr, 6); }
+void W5100Class::getMACAddress(uint8_t *addr) { memcpy(addr, mac, 6); }
+void W5100Class::setIPAddress(const uint8_t *addr) { memcpy(ip, addr, 4); }
+void W5100Class::getIPAddress(uint8_t *addr) { memcpy(addr, ip, 4); }
+void W5100Class::setSubnetMask(const uint8_t *addr) { memcpy(subnet, addr, 4); }
+void W5100Class::getSubnetMask(uint8_t *addr) { memcpy(addr, subnet, 4); }
+void W5100Class::setGatewayIp(const uint8_t *addr) { memcpy(gateway, addr, 4); }
+void W5100Class::getGatewayIp(uint8_t *addr) { memcpy(addr, gateway, 4); }
+
+void W5100Class::writeSnDIPR(SOCKET s, const uint8_t *addr)
+{
+    memcpy(host_sockets[s].dest_ip, addr, 4);
+}
+
+void W5100Class::writeSnDPORT(SOCKET s, uint16_t port)
+{
+    host_sockets[s].dest_port = port;
+}
+
+uint8_t socket(SOCKET s, uint8_t protocol, uint16_t port, uint8_t flag)
+{
+    HostSocket *hs = &host_sockets[s];
+    struct sockaddr_in sa;
+    struct ip_mreq mreq;
+    int one = 1;
+
+    if ((protocol != SnMR::TCP) && (protocol != SnMR::UDP))
+        return 0;
+
+    close(s);
+
+    hs->mode = protocol | flag;
+    hs->port = port;
+
+    if (protocol == SnMR::TCP)
+    {
+        // The socket is only created by connect(), or taken from the
+        // listener.
+        hs->status = SnSR::INIT;
+        return 1;
+    }
+
+    if ((hs->fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0)) < 0)
+        return 0;
+
+    setsockopt(hs->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    host_addr(&sa, NULL, host_local_port(port));
+
+    if (::bind(hs->fd, (struct sockaddr *)&sa, sizeof(sa)))
+    {
+        fprintf(stderr, "host: udp port %u: %s\n",
+                host_local_port(port), strerror(errno));
+    }
+
+    if (flag & SnMR::MULTI)
+    {
+        memcpy(&mreq.imr_multiaddr, hs->dest_ip, 4);
+        mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+        setsockopt(hs->fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+    }
+
+    hs->status = SnSR::UDP;
+
+    return 1;
+}
+
+uint8_t socketStatus(SOCKET s)
+{
+    host_poll(s);
+    return host_sockets[s].status;
+}
+
+void close(SOCKET s)
+{
+    host_close_fd(&host_sockets[s]);
+}
+
+uint8_t listen(SOCKET s)
+{
+    HostSocket *hs = &host_sockets[s];
+
+    if (hs->status != SnSR::INIT)
+        return 0;
+
+    if (host_listener(hs->port) < 0)
+        return 0;
+
+    hs->status = SnSR::LISTEN;
+
+    return 1;
+}
+
+uint8_t connect(SOCKET s, uint8_t *addr, uint16_t port)
+{
+    HostSocket *hs = &host_sockets[s];
+    struct sockaddr_in sa;
+    int one = 1;
+
+    if (((addr[0] == 0xff) && (addr[1] == 0xff)
+      && (addr[2] == 0xff) && (addr[3] == 0xff))
+     || ((addr[0] == 0x00) && (addr[1] == 0x00)
+      && (addr[2] == 0x00) && (addr[3] == 0x00))
+     || (port == 0x00))
+    {
+        return 0;
+    }
+
+    if ((hs->fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0)
+        return 0;
+
+    setsockopt(hs->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    host_addr(&sa, addr, port);
+    hs->status = SnSR::SYNSENT;
+
+    // A failure shows up later as the socket going to CLOSED.
+    if (::connect(hs->fd, (struct sockaddr *)&sa, sizeof(sa))
+     && (errno != EINPROGRESS))
+    {
+        host_close_fd(hs);
+    }
+
+    return 1;
+}
+
+void disconnect(SOCKET s)
+{
+    HostSocket *hs = &host_sockets[s];
+
+    switch (hs->status)
+    {
+        case SnSR::ESTABLISHED:
+            ::shutdown(hs->fd, SHUT_WR);
+            hs->status = SnSR::FIN_WAIT;
+            break;
+        case SnSR::CLOSE_WAIT:
+            host_close_fd(hs);
+            break;
+    }
+}
+
+uint16_t send(SOCKET s, const uint8_t *buf, uint16_t len)
+{
+    HostSocket *hs = &host_sockets[s];
+    struct pollfd pfd;
+    uint16_t ret = min(len, W5100Class::SSIZE);
+    uint16_t sent = 0;
+    ssize_t n;
+
+    pfd.fd = hs->fd;
+    pfd.events = POLLOUT;
+
+    while (sent < ret)
+    {
+        if ((hs->status != SnSR::ESTABLISHED)
+         && (hs->status != SnSR::CLOSE_WAIT))
+            return 0;
+
+        n = ::send(hs->fd, buf + sent, ret - sent,
+                   MSG_DONTWAIT | MSG_NOSIGNAL);
+
+        if (n > 0)
+        {
+            sent += n;
+        }
+        else if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        {
+            poll(&pfd, 1, 10);
+        }
+        else
+        {
+            host_close_fd(hs);
+            return 0;
+        }
+    }
+
+    return ret;
+}
+
+int16_t recv(SOCKET s, uint8_t *buf, int16_t len)
+{
+    HostSocket *hs = &host_sockets[s];
+    int16_t ret;
+
+    host_poll(s);
+    ret = hs->rx_len;
+
+    if (ret == 0)
+    {
+        // The remote end has closed its side, this is the eof state.
+        if ((hs->status == SnSR::LISTEN) || (hs->status == SnSR::CLOSED)
+         || (hs->status == SnSR::CLOSE_WAIT))
+            return 0;
+
+        return -1;
+    }
+
+    if (ret > len)
+        ret = len;
+
+    for (int16_t i = 0; i < ret; i++)
+    {
+        buf[i] = hs->rx[hs->rx_head];
+        hs->rx_head = (hs->rx_head + 1) % sizeof(hs->rx);
+    }
+
+    hs->rx_len -= ret;
+
+    return ret;
+}
+
+int16_t recvAvailable(SOCKET s)
+{
+    host_poll(s);
+    return host_sockets[s].rx_len;
+}
+
+uint16_t peek(SOCKET s, uint8_t *buf)
+{
+    HostSocket *hs = &host_sockets[s];
+
+    if (!hs->rx_len)
+        return 0;
+
+    *buf = hs->rx[hs->rx_head];
+
+    return 1;
+}
+
+void flush(SOCKET)
+{
+    // send() has already written everything.
+}
+
+int startUDP(SOCKET s, uint8_t *addr, uint16_t port)
+{
+    HostSocket *hs = &host_sockets[s];
+
+    if (((addr[0] == 0x00) && (addr[1] == 0x00)
+      && (addr[2] == 0x00) && (addr[3] == 0x00))
+     || (port == 0x00))
+    {
+        return 0;
+    }
+
+    memcpy(hs->dest_ip, addr, 4);
+    hs->dest_port = port;
+    hs->tx_len = 0;
+
+    return 1;
+}
+
+uint16_t bufferData(SOCKET s, uint16_t offset, const uint8_t *buf, uint16_t len)
+{
+    HostSocket *hs = &host_sockets[s];
+
+    if (offset > sizeof(hs->tx))
+        return 0;
+
+    len = min(len, (uint16_t)(sizeof(hs->tx) - offset));
+    memcpy(hs->tx + offset, buf, len);
+    hs->tx_len = max(hs->tx_len, (uint16_t)(offset + len));
+
+    return len;
+}
+
+//
+// DHCP, the DISCOVER and REQUEST are answered here with an OFFER and an
+// ACK of the lease from host_lease(), which is only made up.
+//
+#define HOST_DHCP_SERVER_PORT 67
+#define HOST_DHCP_OPTIONS 240
+#define HOST_DHCP_DISCOVER 1
+#define HOST_DHCP_OFFER 2
+#define HOST_DHCP_REQUEST 3
+#define HOST_DHCP_ACK 5
+
+static void host_dhcp_option(uint8_t *buf, int *len, uint8_t code,
+                             const uint8_t *v, uint8_t size)
+{
+    buf[(*len)++] = code;
+    buf[(*len)++] = size;
+    memcpy(&buf[*len], v, size);
+    *len += size;
+}
+
+static void host_dhcp_reply(HostSocket *hs)
+{
+    const uint8_t *req = hs->tx;
+    const char *env = getenv("PANNAN_HOST_LEASE");
+    uint32_t secs = env ? strtoul(env, NULL, 10) : 86400;
+    uint8_t lease_time[4];
+    uint8_t ip[4], subnet[4], gateway[4], dns[4];
+    uint8_t buf[HOST_DHCP_OPTIONS + 64];
+    uint8_t header[8];
+    uint8_t type = 0;
+    int len;
+
+    if (hs->tx_len < HOST_DHCP_OPTIONS)
+        return;
+
+    for (int i = HOST_DHCP_OPTIONS; (i + 1) < hs->tx_len; )
+    {
+        if (req[i] == 255)
+            break;
+        if (req[i] == 0)
+        {
+            i++;
+            continue;
+        }
+        if ((req[i] == 53) && ((i + 2) < hs->tx_len))
+            type = req[i + 2];
+        i += 2 + req[i + 1];
+    }
+
+    if (type == HOST_DHCP_DISCOVER)
+        type = HOST_DHCP_OFFER;
+    else if (type == HOST_DHCP_REQUEST)
+        type = HOST_DHCP_ACK;
+    else
+        return;
+
+    host_lease(ip, subnet, gateway, dns);
+
+    for (int i = 0; i < 4; i++)
+        lease_time[i] = secs >> (24 - i * 8);
+
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, req, HOST_DHCP_OPTIONS);
+    buf[0] = 2;                         // BOOTREPLY
+    memcpy(&buf[16], ip, 4);            // yiaddr
+    memcpy(&buf[20], gateway, 4);       // siaddr
+
+    len = HOST_DHCP_OPTIONS;
+    host_dhcp_option(buf, &len, 53, &type, 1);
+    host_dhcp_option(buf, &len, 54, gateway, 4);
+    host_dhcp_option(buf, &len, 51, lease_time, 4);
+    host_dhcp_option(buf, &len, 1, subnet, 4);
+    host_dhcp_option(buf, &len, 3, gateway, 4);
+    host_dhcp_option(buf, &len, 6, dns, 4);
+    buf[len++] = 255;
+
+    if (len + sizeof(header) > host_rx_free(hs))
+        return;
+
+    memcpy(header, gateway, 4);
+    header[4] = HOST_DHCP_SERVER_PORT >> 8;
+    header[5] = HOST_DHCP_SERVER_PORT & 0xff;
+    header[6] = len >> 8;
+    header[7] = len & 0xff;
+
+    host_rx_put(hs, header, sizeof(header));
+    host_rx_put(hs, buf, len);
+}
+
+int sendUDP(SOCKET s)
+{
+    HostSocket *hs = &host_sockets[s];
+    struct sockaddr_in sa;
+
+    if (hs->status != SnSR::UDP)
+        return 0;
+
+    if (hs->dest_port == HOST_DHCP_SERVER_PORT)
+    {
+        host_dhcp_reply(hs);
+        hs->tx_len = 0;
+        return 1;
+    }
+
+    host_addr(&sa, hs->dest_ip, hs->dest_port);
+
+    if (::sendto(hs->fd, hs->tx, hs->tx_len, 0,
+                 (struct sockaddr *)&sa, sizeof(sa)) < 0)
+    {
+        return 0;
+    }
+
+    hs->tx_len = 0;
+
+    return 1;
+}
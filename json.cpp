@@ -0,0 +1,68 @@
+#include "json.h"
+#include "names.h"
+
+int json_filter_match(const JsonFilter *f, int i)
+{
+    return !f || !f->has_sensors || FILTER_HAS_SENSOR(f, i);
+}
+
+char *get_sensor_json(char *buf, int i, TempSensor *s, uint8_t fields)
+{
+    char str_temp[TEMP_STR_SIZE];
+    const char *sep = "\n";
+
+    if (s->temp == DEVICE_DISCONNECTED_C)
+    {
+        strcpy(str_temp, "null");
+    }
+    else
+    {
+        temp2buf(str_temp, NULL, s->temp);
+    }
+
+    int j = 0;
+    #define ADDKEY(key) ADD2BUF(sep); ADDP2BUF("      \"" key "\": "); sep = ",\n";
+
+    ADDP2BUF("    {");
+    if (fields & JSON_FIELD_NAME)
+    {
+        ADDKEY("name"); ADDP2BUF("\""); ADD2BUF(s->name); ADDP2BUF("\"");
+    }
+    if (fields & JSON_FIELD_INDEX)
+    {
+        ADDKEY("index"); ADDI2BUF(i);
+    }
+    if (fields & JSON_FIELD_ADDR)
+    {
+        ADDKEY("addr"); ADDP2BUF("\"");
+        ADD2BUF(get_address_str(&buf[j], s->addr)); ADDP2BUF("\"");
+    }
+    if (fields & JSON_FIELD_TEMP)
+    {
+        ADDKEY("temp"); ADD2BUF(str_temp);
+    }
+    #ifdef PANNAN_DS2762
+    if (s->type == SENSOR_DS2762)
+    {
+        temp2buf(str_temp, NULL, s->ambient_temp);
+        if (fields & JSON_FIELD_MV)
+        {
+            ADDKEY("mv"); ADDI2BUF(s->microvolts);
+        }
+        if (fields & JSON_FIELD_AMBIENT)
+        {
+            ADDKEY("ambient"); ADD2BUF(str_temp);
+        }
+    }
+    #endif // PANNAN_DS2762
+    #ifdef PANNAN_SNTP
+    if ((fields & JSON_FIELD_TIME) && sntp_synced())
+    {
+        ADDKEY("time"); sntp_time2buf(&buf[j], &j, s->time);
+    }
+    #endif // PANNAN_SNTP
+    ADDP2BUF("\n"
+            "    }");
+
+    return buf;
+}
@@ -0,0 +1,85 @@
+
+#ifndef __JSON_H__
+#define __JSON_H__
+
+#include "pannan.h"
+#include "fmt.h"
+#ifdef PANNAN_SNTP
+#include "sntp.h"
+#endif
+
+//
+// JSON of one sensor, shared by /json and the HTTP client.
+//
+
+#define SENSOR_JSON_FMT                \
+    "    {\n"                          \
+    "      \"name\": \"%s\",\n"        \
+    "      \"index\": %d,\n"           \
+    "      \"addr\": \"%s\",\n"        \
+    "      \"temp\": %s\n"             \
+    "    }" 
+
+#ifdef PANNAN_DS2762
+#define SENSOR_DS2762_JSON_FMT         \
+    ",\n"                              \
+    "      \"mv\": \"%s\",\n"          \
+    "      \"ambient\": \"%s\"\n" 
+#else
+#define SENSOR_DS2762_JSON_FMT
+#endif // PANNAN_DS2762
+
+#ifdef PANNAN_SNTP
+#define SENSOR_TIME_JSON_FMT           \
+    ",\n"                              \
+    "      \"time\": %s"
+#define SENSOR_TIME_SIZE SNTP_TIME_SIZE
+#else
+#define SENSOR_TIME_JSON_FMT
+#define SENSOR_TIME_SIZE 0
+#endif // PANNAN_SNTP
+
+#define SENSOR_ADDR_SIZE (ADDR_SIZE * 2 + 1)
+#define SENSOR_TEMP_SIZE TEMP_STR_SIZE
+#define SENSOR_BUF_SIZE (sizeof(SENSOR_JSON_FMT SENSOR_DS2762_JSON_FMT   \
+                               SENSOR_TIME_JSON_FMT)                    \
+                        + SENSOR_ADDR_SIZE + SENSOR_TEMP_SIZE*2         \
+                        + SENSOR_TIME_SIZE)
+
+//
+// Selects which sensors and which of their fields are serialized
+// as JSON. Passing NULL instead of a filter means everything.
+//
+#define JSON_FIELD_NAME     (1 << 0)
+#define JSON_FIELD_INDEX    (1 << 1)
+#define JSON_FIELD_ADDR     (1 << 2)
+#define JSON_FIELD_TEMP     (1 << 3)
+#define JSON_FIELD_MV       (1 << 4)
+#define JSON_FIELD_AMBIENT  (1 << 5)
+#define JSON_FIELD_TIME     (1 << 6)
+#define JSON_FIELD_ALL      0xff
+
+typedef struct JsonFilter
+{
+    uint8_t sensors[(MAX_TEMP_SENSORS + 7) / 8]; // Bitmask of sensor indexes.
+    uint8_t has_sensors;                         // Any sensor selected at all.
+    uint8_t fields;                              // JSON_FIELD_* bitmask.
+} JsonFilter;
+
+#define FILTER_HAS_SENSOR(f, i) ((f)->sensors[(i) >> 3] & (1 << ((i) & 7)))
+#define FILTER_ADD_SENSOR(f, i) ((f)->sensors[(i) >> 3] |= (1 << ((i) & 7)))
+
+int json_filter_match(const JsonFilter *f, int i);
+
+//
+// Appends to the JSON being built in buf, at index j.
+//
+#define ADD2BUF(str) strcpy(&buf[j], str); j+= strlen(str);
+#define ADDP2BUF(str) strcpy_P(&buf[j], PSTR(str)); j += sizeof(str) - 1;
+#define ADDI2BUF(v) int2buf(&buf[j], &j, v);
+
+// Writes the JSON object of sensor i to buf, which must fit SENSOR_BUF_SIZE.
+char *get_sensor_json(char *buf, int i, TempSensor *s,
+                      uint8_t fields = JSON_FIELD_ALL);
+
+#endif // __JSON_H__
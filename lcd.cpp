@@ -0,0 +1,251 @@
+#include <Arduino.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "lcd.h"
+
+// Command prefix, followed by 128 + position to move the cursor.
+#define LCD_COMMAND 254
+#define LCD_POSITION 128
+#define LCD_ROW_OFFSET 64
+
+#define LCD_CURSOR_UNKNOWN 0xff
+
+// Worst case bytes for a flush, every line with a cursor move.
+#define LCD_FLUSH_MAX (LCD_ROWS * (LCD_COLS + 2))
+
+#define LCD_TX_MASK (LCD_TX_QUEUE_SIZE - 1)
+#define LCD_TIMER_TOP ((F_CPU / 8 / LCD_BAUD) - 1)
+
+// Timer2 in CTC mode, OC2B is set or cleared at the next compare match.
+#define LCD_TCCR2A_HIGH (_BV(WGM21) | _BV(COM2B1) | _BV(COM2B0))
+#define LCD_TCCR2A_LOW  (_BV(WGM21) | _BV(COM2B1))
+
+static volatile uint8_t lcd_tx_queue[LCD_TX_QUEUE_SIZE];
+static volatile uint8_t lcd_tx_head;
+static volatile uint8_t lcd_tx_tail;
+static volatile uint8_t lcd_tx_busy;
+static volatile uint8_t lcd_tx_byte;
+static volatile uint8_t lcd_tx_bit;
+static uint16_t lcd_tx_dropped;
+
+static char lcd_want[LCD_ROWS][LCD_COLS];
+static char lcd_overlay_text[LCD_COLS];
+static uint8_t lcd_overlay_active;
+static unsigned long lcd_overlay_until;
+static char lcd_shown[LCD_ROWS][LCD_COLS];
+static uint8_t lcd_cursor_row = LCD_CURSOR_UNKNOWN;
+static uint8_t lcd_cursor_col;
+
+//
+// Runs at the start of each bit, when the timer has just put the level
+// set up last time on the pin, and sets up the level of the next bit.
+// Since the pin is changed by the timer, the bits are on time even if
+// interrupts were off for a while, as long as it is less than a bit.
+//
+ISR(TIMER2_COMPB_vect)
+{
+    uint8_t high;
+
+    if (lcd_tx_bit < 8)
+    {
+        // Data, least significant bit first.
+        high = lcd_tx_byte & 1;
+        lcd_tx_byte >>= 1;
+        lcd_tx_bit++;
+    }
+    else if (lcd_tx_bit == 8)
+    {
+        // Stop bit.
+        high = 1;
+        lcd_tx_bit++;
+    }
+    else if (lcd_tx_head == lcd_tx_tail)
+    {
+        // Done, the line stays high.
+        TIMSK2 &= ~_BV(OCIE2B);
+        lcd_tx_busy = 0;
+        return;
+    }
+    else
+    {
+        // Start bit of the next byte.
+        lcd_tx_byte = lcd_tx_queue[lcd_tx_tail];
+        lcd_tx_tail = (lcd_tx_tail + 1) & LCD_TX_MASK;
+        lcd_tx_bit = 0;
+        high = 0;
+    }
+
+    TCCR2A = high ? LCD_TCCR2A_HIGH : LCD_TCCR2A_LOW;
+}
+
+static uint8_t lcd_tx_free()
+{
+    return (lcd_tx_tail - lcd_tx_head - 1) & LCD_TX_MASK;
+}
+
+static void lcd_write(uint8_t c)
+{
+    uint8_t next = (lcd_tx_head + 1) & LCD_TX_MASK;
+    uint8_t sreg;
+
+    if (next == lcd_tx_tail)
+    {
+        lcd_tx_dropped++;
+        return;
+    }
+
+    lcd_tx_queue[lcd_tx_head] = c;
+    lcd_tx_head = next;
+
+    sreg = SREG;
+    cli();
+
+    if (!lcd_tx_busy)
+    {
+        // The start bit goes out at the next compare match, a full bit
+        // from now, so the last stop bit is never cut short.
+        lcd_tx_byte = lcd_tx_queue[lcd_tx_tail];
+        lcd_tx_tail = (lcd_tx_tail + 1) & LCD_TX_MASK;
+        lcd_tx_bit = 0;
+        lcd_tx_busy = 1;
+
+        TCCR2A = LCD_TCCR2A_LOW;
+        TCNT2 = 0;
+        TIFR2 = _BV(OCF2B);
+        TIMSK2 |= _BV(OCIE2B);
+    }
+
+    SREG = sreg;
+}
+
+uint16_t lcd_dropped()
+{
+    return lcd_tx_dropped;
+}
+
+void lcd_init()
+{
+    // Idle line is high.
+    TIMSK2 = 0;
+    TCCR2A = LCD_TCCR2A_HIGH;
+    TCCR2B = _BV(FOC2B);
+    pinMode(LCD_TX_PIN, OUTPUT);
+
+    OCR2A = LCD_TIMER_TOP;
+    OCR2B = 0;
+    TCNT2 = 0;
+    TCCR2B = _BV(CS21);     // clk/8
+
+    // What the display shows is unknown, so the first flush sends it all.
+    memset(lcd_shown, 0, sizeof(lcd_shown));
+    lcd_cursor_row = LCD_CURSOR_UNKNOWN;
+    lcd_clear();
+}
+
+void lcd_clear()
+{
+    memset(lcd_want, ' ', sizeof(lcd_want));
+}
+
+void lcd_print(uint8_t row, uint8_t col, const char *s)
+{
+    if (row >= LCD_ROWS)
+        return;
+
+    while (*s && (col < LCD_COLS))
+    {
+        lcd_want[row][col++] = *s++;
+    }
+}
+
+void lcd_print(uint8_t row, uint8_t col, const __FlashStringHelper *s)
+{
+    PGM_P p = reinterpret_cast<PGM_P>(s);
+    char c;
+
+    if (row >= LCD_ROWS)
+        return;
+
+    while ((c = pgm_read_byte(p++)) && (col < LCD_COLS))
+    {
+        lcd_want[row][col++] = c;
+    }
+}
+
+void lcd_overlay(const __FlashStringHelper *s, unsigned long ms)
+{
+    PGM_P p = reinterpret_cast<PGM_P>(s);
+    uint8_t col;
+    char c;
+
+    memset(lcd_overlay_text, ' ', sizeof(lcd_overlay_text));
+
+    for (col = 0; (c = pgm_read_byte(p++)) && (col < LCD_COLS); col++)
+    {
+        lcd_overlay_text[col] = c;
+    }
+
+    lcd_overlay_active = 1;
+    lcd_overlay_until = millis() + ms;
+}
+
+// What a cell should show, the overlay covers the whole display.
+static char lcd_cell(uint8_t row, uint8_t col)
+{
+    if (lcd_overlay_active)
+        return row ? ' ' : lcd_overlay_text[col];
+
+    return lcd_want[row][col];
+}
+
+void lcd_print_right(uint8_t row, const char *s)
+{
+    uint8_t len = strlen(s);
+    lcd_print(row, (len < LCD_COLS) ? (LCD_COLS - len) : 0, s);
+}
+
+//
+// Queues the changed cells. Moving the cursor takes 2 bytes, so short
+// runs of unchanged cells on the way are written over instead. If the
+// queue is too full it is left for the next call.
+//
+void lcd_flush()
+{
+    if (lcd_overlay_active && ((long)(millis() - lcd_overlay_until) >= 0))
+        lcd_overlay_active = 0;
+
+    if (lcd_tx_free() < LCD_FLUSH_MAX)
+        return;
+
+    for (uint8_t row = 0; row < LCD_ROWS; row++)
+    {
+        for (uint8_t col = 0; col < LCD_COLS; col++)
+        {
+            if (lcd_cell(row, col) == lcd_shown[row][col])
+                continue;
+
+            if ((lcd_cursor_row != row)
+             || (col < lcd_cursor_col)
+             || ((col - lcd_cursor_col) > 2))
+            {
+                lcd_write(LCD_COMMAND);
+                lcd_write(LCD_POSITION + row * LCD_ROW_OFFSET + col);
+                lcd_cursor_row = row;
+                lcd_cursor_col = col;
+            }
+
+            for (; lcd_cursor_col <= col; lcd_cursor_col++)
+            {
+                char c = lcd_cell(row, lcd_cursor_col);
+                lcd_write(c);
+                lcd_shown[row][lcd_cursor_col] = c;
+            }
+        }
+
+        // Where the cursor goes after the end of a line differs
+        // between displays.
+        if (lcd_cursor_col >= LCD_COLS)
+            lcd_cursor_row = LCD_CURSOR_UNKNOWN;
+    }
+}
@@ -0,0 +1,37 @@
+
+#ifndef __LCD_H__
+#define __LCD_H__
+
+#include <Arduino.h>
+
+#define LCD_COLS 16
+#define LCD_ROWS 2
+
+//
+// Shadow framebuffer for the 2x16 serial LCD. Text is put in the
+// framebuffer, and lcd_flush() then only sends the cells that differ
+// from what the display is showing.
+//
+// The bytes are queued and sent in the background by Timer2, which
+// drives pin 3 (OC2B) as a 9600 baud serial TX. So nothing here waits
+// for the display, and Timer2 and PWM on pin 3 and 11 can not be used
+// for anything else.
+//
+#define LCD_TX_PIN 3
+#define LCD_BAUD 9600
+
+// Must be a power of 2, and hold a full redraw.
+#define LCD_TX_QUEUE_SIZE 64
+
+void lcd_init();
+void lcd_clear();
+void lcd_print(uint8_t row, uint8_t col, const char *s);
+void lcd_print(uint8_t row, uint8_t col, const __FlashStringHelper *s);
+void lcd_print_right(uint8_t row, const char *s);
+void lcd_flush();
+
+// Shows a message on the first line instead of the framebuffer for a while.
+void lcd_overlay(const __FlashStringHelper *s, unsigned long ms);
+uint16_t lcd_dropped();
+
+#endif // __LCD_H__
@@ -0,0 +1,522 @@
+#include <stddef.h>
+#include <Ethernet.h>
+#include <EthernetUdp.h>
+#include <Dhcp.h>
+#include <EEPROM.h>
+#include <utility/w5100.h>
+
+#include "net.h"
+#include "lease.h"
+
+#define LEASE_MAGIC 0x4c51
+
+#define LEASE_FIRST_ATTEMPT 1000UL
+#define LEASE_RETRY_MIN 10000UL
+#define LEASE_RETRY_MAX (5 * 60 * 1000UL)
+
+// DHCP is done here instead of with DhcpClass from the Ethernet library,
+// which waits for each reply and so holds up the loop for seconds.
+#define LEASE_SERVER_PORT 67
+#define LEASE_CLIENT_PORT 68
+#define LEASE_REPLY_TIMEOUT 2000
+
+#define LEASE_BOOTREQUEST 1
+#define LEASE_BOOTREPLY 2
+#define LEASE_HEADER_SIZE 28        // op up to giaddr.
+#define LEASE_OPTIONS 240           // After chaddr, sname, file and the cookie.
+#define LEASE_MAGIC_COOKIE 0x63825363UL
+
+#define LEASE_DISCOVER 1
+#define LEASE_OFFER 2
+#define LEASE_REQUEST 3
+#define LEASE_ACK 5
+#define LEASE_NAK 6
+
+#define LEASE_OPT_PAD 0
+#define LEASE_OPT_SUBNET 1
+#define LEASE_OPT_ROUTER 3
+#define LEASE_OPT_DNS 6
+#define LEASE_OPT_REQUESTED_IP 50
+#define LEASE_OPT_LEASE_TIME 51
+#define LEASE_OPT_TYPE 53
+#define LEASE_OPT_SERVER_ID 54
+#define LEASE_OPT_PARAMS 55
+#define LEASE_OPT_T1 58
+#define LEASE_OPT_T2 59
+#define LEASE_OPT_END 255
+
+// Lease times are kept in ms, so longer leases are cut to 24 days.
+#define LEASE_TIME_DEFAULT 3600UL
+#define LEASE_TIME_MAX (24 * 24 * 3600UL)
+
+typedef enum lease_state_e
+{
+    LEASE_INIT,         // Waiting for lease_next to send a DISCOVER.
+    LEASE_SELECTING,    // Waiting for an OFFER.
+    LEASE_REQUESTING,   // Waiting for the ACK of the offered address.
+    LEASE_BOUND,        // Waiting for lease_next to renew.
+    LEASE_RENEWING      // Waiting for the ACK of the address we have.
+} lease_state_t;
+
+typedef struct Lease
+{
+    uint16_t magic;
+    uint8_t ip[4];
+    uint8_t subnet[4];
+    uint8_t gateway[4];
+    uint8_t dns[4];
+    uint32_t end;       // Lease times in ms, counted from boot when
+    uint32_t t1;        // the node comes up on the cached lease.
+    uint32_t t2;
+    uint8_t checksum;
+} Lease;
+
+// Last in the EEPROM, the sensor names start from the beginning.
+#define LEASE_OFFSET (EEPROM.length() - sizeof(Lease))
+
+static EthernetUDP lease_udp;
+static lease_state_t lease_state;
+static uint8_t *lease_mac;
+static uint32_t lease_xid;
+static unsigned long lease_next;
+static unsigned long lease_deadline;
+static unsigned long lease_retry = LEASE_RETRY_MIN;
+static unsigned long lease_sent;    // millis() when the REQUEST was sent.
+static unsigned long lease_start;   // millis() when the lease was requested,
+static unsigned long lease_t1;      // and ms from then to renew,
+static unsigned long lease_t2;      // to rebind
+static unsigned long lease_end;     // and until it runs out.
+static uint8_t lease_server[4];
+static Lease lease_offer;           // Addresses of the last OFFER or ACK.
+static IPAddress lease_dns;
+
+static uint8_t lease_checksum(const Lease *l)
+{
+    const uint8_t *p = (const uint8_t *)l;
+    uint8_t sum = 0;
+
+    for (uint8_t i = 0; i < offsetof(Lease, checksum); i++)
+    {
+        sum = ((sum << 1) | (sum >> 7)) ^ p[i];
+    }
+
+    return sum;
+}
+
+static void lease_copy(uint8_t *dst, IPAddress ip)
+{
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        dst[i] = ip[i];
+    }
+}
+
+static int lease_load(Lease *l)
+{
+    EEPROM.get(LEASE_OFFSET, *l);
+
+    return (l->magic == LEASE_MAGIC)
+        && (l->checksum == lease_checksum(l));
+}
+
+static void lease_static(Lease *l)
+{
+    IPAddress ip;
+
+    memset(l, 0, sizeof(*l));
+
+    if (net_parse_ip(LEASE_STATIC_IP, &ip) != NET_OK)
+        return;
+
+    // Same defaults as Ethernet.begin(mac, ip).
+    lease_copy(l->ip, ip);
+    lease_copy(l->gateway, ip);
+    l->gateway[3] = 1;
+    memcpy(l->dns, l->gateway, sizeof(l->dns));
+    memset(l->subnet, 255, 3);
+}
+
+// Takes the addresses into use without resetting the sockets.
+static void lease_use(Lease *l)
+{
+    W5100.setIPAddress(l->ip);
+    W5100.setSubnetMask(l->subnet);
+    W5100.setGatewayIp(l->gateway);
+    lease_dns = IPAddress(l->dns);
+}
+
+static void lease_update(Lease *l)
+{
+    l->magic = LEASE_MAGIC;
+    l->end = lease_end;
+    l->t1 = lease_t1;
+    l->t2 = lease_t2;
+    l->checksum = lease_checksum(l);
+
+    lease_use(l);
+
+    // Only the bytes that changed are written.
+    EEPROM.put(LEASE_OFFSET, *l);
+}
+
+//
+// The lease ran out or was refused, so the address is no longer ours.
+// Go back to the static address, and forget the cached lease so that
+// it is not used again after a reboot.
+//
+static void lease_drop()
+{
+    Lease l;
+
+    lease_static(&l);
+    lease_use(&l);
+
+    EEPROM.put(LEASE_OFFSET, l.magic);
+}
+
+static uint32_t lease_read32(const uint8_t *b)
+{
+    return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16)
+         | ((uint32_t)b[2] << 8) | b[3];
+}
+
+static void lease_put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static unsigned long lease_ms(const uint8_t *b)
+{
+    uint32_t sec = lease_read32(b);
+
+    return min(sec, LEASE_TIME_MAX) * 1000UL;
+}
+
+static uint8_t *lease_option(uint8_t *p, uint8_t code, const uint8_t *v)
+{
+    *p++ = code;
+    *p++ = 4;
+    memcpy(p, v, 4);
+    return p + 4;
+}
+
+//
+// Sends a DISCOVER or REQUEST, always to the broadcast address and asking
+// for a broadcast reply, since the address may not be ours yet.
+//
+static int lease_send(uint8_t type)
+{
+    uint8_t buf[32];
+    uint8_t *p;
+
+    // begin() fails if the socket is still open from the DISCOVER.
+    lease_udp.stop();
+
+    if (!lease_udp.begin(LEASE_CLIENT_PORT)
+     || !lease_udp.beginPacket(IPAddress(255, 255, 255, 255),
+                               LEASE_SERVER_PORT))
+    {
+        return 0;
+    }
+
+    // op, htype, hlen, hops, xid, secs, flags and ciaddr, which is only
+    // set when renewing the address we have.
+    memset(buf, 0, sizeof(buf));
+    buf[0] = LEASE_BOOTREQUEST;
+    buf[1] = 1;
+    buf[2] = 6;
+    lease_put32(&buf[4], lease_xid);
+    buf[10] = 0x80;
+
+    if (lease_state == LEASE_RENEWING)
+        memcpy(&buf[12], lease_offer.ip, 4);
+
+    lease_udp.write(buf, 16);
+
+    // yiaddr, siaddr, giaddr and chaddr.
+    memset(buf, 0, sizeof(buf));
+    memcpy(&buf[12], lease_mac, 6);
+    lease_udp.write(buf, 28);
+
+    // sname and file.
+    memset(buf, 0, sizeof(buf));
+    for (uint8_t i = 0; i < 6; i++)
+    {
+        lease_udp.write(buf, 32);
+    }
+
+    p = buf;
+    lease_put32(p, LEASE_MAGIC_COOKIE);
+    p += 4;
+    *p++ = LEASE_OPT_TYPE;
+    *p++ = 1;
+    *p++ = type;
+
+    if (lease_state == LEASE_REQUESTING)
+    {
+        p = lease_option(p, LEASE_OPT_REQUESTED_IP, lease_offer.ip);
+        p = lease_option(p, LEASE_OPT_SERVER_ID, lease_server);
+    }
+
+    *p++ = LEASE_OPT_PARAMS;
+    *p++ = 3;
+    *p++ = LEASE_OPT_SUBNET;
+    *p++ = LEASE_OPT_ROUTER;
+    *p++ = LEASE_OPT_DNS;
+    *p++ = LEASE_OPT_END;
+    lease_udp.write(buf, p - buf);
+
+    if (!lease_udp.endPacket())
+        return 0;
+
+    lease_sent = millis();
+    lease_deadline = lease_sent + LEASE_REPLY_TIMEOUT;
+
+    return 1;
+}
+
+//
+// Reads a reply to the last DISCOVER or REQUEST and returns its type,
+// or 0 when there is none. Only a reply of the expected type is taken
+// into lease_offer and the lease times.
+//
+static uint8_t lease_receive(uint8_t expect)
+{
+    uint8_t buf[LEASE_HEADER_SIZE];
+    uint8_t server[4];
+    Lease l;
+    unsigned long end = LEASE_TIME_DEFAULT * 1000UL;
+    unsigned long t1 = 0;
+    unsigned long t2 = 0;
+    uint8_t type = 0;
+    int code;
+    int len;
+
+    if (lease_udp.parsePacket() < LEASE_OPTIONS)
+        return 0;
+
+    if ((lease_udp.read(buf, sizeof(buf)) != sizeof(buf))
+     || (buf[0] != LEASE_BOOTREPLY)
+     || (lease_read32(&buf[4]) != lease_xid))
+    {
+        return 0;
+    }
+
+    memset(&l, 0, sizeof(l));
+    memset(server, 0, sizeof(server));
+    memcpy(l.ip, &buf[16], 4);
+
+    // Skip chaddr, sname and file.
+    for (len = LEASE_OPTIONS - 4 - LEASE_HEADER_SIZE; len > 0; len -= sizeof(buf))
+    {
+        lease_udp.read(buf, min(len, (int)sizeof(buf)));
+    }
+
+    if ((lease_udp.read(buf, 4) != 4)
+     || (lease_read32(buf) != LEASE_MAGIC_COOKIE))
+    {
+        return 0;
+    }
+
+    // Only the first 4 bytes of each option are used.
+    while (((code = lease_udp.read()) >= 0) && (code != LEASE_OPT_END))
+    {
+        if (code == LEASE_OPT_PAD)
+            continue;
+
+        if ((len = lease_udp.read()) < 0)
+            return 0;
+
+        memset(buf, 0, 4);
+        lease_udp.read(buf, min(len, 4));
+
+        for (; len > 4; len--)
+        {
+            lease_udp.read();
+        }
+
+        switch (code)
+        {
+            case LEASE_OPT_TYPE: type = buf[0]; break;
+            case LEASE_OPT_SUBNET: memcpy(l.subnet, buf, 4); break;
+            case LEASE_OPT_ROUTER: memcpy(l.gateway, buf, 4); break;
+            case LEASE_OPT_DNS: memcpy(l.dns, buf, 4); break;
+            case LEASE_OPT_SERVER_ID: memcpy(server, buf, 4); break;
+            case LEASE_OPT_LEASE_TIME: end = lease_ms(buf); break;
+            case LEASE_OPT_T1: t1 = lease_ms(buf); break;
+            case LEASE_OPT_T2: t2 = lease_ms(buf); break;
+        }
+    }
+
+    if (type != expect)
+        return type;
+
+    lease_offer = l;
+    memcpy(lease_server, server, 4);
+    lease_end = end;
+    lease_t1 = (t1 && (t1 < end)) ? t1 : end / 2;
+    lease_t2 = (t2 && (t2 < end)) ? t2 : end / 8 * 7;
+
+    return type;
+}
+
+void lease_begin(uint8_t *mac)
+{
+    Lease l;
+
+    lease_mac = mac;
+    lease_xid = ((uint32_t)mac[3] << 24) | ((uint32_t)mac[4] << 16)
+              | ((uint16_t)mac[5] << 8);
+
+    lease_state = LEASE_INIT;
+
+    //
+    // How long the node was off is not known, so the cached lease is
+    // only kept for its lease time from boot, and renewed right away.
+    //
+    if (lease_load(&l))
+    {
+        lease_state = LEASE_BOUND;
+        lease_offer = l;
+        lease_end = l.end;
+        lease_t1 = l.t1;
+        lease_t2 = l.t2;
+    }
+    else
+    {
+        lease_static(&l);
+    }
+
+    Ethernet.begin(mac, IPAddress(l.ip), IPAddress(l.dns),
+                   IPAddress(l.gateway), IPAddress(l.subnet));
+    lease_dns = IPAddress(l.dns);
+
+    lease_start = millis();
+    lease_next = lease_start + LEASE_FIRST_ATTEMPT;
+}
+
+static int lease_bound(int rc)
+{
+    lease_udp.stop();
+    lease_update(&lease_offer);
+
+    lease_state = LEASE_BOUND;
+    lease_start = lease_sent;
+    lease_next = lease_start + lease_t1;
+    lease_retry = LEASE_RETRY_MIN;
+
+    return rc;
+}
+
+static int lease_fail()
+{
+    unsigned long now = millis();
+
+    lease_udp.stop();
+
+    // Keep using the lease until it runs out, and try again after
+    // half the time that is left of it.
+    if (lease_state == LEASE_RENEWING)
+    {
+        unsigned long left = lease_end - (now - lease_start);
+
+        lease_state = LEASE_BOUND;
+        lease_next = now + max(left / 2, LEASE_RETRY_MIN);
+
+        return ((now - lease_start) < lease_t2)
+             ? DHCP_CHECK_RENEW_FAIL : DHCP_CHECK_REBIND_FAIL;
+    }
+
+    lease_state = LEASE_INIT;
+    lease_next = now + lease_retry;
+    lease_retry = min(lease_retry * 2, LEASE_RETRY_MAX);
+
+    return DHCP_CHECK_REBIND_FAIL;
+}
+
+int lease_maintain()
+{
+    unsigned long now = millis();
+    uint8_t type;
+
+    switch (lease_state)
+    {
+        case LEASE_INIT:
+            if ((long)(now - lease_next) < 0)
+                break;
+
+            lease_xid++;
+
+            if (!lease_send(LEASE_DISCOVER))
+                return lease_fail();
+
+            lease_state = LEASE_SELECTING;
+            break;
+        case LEASE_SELECTING:
+            type = lease_receive(LEASE_OFFER);
+
+            if (type == LEASE_OFFER)
+            {
+                lease_state = LEASE_REQUESTING;
+
+                if (!lease_send(LEASE_REQUEST))
+                    return lease_fail();
+            }
+            else if ((long)(now - lease_deadline) >= 0)
+            {
+                return lease_fail();
+            }
+            break;
+        case LEASE_REQUESTING:
+        case LEASE_RENEWING:
+            type = lease_receive(LEASE_ACK);
+
+            if (type == LEASE_ACK)
+            {
+                return lease_bound(((lease_state == LEASE_RENEWING)
+                                 && ((now - lease_start) < lease_t2))
+                                 ? DHCP_CHECK_RENEW_OK : DHCP_CHECK_REBIND_OK);
+            }
+
+            // The server refused the address, start over with a DISCOVER.
+            if (type == LEASE_NAK)
+            {
+                if (lease_state == LEASE_RENEWING)
+                    lease_drop();
+
+                lease_state = LEASE_INIT;
+            }
+
+            if ((type == LEASE_NAK) || ((long)(now - lease_deadline) >= 0))
+                return lease_fail();
+            break;
+        case LEASE_BOUND:
+            if ((now - lease_start) >= lease_end)
+            {
+                lease_drop();
+                lease_state = LEASE_INIT;
+                lease_next = now;
+                return DHCP_CHECK_REBIND_FAIL;
+            }
+
+            if ((long)(now - lease_next) < 0)
+                break;
+
+            lease_xid++;
+            lease_state = LEASE_RENEWING;
+
+            if (!lease_send(LEASE_REQUEST))
+                return lease_fail();
+            break;
+    }
+
+    return DHCP_CHECK_NONE;
+}
+
+IPAddress lease_dns_server()
+{
+    return lease_dns;
+}
@@ -0,0 +1,26 @@
+
+#ifndef __LEASE_H__
+#define __LEASE_H__
+
+#include <Ethernet.h>
+
+//
+// The node comes up right away on the last DHCP lease, which is cached
+// at the end of the EEPROM, or on the static address when there is no
+// lease. DHCP is then done in the background from lease_maintain(),
+// which only looks for a reply and never waits for one. A cached lease
+// is renewed right away, and is only kept for its lease time from boot.
+//
+#ifndef LEASE_STATIC_IP
+#define LEASE_STATIC_IP ""
+#endif
+
+void lease_begin(uint8_t *mac);
+
+// Returns DHCP_CHECK_*, the same as Ethernet.maintain().
+int lease_maintain();
+
+// Use instead of Ethernet.dnsServerIP(), which is not updated by the lease.
+IPAddress lease_dns_server();
+
+#endif // __LEASE_H__
@@ -0,0 +1,72 @@
+#include <Arduino.h>
+#include <avr/wdt.h>
+
+#include "log.h"
+
+#define LOG_MASK (LOG_BUFFER_SIZE - 1)
+
+Logger logger;
+
+static uint8_t log_buf[LOG_BUFFER_SIZE];
+static uint8_t log_head;
+static uint8_t log_tail;
+static uint8_t log_blocking = 1;
+
+size_t Logger::write(uint8_t c)
+{
+    uint8_t next = (log_head + 1) & LOG_MASK;
+
+    while (next == log_tail)
+    {
+        if (!log_blocking)
+        {
+            dropped++;
+            return 0;
+        }
+
+        // Still in setup(), wait for the port instead.
+        feed_log();
+        wdt_reset();
+    }
+
+    log_buf[log_head] = c;
+    log_head = next;
+
+    return 1;
+}
+
+size_t Logger::write(const uint8_t *buf, size_t size)
+{
+    size_t n = 0;
+
+    while (size--)
+    {
+        n += write(*buf++);
+    }
+
+    return n;
+}
+
+void feed_log()
+{
+    int n = Serial.availableForWrite();
+
+    while ((n-- > 0) && (log_tail != log_head))
+    {
+        Serial.write(log_buf[log_tail]);
+        log_tail = (log_tail + 1) & LOG_MASK;
+    }
+}
+
+void log_flush()
+{
+    while (log_tail != log_head)
+    {
+        feed_log();
+    }
+}
+
+void log_background()
+{
+    log_blocking = 0;
+}
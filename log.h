@@ -0,0 +1,61 @@
+
+#ifndef __LOG_H__
+#define __LOG_H__
+
+#include <Arduino.h>
+
+//
+// Log messages are put in a ring buffer and sent to Serial in the
+// background by feed_log(), only as much as fits in the transmit buffer
+// of the serial port, so logging never waits for the port. When the
+// ring buffer is full the bytes are dropped and counted, once
+// log_background() has been called at the end of setup().
+//
+// Messages above LOG_LEVEL are removed at compile time:
+//   LOG_DEBUG.print(F("Temperature: "));
+//   LOG_DEBUG.println(t);
+//
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Must be a power of 2.
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE 64
+#endif
+
+class Logger : public Print
+{
+    public:
+        virtual size_t write(uint8_t c);
+        virtual size_t write(const uint8_t *buf, size_t size);
+        using Print::write;
+
+        uint16_t dropped;
+};
+
+extern Logger logger;
+
+#define LOG_ENABLED(level) ((level) <= LOG_LEVEL)
+#define LOG_AT(level) if (!LOG_ENABLED(level)) {} else logger
+#define LOG_ERROR LOG_AT(LOG_LEVEL_ERROR)
+#define LOG_WARN LOG_AT(LOG_LEVEL_WARN)
+#define LOG_INFO LOG_AT(LOG_LEVEL_INFO)
+#define LOG_DEBUG LOG_AT(LOG_LEVEL_DEBUG)
+
+void feed_log();
+
+// Waits until everything is sent, only for use in setup().
+void log_flush();
+
+// Until this is called a full buffer waits for the serial port instead
+// of dropping, so nothing logged while booting is lost.
+void log_background();
+
+#endif // __LOG_H__
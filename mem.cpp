@@ -0,0 +1,121 @@
+#include <Arduino.h>
+#include <avr/wdt.h>
+
+#include "mem.h"
+
+static uint8_t arena[ARENA_SIZE];
+static uint8_t arena_used;
+static uint8_t arena_max;
+
+void arena_reset()
+{
+    arena_used = 0;
+}
+
+// Returns NULL when the arena is full, callers must handle that.
+void *arena_alloc(size_t size)
+{
+    void *p;
+
+    // Keep pointers aligned for the host build.
+    size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+    if (size > (size_t)(ARENA_SIZE - arena_used))
+        return NULL;
+
+    p = &arena[arena_used];
+    arena_used += size;
+
+    if (arena_used > arena_max)
+        arena_max = arena_used;
+
+    return p;
+}
+
+char *arena_strdup(const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *p = (char *)arena_alloc(len);
+
+    if (p)
+        memcpy(p, s, len);
+
+    return p;
+}
+
+int arena_used_max()
+{
+    return arena_max;
+}
+
+#ifdef __AVR__
+
+//
+// Stack high-water mark. Before main() the unused RAM between the end
+// of .bss and the top of the stack is painted with a canary, the amount
+// of canary left untouched tells how deep the stack has ever been.
+// Since there is no heap nothing else writes to that RAM.
+//
+// This is also where the reset cause is saved, since MCUSR has to be
+// cleared early to not get stuck in watchdog resets.
+//
+#define STACK_CANARY 0xc5
+
+extern uint8_t _end;
+extern uint8_t __stack;
+
+static uint8_t reset_cause __attribute__((section(".noinit")));
+
+void mem_early_init(void) __attribute__((naked, used, section(".init3")));
+void mem_early_init(void)
+{
+    uint8_t *p = &_end;
+
+    reset_cause = MCUSR;
+    MCUSR = 0;
+    wdt_disable();
+
+    while (p <= &__stack)
+    {
+        *p++ = STACK_CANARY;
+    }
+}
+
+int mem_free()
+{
+    // Not using __brkval since that would link in malloc.
+    return (uint8_t *)SP - &_end;
+}
+
+int mem_stack_unused()
+{
+    const uint8_t *p = &_end;
+
+    while ((p <= &__stack) && (*p == STACK_CANARY))
+    {
+        p++;
+    }
+
+    return p - &_end;
+}
+
+#else
+
+static uint8_t reset_cause;
+
+int mem_free()
+{
+    return 0;
+}
+
+int mem_stack_unused()
+{
+    return 0;
+}
+
+#endif // __AVR__
+
+uint8_t mem_reset_cause()
+{
+    return reset_cause;
+}
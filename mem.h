@@ -0,0 +1,36 @@
+
+#ifndef __MEM_H__
+#define __MEM_H__
+
+#include <Arduino.h>
+
+//
+// The firmware does not use the heap, so that the memory use does not
+// change over months of uptime. Memory only needed while serving one
+// request is taken from a fixed scratch arena that is reset at the
+// start of each request.
+//
+#ifndef ARENA_SIZE
+#define ARENA_SIZE 48
+#endif
+
+// Warn when less than this much of the stack has never been used.
+#ifndef STACK_LOW_WATER
+#define STACK_LOW_WATER 64
+#endif
+
+void arena_reset();
+void *arena_alloc(size_t size);
+char *arena_strdup(const char *s);
+int arena_used_max();
+
+// RAM between the end of the static data and the stack pointer.
+int mem_free();
+
+// Bytes of stack that have never been used since reset.
+int mem_stack_unused();
+
+// MCUSR of the last reset.
+uint8_t mem_reset_cause();
+
+#endif // __MEM_H__
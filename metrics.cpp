@@ -0,0 +1,242 @@
+#include "pannan.h"
+#include "metrics.h"
+#include "sched.h"
+#include "log.h"
+#include "mem.h"
+#include "fmt.h"
+
+#ifdef PANNAN_METRICS
+
+Metrics metrics;
+
+static const char HTTP_CLASS_NAMES[METRICS_HTTP_CLASSES][7] PROGMEM =
+{
+    "failed",
+    "1xx",
+    "2xx",
+    "3xx",
+    "4xx",
+    "5xx"
+};
+
+void metrics_init()
+{
+    memset(&metrics, 0, sizeof(metrics));
+    metrics.loop_min_us = 0xffffffff;
+}
+
+void metrics_loop(unsigned long us)
+{
+    metrics.loop_count++;
+    metrics.loop_us += us;
+
+    if (us < metrics.loop_min_us)
+        metrics.loop_min_us = us;
+
+    if (us > metrics.loop_max_us)
+        metrics.loop_max_us = us;
+}
+
+void metrics_sensor_read(int i, unsigned long us, int failed)
+{
+    metrics.sensor_read_us[i] = us;
+
+    if (failed)
+        metrics.sensor_failures[i]++;
+}
+
+void metrics_http_request(int status, unsigned long us)
+{
+    int c = status / 100;
+
+    if ((c < 1) || (c >= METRICS_HTTP_CLASSES))
+        c = METRICS_HTTP_FAILED;
+
+    metrics.http_requests[c]++;
+    metrics.http_last_us = us;
+    metrics.http_us += us;
+}
+
+//
+// Prometheus text format. Lines must end with a plain '\n'.
+//
+static void metric_type(Print &c, const __FlashStringHelper *name,
+                        const __FlashStringHelper *type)
+{
+    c.print(F("# TYPE "));
+    c.print(name);
+    c.print(' ');
+    c.print(type);
+    c.print('\n');
+}
+
+// Prints a metric that has a single value, with its type.
+static void metric_scalar(Print &c, const __FlashStringHelper *name,
+                          const __FlashStringHelper *type, unsigned long v)
+{
+    metric_type(c, name, type);
+    c.print(name);
+    c.print(' ');
+    c.print(v);
+    c.print('\n');
+}
+
+// Prints "name{index="0",name="flue"} "
+static void metric_sensor(Print &c, const __FlashStringHelper *name,
+                          int i, TempSensor *s)
+{
+    c.print(name);
+    c.print(F("{index=\""));
+    c.print(i);
+    c.print(F("\",name=\""));
+    c.print(s->name);
+    c.print(F("\"} "));
+}
+
+// Prints "name{label="value"} " with the value stored in flash.
+static void metric_label(Print &c, const __FlashStringHelper *name,
+                         const __FlashStringHelper *label,
+                         const char *value_P)
+{
+    c.print(name);
+    c.print('{');
+    c.print(label);
+    c.print(F("=\""));
+    c.print((const __FlashStringHelper *)value_P);
+    c.print(F("\"} "));
+}
+
+#define COUNTER F("counter")
+#define GAUGE F("gauge")
+
+void metrics_print(Print &c, Context *ctx)
+{
+    const __FlashStringHelper *name;
+    int i;
+
+    name = F("pannan_temperature_celsius");
+    metric_type(c, name, GAUGE);
+    for (i = 0; i < ctx->count; i++)
+    {
+        metric_sensor(c, name, i, &ctx->temps[i]);
+        if (ctx->temps[i].temp == DEVICE_DISCONNECTED_C)
+            c.print(F("NaN"));
+        else
+            print_temp(c, ctx->temps[i].temp);
+        c.print('\n');
+    }
+
+    name = F("pannan_sensor_read_microseconds");
+    metric_type(c, name, GAUGE);
+    for (i = 0; i < ctx->count; i++)
+    {
+        metric_sensor(c, name, i, &ctx->temps[i]);
+        c.print(metrics.sensor_read_us[i]);
+        c.print('\n');
+    }
+
+    name = F("pannan_sensor_read_failures_total");
+    metric_type(c, name, COUNTER);
+    for (i = 0; i < ctx->count; i++)
+    {
+        metric_sensor(c, name, i, &ctx->temps[i]);
+        c.print(metrics.sensor_failures[i]);
+        c.print('\n');
+    }
+
+    metric_scalar(c, F("pannan_loop_iterations_total"), COUNTER,
+                  metrics.loop_count);
+    metric_scalar(c, F("pannan_loop_microseconds_total"), COUNTER,
+                  metrics.loop_us);
+    metric_scalar(c, F("pannan_loop_min_microseconds"), GAUGE,
+                  metrics.loop_count ? metrics.loop_min_us : 0);
+    metric_scalar(c, F("pannan_loop_max_microseconds"), GAUGE,
+                  metrics.loop_max_us);
+
+    // The scheduler keeps the time of each task.
+    name = F("pannan_task_microseconds_total");
+    metric_type(c, name, COUNTER);
+    for (i = 0; i < sched_task_count; i++)
+    {
+        metric_label(c, name, F("task"), sched_tasks[i].name);
+        c.print(sched_tasks[i].us);
+        c.print('\n');
+    }
+
+    name = F("pannan_task_runs_total");
+    metric_type(c, name, COUNTER);
+    for (i = 0; i < sched_task_count; i++)
+    {
+        metric_label(c, name, F("task"), sched_tasks[i].name);
+        c.print(sched_tasks[i].runs);
+        c.print('\n');
+    }
+
+    name = F("pannan_task_max_microseconds");
+    metric_type(c, name, GAUGE);
+    for (i = 0; i < sched_task_count; i++)
+    {
+        metric_label(c, name, F("task"), sched_tasks[i].name);
+        c.print(sched_tasks[i].max_us);
+        c.print('\n');
+        sched_tasks[i].max_us = 0;
+    }
+
+    // How late the periodic tasks started, the jitter of the sweeps.
+    name = F("pannan_task_max_late_milliseconds");
+    metric_type(c, name, GAUGE);
+    for (i = 0; i < sched_task_count; i++)
+    {
+        metric_label(c, name, F("task"), sched_tasks[i].name);
+        c.print(sched_tasks[i].max_late);
+        c.print('\n');
+        sched_tasks[i].max_late = 0;
+    }
+
+    name = F("pannan_task_overruns_total");
+    metric_type(c, name, COUNTER);
+    for (i = 0; i < sched_task_count; i++)
+    {
+        metric_label(c, name, F("task"), sched_tasks[i].name);
+        c.print(sched_tasks[i].overruns);
+        c.print('\n');
+    }
+
+    name = F("pannan_task_missed_total");
+    metric_type(c, name, COUNTER);
+    for (i = 0; i < sched_task_count; i++)
+    {
+        metric_label(c, name, F("task"), sched_tasks[i].name);
+        c.print(sched_tasks[i].missed);
+        c.print('\n');
+    }
+
+    name = F("pannan_http_client_requests_total");
+    metric_type(c, name, COUNTER);
+    for (i = 0; i < METRICS_HTTP_CLASSES; i++)
+    {
+        metric_label(c, name, F("code"), HTTP_CLASS_NAMES[i]);
+        c.print(metrics.http_requests[i]);
+        c.print('\n');
+    }
+
+    metric_scalar(c, F("pannan_http_client_last_microseconds"), GAUGE,
+                  metrics.http_last_us);
+    metric_scalar(c, F("pannan_http_client_microseconds_total"), COUNTER,
+                  metrics.http_us);
+    metric_scalar(c, F("pannan_free_memory_bytes"), GAUGE, mem_free());
+    metric_scalar(c, F("pannan_stack_unused_bytes"), GAUGE,
+                  mem_stack_unused());
+    metric_scalar(c, F("pannan_arena_max_bytes"), GAUGE, arena_used_max());
+    metric_scalar(c, F("pannan_log_dropped_bytes_total"), COUNTER,
+                  logger.dropped);
+    metric_scalar(c, F("pannan_reset_cause"), GAUGE,
+                  mem_reset_cause());
+    metric_scalar(c, F("pannan_uptime_milliseconds"), COUNTER, millis());
+
+    // Min and max are per scrape.
+    metrics.loop_min_us = 0xffffffff;
+    metrics.loop_max_us = 0;
+}
+
+#endif // PANNAN_METRICS
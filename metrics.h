@@ -0,0 +1,32 @@
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include "pannan.h"
+
+// HTTP client results, failed connections and status code classes.
+#define METRICS_HTTP_FAILED 0
+#define METRICS_HTTP_CLASSES 6 // failed, 1xx, 2xx, 3xx, 4xx, 5xx
+
+typedef struct Metrics
+{
+    uint32_t loop_count;
+    uint32_t loop_us;               // Total time spent in loop().
+    uint32_t loop_min_us;           // Since last scrape.
+    uint32_t loop_max_us;           // Since last scrape.
+    uint32_t sensor_read_us[MAX_TEMP_SENSORS];  // Last read.
+    uint16_t sensor_failures[MAX_TEMP_SENSORS];
+    uint16_t http_requests[METRICS_HTTP_CLASSES];
+    uint32_t http_last_us;
+    uint32_t http_us;
+} Metrics;
+
+extern Metrics metrics;
+
+void metrics_init();
+void metrics_loop(unsigned long us);
+void metrics_sensor_read(int i, unsigned long us, int failed);
+void metrics_http_request(int status, unsigned long us);
+void metrics_print(Print &c, Context *ctx);
+
+#endif // __METRICS_H__
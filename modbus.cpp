@@ -0,0 +1,324 @@
+#include <Ethernet.h>
+#include <utility/w5100.h>
+#include <utility/socket.h>
+
+#include "pannan.h"
+#include "net.h"
+#include "modbus.h"
+#ifdef PANNAN_SNTP
+#include "sntp.h"
+#endif
+
+#ifdef PANNAN_MODBUS
+
+#define MODBUS_MBAP_SIZE 7
+#define MODBUS_PDU_SIZE 5
+
+// Unit id and PDU, as counted by the MBAP length.
+#define MODBUS_MAX_LENGTH 254
+
+#define MODBUS_READ_HOLDING_REGISTERS 0x03
+#define MODBUS_READ_INPUT_REGISTERS 0x04
+
+#define MODBUS_ILLEGAL_FUNCTION 0x01
+#define MODBUS_ILLEGAL_ADDRESS 0x02
+#define MODBUS_ILLEGAL_VALUE 0x03
+
+#define MODBUS_STATUS_OK 0
+#define MODBUS_STATUS_DISCONNECTED 1
+
+// How long a connection is kept open without a request, and how long
+// it is given to close before it is forced closed.
+#define MODBUS_IDLE_TIMEOUT 30000
+#define MODBUS_CLOSE_TIMEOUT 1000
+
+// Connections kept open between polls, each on its own socket. One of
+// them listens while there is room for another, so Modbus never takes
+// more than this many of the 4 sockets.
+#ifndef MODBUS_CONNECTIONS
+#define MODBUS_CONNECTIONS 2
+#endif
+
+typedef struct ModbusConn
+{
+    uint8_t sock;
+    uint8_t has_mbap;               // mbap holds the header of the next request.
+    uint8_t mbap[MODBUS_MBAP_SIZE];
+    unsigned long active;
+} ModbusConn;
+
+static ModbusConn modbus_conns[MODBUS_CONNECTIONS];
+static uint8_t modbus_waiting;      // No socket was free to listen on.
+static unsigned long modbus_failed;
+static unsigned long modbus_time;
+
+static uint16_t modbus_read16(const uint8_t *b)
+{
+    return ((uint16_t)b[0] << 8) | b[1];
+}
+
+static uint8_t *modbus_put16(uint8_t *p, uint16_t v)
+{
+    *p++ = v >> 8;
+    *p++ = v & 0xff;
+    return p;
+}
+
+static uint16_t modbus_register(Context *ctx, uint16_t reg)
+{
+    TempSensor *s;
+
+    if (reg < MODBUS_SENSOR_BASE)
+    {
+        #ifdef PANNAN_SNTP
+        uint16_t msec;
+        uint32_t sec = sntp_synced() ? sntp_unix(modbus_time, &msec) : 0;
+
+        if (!sec)
+            msec = 0;
+        #endif
+
+        switch (reg)
+        {
+            case 0: return ctx->count;
+            case 1: return TEMP_FIXED_SCALE;
+            #ifdef PANNAN_SNTP
+            case 2: return sec >> 16;
+            case 3: return sec & 0xffff;
+            case 4: return msec;
+            case 5: return sntp_synced();
+            #endif
+            default: return 0;
+        }
+    }
+
+    reg -= MODBUS_SENSOR_BASE;
+    s = &ctx->temps[reg / MODBUS_SENSOR_REGS];
+
+    switch (reg % MODBUS_SENSOR_REGS)
+    {
+        case 0:
+            return temp_to_fixed(s->temp);
+        case 1:
+            return (s->temp == DEVICE_DISCONNECTED_C)
+                 ? MODBUS_STATUS_DISCONNECTED : MODBUS_STATUS_OK;
+        #ifdef PANNAN_DS2762
+        case 2:
+            // Each raw count is 15.625 uV.
+            return (s->type == SENSOR_DS2762)
+                 ? (int16_t)(((long)s->microvolts * 25) / 16) : 0;
+        case 3:
+            return (s->type == SENSOR_DS2762)
+                 ? temp_to_fixed(s->ambient_temp) : 0;
+        #endif // PANNAN_DS2762
+        default:
+            return 0;
+    }
+}
+
+//
+// Answers one request once all of it has come in, going by the length
+// in its MBAP header. The whole response is written at once so it goes
+// out in a single segment. Returns NET_FAIL for something that isn't
+// Modbus, the connection is then closed.
+//
+static int modbus_request(EthernetClient &client, ModbusConn *c, Context *ctx)
+{
+    uint8_t buf[MODBUS_MBAP_SIZE + 2 + MODBUS_MAX_REGS * 2];
+    uint8_t *p;
+    uint16_t len;
+    uint16_t start;
+    uint16_t count;
+    uint8_t function;
+    uint8_t error = 0;
+
+    if (!c->has_mbap)
+    {
+        if (client.available() < MODBUS_MBAP_SIZE)
+            return NET_PENDING;
+
+        client.read(c->mbap, MODBUS_MBAP_SIZE);
+        c->has_mbap = 1;
+    }
+
+    len = modbus_read16(&c->mbap[4]);
+
+    if ((modbus_read16(&c->mbap[2]) != 0)
+     || (len < 2) || (len > MODBUS_MAX_LENGTH))
+    {
+        return NET_FAIL;
+    }
+
+    // The unit id is counted too, it is the last byte of the header.
+    len--;
+
+    if (client.available() < len)
+        return NET_PENDING;
+
+    c->has_mbap = 0;
+    memcpy(buf, c->mbap, MODBUS_MBAP_SIZE);
+    client.read(&buf[MODBUS_MBAP_SIZE], min(len, MODBUS_PDU_SIZE));
+
+    function = buf[MODBUS_MBAP_SIZE];
+    start = modbus_read16(&buf[MODBUS_MBAP_SIZE + 1]);
+    count = modbus_read16(&buf[MODBUS_MBAP_SIZE + 3]);
+
+    // Skip anything longer than the requests we know about.
+    for (uint16_t i = MODBUS_PDU_SIZE; i < len; i++)
+    {
+        client.read();
+    }
+
+    if ((function != MODBUS_READ_INPUT_REGISTERS)
+     && (function != MODBUS_READ_HOLDING_REGISTERS))
+    {
+        error = MODBUS_ILLEGAL_FUNCTION;
+    }
+    else if ((len != MODBUS_PDU_SIZE) || (count < 1) || (count > 125))
+    {
+        error = MODBUS_ILLEGAL_VALUE;
+    }
+    else if (((uint32_t)start + count)
+             > (MODBUS_SENSOR_BASE + ctx->count * MODBUS_SENSOR_REGS))
+    {
+        error = MODBUS_ILLEGAL_ADDRESS;
+    }
+
+    // Transaction id, protocol id and unit id are sent back as is.
+    p = &buf[MODBUS_MBAP_SIZE];
+
+    if (error)
+    {
+        *p++ = function | 0x80;
+        *p++ = error;
+    }
+    else
+    {
+        *p++ = function;
+        *p++ = count * 2;
+
+        for (uint16_t i = 0; i < count; i++)
+        {
+            p = modbus_put16(p, modbus_register(ctx, start + i));
+        }
+    }
+
+    modbus_put16(&buf[4], p - &buf[MODBUS_MBAP_SIZE - 1]);
+    client.write(buf, p - buf);
+
+    return NET_OK;
+}
+
+void modbus_sweep(unsigned long time)
+{
+    modbus_time = time;
+}
+
+static void modbus_listen(ModbusConn *c)
+{
+    c->sock = net_listen_start(MODBUS_PORT);
+    c->has_mbap = 0;
+    c->active = millis();
+
+    // All sockets were taken, try again a bit later.
+    modbus_waiting = (c->sock == NET_NO_SOCKET);
+    modbus_failed = c->active;
+}
+
+void modbus_begin()
+{
+    for (uint8_t i = 0; i < MODBUS_CONNECTIONS; i++)
+    {
+        modbus_conns[i].sock = NET_NO_SOCKET;
+    }
+
+    modbus_listen(&modbus_conns[0]);
+}
+
+// Returns 1 while the socket is listening.
+static uint8_t modbus_feed_conn(ModbusConn *c, Context *ctx)
+{
+    unsigned long idle = millis() - c->active;
+    uint8_t status;
+
+    if (EthernetClass::_server_port[c->sock] != MODBUS_PORT)
+    {
+        c->sock = NET_NO_SOCKET;
+        return 0;
+    }
+
+    switch (status = socketStatus(c->sock))
+    {
+        case SnSR::LISTEN:
+        case SnSR::SYNRECV:
+            c->active = millis();
+            return 1;
+        case SnSR::ESTABLISHED:
+        case SnSR::CLOSE_WAIT:
+        {
+            EthernetClient client(c->sock);
+
+            // Answers one request per call, a request that has only
+            // partly arrived waits for the next call.
+            int rc = modbus_request(client, c, ctx);
+
+            if (rc == NET_OK)
+            {
+                c->active = millis();
+            }
+            else if ((rc == NET_FAIL) || (status == SnSR::CLOSE_WAIT)
+                  || (idle >= MODBUS_IDLE_TIMEOUT))
+            {
+                net_close_start(c->sock);
+                c->active = millis();
+            }
+            break;
+        }
+        case SnSR::CLOSED:
+            c->sock = NET_NO_SOCKET;
+            break;
+        case SnSR::FIN_WAIT:
+        case SnSR::CLOSING:
+        case SnSR::TIME_WAIT:
+        case SnSR::LAST_ACK:
+            if (idle >= MODBUS_CLOSE_TIMEOUT)
+            {
+                net_close(c->sock);
+                c->sock = NET_NO_SOCKET;
+            }
+            break;
+        default:
+            // Taken for UDP, which leaves the port as it was.
+            c->sock = NET_NO_SOCKET;
+            break;
+    }
+
+    return 0;
+}
+
+void feed_modbus(Context *ctx)
+{
+    ModbusConn *free_conn = NULL;
+    uint8_t listening = 0;
+
+    for (uint8_t i = 0; i < MODBUS_CONNECTIONS; i++)
+    {
+        ModbusConn *c = &modbus_conns[i];
+
+        if (c->sock != NET_NO_SOCKET)
+            listening |= modbus_feed_conn(c, ctx);
+
+        if ((c->sock == NET_NO_SOCKET) && !free_conn)
+            free_conn = c;
+    }
+
+    // Once every connection is taken nothing listens, and the
+    // next one is refused until one of them is closed.
+    if (!listening && free_conn
+     && (!modbus_waiting || ((millis() - modbus_failed) >= MODBUS_CLOSE_TIMEOUT)))
+    {
+        modbus_listen(free_conn);
+    }
+}
+
+#endif // PANNAN_MODBUS
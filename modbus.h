@@ -0,0 +1,32 @@
+
+#ifndef __MODBUS_H__
+#define __MODBUS_H__
+
+#include "pannan.h"
+
+//
+// Modbus TCP server. Read Input Registers (0x04), and Read Holding
+// Registers (0x03) for PLCs that only do that, both give this map:
+//
+//   0              number of sensors
+//   1              fixed point scale of temperatures (16)
+//   2              time of the last sweep, Unix seconds, high word
+//   3              time of the last sweep, Unix seconds, low word
+//   4              milliseconds of the time of the last sweep
+//   5              1 when the clock is synced, times are 0 otherwise
+//   6 - 7          reserved
+//   8 + i * 4      sensor i temperature, fixed point
+//   9 + i * 4      sensor i status, 0 = ok, 1 = disconnected
+//   10 + i * 4     sensor i DS2762 thermocouple voltage in 10 uV
+//   11 + i * 4     sensor i DS2762 ambient temperature, fixed point
+//
+#define MODBUS_PORT 502
+#define MODBUS_SENSOR_BASE 8
+#define MODBUS_SENSOR_REGS 4
+#define MODBUS_MAX_REGS (MODBUS_SENSOR_BASE + MAX_TEMP_SENSORS * MODBUS_SENSOR_REGS)
+
+void modbus_begin();
+void modbus_sweep(unsigned long time);
+void feed_modbus(Context *ctx);
+
+#endif // __MODBUS_H__
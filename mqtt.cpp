@@ -0,0 +1,540 @@
+#include <Ethernet.h>
+
+#include "pannan.h"
+#include "names.h"
+#include "fmt.h"
+#include "net.h"
+#include "lease.h"
+#include "mqtt.h"
+#ifdef PANNAN_SNTP
+#include "sntp.h"
+#endif
+
+#ifdef PANNAN_MQTT
+
+//
+// The connection is made without blocking like the HTTP client, and
+// kept open with PINGREQ. The session is persistent (clean session off),
+// so QoS 1 messages that were not acknowledged are sent again with
+// the DUP flag after a reconnect.
+//
+
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_PUBACK 0x40
+#define MQTT_PINGREQ 0xc0
+#define MQTT_PINGRESP 0xd0
+
+#define MQTT_FLAG_DUP 0x08
+#define MQTT_FLAG_RETAIN 0x01
+
+#define MQTT_RESOLVE_TIMEOUT 2000
+#define MQTT_CONNECT_TIMEOUT 3000
+#define MQTT_CONNACK_TIMEOUT 3000
+#define MQTT_RETRY_TIMEOUT 5000
+#define MQTT_BACKOFF_MIN 5000UL
+#define MQTT_BACKOFF_MAX 300000UL
+
+#ifdef PANNAN_SNTP
+#define MQTT_PACKET_SIZE (64 + 10 + SNTP_TIME_SIZE)
+#else
+#define MQTT_PACKET_SIZE 64
+#endif
+#define MQTT_CLIENT_ID_SIZE 20
+
+typedef enum mqtt_state_e
+{
+    MQTT_IDLE,
+    MQTT_RESOLVE,
+    MQTT_CONNECTING,
+    MQTT_WAIT_CONNACK,
+    MQTT_CONNECTED
+} mqtt_state_t;
+
+typedef struct MqttInflight
+{
+    uint16_t id;                // 0 when the slot is free.
+    uint8_t sensor;
+    temp_fixed_t temp;
+    #ifdef PANNAN_SNTP
+    unsigned long time;         // millis() of the reading.
+    #endif
+    unsigned long sent;
+} MqttInflight;
+
+typedef struct Mqtt
+{
+    mqtt_state_t state;
+    unsigned long deadline;
+    unsigned long next_attempt;
+    unsigned long last_tx;
+    unsigned long ping_sent;
+    uint8_t ping_outstanding;
+    uint8_t failures;
+    uint8_t sock;
+    uint16_t next_id;
+    uint8_t pending[(MAX_TEMP_SENSORS + 7) / 8];
+    MqttInflight inflight[MQTT_INFLIGHT];
+    IPAddress ip;
+    DnsQuery dns;
+    char client_id[MQTT_CLIENT_ID_SIZE];
+
+    // Incoming packet.
+    uint8_t rx_type;
+    uint8_t rx_header;          // Bytes of fixed header read.
+    uint16_t rx_len;
+    uint16_t rx_pos;
+    uint8_t rx_buf[2];
+} Mqtt;
+
+static Mqtt mqtt;
+
+#define PENDING_SET(i) (mqtt.pending[(i) >> 3] |= (1 << ((i) & 7)))
+#define PENDING_CLEAR(i) (mqtt.pending[(i) >> 3] &= ~(1 << ((i) & 7)))
+#define PENDING_GET(i) (mqtt.pending[(i) >> 3] & (1 << ((i) & 7)))
+
+static void mqtt_step(mqtt_state_t state, unsigned long timeout)
+{
+    mqtt.state = state;
+    mqtt.deadline = millis() + timeout;
+}
+
+static int mqtt_expired()
+{
+    return (long)(millis() - mqtt.deadline) >= 0;
+}
+
+static void mqtt_fail()
+{
+    unsigned long wait = MQTT_BACKOFF_MIN;
+
+    if (mqtt.sock != NET_NO_SOCKET)
+    {
+        net_close(mqtt.sock);
+        mqtt.sock = NET_NO_SOCKET;
+    }
+
+    if (mqtt.failures < 0xff)
+        mqtt.failures++;
+
+    for (uint8_t i = 1; (i < mqtt.failures) && (wait < MQTT_BACKOFF_MAX); i++)
+        wait <<= 1;
+
+    mqtt.next_attempt = millis() + min(wait, MQTT_BACKOFF_MAX);
+    mqtt.state = MQTT_IDLE;
+}
+
+static uint8_t *mqtt_put16(uint8_t *p, uint16_t v)
+{
+    *p++ = v >> 8;
+    *p++ = v & 0xff;
+    return p;
+}
+
+static uint8_t *mqtt_put_str(uint8_t *p, const char *s)
+{
+    uint16_t len = strlen(s);
+    p = mqtt_put16(p, len);
+    memcpy(p, s, len);
+    return p + len;
+}
+
+//
+// Sends a packet where buf has room for the fixed header first,
+// the remaining length is at most 127 so it's always one byte.
+//
+static int mqtt_send(uint8_t *buf, uint8_t *end, uint8_t type)
+{
+    EthernetClient client(mqtt.sock);
+
+    buf[0] = type;
+    buf[1] = end - (buf + 2);
+
+    if (client.write(buf, end - buf) != (size_t)(end - buf))
+        return -1;
+
+    mqtt.last_tx = millis();
+    return 0;
+}
+
+static void mqtt_send_connect(Context *ctx)
+{
+    uint8_t buf[MQTT_PACKET_SIZE];
+    uint8_t *p = buf + 2;
+
+    p = mqtt_put_str(p, "MQTT");
+    *p++ = 4;       // Protocol level 3.1.1
+    *p++ = 0;       // Flags, clean session off.
+    p = mqtt_put16(p, ctx->settings.mqtt_keepalive);
+    p = mqtt_put_str(p, mqtt.client_id);
+
+    if (mqtt_send(buf, p, MQTT_CONNECT) < 0)
+        mqtt_fail();
+}
+
+static uint8_t *mqtt_put_topic(uint8_t *p, TempSensor *s)
+{
+    char topic[sizeof(MQTT_TOPIC_PREFIX) + ADDR_SIZE * 2 + 1];
+
+    strcpy(topic, MQTT_TOPIC_PREFIX "/");
+
+    if (s->name[0] && strcmp(s->name, "unknown"))
+    {
+        char *it = topic + strlen(topic);
+        strncat(topic, s->name, sizeof(topic) - strlen(topic) - 1);
+
+        for (; *it; it++)
+        {
+            if ((*it == ' ') || (*it == '+') || (*it == '#'))
+                *it = '_';
+        }
+    }
+    else
+    {
+        get_address_str(topic + strlen(topic), s->addr);
+    }
+
+    return mqtt_put_str(p, topic);
+}
+
+static int mqtt_send_publish(Context *ctx, uint8_t sensor, temp_fixed_t temp,
+                             unsigned long time, uint16_t id, uint8_t flags)
+{
+    uint8_t buf[MQTT_PACKET_SIZE];
+    uint8_t *p = buf + 2;
+    char str_temp[TEMP_STR_SIZE];
+
+    p = mqtt_put_topic(p, &ctx->temps[sensor]);
+
+    if (id)
+    {
+        p = mqtt_put16(p, id);
+        flags |= (1 << 1);  // QoS 1
+    }
+
+    if (ctx->settings.mqtt_retain)
+        flags |= MQTT_FLAG_RETAIN;
+
+    if (temp == temp_to_fixed(DEVICE_DISCONNECTED_C))
+    {
+        strcpy(str_temp, "null");
+    }
+    else
+    {
+        // 1/16 C to hundredths, rounded.
+        centi2buf(str_temp, NULL,
+                  ((long)temp * 25 + ((temp < 0) ? -2 : 2)) / 4);
+    }
+
+    strcpy((char *)p, "{\"temp\": ");
+    strcat((char *)p, str_temp);
+    #ifdef PANNAN_SNTP
+    if (sntp_synced())
+    {
+        strcat((char *)p, ", \"time\": ");
+        sntp_time2buf((char *)p + strlen((char *)p), NULL, time);
+    }
+    #endif
+    strcat((char *)p, "}");
+    p += strlen((char *)p);
+
+    return mqtt_send(buf, p, MQTT_PUBLISH | flags);
+}
+
+static void mqtt_send_ping()
+{
+    uint8_t buf[2];
+
+    if (mqtt_send(buf, buf + 2, MQTT_PINGREQ) < 0)
+    {
+        mqtt_fail();
+        return;
+    }
+
+    mqtt.ping_outstanding = 1;
+    mqtt.ping_sent = millis();
+}
+
+static MqttInflight *mqtt_free_slot()
+{
+    for (uint8_t i = 0; i < MQTT_INFLIGHT; i++)
+    {
+        if (!mqtt.inflight[i].id)
+            return &mqtt.inflight[i];
+    }
+
+    return NULL;
+}
+
+static void mqtt_publish_pending(Context *ctx)
+{
+    for (int i = 0; i < ctx->count; i++)
+    {
+        temp_fixed_t temp;
+        unsigned long time = 0;
+        MqttInflight *f = NULL;
+        uint16_t id = 0;
+
+        if (!PENDING_GET(i))
+            continue;
+
+        temp = temp_to_fixed(ctx->temps[i].temp);
+        #ifdef PANNAN_SNTP
+        time = ctx->temps[i].time;
+        #endif
+
+        if (ctx->settings.mqtt_qos)
+        {
+            // Wait for a PUBACK if the window is full.
+            if (!(f = mqtt_free_slot()))
+                return;
+
+            if (!++mqtt.next_id)
+                mqtt.next_id = 1;
+            id = mqtt.next_id;
+        }
+
+        if (mqtt_send_publish(ctx, i, temp, time, id, 0) < 0)
+        {
+            mqtt_fail();
+            return;
+        }
+
+        if (f)
+        {
+            f->id = id;
+            f->sensor = i;
+            f->temp = temp;
+            #ifdef PANNAN_SNTP
+            f->time = time;
+            #endif
+            f->sent = millis();
+        }
+
+        PENDING_CLEAR(i);
+    }
+}
+
+static void mqtt_resend_inflight(Context *ctx, unsigned long timeout)
+{
+    for (uint8_t i = 0; i < MQTT_INFLIGHT; i++)
+    {
+        MqttInflight *f = &mqtt.inflight[i];
+
+        if (!f->id || ((millis() - f->sent) < timeout))
+            continue;
+
+        #ifdef PANNAN_SNTP
+        unsigned long time = f->time;
+        #else
+        unsigned long time = 0;
+        #endif
+
+        if (mqtt_send_publish(ctx, f->sensor, f->temp, time,
+                              f->id, MQTT_FLAG_DUP) < 0)
+        {
+            mqtt_fail();
+            return;
+        }
+
+        f->sent = millis();
+    }
+}
+
+static void mqtt_packet(Context *ctx)
+{
+    uint16_t id = ((uint16_t)mqtt.rx_buf[0] << 8) | mqtt.rx_buf[1];
+
+    switch (mqtt.rx_type & 0xf0)
+    {
+        case MQTT_CONNACK:
+            if ((mqtt.state != MQTT_WAIT_CONNACK) || mqtt.rx_buf[1])
+            {
+                mqtt_fail();
+                return;
+            }
+
+            mqtt.failures = 0;
+            mqtt.ping_outstanding = 0;
+            mqtt.state = MQTT_CONNECTED;
+            mqtt_resend_inflight(ctx, 0);
+            break;
+        case MQTT_PUBACK:
+            for (uint8_t i = 0; i < MQTT_INFLIGHT; i++)
+            {
+                if (mqtt.inflight[i].id == id)
+                    mqtt.inflight[i].id = 0;
+            }
+            break;
+        case MQTT_PINGRESP:
+            mqtt.ping_outstanding = 0;
+            break;
+        default:
+            break;
+    }
+}
+
+//
+// Reads incoming packets, only the first two bytes of the variable
+// header are kept since that's all CONNACK and PUBACK have.
+//
+static void mqtt_read(Context *ctx)
+{
+    EthernetClient client(mqtt.sock);
+
+    while (client.available())
+    {
+        uint8_t c = client.read();
+
+        if (mqtt.rx_header == 0)
+        {
+            mqtt.rx_type = c;
+            mqtt.rx_len = 0;
+            mqtt.rx_pos = 0;
+            mqtt.rx_header = 1;
+            continue;
+        }
+
+        if (mqtt.rx_header < 4)
+        {
+            // Remaining length, 7 bits per byte.
+            mqtt.rx_len |= (uint16_t)(c & 0x7f) << (7 * (mqtt.rx_header - 1));
+            mqtt.rx_header = (c & 0x80) ? (mqtt.rx_header + 1) : 4;
+        }
+        else
+        {
+            if (mqtt.rx_pos < sizeof(mqtt.rx_buf))
+                mqtt.rx_buf[mqtt.rx_pos] = c;
+            mqtt.rx_pos++;
+        }
+
+        if ((mqtt.rx_header == 4) && (mqtt.rx_pos >= mqtt.rx_len))
+        {
+            mqtt.rx_header = 0;
+            mqtt_packet(ctx);
+
+            if (mqtt.state == MQTT_IDLE)
+                return;
+        }
+    }
+}
+
+static void mqtt_connect_start(Context *ctx)
+{
+    mqtt.sock = net_connect_start(mqtt.ip, ctx->settings.mqtt_port);
+    mqtt_step(MQTT_CONNECTING, MQTT_CONNECT_TIMEOUT);
+}
+
+void mqtt_init(const uint8_t *mac)
+{
+    mqtt.sock = NET_NO_SOCKET;
+    mqtt.state = MQTT_IDLE;
+
+    strcpy(mqtt.client_id, "pannan-");
+    for (uint8_t i = 3; i < 6; i++)
+    {
+        hex2buf(mqtt.client_id + strlen(mqtt.client_id), mac[i]);
+    }
+}
+
+void mqtt_sensor_updated(Context *ctx, int i)
+{
+    PENDING_SET(i);
+
+    if (mqtt.state == MQTT_CONNECTED)
+        mqtt_publish_pending(ctx);
+}
+
+void feed_mqtt(Context *ctx)
+{
+    unsigned long keepalive = ctx->settings.mqtt_keepalive * 1000UL;
+    int ret;
+
+    switch (mqtt.state)
+    {
+        case MQTT_IDLE:
+            if ((long)(millis() - mqtt.next_attempt) < 0)
+                break;
+
+            mqtt.rx_header = 0;
+
+            if (net_parse_ip(ctx->settings.mqtt_host, &mqtt.ip) == NET_OK)
+            {
+                mqtt_connect_start(ctx);
+            }
+            else if (dns_query_start(&mqtt.dns, lease_dns_server(),
+                                     ctx->settings.mqtt_host) == NET_OK)
+            {
+                mqtt_step(MQTT_RESOLVE, MQTT_RESOLVE_TIMEOUT);
+            }
+            else
+            {
+                mqtt_fail();
+            }
+            break;
+        case MQTT_RESOLVE:
+            ret = dns_query_poll(&mqtt.dns, &mqtt.ip, NULL);
+
+            if (ret == NET_OK)
+            {
+                mqtt_connect_start(ctx);
+            }
+            else if ((ret == NET_FAIL) || mqtt_expired())
+            {
+                dns_query_stop(&mqtt.dns);
+                mqtt_fail();
+            }
+            break;
+        case MQTT_CONNECTING:
+            ret = (mqtt.sock == NET_NO_SOCKET)
+                ? NET_FAIL : net_connect_poll(mqtt.sock);
+
+            if (ret == NET_OK)
+            {
+                mqtt_step(MQTT_WAIT_CONNACK, MQTT_CONNACK_TIMEOUT);
+                mqtt_send_connect(ctx);
+            }
+            else if ((ret == NET_FAIL) || mqtt_expired())
+            {
+                mqtt_fail();
+            }
+            break;
+        case MQTT_WAIT_CONNACK:
+            mqtt_read(ctx);
+
+            if ((mqtt.state == MQTT_WAIT_CONNACK) && mqtt_expired())
+                mqtt_fail();
+            break;
+        case MQTT_CONNECTED:
+            if (net_connect_poll(mqtt.sock) != NET_OK)
+            {
+                mqtt_fail();
+                break;
+            }
+
+            mqtt_read(ctx);
+
+            if (mqtt.state != MQTT_CONNECTED)
+                break;
+
+            if (mqtt.ping_outstanding)
+            {
+                if ((millis() - mqtt.ping_sent) > keepalive)
+                {
+                    mqtt_fail();
+                    break;
+                }
+            }
+            else if ((millis() - mqtt.last_tx) > (keepalive / 2))
+            {
+                mqtt_send_ping();
+            }
+
+            mqtt_resend_inflight(ctx, MQTT_RETRY_TIMEOUT);
+            mqtt_publish_pending(ctx);
+            break;
+    }
+}
+
+#endif // PANNAN_MQTT
@@ -0,0 +1,23 @@
+
+#ifndef __MQTT_H__
+#define __MQTT_H__
+
+#include "pannan.h"
+
+//
+// MQTT 3.1.1 publisher. Each sensor is published to its own topic
+// "<prefix>/<name>", or "<prefix>/<address>" for sensors without a name,
+// with the payload {"temp": 21.50}.
+//
+#ifndef MQTT_TOPIC_PREFIX
+#define MQTT_TOPIC_PREFIX "pannan"
+#endif
+
+// Max number of QoS 1 messages waiting for PUBACK.
+#define MQTT_INFLIGHT 4
+
+void mqtt_init(const uint8_t *mac);
+void mqtt_sensor_updated(Context *ctx, int i);
+void feed_mqtt(Context *ctx);
+
+#endif // __MQTT_H__
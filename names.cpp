@@ -1,14 +1,26 @@
 #include "pannan.h"
+#include "log.h"
+#include "fmt.h"
 #include <EEPROM.h>
 
-void print_address(Print &c, DeviceAddress addr)
+char *get_address_str(char *buf, DeviceAddress addr)
 {
+    uint8_t j = 0;
+
     for (uint8_t i = 0; i < ADDR_SIZE; i++)
     {
-        // zero pad the address if necessary
-        if (addr[i] < 16) c.print("0");
-        c.print(addr[i], HEX);
+        hex2buf(&buf[j], addr[i]);
+        j += 2;
     }
+    buf[j] = 0;
+
+    return buf;
+}
+
+void print_address(Print &c, DeviceAddress addr)
+{
+    char buf[ADDR_SIZE * 2 + 1];
+    c.print(get_address_str(buf, addr));
 }
 
 int eeprom_read_temp_sensor_index(int i, TempSensor *sensor)
@@ -40,18 +52,18 @@ void eeprom_read_temp_sensors(TempSensor *temps, int *count)
 
     for (i = 0; i < MAX_TEMP_SENSORS; i++)
     {
-        Serial.print(".");
+        LOG_DEBUG.print('.');
 
         if (eeprom_read_temp_sensor_index(i, &temps[i]) < 0)
         {
-            Serial.println();
+            LOG_DEBUG.println();
             return;
         }
 
         (*count)++;
     }
 
-    Serial.println();
+    LOG_DEBUG.println();
 }
 
 void eeprom_write_temp_sensor(int i, TempSensor *sensor)
@@ -93,7 +105,7 @@ int eeprom_find_address(TempSensor *temps, int temp_count,
 
     for (i = 0; i < temp_count; i++)
     {
-        if (!memcmp(temps[i].addr, addr, sizeof(addr)))
+        if (!memcmp(temps[i].addr, addr, ADDR_SIZE))
         {
             if (buf)
             {
@@ -103,7 +115,8 @@ int eeprom_find_address(TempSensor *temps, int temp_count,
         }
     }
 
-    buf[0] = '\0';
+    if (buf)
+        buf[0] = '\0';
     return -1;
 }
 
@@ -126,50 +139,40 @@ void eeprom_add_name(DeviceAddress addr, const char *name)
     eeprom_read_temp_sensors(temps, &temp_count);
 
     if ((i = eeprom_find_address(temps, temp_count, addr, NULL, 0)) < 0)
-    {
         i = temp_count; // Address not found so append.
-        //Serial.print(" Address not found, appending to index ");
-    }
-    else
-    {
-        //Serial.print(" Adding address to index ");
-    }
-
-    //Serial.println(i);
 
     eeprom_set_name(i, addr, name);
 }
 
-void eeprom_list_names()
+void eeprom_list_names(Print &c)
 {
     TempSensor sensors[MAX_TEMP_SENSORS];
     int count = 0;
     int i;
-    int j;
 
     eeprom_read_temp_sensors(sensors, &count);
 
-    //Serial.print("OK ");
-    //Serial.print(count);
-    //Serial.println(F(" found"));
-    Serial.println(F(" Index;Address;Name"));
+    c.println(F(" Index;Address;Name"));
 
     for (i = 0; i < count; i++)
     {
-        Serial.print(" ");
-        Serial.print(i);
-        Serial.print(";");
+        c.print(' ');
+        c.print(i);
+        c.print(';');
 
-        print_address(Serial, sensors[i].addr);
+        print_address(c, sensors[i].addr);
 
-        Serial.print(";");
-        Serial.println(sensors[i].name);
+        c.print(';');
+        c.println(sensors[i].name);
     }
 }
 
+// Only the names, the DHCP lease at the end of the EEPROM is kept.
 void eeprom_clear_names()
 {
-    for (int i = 0 ; i < EEPROM.length(); i++)
+    int len = min(MAX_TEMP_SENSORS * DATA_SIZE, (int)EEPROM.length());
+
+    for (int i = 0 ; i < len; i++)
     {
         EEPROM.write(i, 0);
     }
@@ -4,11 +4,12 @@
 
 #include <DallasTemperature.h>
 
+char *get_address_str(char *buf, DeviceAddress addr);
 void print_address(Print &c, DeviceAddress addr);
 
 void eeprom_add_name(DeviceAddress addr, const char *name);
 void eeprom_clear_names();
-void eeprom_list_names();
+void eeprom_list_names(Print &c);
 void eeprom_read_temp_sensors(TempSensor *temps, int *count);
 int eeprom_find_address(TempSensor *temps, int temp_count,
                 DeviceAddress addr, char *buf, int bufsize);
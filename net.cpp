@@ -0,0 +1,299 @@
+#include <Ethernet.h>
+#include <utility/w5100.h>
+#include <utility/socket.h>
+
+#include "net.h"
+
+#define DNS_PORT 53
+#define DNS_HEADER_SIZE 12
+#define DNS_TYPE_A 1
+#define DNS_CLASS_IN 1
+
+// Source ports for outgoing connections, same range as EthernetClient.
+#define NET_SRCPORT_FIRST 49152
+
+static uint16_t net_srcport = NET_SRCPORT_FIRST;
+
+int net_parse_ip(const char *s, IPAddress *ip)
+{
+    uint8_t b[4];
+
+    for (int i = 0; i < 4; i++)
+    {
+        int v = 0;
+
+        if (!isdigit(*s))
+            return NET_FAIL;
+
+        while (isdigit(*s))
+        {
+            v = v * 10 + (*s++ - '0');
+
+            if (v > 255)
+                return NET_FAIL;
+        }
+
+        if (*s != ((i < 3) ? '.' : '\0'))
+            return NET_FAIL;
+        s++;
+
+        b[i] = v;
+    }
+
+    // Only once all of it parsed, ip may be an address in use.
+    *ip = IPAddress(b[0], b[1], b[2], b[3]);
+
+    return NET_OK;
+}
+
+int dns_query_start(DnsQuery *q, IPAddress server, const char *name)
+{
+    uint8_t header[DNS_HEADER_SIZE];
+    const char *label = name;
+
+    if (!q->udp.begin(1024 + (millis() & 0xf)))
+        return NET_FAIL;
+
+    q->id = millis();
+
+    memset(header, 0, sizeof(header));
+    header[0] = q->id >> 8;
+    header[1] = q->id & 0xff;
+    header[2] = 0x01;   // Recursion desired.
+    header[5] = 1;      // One question.
+
+    if (!q->udp.beginPacket(server, DNS_PORT))
+        goto fail;
+
+    q->udp.write(header, sizeof(header));
+
+    // The name is sent as length prefixed labels "\x05higgs\x00"
+    while (*label)
+    {
+        const char *dot = strchr(label, '.');
+        uint8_t len = dot ? (dot - label) : strlen(label);
+
+        q->udp.write(len);
+        q->udp.write((const uint8_t *)label, len);
+
+        label += len;
+        if (*label)
+            label++;
+    }
+
+    q->udp.write((uint8_t)0);
+    q->udp.write((uint8_t)0);
+    q->udp.write((uint8_t)DNS_TYPE_A);
+    q->udp.write((uint8_t)0);
+    q->udp.write((uint8_t)DNS_CLASS_IN);
+
+    if (!q->udp.endPacket())
+        goto fail;
+
+    return NET_OK;
+fail:
+    q->udp.stop();
+    return NET_FAIL;
+}
+
+// Skips a possibly compressed name, returns -1 on a short packet.
+static int dns_skip_name(EthernetUDP &udp)
+{
+    int len;
+
+    while ((len = udp.read()) > 0)
+    {
+        if ((len & 0xc0) == 0xc0)
+        {
+            return (udp.read() < 0) ? -1 : 0;
+        }
+
+        while (len--)
+        {
+            if (udp.read() < 0)
+                return -1;
+        }
+    }
+
+    return len;
+}
+
+static uint16_t dns_read16(const uint8_t *b)
+{
+    return ((uint16_t)b[0] << 8) | b[1];
+}
+
+int dns_query_poll(DnsQuery *q, IPAddress *addr, uint32_t *ttl)
+{
+    uint8_t buf[DNS_HEADER_SIZE];
+    uint16_t count;
+
+    if (q->udp.parsePacket() <= 0)
+        return NET_PENDING;
+
+    if ((q->udp.read(buf, DNS_HEADER_SIZE) != DNS_HEADER_SIZE)
+     || (dns_read16(buf) != q->id))
+    {
+        // Not our reply, wait for the next one.
+        q->udp.flush();
+        return NET_PENDING;
+    }
+
+    // Must be a reply without error.
+    if (!(buf[2] & 0x80) || (buf[3] & 0x0f))
+        goto fail;
+
+    // Skip the questions.
+    count = dns_read16(&buf[4]);
+    while (count--)
+    {
+        if (dns_skip_name(q->udp) < 0)
+            goto fail;
+        q->udp.read(buf, 4);
+    }
+
+    // Use the first A record among the answers.
+    count = dns_read16(&buf[6]);
+    while (count--)
+    {
+        uint16_t len;
+
+        if ((dns_skip_name(q->udp) < 0)
+         || (q->udp.read(buf, 10) != 10))
+            goto fail;
+
+        len = dns_read16(&buf[8]);
+
+        if ((dns_read16(&buf[0]) == DNS_TYPE_A)
+         && (dns_read16(&buf[2]) == DNS_CLASS_IN)
+         && (len == 4))
+        {
+            uint8_t ip[4];
+
+            if (q->udp.read(ip, sizeof(ip)) != sizeof(ip))
+                goto fail;
+
+            *addr = IPAddress(ip);
+
+            if (ttl)
+            {
+                *ttl = ((uint32_t)dns_read16(&buf[4]) << 16)
+                     | dns_read16(&buf[6]);
+            }
+
+            dns_query_stop(q);
+            return NET_OK;
+        }
+
+        while (len--)
+            q->udp.read();
+    }
+
+fail:
+    dns_query_stop(q);
+    return NET_FAIL;
+}
+
+void dns_query_stop(DnsQuery *q)
+{
+    q->udp.stop();
+}
+
+static uint8_t net_free_socket()
+{
+    uint8_t sock;
+
+    for (sock = 0; sock < MAX_SOCK_NUM; sock++)
+    {
+        uint8_t s = socketStatus(sock);
+
+        if ((s == SnSR::CLOSED) || (s == SnSR::FIN_WAIT)
+         || (s == SnSR::CLOSE_WAIT))
+        {
+            break;
+        }
+    }
+
+    // Make sure the server does not think this socket is one of its own.
+    if (sock != MAX_SOCK_NUM)
+        EthernetClass::_server_port[sock] = 0;
+
+    return sock;
+}
+
+uint8_t net_connect_start(IPAddress ip, uint16_t port)
+{
+    uint8_t addr[4];
+    uint8_t sock = net_free_socket();
+
+    if (sock == NET_NO_SOCKET)
+        return NET_NO_SOCKET;
+
+    if (++net_srcport == 0)
+        net_srcport = NET_SRCPORT_FIRST;
+
+    socket(sock, SnMR::TCP, net_srcport, 0);
+
+    // IPAddress::raw_address() is private outside the Ethernet classes.
+    for (int i = 0; i < 4; i++)
+        addr[i] = ip[i];
+
+    if (!connect(sock, addr, port))
+    {
+        close(sock);
+        return NET_NO_SOCKET;
+    }
+
+    return sock;
+}
+
+int net_connect_poll(uint8_t sock)
+{
+    switch (socketStatus(sock))
+    {
+        case SnSR::ESTABLISHED:
+            return NET_OK;
+        case SnSR::CLOSED:
+        case SnSR::CLOSE_WAIT:
+            return NET_FAIL;
+        default:
+            return NET_PENDING;
+    }
+}
+
+uint8_t net_listen_start(uint16_t port)
+{
+    uint8_t sock = net_free_socket();
+
+    if (sock == NET_NO_SOCKET)
+        return NET_NO_SOCKET;
+
+    socket(sock, SnMR::TCP, port, 0);
+
+    if (!listen(sock))
+    {
+        close(sock);
+        return NET_NO_SOCKET;
+    }
+
+    // Cleared if the socket is taken by someone else once it is closed.
+    EthernetClass::_server_port[sock] = port;
+
+    return sock;
+}
+
+void net_close_start(uint8_t sock)
+{
+    disconnect(sock);
+}
+
+int net_close_poll(uint8_t sock)
+{
+    return (socketStatus(sock) == SnSR::CLOSED) ? NET_OK : NET_PENDING;
+}
+
+void net_close(uint8_t sock)
+{
+    close(sock);
+    EthernetClass::_server_port[sock] = 0;
+}
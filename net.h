@@ -0,0 +1,56 @@
+
+#ifndef __NET_H__
+#define __NET_H__
+
+#include <Ethernet.h>
+#include <EthernetUdp.h>
+
+//
+// Non-blocking network helpers. Each poll function returns one of these.
+//
+#define NET_PENDING 0
+#define NET_OK 1
+#define NET_FAIL -1
+
+#define NET_NO_SOCKET MAX_SOCK_NUM
+
+// Parses a dotted quad, ip is left as it was unless it returns NET_OK.
+int net_parse_ip(const char *s, IPAddress *ip);
+
+//
+// DNS A record lookup on UDP, the reply is polled for instead of
+// blocking in the Ethernet library DNSClient.
+//
+typedef struct DnsQuery
+{
+    EthernetUDP udp;
+    uint16_t id;
+} DnsQuery;
+
+int dns_query_start(DnsQuery *q, IPAddress server, const char *name);
+int dns_query_poll(DnsQuery *q, IPAddress *addr, uint32_t *ttl);
+void dns_query_stop(DnsQuery *q);
+
+//
+// TCP connect that returns right away, unlike EthernetClient::connect()
+// which waits until the connection is established. Once connected
+// the socket can be used with EthernetClient(sock).
+//
+uint8_t net_connect_start(IPAddress ip, uint16_t port);
+int net_connect_poll(uint8_t sock);
+
+//
+// Listens on a single socket, for a server that takes one connection
+// at a time. EthernetServer keeps another socket listening for as long
+// as any of its connections are open. The socket does the connection
+// itself, and has to be listened on again once it is closed, or when
+// EthernetClass::_server_port of it is no longer the port.
+//
+uint8_t net_listen_start(uint16_t port);
+
+// Starts closing a socket, and forces it closed when the poll gives up.
+void net_close_start(uint8_t sock);
+int net_close_poll(uint8_t sock);
+void net_close(uint8_t sock);
+
+#endif // __NET_H__
@@ -3,14 +3,44 @@
 #include <DallasTemperature.h>
 #include <EEPROM.h>
 #include <Ethernet.h>
-#include <SoftwareSerial.h>
+#include <utility/w5100.h>
+#include <utility/socket.h>
 #include <Button.h>
 #include <DS2762.h>
-#include <thermocouple.h>
-#include <MemoryFree.h>
 
 #include "pannan.h"
 #include "names.h"
+#include "json.h"
+#include "fmt.h"
+#include "net.h"
+#include "lease.h"
+#include "lcd.h"
+#include "thermo.h"
+#include "sched.h"
+#include "profile.h"
+#include "log.h"
+#include "mem.h"
+#ifdef PANNAN_HISTORY
+#include "history.h"
+#endif
+#ifdef PANNAN_QUEUE
+#include "queue.h"
+#endif
+#ifdef PANNAN_TELEMETRY
+#include "telemetry.h"
+#endif
+#ifdef PANNAN_MQTT
+#include "mqtt.h"
+#endif
+#ifdef PANNAN_MODBUS
+#include "modbus.h"
+#endif
+#ifdef PANNAN_SNTP
+#include "sntp.h"
+#endif
+#ifdef PANNAN_METRICS
+#include "metrics.h"
+#endif
 #include <avr/wdt.h>
 
 //
@@ -20,6 +50,7 @@
 // Since this works with the normal Arduino environment it should be possible
 // to fix this in arduino-cmake instead.
 //
+#ifdef __AVR__
 __extension__ typedef int __guard __attribute__((mode (__DI__)));
 extern "C" int __cxa_guard_acquire(__guard *);
 extern "C" void __cxa_guard_release (__guard *);
@@ -39,6 +70,7 @@ extern "C" void __cxa_pure_virtual(void);
 void __cxa_pure_virtual(void)
 {
 }
+#endif // __AVR__
 
 //
 // Helper to reuse the same flash string.
@@ -62,9 +94,6 @@ int lcd_scroll_enabled = 1;
 // Time between reading the temperature sensors.
 #define READ_DELAY 5000
 
-// Attach the serial display's RX line to digital pin 3
-SoftwareSerial lcd(4,3); // pin 4 = RX (unused), pin 3 = TX
-
 byte mac[] = { 0xDE, 0x01, 0xBE, 0x3E, 0x21, 0xED };
 
 OneWire oneWire(ONE_WIRE_BUS);
@@ -73,136 +102,99 @@ DallasTemperature sensors(&oneWire);
 
 #ifdef PANNAN_CLIENT
 
+#ifndef HTTP_REQUEST_HOST_DEFAULT
+#define HTTP_REQUEST_HOST_DEFAULT "higgs"
+#endif
+#ifndef HTTP_REQUEST_PORT_DEFAULT
 #define HTTP_REQUEST_PORT_DEFAULT 9000
+#endif
 #define HTTP_REQUEST_DELAY_DEFAULT 5000
-const char DEFAULT_HOSTNAME[] PROGMEM = "higgs";
-
-// This is used to do HTTP PUT of the json to a specified server.
-unsigned long last_http_request = 0;
+const char DEFAULT_HOSTNAME[] PROGMEM = HTTP_REQUEST_HOST_DEFAULT;
 
 #endif // PANNAN_CLIENT
 
-#ifdef PANNAN_SERVER
-EthernetServer server(80);
-#endif
-
-Context ctx;
-unsigned long last_temp_read;
-
-void set_error(const char *error)
-{
-    // TODO: Set error stuff. Turn on LED, show LCD message.
-}
-
-static char byte_map[] = 
-{
-    '0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
-    'A', 'B', 'C', 'D', 'E', 'F'
-};
-
-// Utility function to convert nibbles (4 bit values)
-// into a hex character representation.
-static char nibble_to_char(uint8_t nibble)
-{
-    if (nibble < sizeof(byte_map))
-        return byte_map[nibble];
-    return '*';
-}
-
-char *hex2buf(char *buf, uint8_t b)
-{
-    buf[0] = nibble_to_char(b >> 4);
-    buf[1] = nibble_to_char(b & 0x0f);
-    buf[2] = 0;
-    return buf;
-}
+#ifdef PANNAN_TELEMETRY
 
+#ifndef TELEMETRY_ADDR_DEFAULT
+#define TELEMETRY_ADDR_DEFAULT "239.255.0.80"
+#endif
+#ifndef TELEMETRY_PORT_DEFAULT
+#define TELEMETRY_PORT_DEFAULT 7080
+#endif
+#define TELEMETRY_DELAY_DEFAULT READ_DELAY
 
-char *int2buf(char *buf, int *i, int val)
-{
-    int len = 0;
-    char neg = 0;
-    int valcpy = val;
-
-    if (val == 0)
-    {
-        buf[0] = '0';
-        buf[1] = 0;
-        len = 1;
-        goto done;
-    }
+#endif // PANNAN_TELEMETRY
 
-    if (val < 0)
-    {
-        neg = 1;
-        val = -val;
-        len++;
-    }
+#ifdef PANNAN_MQTT
 
-    // Get length of final string.
-    while (valcpy != 0)
-    {
-        len++;
-        valcpy /= 10;
-    }
+#ifndef MQTT_HOST_DEFAULT
+#define MQTT_HOST_DEFAULT "higgs"
+#endif
+#ifndef MQTT_PORT_DEFAULT
+#define MQTT_PORT_DEFAULT 1883
+#endif
+#ifndef MQTT_QOS_DEFAULT
+#define MQTT_QOS_DEFAULT 1
+#endif
+#define MQTT_KEEPALIVE_DEFAULT 60
+const char DEFAULT_MQTT_HOST[] PROGMEM = MQTT_HOST_DEFAULT;
 
-    for (int j = 0; j < len; j++)
-    {
-        buf[len - (j + 1)] = (val % 10) + '0';
-        val /= 10;
-    }
+#endif // PANNAN_MQTT
 
-    if (neg)
-    {
-        buf[0] = '-';
-    }
+#ifdef PANNAN_SNTP
+const char DEFAULT_NTP_HOST[] PROGMEM = SNTP_SERVER_DEFAULT;
+#endif // PANNAN_SNTP
 
-    buf[len] = 0;
+#ifdef PANNAN_SERVER
+#define SERVER_PORT 80
+EthernetServer server(SERVER_PORT);
+#endif
 
-done:
-    if (i)
-        (*i) += len;
+Context ctx;
+unsigned long last_temp_read;
 
-    return buf;
+void set_error(const char *error)
+{
+    // TODO: Set error stuff. Turn on LED, show LCD message.
 }
 
-void print_sensor(int i, TempSensor *sensor,
+void print_sensor(Print &c, int i, TempSensor *sensor,
                   byte newline = 1, byte show_temperature = 0)
 {
-    Serial.print(i);
-    Serial.print(": ");
-    print_address(Serial, sensor->addr);
+    c.print(i);
+    c.print(F(": "));
+    print_address(c, sensor->addr);
 
     if (show_temperature)
     {
-        Serial.print(" ");
+        c.print(' ');
 
         #ifndef PANNAN_DS2762
         if (sensor->type == SENSOR_DS2762)
         {
-            Serial.print("-");
+            c.print('-');
         }
         else
         #endif // PANNAN_DS2762
         {
-            Serial.print(sensor->temp);
-            Serial.print("C");
+            print_temp(c, sensor->temp);
+            c.print('C');
         }
     }
 
-    Serial.print(" ");
-    Serial.print(sensor->name);
+    c.print(' ');
+    c.print(sensor->name);
 
     if (sensor->type == SENSOR_DS2762) 
     {
-        Serial.println(" *");
+        c.println(F(" *"));
     }
     else
     {
-        Serial.println(" ");
+        c.println(' ');
     }
 
-    if (newline) Serial.println();
+    if (newline) c.println();
 }
 
 void prepare_sensors()
@@ -214,22 +206,31 @@ void prepare_sensors()
     // Locate devices on the bus
     sensors.begin();
 
+    // The conversions are waited for by read_temp_sensors().
+    sensors.setWaitForConversion(false);
+
     ctx.count = sensors.getDeviceCount();
 
-    Serial.print(F("Locating devices..."));
-    Serial.print(F("Found "));
-    Serial.print(ctx.count, DEC);
-    Serial.println(F(" devices."));
+    LOG_INFO.print(F("Locating devices..."));
+    LOG_INFO.print(F("Found "));
+    LOG_INFO.print(ctx.count, DEC);
+    LOG_INFO.println(F(" devices."));
+
+    if (ctx.count > MAX_TEMP_SENSORS)
+    {
+        LOG_WARN.print(F("Only using the first "));
+        LOG_WARN.println(MAX_TEMP_SENSORS);
+        ctx.count = MAX_TEMP_SENSORS;
+    }
 
-    //Serial.println(F("Get device names from EEPROM..."));
     eeprom_read_temp_sensors(names, &name_count);
 
     for (i = 0; i < ctx.count; i++)
     {
         if (!sensors.getAddress(ctx.temps[i].addr, i))
         {
-            //Serial.print(F("ERROR getting address for sensor at index "));
-            Serial.println(i);
+            LOG_ERROR.print(F("ERROR getting address for sensor at index "));
+            LOG_ERROR.println(i);
         }
         else
         {
@@ -252,124 +253,59 @@ void prepare_sensors()
                 strcpy(ctx.temps[i].name, "unknown");
             }
 
-            print_sensor(i, &ctx.temps[i]);
+            if (LOG_ENABLED(LOG_LEVEL_INFO))
+                print_sensor(logger, i, &ctx.temps[i]);
         }
     }
 }
 
 void print_ip(IPAddress ip)
 {
-    ip.printTo(Serial);
-    Serial.println();
+    if (LOG_ENABLED(LOG_LEVEL_INFO))
+    {
+        ip.printTo(logger);
+        logger.println();
+    }
 }
 
 void feed_dhcp()
 {
-    switch (Ethernet.maintain())
+    switch (lease_maintain())
     {
         case 1:
-            Serial.println(F("ERROR: DHCP renewed fail"));
-            break;
-        case 2:
-            //Serial.println(F("Renew success"));
-            print_ip(Ethernet.localIP());
-            break;
-        case 3:
-            //Serial.println(F("Error: rebind fail"));
+            LOG_WARN.println(F("ERROR: DHCP renewed fail"));
             break;
-        case 4:
-            //Serial.println(F("Rebind success"));
+        case 2:     // Renewed.
+        case 4:     // Rebound.
             print_ip(Ethernet.localIP());
             break;
-
         default:
             break;
     }
 }
 
-char *get_address_str(char *buf, DeviceAddress addr)
-{
-    uint8_t j = 0;
-    uint8_t step;
-
-    #if 1
-    for (uint8_t i = 0; i < ADDR_SIZE; i++)
-    {
-        hex2buf(&buf[j], addr[i]);
-        j += 2;
-    }
-    buf[j] = 0;
-    #endif
-
-    return buf;
-}
-
-#define SENSOR_JSON_FMT                \
-    "    {\n"                          \
-    "      \"name\": \"%s\",\n"        \
-    "      \"index\": %d,\n"           \
-    "      \"addr\": \"%s\",\n"        \
-    "      \"temp\": %s\n"             \
-    "    }" 
-
-#ifdef PANNAN_DS2762
-#define SENSOR_DS2762_JSON_FMT         \
-    ",\n"                              \
-    "      \"mv\": \"%s\",\n"          \
-    "      \"ambient\": \"%s\"\n" 
-#else
-#define SENSOR_DS2762_JSON_FMT
-#endif // PANNAN_DS2762
-
-#define SENSOR_ADDR_SIZE (ADDR_SIZE * 2 + 1)
-#define SENSOR_TEMP_SIZE 7
-#define SENSOR_BUF_SIZE (sizeof(SENSOR_JSON_FMT SENSOR_DS2762_JSON_FMT) \
-                        + SENSOR_ADDR_SIZE + SENSOR_TEMP_SIZE*2)
+// Ends a chunked HTTP body.
+const char HTTP_CHUNK_END[] PROGMEM = "0\r\n\r\n";
 
-char *get_sensor_json(char *buf, int i, TempSensor *s)
+// Prints a string as one chunk of a chunked HTTP body.
+void print_chunk(Print &c, const char *str)
 {
-    char str_temp[SENSOR_TEMP_SIZE];
-
-    if (s->temp == DEVICE_DISCONNECTED_C)
-    {
-        strcpy(str_temp, "null");
-    }
-    else
-    {
-        dtostrf(s->temp, 2, 2, str_temp);
-    }
+    char hex[4];
+    size_t len = strlen(str);
 
-    int j = 0;
-    #define ADD2BUF(str) strcpy(&buf[j], str); j+= strlen(str);
-    #define ADDI2BUF(v) int2buf(&buf[j], &j, v);
-    ADD2BUF("    {\n"
-            "      \"name\": \""); ADD2BUF(s->name);  ADD2BUF("\",\n");
-    ADD2BUF("      \"index\": ");  ADDI2BUF(i);       ADD2BUF(",\n");
-    ADD2BUF("      \"addr\": \""); ADD2BUF(get_address_str(&buf[j], s->addr));
-                                                      ADD2BUF("\",\n");
-    ADD2BUF("      \"temp\": ");   ADD2BUF(str_temp);
-    #ifdef PANNAN_DS2762
-    if (s->type == SENSOR_DS2762)
-    {
-    dtostrf(s->ambient_temp, 2, 2, str_temp);
-    ADD2BUF(",\n");
-    ADD2BUF("      \"mv\": ");     ADDI2BUF(s->microvolts); ADD2BUF(",\n");
-    ADD2BUF("      \"ambient\": ");ADD2BUF(str_temp);
-    }
-    #endif // PANNAN_DS2762
-    ADD2BUF("\n"
-            "    }");
+    // A batch reading of many sensors is more than 255 bytes.
+    if (len > 0xff)
+        c.print(hex2buf(hex, len >> 8));
 
-    return buf;
+    c.println(hex2buf(hex, len));
+    c.println(str);
 }
 
-void print_sensor_json(Print &c, int i, TempSensor *s)
+void print_sensor_json(Print &c, int i, TempSensor *s,
+                       uint8_t fields = JSON_FIELD_ALL)
 {
     char buf[SENSOR_BUF_SIZE];
-    char hex[4];
-    char *str = get_sensor_json(buf, i, s);
-    c.println(hex2buf(hex, strlen(str)));
-    c.println(str);
+    print_chunk(c, get_sensor_json(buf, i, s, fields));
 }
 
 #define PRINT_CHUNK(str)                            \
@@ -382,9 +318,11 @@ void print_sensor_json(Print &c, int i, TempSensor *s)
 //
 // Note! This must be sent with header Transfer-Encoding: chunked
 //
-void print_http_request_json(Print &c)
+void print_http_request_json(Print &c, const JsonFilter *filter = NULL)
 {
     char hex[4];
+    uint8_t fields = filter ? filter->fields : JSON_FIELD_ALL;
+    int first = 1;
 
     PRINT_CHUNK("{\n" \
                 "  \"sensors\":\n"
@@ -392,16 +330,21 @@ void print_http_request_json(Print &c)
     
     for (int i = 0; i < ctx.count; i++)
     {
-        print_sensor_json(c, i, &ctx.temps[i]);
-        
-        if (i != (ctx.count - 1))
+        if (!json_filter_match(filter, i))
+            continue;
+
+        if (!first)
         {
             PRINT_CHUNK(",\n");
         }
-        else
-        {
-            PRINT_CHUNK("\n");
-        }
+
+        print_sensor_json(c, i, &ctx.temps[i], fields);
+        first = 0;
+    }
+
+    if (!first)
+    {
+        PRINT_CHUNK("\n");
     }
 
     PRINT_CHUNK("  ]\n"
@@ -410,6 +353,109 @@ void print_http_request_json(Print &c)
 
 #ifdef PANNAN_CLIENT
 
+#ifdef PANNAN_QUEUE
+
+#define TEMP_FIXED_DISCONNECTED temp_to_fixed(DEVICE_DISCONNECTED_C)
+#ifdef PANNAN_SNTP
+#define READING_BUF_SIZE (32 + 12 + SNTP_TIME_SIZE + MAX_TEMP_SENSORS * 7)
+#else
+#define READING_BUF_SIZE (32 + MAX_TEMP_SENSORS * 7)
+#endif
+
+//
+// Readings that were not uploaded when they were made are sent
+// in batches, oldest first. The temperatures are in the same order
+// as the sensors, in fixed point, and the times are millis() on the
+// node which "now" relates to the time of the upload. Once the clock
+// is synced "time" is also given as Unix time.
+//
+// Note! This must be sent with header Transfer-Encoding: chunked
+//
+void print_http_batch_json(Print &c, uint8_t n)
+{
+    char buf[READING_BUF_SIZE];
+    char hex[4];
+    int i;
+    int j = 0;
+
+    ADDP2BUF("{\n"
+            "  \"now\": "); ulong2buf(&buf[j], &j, millis());
+    #ifdef PANNAN_SNTP
+    if (sntp_synced())
+    {
+        ADDP2BUF(",\n"
+                "  \"time\": "); sntp_time2buf(&buf[j], &j, millis());
+    }
+    #endif // PANNAN_SNTP
+    ADDP2BUF(",\n"
+            "  \"scale\": "); ADDI2BUF(TEMP_FIXED_SCALE);
+    ADDP2BUF(",\n"
+            "  \"sensors\":\n"
+            "  [\n");
+    print_chunk(c, buf);
+
+    for (i = 0; i < ctx.count; i++)
+    {
+        if (i)
+        {
+            PRINT_CHUNK(",\n");
+        }
+
+        print_sensor_json(c, i, &ctx.temps[i],
+                          JSON_FIELD_NAME | JSON_FIELD_INDEX | JSON_FIELD_ADDR);
+    }
+
+    PRINT_CHUNK("\n"
+                "  ],\n"
+                "  \"readings\":\n"
+                "  [\n");
+
+    for (uint8_t k = 0; k < n; k++)
+    {
+        j = 0;
+        if (k)
+        {
+            ADDP2BUF(",\n");
+        }
+        ADDP2BUF("    {\"t\": "); ulong2buf(&buf[j], &j, queue_time(k));
+        #ifdef PANNAN_SNTP
+        if (sntp_synced())
+        {
+            ADDP2BUF(", \"time\": "); sntp_time2buf(&buf[j], &j, queue_time(k));
+        }
+        #endif // PANNAN_SNTP
+        ADDP2BUF(", \"temps\": [");
+
+        for (i = 0; i < ctx.count; i++)
+        {
+            temp_fixed_t t = queue_temp(k, i);
+
+            if (i)
+            {
+                ADDP2BUF(",");
+            }
+
+            if (t == TEMP_FIXED_DISCONNECTED)
+            {
+                ADDP2BUF("null");
+            }
+            else
+            {
+                ADDI2BUF(t);
+            }
+        }
+
+        ADDP2BUF("]}");
+        print_chunk(c, buf);
+    }
+
+    PRINT_CHUNK("\n"
+                "  ]\n"
+                "}\n");
+}
+
+#endif // PANNAN_QUEUE
+
 int get_http_status_code(char *buf, int bufsize)
 {
     if (!strncmp(buf, "HTTP/1.", 7))
@@ -420,7 +466,9 @@ int get_http_status_code(char *buf, int bufsize)
             return 0;
 
         int end = start;
-        while (isdigit(buf[end]) && (end < bufsize)) end++;
+        while ((end < bufsize) && isdigit(buf[end])) end++;
+        if (end >= bufsize)
+            return 0;
         buf[end] = 0;
 
         return atoi(&buf[start]);
@@ -429,178 +477,654 @@ int get_http_status_code(char *buf, int bufsize)
     return 0;
 }
 
-int http_request()
-{
-    int status_code = 0;
-    int ret;
-    EthernetClient client;
-
-    //Serial.print(F("HTTP Client request to "));
-    Serial.println(ctx.settings.server_hostname);
+//
+// The HTTP PUT of the json is done as a state machine so that
+// each call to feed_client() only does a small bounded amount of work.
+// Every step has a deadline, and failed uploads are retried with
+// an exponential backoff.
+//
+// The connection to the collector is kept open between uploads
+// (HTTP/1.1 keep-alive) and the resolved address is cached, so
+// normally an upload is only the PUT and the response.
+//
+#define UPLOAD_RESOLVE_TIMEOUT 2000
+#define UPLOAD_CONNECT_TIMEOUT 3000
+#define UPLOAD_RESPONSE_TIMEOUT 3000
+#define UPLOAD_CLOSE_TIMEOUT 1000
+#define UPLOAD_BACKOFF_MAX 300000UL
 
-    if ((ret = client.connect(ctx.settings.server_hostname,
-                              ctx.settings.server_port)))
-    {
-        int j = 0;
-        int end;
-        //Serial.println(F("  Connected..."));
-
-        client.println(F("PUT / HTTP/1.1\r\n"
-                         //"User-Agent: arduino-ethernet\r\n"
-                         //"Connection: close\r\n"
-                         "Content-Type: application/json\r\n"
-                         "Transfer-Encoding: chunked\r\n"));
-        client.print(F("Host: "));
-        client.print(ctx.settings.server_hostname);
-        client.print(":");
-        client.print(ctx.settings.server_port);
-        client.println(); // End of header.
-
-        // This must be sent as chunked!
-        print_http_request_json(client);
-        client.println("0\r\n"); // End of chunked message.
+// Limits for how long a resolved address is used, in seconds.
+#define UPLOAD_DNS_TTL_MIN 60
+#define UPLOAD_DNS_TTL_MAX 3600
 
-        char buf[16];
-        memset(buf, 0, sizeof(buf));
+// Number of failed uploads in a row before it's flagged as an error.
+#define UPLOAD_FAILURES_ERROR 3
 
-        while (client.connected())
-        {
-            if (client.available())
-            {
-                char c = client.read();
-                Serial.print(c);
+// Most queued readings sent in one upload.
+#define UPLOAD_BATCH_MAX 6
 
-                // Save the first line so we can parse status.
-                if (j < sizeof(buf))
-                {
-                    buf[j++] = c;
-                }
-            }
-        }
+typedef enum upload_state_e
+{
+    UPLOAD_IDLE,
+    UPLOAD_RESOLVE,
+    UPLOAD_CONNECT,
+    UPLOAD_SEND,
+    UPLOAD_STATUS,
+    UPLOAD_HEADERS,
+    UPLOAD_BODY,
+    UPLOAD_CLOSE
+} upload_state_t;
+
+typedef struct Uploader
+{
+    upload_state_t state;
+    unsigned long next;         // When the next upload is due.
+    unsigned long started;      // When the current upload started.
+    unsigned long deadline;     // Deadline of the current step.
+    unsigned long ip_expires;   // When the cached address must be resolved again.
+    uint8_t failures;           // Failures in a row.
+    uint8_t sock;
+    uint8_t reused;             // The connection was kept from an earlier upload.
+    uint8_t keep_alive;         // The server allows the connection to be kept.
+    uint16_t batch_end;         // Queue sequence number after the last reading sent.
+    int status;
+    long content_length;
+    IPAddress ip;
+    DnsQuery dns;
+    char line[24];              // Start of the current response line.
+    uint8_t line_len;
+} Uploader;
+
+Uploader up = { UPLOAD_IDLE, 0, 0, 0, 0, 0, NET_NO_SOCKET };
+
+static void upload_step(upload_state_t state, unsigned long timeout)
+{
+    up.state = state;
+    up.deadline = millis() + timeout;
+}
 
-        status_code = get_http_status_code(buf, sizeof(buf));
+static int upload_expired()
+{
+    return (long)(millis() - up.deadline) >= 0;
+}
 
-        client.stop();
-        //Serial.print("Status: ");
-        Serial.println(status_code);
-        //Serial.println(F("  Disconnected"));
+static void upload_close_start()
+{
+    if (up.sock != NET_NO_SOCKET)
+    {
+        net_close_start(up.sock);
+        upload_step(UPLOAD_CLOSE, UPLOAD_CLOSE_TIMEOUT);
     }
     else
     {
-        Serial.print(F("Connect fail: "));
-        Serial.println(ret);
-        client.stop();
+        up.state = UPLOAD_IDLE;
     }
+}
 
-    return status_code;
+static void upload_connect_start()
+{
+    up.reused = 0;
+    up.sock = net_connect_start(up.ip, ctx.settings.server_port);
+    upload_step(UPLOAD_CONNECT, UPLOAD_CONNECT_TIMEOUT);
 }
 
-void feed_client()
+static void upload_done(int status)
 {
-    if ((millis() - last_http_request) > ctx.settings.http_request_delay)
+    unsigned long wait = ctx.settings.http_request_delay;
+
+    up.status = status;
+
+    #ifdef PANNAN_METRICS
+    metrics_http_request(status, (millis() - up.started) * 1000);
+    #endif
+
+    if ((status >= 200) && (status < 300))
     {
-        int status = http_request();
-        if ((status < 200) && (status >= 300))
-        {
-            set_error("HTTP client fail");
-        }
+        up.failures = 0;
+        ctx.upload_ok++;
 
-        last_http_request = millis(); 
+        #ifdef PANNAN_QUEUE
+        // The readings are only dropped once the collector has them,
+        // if there's a backlog left keep sending right away.
+        queue_ack(up.batch_end);
+
+        if (queue_count() > 1)
+            wait = 0;
+        #endif // PANNAN_QUEUE
     }
-}
-#endif // PANNAN_CLIENT
+    else
+    {
+        ctx.upload_failed++;
 
-#ifdef PANNAN_SERVER
+        if (up.failures < 0xff)
+            up.failures++;
 
-#define SHTML(str) c.print(F(str))
+        if (up.failures >= UPLOAD_FAILURES_ERROR)
+            set_error("HTTP client fail");
 
-#define HTML_OK "200 OK"
-#define HTML_CONTENT_TYPE "text/html; charset=utf-8"
+        // Back off exponentially, up to a limit.
+        for (uint8_t i = 1; (i < up.failures) && (wait < UPLOAD_BACKOFF_MAX); i++)
+            wait <<= 1;
 
-const char HTML_BODY_START[] PROGMEM = 
-    "<html>"
-    "<link rel='stylesheet' href='https://maxcdn.bootstrapcdn.com/bootstrap/3.3.6/css/bootstrap.min.css'>"
-    "<body>";
+        if (wait > UPLOAD_BACKOFF_MAX)
+            wait = UPLOAD_BACKOFF_MAX;
 
-const char HTML_BODY_END[] PROGMEM =
-    "</body>"
-    "</html>";
+        // Resolve again in case the collector moved.
+        if (!status)
+            up.ip_expires = millis();
+    }
 
-void send_http_response_header(Print &c,
-                            const char *status = HTML_OK,
-                            const char *content_type = HTML_CONTENT_TYPE,
-                            int end = 1)
-{
-  SHTML("HTTP/1.1 ");
-  c.println(status);
-  SHTML("Content-Type: ");
-  c.println(content_type);
-  if (end) c.println();
-}
+    LOG_DEBUG.print(F("PUT "));
+    LOG_DEBUG.println(status);
 
-void server_404_reply(Print &c)
-{
-    send_http_response_header(c, "404 Not Found");
-    SHTML("<html>404 bad url!</html>");
-}
+    // Anchor the next upload to when this one started to avoid drift.
+    up.next = up.started + wait;
 
-#if 0
-void server_unsupported_reply(Print &c)
-{
-    send_http_response_header(c, "501 Method not supported");
+    if (up.keep_alive && status && (up.sock != NET_NO_SOCKET))
+    {
+        up.state = UPLOAD_IDLE;
+    }
+    else
+    {
+        upload_close_start();
+    }
 }
-#endif
 
-void server_json_reply(Print &c, char *url)
+//
+// A kept connection may have been closed by the server at any point,
+// if nothing at all came back on it the upload is retried right away
+// on a new connection instead of counting as a failure.
+//
+static void upload_fail()
 {
-    send_http_response_header(c, HTML_OK, "application/json", 0);
-    c.println(F("Transfer-Encoding: chunked"));
-    c.println();
-    print_http_request_json(c);
-    c.println("0\r\n");
+    if (up.reused && !up.line_len && (up.state == UPLOAD_STATUS))
+    {
+        net_close(up.sock);
+        upload_connect_start();
+        return;
+    }
+
+    up.keep_alive = 0;
+    upload_done(0);
 }
 
-void server_home_reply(Print &c, char *url)
+static void upload_start()
 {
-    TempSensor *s;
-    char str_temp[6];
-
-    send_http_response_header(c, HTML_OK, HTML_CONTENT_TYPE, 0);
-    c.println(F("Refresh: 10"));    
-    c.println();
-    c.println(FS(HTML_BODY_START));
-    SHTML("<div class='container'>");
+    up.started = millis();
+    up.line_len = 0;
 
-    for (int i = 0; i < ctx.count; i++)
+    // Use the kept connection if it's still open.
+    if (up.sock != NET_NO_SOCKET)
     {
-        s = &ctx.temps[i];
-        SHTML("<div class='row'>");
-        SHTML("<div class='col-md-1'><strong>");
-        c.print(s->name);
-        SHTML("</strong></div>");
-        SHTML("<div class='col-md-1'>");
-        if (s->temp == DEVICE_DISCONNECTED_C)
-        {
-            strcpy(str_temp, "-");
-        }
-        else
+        if (net_connect_poll(up.sock) == NET_OK)
         {
-            dtostrf(s->temp, 2, 2, str_temp);
+            up.reused = 1;
+            up.state = UPLOAD_SEND;
+            return;
         }
-        c.print(str_temp);
-        SHTML("C</div>");
-        SHTML("</div><br>");
+
+        net_close(up.sock);
+        up.sock = NET_NO_SOCKET;
     }
 
-    SHTML("</div>");
-    c.println(FS(HTML_BODY_END));
+    if ((net_parse_ip(ctx.settings.server_hostname, &up.ip) == NET_OK)
+     || ((long)(millis() - up.ip_expires) < 0))
+    {
+        upload_connect_start();
+    }
+    else if (dns_query_start(&up.dns, lease_dns_server(),
+                             ctx.settings.server_hostname) == NET_OK)
+    {
+        upload_step(UPLOAD_RESOLVE, UPLOAD_RESOLVE_TIMEOUT);
+    }
+    else
+    {
+        upload_fail();
+    }
 }
 
-#ifdef PANNAN_NAME_SUPPORT
-
-const char TD_STARTEND[] PROGMEM = "</td><td>";
-
-void server_names_form_reply(Print &c, char *url)
+static void upload_resolve()
+{
+    uint32_t ttl = 0;
+    int ret = dns_query_poll(&up.dns, &up.ip, &ttl);
+
+    if (ret == NET_OK)
+    {
+        ttl = constrain(ttl, UPLOAD_DNS_TTL_MIN, UPLOAD_DNS_TTL_MAX);
+        up.ip_expires = millis() + ttl * 1000;
+        upload_connect_start();
+    }
+    else if ((ret == NET_FAIL) || upload_expired())
+    {
+        dns_query_stop(&up.dns);
+        upload_fail();
+    }
+}
+
+static void upload_connect()
+{
+    int ret = (up.sock == NET_NO_SOCKET)
+            ? NET_FAIL : net_connect_poll(up.sock);
+
+    if (ret == NET_OK)
+    {
+        up.state = UPLOAD_SEND;
+    }
+    else if ((ret == NET_FAIL) || upload_expired())
+    {
+        // Resolve again in case the collector moved.
+        up.ip_expires = millis();
+        upload_fail();
+    }
+}
+
+static void upload_send()
+{
+    EthernetClient client(up.sock);
+
+    client.print(F("PUT / HTTP/1.1\r\n"
+                   "Host: "));
+    client.print(ctx.settings.server_hostname);
+    client.print(':');
+    client.print(ctx.settings.server_port);
+    client.print(F("\r\n"
+                   "Content-Type: application/json\r\n"
+                   "Transfer-Encoding: chunked\r\n"
+                   "\r\n"));
+
+    // This must be sent as chunked!
+    #ifdef PANNAN_QUEUE
+    // With only the latest reading in the queue it's sent as usual.
+    uint8_t batch = min(queue_count(), UPLOAD_BATCH_MAX);
+
+    up.batch_end = queue_seq(batch);
+
+    if (batch > 1)
+    {
+        print_http_batch_json(client, batch);
+    }
+    else
+    #endif // PANNAN_QUEUE
+    {
+        print_http_request_json(client);
+    }
+    client.print(FS(HTTP_CHUNK_END));
+
+    up.keep_alive = 1;
+    up.content_length = -1;
+    up.line_len = 0;
+    upload_step(UPLOAD_STATUS, UPLOAD_RESPONSE_TIMEOUT);
+}
+
+#define IF_HEADER(line, name) \
+    if (!strncasecmp(line, name, sizeof(name) - 1))
+
+static void upload_header(char *line)
+{
+    IF_HEADER(line, "Content-Length:")
+    {
+        up.content_length = atol(line + sizeof("Content-Length:") - 1);
+    }
+
+    IF_HEADER(line, "Connection: close")
+    {
+        up.keep_alive = 0;
+    }
+
+    // Anything else than a Content-Length framed body has to be
+    // read until the server closes the connection.
+    IF_HEADER(line, "Transfer-Encoding:")
+    {
+        up.keep_alive = 0;
+    }
+}
+
+//
+// Reads the status line and headers one line at a time, only the
+// start of each line is kept since that's all that is needed.
+//
+static void upload_response()
+{
+    EthernetClient client(up.sock);
+
+    while (client.available())
+    {
+        char c = client.read();
+
+        if (c != '\n')
+        {
+            if ((c != '\r') && (up.line_len < (sizeof(up.line) - 1)))
+                up.line[up.line_len++] = c;
+            continue;
+        }
+
+        up.line[up.line_len] = 0;
+
+        if (up.state == UPLOAD_STATUS)
+        {
+            up.status = get_http_status_code(up.line, up.line_len);
+            up.state = UPLOAD_HEADERS;
+        }
+        else if (up.line_len)
+        {
+            upload_header(up.line);
+        }
+        else
+        {
+            // Blank line, end of headers.
+            if (up.content_length < 0)
+                up.keep_alive = 0;
+
+            up.state = UPLOAD_BODY;
+            break;
+        }
+
+        up.line_len = 0;
+    }
+
+    if (up.state == UPLOAD_BODY)
+    {
+        // Skip the body, without a length it ends when the server closes.
+        while ((up.content_length != 0) && client.available())
+        {
+            client.read();
+
+            if (up.content_length > 0)
+                up.content_length--;
+        }
+
+        if ((up.content_length == 0)
+         || (!up.keep_alive && !client.connected()))
+        {
+            upload_done(up.status);
+            return;
+        }
+    }
+
+    if (upload_expired() || !client.connected())
+    {
+        upload_fail();
+    }
+}
+
+static void upload_close()
+{
+    if ((net_close_poll(up.sock) == NET_OK) || upload_expired())
+    {
+        net_close(up.sock);
+        up.sock = NET_NO_SOCKET;
+        up.state = UPLOAD_IDLE;
+    }
+}
+
+void feed_client()
+{
+    switch (up.state)
+    {
+        case UPLOAD_IDLE:
+            if ((long)(millis() - up.next) >= 0)
+                upload_start();
+            break;
+        case UPLOAD_RESOLVE: upload_resolve();  break;
+        case UPLOAD_CONNECT: upload_connect();  break;
+        case UPLOAD_SEND:    upload_send();     break;
+        case UPLOAD_STATUS:
+        case UPLOAD_HEADERS:
+        case UPLOAD_BODY:    upload_response(); break;
+        case UPLOAD_CLOSE:   upload_close();    break;
+    }
+}
+#endif // PANNAN_CLIENT
+
+#ifdef PANNAN_SERVER
+
+#define SHTML(str) c.print(F(str))
+
+//
+// Strings used by more than one reply are only stored once in flash,
+// since every F() string is a copy of its own.
+//
+const char HTML_OK[] PROGMEM = "200 OK";
+const char HTML_BAD_REQUEST[] PROGMEM = "400 Bad request";
+const char HTML_NOT_FOUND[] PROGMEM = "404 Not Found";
+const char HTML_CONTENT_TYPE[] PROGMEM = "text/html; charset=utf-8";
+const char HTML_JSON_TYPE[] PROGMEM = "application/json";
+
+const char HTML_BODY_START[] PROGMEM = 
+    "<html>"
+    "<link rel='stylesheet' href='https://maxcdn.bootstrapcdn.com/bootstrap/3.3.6/css/bootstrap.min.css'>"
+    "<body>";
+
+const char HTML_BODY_END[] PROGMEM =
+    "</body>"
+    "</html>";
+
+// The status and content type are in flash.
+void send_http_response_header(Print &c,
+                            const char *status = HTML_OK,
+                            const char *content_type = HTML_CONTENT_TYPE,
+                            int end = 1)
+{
+  SHTML("HTTP/1.1 ");
+  c.println(FS(status));
+  SHTML("Content-Type: ");
+  c.println(FS(content_type));
+  if (end) c.println();
+}
+
+void server_error_reply(Print &c, const char *status)
+{
+    send_http_response_header(c, status);
+    SHTML("<html>");
+    c.print(FS(status));
+    SHTML("</html>");
+}
+
+void server_404_reply(Print &c)
+{
+    server_error_reply(c, HTML_NOT_FOUND);
+}
+
+#define IF_PARAM(s, param)                      \
+    if (!strncmp(s, param, sizeof(param) - 1)   \
+        && (s += (sizeof(param) - 1)))
+
+//
+// Returns the next comma separated value in a query parameter
+// and advances the string past it, or NULL when there are no more.
+//
+char *server_next_value(char **s)
+{
+    char *value = *s;
+
+    if (!value || !*value)
+        return NULL;
+
+    while (**s && (**s != ','))
+        (*s)++;
+
+    if (**s)
+        *(*s)++ = 0;
+
+    return value;
+}
+
+//
+// Parses the /json query string, for example:
+//   /json?i=0,3&addr=28FF4B6B1604008E&name=flue&fields=name,temp
+// Sensors can be picked by index, address or name, if none is given
+// all sensors are included. Fields default to all of them.
+//
+void server_parse_json_filter(char *query, JsonFilter *f)
+{
+    char *s;
+    char *v;
+    char delimit[] = "&";
+    char addr[SENSOR_ADDR_SIZE];
+
+    memset(f, 0, sizeof(*f));
+    f->fields = JSON_FIELD_ALL;
+
+    s = strtok(query, delimit);
+
+    while (s)
+    {
+        IF_PARAM(s, "i=")
+        {
+            while ((v = server_next_value(&s)))
+            {
+                int i = atoi(v);
+                if ((i >= 0) && (i < ctx.count))
+                    FILTER_ADD_SENSOR(f, i);
+                f->has_sensors = 1;
+            }
+        }
+
+        IF_PARAM(s, "addr=")
+        {
+            while ((v = server_next_value(&s)))
+            {
+                for (int i = 0; i < ctx.count; i++)
+                {
+                    if (!strcasecmp(v, get_address_str(addr, ctx.temps[i].addr)))
+                        FILTER_ADD_SENSOR(f, i);
+                }
+                f->has_sensors = 1;
+            }
+        }
+
+        IF_PARAM(s, "name=")
+        {
+            while ((v = server_next_value(&s)))
+            {
+                for (char *it = v; *it; it++)
+                {
+                    if (*it == '+')
+                        *it = ' ';
+                }
+
+                for (int i = 0; i < ctx.count; i++)
+                {
+                    if (!strcmp(v, ctx.temps[i].name))
+                        FILTER_ADD_SENSOR(f, i);
+                }
+                f->has_sensors = 1;
+            }
+        }
+
+        IF_PARAM(s, "fields=")
+        {
+            f->fields = 0;
+
+            while ((v = server_next_value(&s)))
+            {
+                if (!strcmp(v, "name"))         f->fields |= JSON_FIELD_NAME;
+                else if (!strcmp(v, "index"))   f->fields |= JSON_FIELD_INDEX;
+                else if (!strcmp(v, "addr"))    f->fields |= JSON_FIELD_ADDR;
+                else if (!strcmp(v, "temp"))    f->fields |= JSON_FIELD_TEMP;
+                else if (!strcmp(v, "mv"))      f->fields |= JSON_FIELD_MV;
+                else if (!strcmp(v, "ambient")) f->fields |= JSON_FIELD_AMBIENT;
+                else if (!strcmp(v, "time"))    f->fields |= JSON_FIELD_TIME;
+            }
+        }
+
+        s = strtok(NULL, delimit);
+    }
+}
+
+void server_json_reply(Print &c, char *url)
+{
+    JsonFilter filter;
+    char *query = strchr(url, '?');
+
+    if (query)
+    {
+        server_parse_json_filter(query + 1, &filter);
+    }
+
+    send_http_response_header(c, HTML_OK, HTML_JSON_TYPE, 0);
+    c.println(F("Transfer-Encoding: chunked"));
+    c.println();
+    print_http_request_json(c, query ? &filter : NULL);
+    c.print(FS(HTTP_CHUNK_END));
+}
+
+#ifdef PANNAN_METRICS
+void server_metrics_reply(Print &c, char *url)
+{
+    static const char type[] PROGMEM = "text/plain; version=0.0.4";
+    send_http_response_header(c, HTML_OK, type);
+    metrics_print(c, &ctx);
+}
+#endif // PANNAN_METRICS
+
+#ifdef PANNAN_PROFILE
+void server_profile_reply(Print &c, char *url)
+{
+    send_http_response_header(c, HTML_OK, HTML_JSON_TYPE);
+    profile_print(c);
+
+    if (!strcmp(url, "?clear"))
+        profile_clear();
+}
+#endif // PANNAN_PROFILE
+
+#ifdef PANNAN_HISTORY
+void server_history_reply(Print &c, char *url)
+{
+    uint32_t since = 0;
+    char *s = strstr(url, "since=");
+
+    if (s)
+    {
+        since = strtoul(s + 6, NULL, 10);
+    }
+
+    send_http_response_header(c, HTML_OK, HTML_JSON_TYPE);
+    history_print_json(c, since);
+}
+#endif // PANNAN_HISTORY
+
+void server_home_reply(Print &c, char *url)
+{
+    TempSensor *s;
+    char str_temp[TEMP_STR_SIZE];
+
+    send_http_response_header(c, HTML_OK, HTML_CONTENT_TYPE, 0);
+    c.println(F("Refresh: 10"));    
+    c.println();
+    c.println(FS(HTML_BODY_START));
+    SHTML("<div class='container'>");
+
+    for (int i = 0; i < ctx.count; i++)
+    {
+        s = &ctx.temps[i];
+        SHTML("<div class='row'><div class='col-md-1'><strong>");
+        c.print(s->name);
+        SHTML("</strong></div><div class='col-md-1'>");
+        if (s->temp == DEVICE_DISCONNECTED_C)
+        {
+            strcpy(str_temp, "-");
+        }
+        else
+        {
+            temp2buf(str_temp, NULL, s->temp);
+        }
+        c.print(str_temp);
+        SHTML("C</div></div><br>");
+    }
+
+    SHTML("</div>");
+    c.println(FS(HTML_BODY_END));
+}
+
+#ifdef PANNAN_NAME_SUPPORT
+
+const char TD_STARTEND[] PROGMEM = "</td><td>";
+const char TD_TR[] PROGMEM = "</td></tr>";
+const char INPUT_INDEX[] PROGMEM = "<input type='hidden' name='i' value='";
+
+void server_names_form_reply(Print &c, char *url)
 {
     TempSensor *s;
     send_http_response_header(c);
@@ -622,8 +1146,8 @@ void server_names_form_reply(Print &c, char *url)
         c.print(s->name);
         c.println(FS(TD_STARTEND));
         SHTML("<form action='editname' method='get'>"
-              "<input class='btn btn-link' type='submit' value='Edit' />"
-              "<input type='hidden' name='i' value='");
+              "<input class='btn btn-link' type='submit' value='Edit' />");
+        c.print(FS(INPUT_INDEX));
         c.print(i);
         SHTML("'/></form></td></tr>");
     }
@@ -633,12 +1157,6 @@ void server_names_form_reply(Print &c, char *url)
     c.println(FS(HTML_BODY_END));
 }
 
-#define IF_PARAM(s, param)                      \
-    if (!strncmp(s, param, sizeof(param) - 1)   \
-        && (s += (sizeof(param) - 1)))
-
-const char TD_TR[] PROGMEM = "</td><tr>";
-
 void server_editname_form_reply(Print &c, char *url)
 {
     int i = -1;
@@ -688,246 +1206,414 @@ void server_editname_form_reply(Print &c, char *url)
     SHTML("'>");
     c.println(FS(TD_TR));
 
-    SHTML("</table>"
-          "<br/>"
-          "<input class='btn btn-primary' type='submit' value='Save'>"
-          "<a class='btn btn-link' href='/names'>Cancel</a>"
-          "<input type='hidden' name='i' value='");
-    c.print(i);
-    SHTML("'/>"
-          "</form>");
-    c.println(FS(HTML_BODY_END));
+    SHTML("</table>"
+          "<br/>"
+          "<input class='btn btn-primary' type='submit' value='Save'>"
+          "<a class='btn btn-link' href='/names'>Cancel</a>");
+    c.print(FS(INPUT_INDEX));
+    c.print(i);
+    SHTML("'/>"
+          "</form>");
+    c.println(FS(HTML_BODY_END));
+}
+
+void server_setname_reply(Print &c, char *url, char *post)
+{
+    int i = -1;
+    char name[MAX_NAME_LEN] = { 0 };
+    {
+        char *s;
+        char delimit[] = "&\n";
+        s = strtok(post, delimit);
+
+        while (s)
+        {
+            IF_PARAM(s, "i=")
+            {
+                i = atoi(s);
+            }
+
+            IF_PARAM(s, "name=")
+            {
+                char *it = s;
+                while (*it)
+                {
+                    if (*it == '+')
+                        *it = ' ';
+                    it++;
+                }
+                strncpy(name, s, sizeof(name) - 1);
+            }
+
+            s = strtok(NULL, delimit);
+        }
+    }
+
+    if ((i < 0) || (i >= ctx.count) || (strlen(name) <= 0))
+    {
+        server_error_reply(c, HTML_BAD_REQUEST);
+        return;
+    }
+
+    TempSensor *s = &ctx.temps[i];
+    strcpy(s->name, name);
+    eeprom_add_name(s->addr, name);
+
+    static const char see_other[] PROGMEM = "303 See other";
+    send_http_response_header(c, see_other, HTML_CONTENT_TYPE, 0);
+    SHTML("Location: /names");
+    c.println();
+}
+#endif // PANNAN_NAME_SUPPORT
+
+char *server_get_query_string(int i, char *buf, int bufsize)
+{
+    char *url = &buf[i];
+    while ((i < (bufsize - 1)) && buf[i] != ' ' && buf[i] != '\n')
+        i++;
+    buf[i] = 0;
+
+    return url;
+}
+
+// Must fit the request line including any query string.
+#define SERVER_LINE_SIZE 64
+
+// A client that has not sent the whole request header by then is closed.
+#define SERVER_HEADER_TIMEOUT 2000
+
+// How long a replied connection may take to close before it is forced.
+#define SERVER_CLOSE_TIMEOUT 1000
+
+// Requests that are read at the same time, each with its own line buffer.
+// Further connections wait in the W5100 until a slot is free.
+#ifndef SERVER_SLOTS
+#define SERVER_SLOTS 2
+#endif
+
+typedef enum server_state_e
+{
+    SERVER_FREE,
+    SERVER_HEADER,      // Reading the request header.
+    SERVER_CLOSING      // Replied, waiting for the connection to close.
+} server_state_t;
+
+//
+// One connection being served. Only what available() returns is read each
+// run, so a slow client can't hold up the loop, and the position in
+// the header is kept here until the next run.
+//
+typedef struct ServerSlot
+{
+    uint8_t state;
+    uint8_t sock;
+    uint8_t len;            // Bytes in line.
+    boolean blank_line;     // A HTTP request ends with a blank line.
+    unsigned long deadline;
+    char line[SERVER_LINE_SIZE];
+} ServerSlot;
+
+static ServerSlot server_slots[SERVER_SLOTS];
+
+static void server_request(EthernetClient &sclient, char *buf)
+{
+    char *url = NULL;
+    typedef enum method_type_e
+    {
+        UNSUPPORTED,
+        GET,
+        POST
+    } method_type_t;
+    method_type_t method = UNSUPPORTED;
+
+    arena_reset();
+
+    // Find the URL.
+    for (int i = 0; i < SERVER_LINE_SIZE; i++)
+    {
+        if (!strncmp(&buf[i], "GET ", 4))
+        {
+            i += 4;
+            url = server_get_query_string(i, buf, SERVER_LINE_SIZE);
+            method = GET;
+        }
+        else if (!strncmp(&buf[i], "POST ", 5))
+        {
+            i += 5;
+            url = server_get_query_string(i, buf, SERVER_LINE_SIZE);
+            method = POST;
+        }
+    }
+
+    // One line per request, not each byte as it comes in.
+    if (method != UNSUPPORTED)
+    {
+        LOG_DEBUG.print((method == GET) ? F("GET ") : F("POST "));
+        LOG_DEBUG.println(url);
+    }
+
+    if (method == GET)
+    {
+        if (!strcmp(url, "/"))
+        {
+            server_home_reply(sclient, url + 1);
+        }
+        else if (!strncmp(url, "/json", 5))
+        {
+            server_json_reply(sclient, url);
+        }
+        #ifdef PANNAN_METRICS
+        else if (!strcmp(url, "/metrics"))
+        {
+            server_metrics_reply(sclient, url);
+        }
+        #endif // PANNAN_METRICS
+        #ifdef PANNAN_PROFILE
+        else if (!strncmp(url, "/profile", 8))
+        {
+            server_profile_reply(sclient, url + 8);
+        }
+        #endif // PANNAN_PROFILE
+        #ifdef PANNAN_HISTORY
+        else if (!strncmp(url, "/history", 8))
+        {
+            server_history_reply(sclient, url + 8);
+        }
+        #endif // PANNAN_HISTORY
+        #ifdef PANNAN_NAME_SUPPORT
+        else if (!strncmp(url, "/names", 6))
+        {
+            server_names_form_reply(sclient, url + 6);
+        }
+        else if (!strncmp(url, "/editname?", 10))
+        {
+            server_editname_form_reply(sclient, url + 10);
+        }
+        #endif // PANNAN_NAME_SUPPORT
+        else
+        {
+            server_404_reply(sclient);
+        }
+    }
+    #ifdef PANNAN_NAME_SUPPORT
+    else if (method == POST)
+    {
+        char *post;
+        int j = 0;
+
+        // The body is read into the same buffer as the URL.
+        if (!(url = arena_strdup(url)))
+        {
+            LOG_WARN.println(F("URL too long"));
+            server_404_reply(sclient);
+            return;
+        }
+
+        while (sclient.available())
+        {
+            char c = sclient.read();
+
+            if (j < SERVER_LINE_SIZE)
+                buf[j++] = c;
+        }
+
+        // The body has no newline, so end it where the
+        // request line that is still in buf would go on.
+        if (j < SERVER_LINE_SIZE)
+            buf[j] = '\n';
+
+        post = server_get_query_string(0, buf, SERVER_LINE_SIZE);
+        LOG_DEBUG.print(F("Post: "));
+        LOG_DEBUG.println(post);
+
+        if (!strncmp(url, "/setname", 8))
+        {
+            server_setname_reply(sclient, url + 8, post);
+        }
+    }
+    #endif // PANNAN_NAME_SUPPORT
+    else
+    {
+        //server_unsupported_reply(sclient);
+    }
+}
+
+static void server_close(ServerSlot *s)
+{
+    net_close_start(s->sock);
+    s->state = SERVER_CLOSING;
+    s->deadline = millis() + SERVER_CLOSE_TIMEOUT;
 }
 
-void server_setname_reply(Print &c, char *url, char *post)
+static void server_feed_slot(ServerSlot *s)
 {
-    int i = -1;
-    char name[MAX_NAME_LEN] = { 0 };
+    uint8_t status = socketStatus(s->sock);
+
+    // Taken by someone else, who might not have cleared the port.
+    if (EthernetClass::_server_port[s->sock] != SERVER_PORT)
     {
-        char *s;
-        char delimit[] = "&\n";
-        s = strtok(post, delimit);
+        s->state = SERVER_FREE;
+        return;
+    }
 
-        while (s)
+    if (s->state == SERVER_CLOSING)
+    {
+        if (net_close_poll(s->sock) == NET_OK)
         {
-            IF_PARAM(s, "i=")
-            {
-                i = atoi(s);
-            }
+            s->state = SERVER_FREE;
+            return;
+        }
 
-            IF_PARAM(s, "name=")
-            {
-                char *it = s;
-                while (*it)
+        switch (status)
+        {
+            case SnSR::FIN_WAIT:
+            case SnSR::CLOSING:
+            case SnSR::TIME_WAIT:
+            case SnSR::LAST_ACK:
+                if ((long)(millis() - s->deadline) >= 0)
                 {
-                    if (*it == '+')
-                        *it = ' ';
-                    it++;
+                    net_close(s->sock);
+                    s->state = SERVER_FREE;
                 }
-                strncpy(name, s, sizeof(name) - 1);
-            }
-
-            s = strtok(NULL, delimit);
+                break;
+            default:
+                // Already in use again, a UDP socket or a new
+                // connection, which must not be closed.
+                s->state = SERVER_FREE;
+                break;
         }
+        return;
     }
 
-    if ((i < 0) || (i >= ctx.count) || (strlen(name) <= 0))
+    if ((status != SnSR::ESTABLISHED) && (status != SnSR::CLOSE_WAIT))
     {
-        //Serial.println(F("Invalid params setname"));
-        send_http_response_header(c, "400 Bad request");
-        SHTML("<html>400 Bad request</html>");
+        s->state = SERVER_FREE;
         return;
     }
 
-    TempSensor *s = &ctx.temps[i];
-    strcpy(s->name, name);
-    eeprom_add_name(s->addr, name);
+    EthernetClient sclient(s->sock);
+    int n = sclient.available();
 
-    send_http_response_header(c, "303 See other", HTML_CONTENT_TYPE, 0);
-    SHTML("Location: /names");
-    c.println();
-}
-#endif // PANNAN_NAME_SUPPORT
+    while (n-- > 0)
+    {
+        char c = sclient.read();
 
-char *server_get_query_string(int i, char *buf, int bufsize)
-{
-    char *url = &buf[i];
-    while ((i < (bufsize - 1)) && buf[i] != ' ' && buf[i] != '\n')
-        i++;
-    buf[i] = 0;
+        if (s->len < sizeof(s->line))
+            s->line[s->len++] = c;
 
-    return url;
+        // if we've gotten to the end of the line (received a newline
+        // character) and the line is blank, the http request has ended,
+        // so we can send a reply
+        if (c == '\n' && s->blank_line)
+        {
+            // The rest of the buffer from an earlier request
+            // must not be taken for this one.
+            memset(&s->line[s->len], 0, sizeof(s->line) - s->len);
+            server_request(sclient, s->line);
+            server_close(s);
+            return;
+        }
+
+        if (c == '\n')
+        {
+            // you're starting a new line
+            s->blank_line = true;
+        }
+        else if (c != '\r')
+        {
+            // you've gotten a character on the current line
+            s->blank_line = false;
+        }
+    }
+
+    if ((status == SnSR::CLOSE_WAIT) && !sclient.available())
+    {
+        // The client gave up before the end of the header.
+        server_close(s);
+    }
+    else if ((long)(millis() - s->deadline) >= 0)
+    {
+        LOG_DEBUG.println(F("Header timeout"));
+        server_close(s);
+    }
 }
 
 void feed_server()
 {
-    EthernetClient sclient = server.available();
+    uint8_t sock;
+    uint8_t i;
+    ServerSlot *free_slot = NULL;
+    uint8_t served = 0;
 
-    if (sclient)
+    for (i = 0; i < SERVER_SLOTS; i++)
     {
-        char buf[32];
-        char *url = NULL;
-        int j = 0;
-        typedef enum method_type_e
+        ServerSlot *s = &server_slots[i];
+
+        if (s->state != SERVER_FREE)
+            server_feed_slot(s);
+
+        if (s->state == SERVER_FREE)
         {
-            UNSUPPORTED,
-            GET,
-            POST
-        } method_type_t;
-        method_type_t method = UNSUPPORTED;
+            if (!free_slot)
+                free_slot = s;
+        }
+        else
+        {
+            served |= (1 << s->sock);
+        }
+    }
 
-        //Serial.println(F("New client"));
+    // Keeps a socket listening, the client it returns is
+    // picked up below along with any other new connection.
+    server.available();
 
-        // A HTTP request ends with a blank line.
-        boolean blank_line = true;
+    for (sock = 0; free_slot && (sock < MAX_SOCK_NUM); sock++)
+    {
+        uint8_t status;
 
-        while (sclient.connected())
-        {
-            if (sclient.available())
-            {
-                char c = sclient.read();
-                Serial.write(c);
+        if ((served & (1 << sock))
+         || (EthernetClass::_server_port[sock] != SERVER_PORT))
+            continue;
 
-                if (j < sizeof(buf))
-                    buf[j++] = c;
+        status = socketStatus(sock);
 
-                // if we've gotten to the end of the line (received a newline
-                // character) and the line is blank, the http request has ended,
-                // so we can send a reply
-                if (c == '\n' && blank_line)
-                {
-                    // Find the URL.
-                    for (int i = 0; i < sizeof(buf); i++)
-                    {
-                        if (!strncmp(&buf[i], "GET ", 4))
-                        {
-                            i += 4;
-                            url = server_get_query_string(i, buf, sizeof(buf));
-                            method = GET;
-                        }
-                        else if (!strncmp(&buf[i], "POST ", 5))
-                        {
-                            i += 5;
-                            url = server_get_query_string(i, buf, sizeof(buf));
-                            method = POST;
-                        }
-                    }
-
-                    if (method == GET)
-                    {
-                        if (!strcmp(url, "/"))
-                        {
-                            server_home_reply(sclient, url + 1);
-                        }
-                        else if (!strncmp(url, "/json", 5))
-                        {
-                            server_json_reply(sclient, url);
-                        }
-                        #ifdef PANNAN_NAME_SUPPORT
-                        else if (!strncmp(url, "/names", 6))
-                        {
-                            server_names_form_reply(sclient, url + 6);
-                        }
-                        else if (!strncmp(url, "/editname?", 10))
-                        {
-                            server_editname_form_reply(sclient, url + 10);
-                        }
-                        #endif // PANNAN_NAME_SUPPORT
-                        else
-                        {
-                            server_404_reply(sclient);
-                        }
-                    }
-                    #ifdef PANNAN_NAME_SUPPORT
-                    else if (method == POST)
-                    {
-                        char *post;
-                        // TODO: Get rid of this...
-                        url = strdup(url);
-                        j = 0;
-                        while (sclient.available())
-                        {
-                            c = sclient.read();
-                            Serial.write(c);
-
-                            if (j < sizeof(buf))
-                                buf[j++] = c;
-                        }
-
-                        post = server_get_query_string(0, buf, sizeof(buf));
-                        Serial.print(F("\nPost:"));
-                        Serial.println(post);
-
-                        if (!strncmp(url, "/setname", 8))
-                        {
-                            server_setname_reply(sclient, url + 8, post);
-                        }
-                        free(url);
-                        goto end;
-                    }
-                    #endif // PANNAN_NAME_SUPPORT
-                    else
-                    {
-                        //server_unsupported_reply(sclient);
-                        goto end;
-                    }
-
-                    break;
-                }
+        if ((status != SnSR::ESTABLISHED) && (status != SnSR::CLOSE_WAIT))
+            continue;
 
-                if (c == '\n')
-                {
-                    // you're starting a new line
-                    blank_line = true;
-                }
-                else if (c != '\r')
-                {
-                    // you've gotten a character on the current line
-                    blank_line = false;
-                }
+        free_slot->state = SERVER_HEADER;
+        free_slot->sock = sock;
+        free_slot->len = 0;
+        free_slot->blank_line = true;
+        free_slot->deadline = millis() + SERVER_HEADER_TIMEOUT;
+        served |= (1 << sock);
+
+        // The request is read on the next run.
+        free_slot = NULL;
+        for (i = 0; i < SERVER_SLOTS; i++)
+        {
+            if (server_slots[i].state == SERVER_FREE)
+            {
+                free_slot = &server_slots[i];
+                break;
             }
         }
-    end:
-        // Give the web browser time to receive the data
-        delay(1);
-        sclient.stop();
-        //Serial.println(F("Client disconnected"));
     }
 }
 
 #endif // PANNAN_SERVER
 
 //
-// position 1   2   3   4   5   6   7   8   9   10  11  12  13  14  15  16
-// line 1  128 129 130 131 132 133 134 135 136 137 138 139 140 141 142 143
-// line 2  192 193 194 195 196 197 198 199 200 201 202 203 204 205 206 207
-
-void lcd_clear()
-{
-    lcd.write(254); // Move cursor to beginning of first line.
-    lcd.write(128);
-    lcd.write("                "); // Clear display.
-
-    lcd.write(254); 
-    lcd.write(192);
-    lcd.write("                ");
-
-    lcd.write(254); // move cursor to beginning of first line
-    lcd.write(128);
-}
-
 void print_lcd_started()
 {
     lcd_clear();
-    lcd.write("Started!");
-    lcd.write(254); // move cursor to beginning of first line
-    lcd.write(128);
+    lcd_print(0, 0, F("Started!"));
+    lcd_flush();
     // TODO: Print IP.
 }
 
 void print_lcd_temperature_buf(int i, int line)
 {
-    char str_temp[7];
+    char str_temp[TEMP_STR_SIZE + 1];
     TempSensor *s = &ctx.temps[i];
 
     if ((s->type == SENSOR_DS18B20)
@@ -943,48 +1629,31 @@ void print_lcd_temperature_buf(int i, int line)
     #endif // PANNAN_DS2762
     else
     {
-        dtostrf(s->temp, 2, 2, str_temp);
+        temp2buf(str_temp, NULL, s->temp);
     }
 
-    lcd.write(s->name);
+    lcd_print(line, 0, s->name);
 
     // Right justify temperature.
-    lcd.write(254);
-    if (strlen(str_temp) == 5)
-    {
-        lcd.write((line == 0) ? 138 : 202); // Move to pos 11.
-    }
-    else
-    {
-        lcd.write((line == 0) ? 137 : 201); // Move to pos 10 for >= 100.
-    }
-
-    lcd.write(str_temp);
-    lcd.write("C");
+    strcat(str_temp, "C");
+    lcd_print_right(line, str_temp);
 }
 
 void print_lcd_temperatures()
 {
     int i = lcd_start_index;
-    char str_temp[6];
 
     lcd_clear();
 
-    // Move cursor to beginning of first line.
-    lcd.write(254);
-    lcd.write(128);
-
     print_lcd_temperature_buf(i, 0);
     i++;
 
-    // Move cursor to beginning of second line.
-    lcd.write(254); 
-    lcd.write(192);
-
     if (i < ctx.count)
     {
         print_lcd_temperature_buf(i, 1);
     }
+
+    lcd_flush();
 }
 
 void lcd_do_scroll()
@@ -999,117 +1668,221 @@ void lcd_do_scroll()
     }
 }
 
-void lcd_button_state_change()
+#define LCD_MESSAGE_TIME 1000
+
+//
+// Both buttons together turns scrolling back on, a click on
+// either of them turns it off and steps a page.
+//
+void lcd_button_event(ButtonEvent *e)
 {
-    if (up_button.isPressed() && down_button.isPressed())
+    if (e->type == BUTTON_EVENT_CHORD)
     {
         if (!lcd_scroll_enabled)
         {
             lcd_scroll_enabled = 1;
-            lcd_clear();
-            lcd.println(F("Scroll enabled"));
-            wdt_reset();
-            delay(1000);
-        }    
+            lcd_overlay(F("Scroll enabled"), LCD_MESSAGE_TIME);
+        }
         return;
     }
 
-    if (millis() - lcd_last_page_switch > 500)
+    if (e->type != BUTTON_EVENT_RELEASE)
+        return;
+
+    if (e->buttons == up_button.mask())
     {
-        if (up_button.isPressed())
-        {
-            Serial.println("UP");
-            lcd_start_index -= 2;
-        }
-        else if (down_button.isPressed())
-        {
-            Serial.println("DOWN");
+        LOG_DEBUG.println(F("UP"));
+        lcd_start_index -= 2;
+    }
+    else if (e->buttons == down_button.mask())
+    {
+        LOG_DEBUG.println(F("DOWN"));
 
-            if ((lcd_start_index + 1) < ctx.count)
-                lcd_start_index += 2;
-        }
+        if ((lcd_start_index + 1) < ctx.count)
+            lcd_start_index += 2;
+    }
 
-        if (lcd_scroll_enabled)
-        {
-            lcd.println(F("Scroll disabled"));
-            wdt_reset();
-            delay(1000);
-            lcd_scroll_enabled = 0;
-        }
+    if (lcd_scroll_enabled)
+    {
+        lcd_overlay(F("Scroll disabled"), LCD_MESSAGE_TIME);
+        lcd_scroll_enabled = 0;
+    }
 
-        lcd_start_index = max(0, lcd_start_index);
-        lcd_start_index %= ctx.count;
+    lcd_start_index = max(0, lcd_start_index);
+    lcd_start_index %= ctx.count;
+    lcd_last_page_switch = millis();
 
-        print_lcd_temperatures();
-    }
+    print_lcd_temperatures();
 }
 
 void feed_lcd()
 {
+    ButtonEvent e;
+
+    // Does nothing unless a button has changed or is held.
+    Button::update();
+
+    while (Button::getEvent(&e))
+    {
+        lcd_button_event(&e);
+    }
+
     if (lcd_scroll_enabled)
     {
         lcd_do_scroll();
     }
 
-    if (up_button.isPressed() || down_button.isPressed())
+    // Sends the overlay changes, and what did not fit in the queue last time.
+    lcd_flush();
+}
+
+//
+// A sweep is done in small steps so that no task run waits for the
+// conversions. start_temp_sensors() only starts a sweep, and each run of
+// read_temp_sensors() then takes one step: starting the conversion of
+// one DS18B20, or once they have had the time to convert, reading one
+// sensor back.
+//
+#define CONVERSION_MS (750 >> (12 - TEMPERATURE_PRECISION))
+
+typedef enum sweep_state_e
+{
+    SWEEP_IDLE,
+    SWEEP_START,        // Starting the conversions, one sensor per run.
+    SWEEP_CONVERT,      // Waiting for the conversions to finish.
+    SWEEP_READ          // Reading the sensors back, one per run.
+} sweep_state_t;
+
+static sweep_state_t sweep_state;
+static uint8_t sweep_index;
+static unsigned long sweep_ready;       // When the last conversion is done.
+
+void start_temp_sensors()
+{
+    LOG_DEBUG.println();
+
+    sweep_index = 0;
+    sweep_ready = millis();
+    sweep_state = SWEEP_START;
+}
+
+static void read_temp_sensor(int i)
+{
+    TempSensor *s = &ctx.temps[i];
+    #ifdef PANNAN_METRICS
+    unsigned long start = micros();
+    #endif
+
+    if (s->type == SENSOR_DS18B20)
+    {
+        PROFILE_BEGIN(profile_start);
+        s->temp = sensors.getTempC(s->addr);
+        PROFILE_END(PROFILE_DS18B20, profile_start);
+    }
+    else
     {
-        lcd_button_state_change();
+        #ifdef PANNAN_DS2762
+        PROFILE_BEGIN(profile_start);
+        DS2762 ds(&oneWire, s->addr);
+        // Each raw value count equals 15.625 microVolt.
+        int16_t current = ds.readCurrentRaw();
+        s->microvolts = current;
+
+        // Each raw value count equals 0.125C,
+        // the conversion wants it x1000.
+        int16_t ambient_temp = ds.readTempRaw();
+        s->ambient_temp = ambient_temp * 0.125;
+
+        long raw_temp = thermo_convert((long)current * 125 / 8,
+                                       (long)ambient_temp * 125);
+
+        s->temp = raw_temp / 1000.0;
+        PROFILE_END(PROFILE_DS2762, profile_start);
+        #endif // PANNAN_DS2762
     }
+
+    #ifdef PANNAN_SNTP
+    s->time = millis();
+    #endif
+
+    #ifdef PANNAN_METRICS
+    metrics_sensor_read(i, micros() - start,
+                        s->temp == DEVICE_DISCONNECTED_C);
+    #endif
+
+    #ifdef PANNAN_MQTT
+    mqtt_sensor_updated(&ctx, i);
+    #endif
+
+    if (LOG_ENABLED(LOG_LEVEL_DEBUG))
+        print_sensor(logger, i, s, 0, 1);
 }
 
-void read_temp_sensors()
+// Not static, and not inlined into its one caller, so that the
+// simulator can find where a sweep ends.
+void __attribute__((noinline)) sweep_done()
 {
-    if ((millis() - last_temp_read) > READ_DELAY)
-    {
-        TempSensor *s;
+    last_temp_read = millis();
 
-        Serial.println();
+    #ifdef PANNAN_HISTORY
+    history_record(ctx.temps, ctx.count, last_temp_read);
+    #endif
 
-        // We request the temperature by address to each
-        // sensor individually instead of using sensors.requestTemperatures()
-        // since we have a sensor that is not DS18B20 on the bus.
-        for (int i = 0; i < ctx.count; i++)
-        {
-            s = &ctx.temps[i];
+    #ifdef PANNAN_QUEUE
+    queue_push(last_temp_read, ctx.temps);
+    #endif
+
+    #ifdef PANNAN_TELEMETRY
+    telemetry_sweep(last_temp_read);
+    #endif
+
+    #ifdef PANNAN_MODBUS
+    modbus_sweep(last_temp_read);
+    #endif
+
+    print_lcd_temperatures();
+}
 
-            if (s->type == SENSOR_DS18B20)
+void read_temp_sensors()
+{
+    switch (sweep_state)
+    {
+        case SWEEP_IDLE:
+            break;
+        case SWEEP_START:
+            // We request the temperature by address to each
+            // sensor individually instead of using sensors.requestTemperatures()
+            // since we have a sensor that is not DS18B20 on the bus.
+            while ((sweep_index < ctx.count)
+                && (ctx.temps[sweep_index].type != SENSOR_DS18B20))
             {
-                sensors.requestTemperaturesByAddress(s->addr);
-                s->temp = sensors.getTempC(s->addr);
+                sweep_index++;
             }
-            else
+
+            if (sweep_index < ctx.count)
             {
-                #ifdef PANNAN_DS2762
-                DS2762 ds(&oneWire, s->addr);
-                // Each raw value count equals 15.625 microVolt,
-                // we want it in millivolts.
-                s->microvolts = ds.readCurrentRaw();
-
-                // Each raw value count equals 0.125C, 
-                // The thermocouple lib wants it x1000.
-                // So 0.125*1000 = 125.
-                int16_t ambient_temp = ds.readTempRaw();
-                s->ambient_temp = ambient_temp * 0.125;
-
-                //Serial.print(" Current: ");
-                //Serial.print(current);
-                //Serial.print("mV Ambient temp: ");
-                //Serial.println(ambient_temp);
-                long raw_temp = thermocoupleConvertWithCJCompensation(
-                                    (unsigned long)ds.readCurrentRaw() * 15.625,
-                                    ambient_temp * 125ul);
-
-                s->temp = (double)raw_temp / 1000;
-                #endif // PANNAN_DS2762
+                sensors.requestTemperaturesByAddress(ctx.temps[sweep_index++].addr);
+                sweep_ready = millis() + CONVERSION_MS;
+                break;
             }
 
-            print_sensor(i, s, 0, 1);
-            delay(10);
-        }
-
-        last_temp_read = millis();
+            sweep_index = 0;
+            sweep_state = SWEEP_CONVERT;
+            break;
+        case SWEEP_CONVERT:
+            if ((long)(millis() - sweep_ready) >= 0)
+                sweep_state = SWEEP_READ;
+            break;
+        case SWEEP_READ:
+            if (sweep_index < ctx.count)
+            {
+                read_temp_sensor(sweep_index++);
+                break;
+            }
 
-        print_lcd_temperatures();
+            sweep_state = SWEEP_IDLE;
+            sweep_done();
+            break;
     }
 }
 
@@ -1122,23 +1895,182 @@ void init_default_settings()
     ctx.settings.http_request_delay = HTTP_REQUEST_DELAY_DEFAULT;
     ctx.settings.http_client_enabled = 1;
     #endif // PANNAN_CLIENT
+
+    #ifdef PANNAN_TELEMETRY
+    IPAddress ip;
+    net_parse_ip(TELEMETRY_ADDR_DEFAULT, &ip);
+    for (int i = 0; i < 4; i++)
+        ctx.settings.telemetry_ip[i] = ip[i];
+    ctx.settings.telemetry_port = TELEMETRY_PORT_DEFAULT;
+    ctx.settings.telemetry_delay = TELEMETRY_DELAY_DEFAULT;
+    ctx.settings.node_id = mac[sizeof(mac) - 1];
+    #endif // PANNAN_TELEMETRY
+
+    #ifdef PANNAN_MQTT
+    strncpy_P(ctx.settings.mqtt_host,
+              DEFAULT_MQTT_HOST, sizeof(ctx.settings.mqtt_host) - 1);
+    ctx.settings.mqtt_port = MQTT_PORT_DEFAULT;
+    ctx.settings.mqtt_keepalive = MQTT_KEEPALIVE_DEFAULT;
+    ctx.settings.mqtt_qos = MQTT_QOS_DEFAULT;
+    ctx.settings.mqtt_retain = 1;
+    #endif // PANNAN_MQTT
+
+    #ifdef PANNAN_SNTP
+    strncpy_P(ctx.settings.ntp_host,
+              DEFAULT_NTP_HOST, sizeof(ctx.settings.ntp_host) - 1);
+    #endif // PANNAN_SNTP
 }
 
 void print_free_mem()
 {
-    static unsigned long last_free = 0;
+    int unused = mem_stack_unused();
+
+    LOG_DEBUG.print(F("mem: "));
+    LOG_DEBUG.print(mem_free());
+    LOG_DEBUG.print(F(" stack unused: "));
+    LOG_DEBUG.println(unused);
+
+    // The host build has no stack to measure.
+    #ifdef __AVR__
+    if (unused < STACK_LOW_WATER)
+    {
+        LOG_WARN.print(F("Low stack, never used: "));
+        LOG_WARN.println(unused);
+    }
+    #endif
+}
+
+#ifdef PANNAN_PROFILE
+#define SERIAL_LINE_SIZE 16
+
+//
+// Commands on the serial port:
+//   PROFILE        Prints the timing histograms.
+//   PROFILE CLEAR  Prints and then clears them.
+//
+void feed_serial()
+{
+    static char line[SERIAL_LINE_SIZE];
+    static uint8_t len = 0;
 
-    if ((millis() - last_free) > READ_DELAY)
+    while (Serial.available() > 0)
     {
-        Serial.print("mem: ");
-        Serial.println(freeMemory());
-        last_free = millis();
+        char c = Serial.read();
+
+        if (c == '\r')
+            continue;
+
+        if (c != '\n')
+        {
+            if (len < (SERIAL_LINE_SIZE - 1))
+                line[len++] = c;
+            continue;
+        }
+
+        line[len] = 0;
+        len = 0;
+
+        if (!strncmp_P(line, PSTR("PROFILE"), 7))
+        {
+            profile_print(Serial);
+
+            if (!strcmp_P(line + 7, PSTR(" CLEAR")))
+                profile_clear();
+        }
+        else if (line[0])
+        {
+            LOG_WARN.print(F("ERROR Unknown cmd: '"));
+            LOG_WARN.print(line);
+            LOG_WARN.println('\'');
+        }
     }
 }
+#endif // PANNAN_PROFILE
+
+#ifdef PANNAN_TELEMETRY
+void task_telemetry()
+{
+    feed_telemetry(&ctx);
+}
+#endif
+
+#ifdef PANNAN_MQTT
+void task_mqtt()
+{
+    feed_mqtt(&ctx);
+}
+#endif
+
+#ifdef PANNAN_MODBUS
+void task_modbus()
+{
+    feed_modbus(&ctx);
+}
+#endif
+
+#ifdef PANNAN_SNTP
+void task_sntp()
+{
+    feed_sntp(&ctx);
+}
+#endif
+
+const char TASK_SENSORS[] PROGMEM = "sensors";
+const char TASK_SENSOR_IO[] PROGMEM = "sensor_io";
+const char TASK_CLIENT[] PROGMEM = "client";
+const char TASK_SERVER[] PROGMEM = "server";
+const char TASK_TELEMETRY[] PROGMEM = "telemetry";
+const char TASK_MQTT[] PROGMEM = "mqtt";
+const char TASK_MODBUS[] PROGMEM = "modbus";
+const char TASK_SNTP[] PROGMEM = "sntp";
+const char TASK_DHCP[] PROGMEM = "dhcp";
+const char TASK_LCD[] PROGMEM = "lcd";
+const char TASK_MEM[] PROGMEM = "mem";
+const char TASK_SERIAL[] PROGMEM = "serial";
+const char TASK_LOG[] PROGMEM = "log";
+
+//
+// Highest priority first, sampling, then networking, then the LCD.
+// Periods and budgets are in ms.
+//
+Task tasks[] =
+{
+    // A sweep starts every READ_DELAY, the 1-Wire work is done in steps.
+    SCHED_TASK(start_temp_sensors, TASK_SENSORS, READ_DELAY, 1),
+    SCHED_TASK(read_temp_sensors, TASK_SENSOR_IO, 0, 20),
+    #ifdef PANNAN_CLIENT
+    SCHED_TASK(feed_client, TASK_CLIENT, 0, 20),
+    #endif
+    #ifdef PANNAN_SERVER
+    SCHED_TASK(feed_server, TASK_SERVER, 0, 50),
+    #endif
+    #ifdef PANNAN_TELEMETRY
+    SCHED_TASK(task_telemetry, TASK_TELEMETRY, 0, 5),
+    #endif
+    #ifdef PANNAN_MQTT
+    SCHED_TASK(task_mqtt, TASK_MQTT, 0, 10),
+    #endif
+    #ifdef PANNAN_MODBUS
+    SCHED_TASK(task_modbus, TASK_MODBUS, 0, 10),
+    #endif
+    #ifdef PANNAN_SNTP
+    SCHED_TASK(task_sntp, TASK_SNTP, 0, 5),
+    #endif
+    SCHED_TASK(feed_dhcp, TASK_DHCP, 100, 5),
+    SCHED_TASK(feed_lcd, TASK_LCD, 20, 2),
+    SCHED_TASK(print_free_mem, TASK_MEM, READ_DELAY, 20),
+    #ifdef PANNAN_PROFILE
+    SCHED_TASK(feed_serial, TASK_SERIAL, 50, 200),
+    #endif
+    SCHED_TASK(feed_log, TASK_LOG, 0, 1)
+};
 
 void setup()
 {
     wdt_enable(WDTO_4S);
+    #ifdef PANNAN_METRICS
+    metrics_init();
+    #endif
     Serial.begin(9600);
     wdt_reset();
 
@@ -1150,57 +2082,74 @@ void setup()
     init_default_settings();
     wdt_reset();
 
-    Serial.println(F("Serial port active..."));
+    LOG_INFO.println(F("Serial port active..."));
     wdt_reset();
 
-    lcd.begin(9600);
+    // Attach the serial display's RX line to digital pin 3.
+    lcd_init();
+    up_button.attach();
+    down_button.attach();
     delay(500);
     wdt_reset();
-    //Serial.println(F("LCD serial active..."));
 
     prepare_sensors();
+    log_flush();
     wdt_reset();
 
-    //Serial.println(F("Start Ethernet..."));
-    lcd_clear();
-    lcd.write("Getting IP");
+    #ifdef PANNAN_HISTORY
+    history_init(ctx.count, READ_DELAY);
+    #endif
 
-    // Initiate DHCP request for IP.
-    if (Ethernet.begin(mac) == 0)
-    {
-        while (1);
-    }
+    #ifdef PANNAN_QUEUE
+    queue_init(ctx.count);
+    #endif
+
+    // Comes up on the cached lease or the static IP without waiting,
+    // DHCP is done in the background by feed_dhcp().
+    lease_begin(mac);
 
     print_ip(Ethernet.localIP());
+    log_flush();
     wdt_reset();
 
     #ifdef PANNAN_SERVER
     server.begin();
     #endif
+
+    #ifdef PANNAN_MQTT
+    mqtt_init(mac);
+    #endif
+
+    #ifdef PANNAN_MODBUS
+    modbus_begin();
+    #endif
     wdt_reset();
 
     print_lcd_started();
-    delay(1000);
     wdt_reset();
+
+    // From now on the log must never hold up the loop.
+    log_background();
+
+    // The first sweep is done right away.
+    sched_start(tasks, sizeof(tasks) / sizeof(tasks[0]));
 }
 
 void loop()
 {
-    wdt_reset();
+    #ifdef PANNAN_METRICS
+    unsigned long loop_start = micros();
+    #endif
 
-    feed_lcd();
+    PROFILE_BEGIN(profile_start);
 
-    read_temp_sensors();
+    wdt_reset();
 
-    #ifdef PANNAN_CLIENT
-    feed_client();
-    #endif // PANNAN_CLIENT
+    sched_run();
 
-    // Server.
-    #ifdef PANNAN_SERVER
-    feed_server();
-    #endif // PANNAN_SERVER
+    PROFILE_END(PROFILE_LOOP, profile_start);
 
-    feed_dhcp();
-    print_free_mem();
+    #ifdef PANNAN_METRICS
+    metrics_loop(micros() - loop_start);
+    #endif
 }
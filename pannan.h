@@ -4,9 +4,20 @@
 
 #include <DallasTemperature.h>
 
+#ifndef MAX_TEMP_SENSORS
 #define MAX_TEMP_SENSORS 14 // TODO: To raise this, read from eeprom value by value instead.
+#endif
 #define MAX_NAME_LEN 10
 
+//
+// Compact fixed point temperature, in 1/16 degrees C which is the
+// resolution of the DS18B20. Fits -2048 to +2047 C.
+//
+#define TEMP_FIXED_SCALE 16
+typedef int16_t temp_fixed_t;
+
+#define temp_to_fixed(t) ((temp_fixed_t)((t) * TEMP_FIXED_SCALE))
+
 #define member_size(type, member) sizeof(((type *)0)->member)
 
 typedef enum sensor_type_e
@@ -25,6 +36,9 @@ typedef struct TempSensor
     float microvolts;
     float ambient_temp;
     #endif // PANNAN_DS2762
+    #ifdef PANNAN_SNTP
+    unsigned long time;         // millis() when the conversion was done.
+    #endif // PANNAN_SNTP
 } TempSensor;
 
 #define ADDR_SIZE member_size(TempSensor, addr)
@@ -33,10 +47,28 @@ typedef struct TempSensor
 
 typedef struct Settings
 {
+	#ifdef PANNAN_CLIENT
 	byte http_client_enabled;
 	char server_hostname[16];
 	int server_port;
 	int http_request_delay;
+	#endif
+	#ifdef PANNAN_TELEMETRY
+	uint8_t telemetry_ip[4];
+	uint16_t telemetry_port;
+	uint16_t telemetry_delay;
+	uint8_t node_id;
+	#endif
+	#ifdef PANNAN_MQTT
+	char mqtt_host[16];
+	uint16_t mqtt_port;
+	uint16_t mqtt_keepalive;
+	byte mqtt_qos;
+	byte mqtt_retain;
+	#endif
+	#ifdef PANNAN_SNTP
+	char ntp_host[16];
+	#endif
 } Settings;
 
 typedef struct Context
@@ -44,8 +76,10 @@ typedef struct Context
 	TempSensor temps[MAX_TEMP_SENSORS];
 	int count;
 	int err;
-	#ifdef PANNAN_CLIENT
 	Settings settings;
+	#ifdef PANNAN_CLIENT
+	uint16_t upload_ok;
+	uint16_t upload_failed;
 	#endif
 } Context;
 
@@ -0,0 +1,98 @@
+#include <Arduino.h>
+
+#include "profile.h"
+#include "sched.h"
+
+#ifdef PANNAN_PROFILE
+
+static Histogram profile_hists[PROFILE_COUNT];
+
+static const char PROFILE_NAMES[PROFILE_COUNT][8] PROGMEM =
+{
+    "loop",
+    "ds18b20",
+    "ds2762"
+};
+
+void profile_add(Histogram *h, unsigned long us)
+{
+    uint8_t b = 0;
+
+    for (us >>= PROFILE_SHIFT; us && (b < (PROFILE_BUCKETS - 1)); us >>= 1)
+    {
+        b++;
+    }
+
+    // Saturate instead of wrapping.
+    if (h->counts[b] != 0xffff)
+        h->counts[b]++;
+}
+
+void profile_record(profile_t p, unsigned long us)
+{
+    profile_add(&profile_hists[p], us);
+}
+
+void profile_clear()
+{
+    memset(profile_hists, 0, sizeof(profile_hists));
+
+    for (uint8_t i = 0; i < sched_task_count; i++)
+    {
+        memset(&sched_tasks[i].hist, 0, sizeof(Histogram));
+    }
+}
+
+static void profile_print_hist(Print &c, const char *name_P, Histogram *h)
+{
+    // The loop is always printed first.
+    if (h != &profile_hists[PROFILE_LOOP])
+        c.print(',');
+
+    c.print(F("\n    \""));
+    c.print((const __FlashStringHelper *)name_P);
+    c.print(F("\": ["));
+
+    for (uint8_t b = 0; b < PROFILE_BUCKETS; b++)
+    {
+        if (b)
+            c.print(',');
+        c.print(h->counts[b]);
+    }
+
+    c.print(']');
+}
+
+//
+// Prints the upper bound of each bucket but the last, and then the
+// counts of each histogram.
+//
+void profile_print(Print &c)
+{
+    uint8_t i;
+
+    c.print(F("{\n  \"le_us\": ["));
+
+    for (i = 0; i < (PROFILE_BUCKETS - 1); i++)
+    {
+        if (i)
+            c.print(',');
+        c.print(1UL << (i + PROFILE_SHIFT));
+    }
+
+    c.print(F("],\n  \"histograms\":\n  {"));
+
+    for (i = 0; i < PROFILE_COUNT; i++)
+    {
+        profile_print_hist(c, PROFILE_NAMES[i], &profile_hists[i]);
+    }
+
+    for (i = 0; i < sched_task_count; i++)
+    {
+        profile_print_hist(c, sched_tasks[i].name, &sched_tasks[i].hist);
+    }
+
+    c.println(F("\n  }\n}"));
+}
+
+#endif // PANNAN_PROFILE
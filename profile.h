@@ -0,0 +1,47 @@
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <Arduino.h>
+
+//
+// Timing histograms, each bucket is twice as wide as the one before:
+// bucket 0 is below 32 us, bucket n is from 2^(n+4) us up to 2^(n+5) us
+// and the last bucket also holds everything longer.
+//
+// Built only with PANNAN_PROFILE, otherwise the macros are empty.
+//
+#define PROFILE_BUCKETS 16
+#define PROFILE_SHIFT 5
+
+typedef struct Histogram
+{
+    uint16_t counts[PROFILE_BUCKETS];
+} Histogram;
+
+typedef enum profile_e
+{
+    PROFILE_LOOP,
+    PROFILE_DS18B20,            // Conversion and read of one sensor.
+    PROFILE_DS2762,             // Reading voltage and temperature.
+    PROFILE_COUNT
+} profile_t;
+
+#ifdef PANNAN_PROFILE
+
+void profile_add(Histogram *h, unsigned long us);
+void profile_record(profile_t p, unsigned long us);
+void profile_clear();
+void profile_print(Print &c);
+
+#define PROFILE_BEGIN(start) unsigned long start = micros()
+#define PROFILE_END(p, start) profile_record(p, micros() - (start))
+
+#else
+
+#define PROFILE_BEGIN(start)
+#define PROFILE_END(p, start)
+
+#endif // PANNAN_PROFILE
+
+#endif // __PROFILE_H__
@@ -0,0 +1,121 @@
+#include "pannan.h"
+#include "queue.h"
+
+#ifdef PANNAN_QUEUE
+
+//
+// Readings waiting to be uploaded, oldest first. This is a ring of
+// fixed size entries, sized after the number of sensors:
+//
+//   uint32_t time
+//   temp_fixed_t temps[count]
+//
+// When it's full the oldest reading is dropped. The readings are
+// numbered in the order they were pushed, so that an upload acknowledges
+// the ones it sent even if some of them were dropped meanwhile.
+//
+
+static uint8_t queue_pool[UPLOAD_QUEUE_BYTES];
+static uint8_t queue_sensors;
+static uint8_t queue_entry_size;
+static uint8_t queue_size;
+static uint8_t queue_head;
+static uint8_t queue_used;
+static uint16_t queue_head_seq;     // Sequence number of the oldest reading.
+static uint16_t queue_drops;
+
+static uint8_t *queue_entry(uint8_t n)
+{
+    return &queue_pool[((queue_head + n) % queue_size) * queue_entry_size];
+}
+
+static void queue_pop(uint8_t n);
+
+void queue_init(int count)
+{
+    queue_sensors = count;
+    queue_entry_size = sizeof(uint32_t) + count * sizeof(temp_fixed_t);
+    queue_size = min(UPLOAD_QUEUE_BYTES / queue_entry_size, 0xff);
+    queue_head = 0;
+    queue_used = 0;
+    queue_head_seq = 0;
+    queue_drops = 0;
+}
+
+void queue_push(uint32_t time, TempSensor *temps)
+{
+    uint8_t *e;
+
+    if (!queue_size)
+        return;
+
+    if (queue_used == queue_size)
+    {
+        queue_pop(1);
+        queue_drops++;
+    }
+
+    e = queue_entry(queue_used++);
+    memcpy(e, &time, sizeof(time));
+    e += sizeof(time);
+
+    for (uint8_t i = 0; i < queue_sensors; i++)
+    {
+        temp_fixed_t t = temp_to_fixed(temps[i].temp);
+        memcpy(e, &t, sizeof(t));
+        e += sizeof(t);
+    }
+}
+
+static void queue_pop(uint8_t n)
+{
+    if (n > queue_used)
+        n = queue_used;
+
+    if (!n)
+        return;
+
+    queue_head = (queue_head + n) % queue_size;
+    queue_used -= n;
+    queue_head_seq += n;
+}
+
+uint16_t queue_seq(uint8_t n)
+{
+    return queue_head_seq + n;
+}
+
+void queue_ack(uint16_t seq)
+{
+    int16_t n = seq - queue_head_seq;
+
+    if (n > 0)
+        queue_pop(n);
+}
+
+uint8_t queue_count()
+{
+    return queue_used;
+}
+
+uint32_t queue_time(uint8_t n)
+{
+    uint32_t time;
+    memcpy(&time, queue_entry(n), sizeof(time));
+    return time;
+}
+
+temp_fixed_t queue_temp(uint8_t n, uint8_t sensor)
+{
+    temp_fixed_t t;
+    memcpy(&t, queue_entry(n) + sizeof(uint32_t) + sensor * sizeof(t),
+           sizeof(t));
+    return t;
+}
+
+uint16_t queue_dropped()
+{
+    return queue_drops;
+}
+
+#endif // PANNAN_QUEUE
@@ -0,0 +1,30 @@
+
+#ifndef __QUEUE_H__
+#define __QUEUE_H__
+
+#include "pannan.h"
+
+//
+// Bytes used for readings waiting to be uploaded. Each reading takes
+// 4 bytes for the time plus 2 bytes per sensor.
+//
+#ifndef UPLOAD_QUEUE_BYTES
+#define UPLOAD_QUEUE_BYTES 256
+#endif
+
+void queue_init(int count);
+void queue_push(uint32_t time, TempSensor *temps);
+
+// Sequence number of reading n, counting from the oldest one.
+uint16_t queue_seq(uint8_t n);
+
+// Drops the readings before seq once an upload of them is acknowledged.
+// Readings dropped meanwhile to make room are not dropped again.
+void queue_ack(uint16_t seq);
+
+uint8_t queue_count();
+uint32_t queue_time(uint8_t n);
+temp_fixed_t queue_temp(uint8_t n, uint8_t sensor);
+uint16_t queue_dropped();
+
+#endif // __QUEUE_H__
@@ -0,0 +1,97 @@
+#include <Arduino.h>
+
+#include "sched.h"
+
+Task *sched_tasks;
+uint8_t sched_task_count;
+
+void sched_start(Task *tasks, uint8_t count)
+{
+    unsigned long now = millis();
+
+    sched_tasks = tasks;
+    sched_task_count = min(count, 16);
+
+    for (uint8_t i = 0; i < sched_task_count; i++)
+    {
+        tasks[i].next = now;
+    }
+}
+
+static uint8_t sched_due(Task *t, unsigned long now)
+{
+    return !t->period || ((long)(now - t->next) >= 0);
+}
+
+static void sched_run_task(Task *t)
+{
+    unsigned long start = micros();
+    unsigned long us;
+
+    #ifdef PANNAN_METRICS
+    t->runs++;
+
+    if (t->period)
+    {
+        unsigned long late = millis() - t->next;
+
+        if (late > t->max_late)
+            t->max_late = min(late, 0xffffUL);
+    }
+    #endif
+
+    t->run();
+
+    us = micros() - start;
+    t->us += us;
+
+    if (us > t->max_us)
+        t->max_us = us;
+
+    if (us > t->budget * 1000UL)
+        t->overruns++;
+
+    #ifdef PANNAN_PROFILE
+    profile_add(&t->hist, us);
+    #endif
+
+    if (!t->period)
+        return;
+
+    // Keep to the same deadlines, skipping the ones already passed.
+    t->next += t->period;
+
+    while ((long)(millis() - t->next) >= 0)
+    {
+        t->next += t->period;
+        t->missed++;
+    }
+}
+
+//
+// Runs each due task once. After each task the table is looked at
+// from the start again, so a task that became due meanwhile runs
+// before the tasks with lower priority.
+//
+void sched_run()
+{
+    uint16_t ran = 0;
+
+    for (;;)
+    {
+        unsigned long now = millis();
+        uint8_t i;
+
+        for (i = 0; i < sched_task_count; i++)
+        {
+            if (!(ran & (1U << i)) && sched_due(&sched_tasks[i], now))
+                break;
+        }
+
+        if (i == sched_task_count)
+            return;
+
+        ran |= (1U << i);
+        sched_run_task(&sched_tasks[i]);
+    }
+}
@@ -0,0 +1,44 @@
+
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+#include <Arduino.h>
+
+#include "profile.h"
+
+//
+// Cooperative scheduler. A task with a period runs on fixed deadlines,
+// each one a period after the last, so the cadence does not drift with
+// the time the task takes. Tasks without a period run on every pass.
+// The table is in priority order, the first task runs first.
+//
+typedef struct Task
+{
+    void (*run)();
+    const char *name;           // In flash.
+    uint16_t period;            // ms between runs, 0 runs on every pass.
+    uint16_t budget;            // ms a run is expected to take at most.
+    unsigned long next;         // Deadline of the next run.
+    uint32_t us;                // Total time spent running.
+    uint32_t max_us;            // Longest run since it was last cleared.
+    uint16_t overruns;          // Runs that went over the budget.
+    uint16_t missed;            // Runs skipped, a whole period late.
+    #ifdef PANNAN_METRICS
+    uint32_t runs;
+    uint16_t max_late;          // Latest start after the deadline in ms, since cleared.
+    #endif
+    #ifdef PANNAN_PROFILE
+    Histogram hist;
+    #endif
+} Task;
+
+#define SCHED_TASK(run, name, period, budget) \
+    { run, name, period, budget, 0, 0, 0, 0, 0 }
+
+extern Task *sched_tasks;
+extern uint8_t sched_task_count;
+
+void sched_start(Task *tasks, uint8_t count);
+void sched_run();
+
+#endif // __SCHED_H__
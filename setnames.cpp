@@ -1,6 +1,7 @@
 
 #include "pannan.h"
 #include "names.h"
+#include "log.h"
 
 int hex2bin(const char *s)
 {
@@ -57,27 +58,29 @@ fail:
 void parse_set_cmd()
 {
     DeviceAddress addr;
-    //String addr_str = Serial.readStringUntil(' ');
-    char *addr_str = strtok(NULL, " ");
+    char *addr_str = strtok(NULL, " \r");
+    char *name = strtok(NULL, " \r");
+
+    if (!addr_str || !name)
+    {
+        Serial.println(F("\nERROR Usage: SET <addr> <name>"));
+        return;
+    }
 
     if (parse_1wire_address(addr_str, addr) < 0)
     {
         Serial.print("\nERROR Could not parse address: ");
         Serial.println(addr_str);
-        //Serial.readStringUntil('\n');
         return;
     }
 
-    //String name = Serial.readStringUntil('\n');
-    char *name = strtok(NULL, " ");
-
     eeprom_add_name(addr, name);
 }
 
 void parse_clear_cmd()
 {
     eeprom_clear_names();
-    Serial.println("OK Cleared EEPROM");
+    Serial.println("OK Cleared names");
 }
 
 void parse_help_cmd()
@@ -91,62 +94,35 @@ void parse_help_cmd()
 
 void parse_list_cmd()
 {
-    eeprom_list_names();
+    eeprom_list_names(Serial);
 }
 
 //SET 1234567891234567 abadb
 
-void parse_serial()
-{
-    if (Serial.available() > 0)
-    {
-        String cmd = Serial.readStringUntil(' ');
-        cmd.replace("\r", "");
-
-        if (cmd == "SET") parse_set_cmd();
-        else if (cmd == "LIST") parse_list_cmd();
-        else if (cmd == "CLEAR") parse_clear_cmd();
-        else if (cmd == "HELP") parse_help_cmd();
-        else if (cmd == " ") ;
-        else
-        {
-            Serial.print("ERROR Unknown cmd: '");
-            Serial.print(cmd);
-            Serial.print("'");
-            Serial.println("");
-            Serial.readStringUntil('\n');
-            return;
-        }
-    }
-}
-
 void parse_serial2()
 {
     #define LINE_MAX 32
     char line[LINE_MAX];
+    char *cmd;
 
     if (Serial.available() <= 0)
         return;
 
-    int size = Serial.readBytesUntil('\n', line, LINE_MAX);
+    int size = Serial.readBytesUntil('\n', line, LINE_MAX - 1);
     line[size] = 0;
 
-    String cmd = strtok(line, " ");
-    cmd.replace("\r", "");
-    cmd.trim();
+    cmd = strtok(line, " \r");
 
-    if (cmd == "SET") parse_set_cmd();
-    else if (cmd == "LIST") parse_list_cmd();
-    else if (cmd == "CLEAR") parse_clear_cmd();
-    else if (cmd == "HELP") parse_help_cmd();
+    if (!cmd) ;
+    else if (!strcmp(cmd, "SET")) parse_set_cmd();
+    else if (!strcmp(cmd, "LIST")) parse_list_cmd();
+    else if (!strcmp(cmd, "CLEAR")) parse_clear_cmd();
+    else if (!strcmp(cmd, "HELP")) parse_help_cmd();
     else
     {
-        Serial.print("ERROR Unknown cmd: '");
+        Serial.print(F("ERROR Unknown cmd: '"));
         Serial.print(cmd);
-        Serial.print("'");
-        Serial.println("");
-        Serial.readStringUntil('\n');
-        return;
+        Serial.println('\'');
     }
 }
 
@@ -165,5 +141,6 @@ void setup()
 void loop()
 {
     parse_serial2();
+    feed_log();
 }
 
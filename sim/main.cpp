@@ -0,0 +1,597 @@
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_io.h>
+#include <avr_uart.h>
+#include <avr_eeprom.h>
+#include <avr_ioport.h>
+
+#include <libelf.h>
+#include <gelf.h>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "host.h"
+
+//
+// Runs the firmware ELF under simavr and counts the cycles spent in a
+// few of its functions, loop() and the sweep and the server tasks by
+// default, and the deepest the stack got. A function call is counted
+// from its first instruction until the stack pointer is above where it
+// was then, which is when it has returned.
+//
+// A sweep runs over many loops, it is counted from the start of
+// start_temp_sensors() until sweep_done() has returned. Most of that
+// is waiting for the conversion, so the cycles of the steps of it are
+// counted too.
+//
+#define SIM_MAX_FUNCTIONS 12
+#define SIM_MAX_FRAMES 32
+#define SIM_POLL_CYCLES 1000
+
+// ATmega328.
+#define SIM_SPL 0x5d
+#define SIM_SPH 0x5e
+#define SIM_RAMEND 0x8ff
+#define SIM_EEPROM_SIZE 1024
+
+avr_t *sim_avr;
+
+typedef struct SimFunction
+{
+    const char *name;
+    uint32_t addr;
+    unsigned long calls;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    uint16_t stack;     // Deepest below the stack pointer at the call.
+} SimFunction;
+
+typedef struct SimSweep
+{
+    SimFunction *start;
+    SimFunction *step;
+    SimFunction *done;
+    int active;
+    uint64_t begin;
+    uint64_t busy;      // Cycles in the steps of this sweep.
+    unsigned long count;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    uint64_t busy_total;
+    uint64_t busy_max;
+} SimSweep;
+
+typedef struct SimFrame
+{
+    SimFunction *fn;
+    uint64_t start;
+    uint16_t sp;
+    uint16_t min_sp;
+} SimFrame;
+
+static const char *default_functions[] =
+{
+    "loop",
+    "start_temp_sensors",   // Starts a sweep.
+    "read_temp_sensors",    // One step of a sweep, a sensor at most.
+    "sweep_done",           // Ends a sweep.
+    "feed_server",          // Reads what has come in of the requests.
+    "feed_client"
+};
+
+static SimFunction functions[SIM_MAX_FUNCTIONS];
+static int function_count;
+static SimFrame frames[SIM_MAX_FRAMES];
+static int depth;
+static SimSweep sweep;
+static uint16_t min_sp = SIM_RAMEND;
+static uint32_t bss_end;
+
+static volatile sig_atomic_t sim_stopping;
+
+static void sim_stop(int)
+{
+    sim_stopping = 1;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [-e eeprom] [-s scenario] [-r requests] [-t seconds]\n"
+        "          [-f function] [-o results.json] [-v] pannan.elf\n"
+        "  -e  File with the EEPROM, saved back at the end\n"
+        "  -s  Devices on the 1-Wire bus, see host/bus.cpp\n"
+        "  -r  HTTP requests to make, see sim/w5100.cpp\n"
+        "  -t  Seconds to run (default 60)\n"
+        "  -f  Count the cycles of this function too\n"
+        "  -o  Save the results as JSON\n"
+        "  -v  Show the serial port of the firmware on stderr\n",
+        prog);
+}
+
+static int add_function(const char *name)
+{
+    if (function_count >= SIM_MAX_FUNCTIONS)
+    {
+        fprintf(stderr, "At most %d functions\n", SIM_MAX_FUNCTIONS);
+        return -1;
+    }
+
+    functions[function_count++].name = name;
+    return 0;
+}
+
+// A C name, or the mangled name of a C++ function with that name.
+static int symbol_matches(const char *sym, const char *name)
+{
+    char prefix[64];
+
+    if (!strcmp(sym, name))
+        return 1;
+
+    snprintf(prefix, sizeof(prefix), "_Z%zu%s", strlen(name), name);
+    return !strncmp(sym, prefix, strlen(prefix));
+}
+
+static SimFunction *find_function(const char *name)
+{
+    for (int j = 0; j < function_count; j++)
+    {
+        if (!strcmp(functions[j].name, name))
+            return &functions[j];
+    }
+
+    return NULL;
+}
+
+static int read_symbols(const char *path)
+{
+    Elf *elf;
+    Elf_Scn *scn = NULL;
+    int fd;
+
+    elf_version(EV_CURRENT);
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    if (!(elf = elf_begin(fd, ELF_C_READ, NULL)))
+    {
+        fprintf(stderr, "%s: %s\n", path, elf_errmsg(-1));
+        close(fd);
+        return -1;
+    }
+
+    while ((scn = elf_nextscn(elf, scn)))
+    {
+        GElf_Shdr shdr;
+        Elf_Data *data;
+
+        if (!gelf_getshdr(scn, &shdr) || (shdr.sh_type != SHT_SYMTAB))
+            continue;
+
+        data = elf_getdata(scn, NULL);
+
+        for (size_t i = 0; i < shdr.sh_size / shdr.sh_entsize; i++)
+        {
+            GElf_Sym sym;
+            const char *name;
+
+            if (!gelf_getsym(data, i, &sym)
+                || !(name = elf_strptr(elf, shdr.sh_link, sym.st_name)))
+                continue;
+
+            if (!strcmp(name, "__bss_end"))
+                bss_end = sym.st_value;
+
+            if (GELF_ST_TYPE(sym.st_info) != STT_FUNC)
+                continue;
+
+            for (int j = 0; j < function_count; j++)
+            {
+                if (!functions[j].addr && symbol_matches(name, functions[j].name))
+                    functions[j].addr = sym.st_value;
+            }
+        }
+    }
+
+    elf_end(elf);
+    close(fd);
+
+    // Data addresses are offset by 0x800000 in AVR ELF files.
+    bss_end &= 0xffff;
+
+    for (int j = 0; j < function_count; j++)
+    {
+        if (!functions[j].addr)
+            fprintf(stderr, "%s is not in %s\n", functions[j].name, path);
+    }
+
+    return 0;
+}
+
+static uint16_t sim_sp()
+{
+    return sim_avr->data[SIM_SPL] | (sim_avr->data[SIM_SPH] << 8);
+}
+
+static void function_done(SimFrame *f)
+{
+    SimFunction *fn = f->fn;
+    uint64_t cycles = sim_avr->cycle - f->start;
+
+    fn->calls++;
+    fn->total += cycles;
+
+    if (!fn->min || (cycles < fn->min))
+        fn->min = cycles;
+    if (cycles > fn->max)
+        fn->max = cycles;
+    if ((f->sp - f->min_sp) > fn->stack)
+        fn->stack = f->sp - f->min_sp;
+
+    if (!sweep.active)
+        return;
+
+    if ((fn == sweep.start) || (fn == sweep.step))
+        sweep.busy += cycles;
+
+    if (fn != sweep.done)
+        return;
+
+    // The step that ended the sweep has not returned yet.
+    for (int i = 0; i < depth; i++)
+    {
+        if (frames[i].fn == sweep.step)
+            sweep.busy += sim_avr->cycle - frames[i].start;
+    }
+
+    cycles = sim_avr->cycle - sweep.begin;
+    sweep.active = 0;
+    sweep.count++;
+    sweep.total += cycles;
+    sweep.busy_total += sweep.busy;
+
+    if (!sweep.min || (cycles < sweep.min))
+        sweep.min = cycles;
+    if (cycles > sweep.max)
+        sweep.max = cycles;
+    if (sweep.busy > sweep.busy_max)
+        sweep.busy_max = sweep.busy;
+}
+
+static void profile_step()
+{
+    uint16_t sp = sim_sp();
+
+    if (sp < min_sp)
+        min_sp = sp;
+
+    while (depth && (sp > frames[depth - 1].sp))
+    {
+        SimFrame *f = &frames[--depth];
+
+        function_done(f);
+
+        if (depth && (f->min_sp < frames[depth - 1].min_sp))
+            frames[depth - 1].min_sp = f->min_sp;
+    }
+
+    if (depth && (sp < frames[depth - 1].min_sp))
+        frames[depth - 1].min_sp = sp;
+
+    for (int j = 0; j < function_count; j++)
+    {
+        if (!functions[j].addr || (sim_avr->pc != functions[j].addr))
+            continue;
+
+        if (depth < SIM_MAX_FRAMES)
+        {
+            SimFrame *f = &frames[depth++];
+            f->fn = &functions[j];
+            f->start = sim_avr->cycle;
+            f->sp = sp;
+            f->min_sp = sp;
+        }
+
+        if (&functions[j] == sweep.start)
+        {
+            sweep.active = 1;
+            sweep.begin = sim_avr->cycle;
+            sweep.busy = 0;
+        }
+    }
+}
+
+static void serial_out(avr_irq_t *, uint32_t value, void *)
+{
+    fputc(value, stderr);
+}
+
+static void serial_init(int verbose)
+{
+    uint32_t flags = 0;
+
+    // simavr prints the serial port itself otherwise.
+    avr_ioctl(sim_avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(sim_avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+
+    if (verbose)
+    {
+        avr_irq_register_notify(
+            avr_io_getirq(sim_avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT),
+            serial_out, NULL);
+    }
+}
+
+static int eeprom_load(const char *path)
+{
+    uint8_t buf[SIM_EEPROM_SIZE];
+    avr_eeprom_desc_t desc;
+    FILE *f;
+
+    // Erased, unless the file has something else.
+    memset(buf, 0xff, sizeof(buf));
+
+    if ((f = fopen(path, "rb")))
+    {
+        if (fread(buf, 1, sizeof(buf), f) == 0)
+            fprintf(stderr, "%s is empty\n", path);
+        fclose(f);
+    }
+
+    desc.ee = buf;
+    desc.offset = 0;
+    desc.size = sizeof(buf);
+    avr_ioctl(sim_avr, AVR_IOCTL_EEPROM_SET, &desc);
+
+    return 0;
+}
+
+static void eeprom_save(const char *path)
+{
+    uint8_t buf[SIM_EEPROM_SIZE];
+    avr_eeprom_desc_t desc;
+    FILE *f;
+
+    desc.ee = buf;
+    desc.offset = 0;
+    desc.size = sizeof(buf);
+    avr_ioctl(sim_avr, AVR_IOCTL_EEPROM_GET, &desc);
+
+    if (!(f = fopen(path, "wb")))
+    {
+        perror(path);
+        return;
+    }
+
+    fwrite(desc.ee, 1, desc.size, f);
+    fclose(f);
+}
+
+static void report(FILE *json)
+{
+    fprintf(stdout, "%.3f s, %llu cycles\n",
+            (double)sim_avr->cycle / SIM_FREQUENCY,
+            (unsigned long long)sim_avr->cycle);
+    fprintf(stdout, "Stack peak %d bytes",
+            SIM_RAMEND - min_sp);
+    if (bss_end)
+        fprintf(stdout, ", %d bytes above the end of .bss", min_sp - bss_end);
+    fprintf(stdout, "\n");
+
+    if (json)
+    {
+        fprintf(json, "{\n  \"cycles\": %llu,\n  \"stack_peak\": %d,\n"
+                      "  \"functions\": [",
+                (unsigned long long)sim_avr->cycle, SIM_RAMEND - min_sp);
+    }
+
+    for (int j = 0; j < function_count; j++)
+    {
+        SimFunction *fn = &functions[j];
+        uint64_t avg = fn->calls ? (fn->total / fn->calls) : 0;
+
+        if (!fn->addr)
+            continue;
+
+        fprintf(stdout, "%-20s %8lu calls  cycles min %9llu avg %9llu "
+                        "max %9llu  stack %u bytes\n",
+                fn->name, fn->calls,
+                (unsigned long long)fn->min,
+                (unsigned long long)avg,
+                (unsigned long long)fn->max, fn->stack);
+
+        if (json)
+        {
+            fprintf(json, "%s\n    {\"name\": \"%s\", \"calls\": %lu, "
+                          "\"min\": %llu, \"avg\": %llu, \"max\": %llu, "
+                          "\"stack\": %u}",
+                    j ? "," : "", fn->name, fn->calls,
+                    (unsigned long long)fn->min,
+                    (unsigned long long)avg,
+                    (unsigned long long)fn->max, fn->stack);
+        }
+    }
+
+    if (json)
+        fprintf(json, "\n  ],\n");
+
+    if (sweep.start && sweep.start->addr && sweep.done && sweep.done->addr)
+    {
+        uint64_t avg = sweep.count ? (sweep.total / sweep.count) : 0;
+        uint64_t busy = sweep.count ? (sweep.busy_total / sweep.count) : 0;
+
+        fprintf(stdout, "%-20s %8lu sweeps cycles min %9llu avg %9llu "
+                        "max %9llu  busy avg %llu max %llu\n",
+                "sweep", sweep.count,
+                (unsigned long long)sweep.min,
+                (unsigned long long)avg,
+                (unsigned long long)sweep.max,
+                (unsigned long long)busy,
+                (unsigned long long)sweep.busy_max);
+
+        if (json)
+        {
+            fprintf(json, "  \"sweeps\": {\"count\": %lu, \"min\": %llu, "
+                          "\"avg\": %llu, \"max\": %llu, "
+                          "\"busy_avg\": %llu, \"busy_max\": %llu},\n",
+                    sweep.count,
+                    (unsigned long long)sweep.min,
+                    (unsigned long long)avg,
+                    (unsigned long long)sweep.max,
+                    (unsigned long long)busy,
+                    (unsigned long long)sweep.busy_max);
+        }
+    }
+
+    sim_net_report(stdout, json);
+
+    if (json)
+        fprintf(json, "\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *eeprom_path = NULL;
+    const char *json_path = NULL;
+    unsigned long run_s = 60;
+    uint64_t end_cycle;
+    uint64_t next_poll = 0;
+    elf_firmware_t fw;
+    int verbose = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "e:s:r:t:f:o:vh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'e':
+                eeprom_path = optarg;
+                break;
+            case 's':
+                if (host_bus_load(optarg))
+                    return 1;
+                break;
+            case 'r':
+                if (sim_requests_load(optarg))
+                    return 1;
+                break;
+            case 't':
+                run_s = strtoul(optarg, NULL, 10);
+                break;
+            case 'f':
+                if (add_function(optarg))
+                    return 1;
+                break;
+            case 'o':
+                json_path = optarg;
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return (opt == 'h') ? 0 : 1;
+        }
+    }
+
+    if (optind != (argc - 1))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    for (size_t i = 0; i < sizeof(default_functions) / sizeof(default_functions[0]); i++)
+    {
+        if (add_function(default_functions[i]))
+            return 1;
+    }
+
+    memset(&fw, 0, sizeof(fw));
+    if (elf_read_firmware(argv[optind], &fw))
+    {
+        fprintf(stderr, "Failed to load %s\n", argv[optind]);
+        return 1;
+    }
+
+    if (read_symbols(argv[optind]))
+        return 1;
+
+    sweep.start = find_function("start_temp_sensors");
+    sweep.step = find_function("read_temp_sensors");
+    sweep.done = find_function("sweep_done");
+
+    if (!(sim_avr = avr_make_mcu_by_name(SIM_MCU)))
+    {
+        fprintf(stderr, "simavr does not know the %s\n", SIM_MCU);
+        return 1;
+    }
+
+    avr_init(sim_avr);
+    avr_load_firmware(sim_avr, &fw);
+
+    // The ELF does not say, the Arduino Ethernet has a 16 MHz crystal.
+    sim_avr->frequency = SIM_FREQUENCY;
+
+    serial_init(verbose);
+    sim_w5100_init(sim_avr);
+    sim_onewire_init(sim_avr);
+
+    // The buttons on pin 5 and 6 have pull-ups and are not pressed.
+    avr_raise_irq(avr_io_getirq(sim_avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 5), 1);
+    avr_raise_irq(avr_io_getirq(sim_avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 6), 1);
+
+    if (eeprom_path && eeprom_load(eeprom_path))
+        return 1;
+
+    signal(SIGINT, sim_stop);
+    signal(SIGTERM, sim_stop);
+
+    end_cycle = (uint64_t)run_s * SIM_FREQUENCY;
+
+    while (!sim_stopping && (sim_avr->cycle < end_cycle))
+    {
+        int state = avr_run(sim_avr);
+
+        if ((state == cpu_Done) || (state == cpu_Crashed))
+        {
+            fprintf(stderr, "The MCU stopped at 0x%04x\n", sim_avr->pc);
+            break;
+        }
+
+        profile_step();
+
+        if (sim_avr->cycle >= next_poll)
+        {
+            sim_net_poll();
+            next_poll = sim_avr->cycle + SIM_POLL_CYCLES;
+        }
+    }
+
+    FILE *json = NULL;
+    if (json_path && !(json = fopen(json_path, "w")))
+        perror(json_path);
+
+    report(json);
+    host_bus_report();
+
+    if (json)
+        fclose(json);
+
+    if (eeprom_path)
+        eeprom_save(eeprom_path);
+
+    return 0;
+}
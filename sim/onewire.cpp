@@ -0,0 +1,154 @@
+#include <sim_avr.h>
+#include <sim_irq.h>
+#include <sim_io.h>
+#include <sim_cycle_timers.h>
+#include <avr_ioport.h>
+
+#include "sim.h"
+#include "host.h"
+
+//
+// The 1-Wire bus on pin 2 (PD2). The devices and their state machines
+// are the ones of the host build in host/bus.cpp, here they are driven
+// by the edges the OneWire library makes on the pin instead of by calls
+// from a replaced library, so the real bit banging code is what runs.
+//
+// The master pulls the line low by making the pin an output with the
+// port bit cleared, and lets it go by making it an input again. How
+// long it held the line low tells what the slot was:
+//
+//   read slot       3 us, the devices answer a 0 by holding the line
+//                   low until 30 us after the start of the slot
+//   write 1         10 us
+//   write 0         65 us
+//   reset           480 us, followed by a presence pulse from 30 us to
+//                   150 us after the master lets go
+//
+// On the wire a read slot looks like a write 1 that the master lets go
+// of sooner, a device knows which one it is from its own state. The
+// model has no such state, so it goes by the length, which is what
+// the OneWire library does on this MCU.
+//
+#define OW_PORT 'D'
+#define OW_BIT 2
+
+#define OW_READ_MAX_US 7
+#define OW_WRITE1_MAX_US 30
+#define OW_RESET_MIN_US 300
+
+#define OW_READ_HOLD_US 30
+#define OW_PRESENCE_WAIT_US 30
+#define OW_PRESENCE_US 120
+
+// The bus functions of host/shim/OneWire.h, implemented by host/bus.cpp.
+uint8_t onewire_bus_reset(uint8_t pin);
+void onewire_bus_write_bit(uint8_t pin, uint8_t v);
+uint8_t onewire_bus_read_bit(uint8_t pin);
+
+static avr_irq_t *ow_pin;
+static uint8_t ow_ddr;
+static uint8_t ow_port;
+static uint8_t ow_master_low;
+static uint64_t ow_low_start;
+
+// The slots on the bus are as long as they are on the board already.
+void host_time_advance(unsigned long)
+{
+}
+
+unsigned long micros()
+{
+    return sim_us();
+}
+
+static void ow_device_level(uint8_t v)
+{
+    avr_raise_irq(ow_pin, v);
+}
+
+static avr_cycle_count_t ow_release(avr_t *, avr_cycle_count_t, void *)
+{
+    ow_device_level(1);
+    return 0;
+}
+
+static avr_cycle_count_t ow_presence(avr_t *avr, avr_cycle_count_t, void *)
+{
+    ow_device_level(0);
+    avr_cycle_timer_register_usec(avr, OW_PRESENCE_US, ow_release, NULL);
+    return 0;
+}
+
+static void ow_slot(unsigned long low_us)
+{
+    if (low_us >= OW_RESET_MIN_US)
+    {
+        if (onewire_bus_reset(OW_BIT))
+        {
+            avr_cycle_timer_register_usec(sim_avr, OW_PRESENCE_WAIT_US,
+                                          ow_presence, NULL);
+        }
+    }
+    else if (low_us < OW_READ_MAX_US)
+    {
+        if (!onewire_bus_read_bit(OW_BIT))
+        {
+            ow_device_level(0);
+            avr_cycle_timer_register_usec(sim_avr,
+                                          OW_READ_HOLD_US - low_us,
+                                          ow_release, NULL);
+        }
+    }
+    else
+    {
+        onewire_bus_write_bit(OW_BIT, low_us < OW_WRITE1_MAX_US);
+    }
+}
+
+static void ow_update()
+{
+    uint8_t low = (ow_ddr & (1 << OW_BIT)) && !(ow_port & (1 << OW_BIT));
+
+    if (low == ow_master_low)
+        return;
+
+    ow_master_low = low;
+
+    if (low)
+    {
+        ow_low_start = sim_us();
+        return;
+    }
+
+    // The pin still reads the port bit it had as an output.
+    ow_device_level(1);
+
+    ow_slot(sim_us() - ow_low_start);
+}
+
+static void ow_port_changed(avr_irq_t *, uint32_t value, void *)
+{
+    ow_port = value;
+    ow_update();
+}
+
+static void ow_ddr_changed(avr_irq_t *, uint32_t value, void *)
+{
+    ow_ddr = value;
+    ow_update();
+}
+
+void sim_onewire_init(avr_t *avr)
+{
+    ow_pin = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(OW_PORT), OW_BIT);
+
+    avr_irq_register_notify(
+        avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(OW_PORT), IOPORT_IRQ_REG_PORT),
+        ow_port_changed, NULL);
+    avr_irq_register_notify(
+        avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(OW_PORT), IOPORT_IRQ_DIRECTION_ALL),
+        ow_ddr_changed, NULL);
+
+    // The pull-up resistor.
+    ow_device_level(1);
+}
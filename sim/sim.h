@@ -0,0 +1,38 @@
+
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <sim_avr.h>
+
+//
+// The pannan firmware under simavr, see the README. The parts of the
+// Arduino Ethernet that are not in the ATmega328 are modelled here:
+// the W5100 on the SPI bus and the 1-Wire devices on pin 2.
+//
+#define SIM_MCU "atmega328p"
+#define SIM_FREQUENCY 16000000UL
+
+#define SIM_CYCLES_PER_US (SIM_FREQUENCY / 1000000UL)
+#define SIM_CYCLES_PER_MS (SIM_FREQUENCY / 1000UL)
+
+extern avr_t *sim_avr;
+
+// Microseconds on the clock of the simulated MCU.
+static inline uint64_t sim_us()
+{
+    return sim_avr->cycle / SIM_CYCLES_PER_US;
+}
+
+// W5100 and the network around it, see w5100.cpp.
+void sim_w5100_init(avr_t *avr);
+int sim_requests_load(const char *path);
+void sim_net_poll();
+void sim_net_report(FILE *f, FILE *json);
+
+// 1-Wire bus on pin 2, the devices come from host/bus.cpp.
+void sim_onewire_init(avr_t *avr);
+
+#endif // __SIM_H__
@@ -0,0 +1,742 @@
+#include <sim_avr.h>
+#include <sim_irq.h>
+#include <sim_io.h>
+#include <avr_spi.h>
+#include <avr_ioport.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+
+//
+// The W5100 on the SPI bus, select on pin 10 (PB2). Each access is a
+// frame of 4 bytes, 0xF0 (write) or 0x0F (read), the address and the
+// data, which goes to the 32 KB address space of the chip:
+//
+//   0x0000  common registers
+//   0x0400  socket registers, 0x100 per socket
+//   0x4000  transmit buffers, 2 KB per socket
+//   0x6000  receive buffers, 2 KB per socket
+//
+// The socket commands act on a small scripted network instead of a real
+// one, which is on the same clock as the MCU so the runs repeat exactly:
+//
+//  - A DHCP server at 10.0.0.1 hands out 10.0.0.50, and is the DNS
+//    server too. Every name resolves to 10.0.0.2.
+//  - Connections to 10.0.0.2 are a collector that answers each chunked
+//    PUT with 200 OK once the last chunk is in.
+//  - HTTP requests come in on port 80 at the times in a request script,
+//    one request per line:
+//
+//      get <ms> <path> [every=MS] [count=N]
+//
+//    The first request is made <ms> after reset, and then every MS ms,
+//    N times in all, or until the end of the run without a count.
+//    A request that comes in while no socket listens is refused, like
+//    the chip resets the connection.
+//
+// Other datagrams are dropped, and other connections time out.
+//
+#define W5100_SS_PORT 'B'
+#define W5100_SS_BIT 2
+
+#define W5100_SOCKETS 4
+#define W5100_BUF_SIZE 2048
+#define W5100_BUF_MASK (W5100_BUF_SIZE - 1)
+#define W5100_TX_BASE 0x4000
+#define W5100_RX_BASE 0x6000
+
+#define W5100_WRITE 0xF0
+#define W5100_READ 0x0F
+
+#define W5100_MR 0x0000
+#define W5100_MR_RST 0x80
+
+// Socket registers, from the base of each socket.
+#define SN_BASE(s) (0x0400 + (s) * 0x100)
+#define SN_MR 0x00
+#define SN_CR 0x01
+#define SN_IR 0x02
+#define SN_SR 0x03
+#define SN_PORT 0x04
+#define SN_DIPR 0x0C
+#define SN_DPORT 0x10
+#define SN_TX_FSR 0x20
+#define SN_TX_RD 0x22
+#define SN_TX_WR 0x24
+#define SN_RX_RSR 0x26
+#define SN_RX_RD 0x28
+
+#define SN_MR_TCP 0x01
+#define SN_MR_UDP 0x02
+
+#define SN_CR_OPEN 0x01
+#define SN_CR_LISTEN 0x02
+#define SN_CR_CONNECT 0x04
+#define SN_CR_DISCON 0x08
+#define SN_CR_CLOSE 0x10
+#define SN_CR_SEND 0x20
+#define SN_CR_SEND_MAC 0x21
+#define SN_CR_SEND_KEEP 0x22
+#define SN_CR_RECV 0x40
+
+#define SN_IR_SEND_OK 0x10
+#define SN_IR_TIMEOUT 0x08
+
+#define SN_SR_CLOSED 0x00
+#define SN_SR_INIT 0x13
+#define SN_SR_LISTEN 0x14
+#define SN_SR_ESTABLISHED 0x17
+#define SN_SR_UDP 0x22
+
+#define NET_HTTP_PORT 80
+#define NET_DHCP_SERVER_PORT 67
+#define NET_DHCP_CLIENT_PORT 68
+#define NET_DNS_PORT 53
+
+#define NET_MAX_REQUESTS 32
+#define NET_PATH_SIZE 48
+
+static const uint8_t net_server[4] = { 10, 0, 0, 1 };
+static const uint8_t net_node[4] = { 10, 0, 0, 50 };
+static const uint8_t net_collector[4] = { 10, 0, 0, 2 };
+static const uint8_t net_browser[4] = { 10, 0, 0, 9 };
+static const uint8_t net_mask[4] = { 255, 255, 255, 0 };
+
+typedef enum sim_conn_e
+{
+    CONN_NONE,
+    CONN_REQUEST,   // A scripted request to the webserver.
+    CONN_COLLECTOR  // An upload from the HTTP client.
+} sim_conn_t;
+
+typedef struct SimRequest
+{
+    char path[NET_PATH_SIZE];
+    uint64_t next_us;
+    uint64_t every_us;
+    unsigned long left;     // 0 for no limit.
+
+    // Results.
+    unsigned long done;
+    unsigned long refused;
+    unsigned long errors;   // Anything but 200.
+    uint64_t cycles_total;
+    uint64_t cycles_min;
+    uint64_t cycles_max;
+    unsigned long bytes_total;
+} SimRequest;
+
+typedef struct SimSocket
+{
+    uint16_t rx_wr;         // End of the data in the receive buffer.
+    uint16_t tx_rd;         // Start of the data not sent yet.
+    sim_conn_t conn;
+    SimRequest *req;
+    uint64_t start_cycle;
+    unsigned long bytes;
+    char head[16];          // Start of what the firmware sent.
+    uint8_t head_len;
+    char tail[5];           // End of what it sent, for the last chunk.
+} SimSocket;
+
+static uint8_t mem[0x8000];
+static SimSocket socks[W5100_SOCKETS];
+
+static avr_irq_t *spi_in;
+static uint8_t frame[4];
+static uint8_t frame_len;
+static uint8_t selected;
+
+static SimRequest requests[NET_MAX_REQUESTS];
+static int request_count;
+
+static unsigned long uploads;
+static unsigned long upload_bytes;
+static unsigned long dhcp_acks;
+static unsigned long dns_answers;
+static unsigned long dropped;
+
+static uint16_t get16(uint16_t addr)
+{
+    return (mem[addr] << 8) | mem[addr + 1];
+}
+
+static void put16(uint16_t addr, uint16_t v)
+{
+    mem[addr] = v >> 8;
+    mem[addr + 1] = v & 0xff;
+}
+
+static uint16_t sn_reg(int s, uint16_t reg)
+{
+    return SN_BASE(s) + reg;
+}
+
+static void sock_status(int s, uint8_t sr)
+{
+    mem[sn_reg(s, SN_SR)] = sr;
+}
+
+// Puts data in the receive buffer as if it came from the network.
+static int sock_receive(int s, const uint8_t *buf, uint16_t len)
+{
+    SimSocket *k = &socks[s];
+    uint16_t used = k->rx_wr - get16(sn_reg(s, SN_RX_RD));
+
+    if ((used + len) > W5100_BUF_SIZE)
+        return -1;
+
+    for (uint16_t i = 0; i < len; i++)
+    {
+        mem[W5100_RX_BASE + s * W5100_BUF_SIZE
+            + ((k->rx_wr + i) & W5100_BUF_MASK)] = buf[i];
+    }
+
+    k->rx_wr += len;
+    put16(sn_reg(s, SN_RX_RSR), k->rx_wr - get16(sn_reg(s, SN_RX_RD)));
+
+    return 0;
+}
+
+static void udp_receive(int s, const uint8_t *ip, uint16_t port,
+                        const uint8_t *buf, uint16_t len)
+{
+    uint8_t header[8];
+
+    memcpy(header, ip, 4);
+    header[4] = port >> 8;
+    header[5] = port & 0xff;
+    header[6] = len >> 8;
+    header[7] = len & 0xff;
+
+    if (sock_receive(s, header, sizeof(header)) || sock_receive(s, buf, len))
+        dropped++;
+}
+
+//
+// DHCP, answers DISCOVER with OFFER and REQUEST with ACK.
+//
+#define DHCP_OPTIONS 240
+#define DHCP_DISCOVER 1
+#define DHCP_OFFER 2
+#define DHCP_REQUEST 3
+#define DHCP_ACK 5
+
+static void dhcp_option(uint8_t *buf, int *len, uint8_t code,
+                        const uint8_t *v, uint8_t size)
+{
+    buf[(*len)++] = code;
+    buf[(*len)++] = size;
+    memcpy(&buf[*len], v, size);
+    *len += size;
+}
+
+static void dhcp_reply(int s, const uint8_t *req, uint16_t req_len)
+{
+    static const uint8_t lease_time[4] = { 0, 1, 0x51, 0x80 }; // 1 day.
+    uint8_t buf[DHCP_OPTIONS + 64];
+    uint8_t type = 0;
+    int len;
+
+    if (req_len < DHCP_OPTIONS)
+        return;
+
+    for (int i = DHCP_OPTIONS; (i + 1) < req_len; )
+    {
+        if (req[i] == 255)
+            break;
+        if (req[i] == 0)
+        {
+            i++;
+            continue;
+        }
+        if ((req[i] == 53) && ((i + 2) < req_len))
+            type = req[i + 2];
+        i += 2 + req[i + 1];
+    }
+
+    if (type == DHCP_DISCOVER)
+        type = DHCP_OFFER;
+    else if (type == DHCP_REQUEST)
+        type = DHCP_ACK;
+    else
+        return;
+
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, req, DHCP_OPTIONS);
+    buf[0] = 2;                         // BOOTREPLY
+    memcpy(&buf[16], net_node, 4);      // yiaddr
+    memcpy(&buf[20], net_server, 4);    // siaddr
+
+    len = DHCP_OPTIONS;
+    dhcp_option(buf, &len, 53, &type, 1);
+    dhcp_option(buf, &len, 54, net_server, 4);
+    dhcp_option(buf, &len, 51, lease_time, 4);
+    dhcp_option(buf, &len, 1, net_mask, 4);
+    dhcp_option(buf, &len, 3, net_server, 4);
+    dhcp_option(buf, &len, 6, net_server, 4);
+    buf[len++] = 255;
+
+    udp_receive(s, net_server, NET_DHCP_SERVER_PORT, buf, len);
+
+    if (type == DHCP_ACK)
+        dhcp_acks++;
+}
+
+//
+// DNS, answers the first question with an A record for the collector.
+//
+static void dns_reply(int s, const uint8_t *req, uint16_t req_len)
+{
+    uint8_t buf[512];
+    int len = 12;
+
+    if ((req_len < 12) || (req_len > (sizeof(buf) - 16)))
+        return;
+
+    // Skip the name and the type and class of the question.
+    while ((len < req_len) && req[len])
+        len += req[len] + 1;
+    len += 5;
+
+    if (len > req_len)
+        return;
+
+    memcpy(buf, req, len);
+    buf[2] = 0x81;                      // Response, recursion desired.
+    buf[3] = 0x80;                      // Recursion available, no error.
+    buf[4] = 0; buf[5] = 1;             // 1 question.
+    buf[6] = 0; buf[7] = 1;             // 1 answer.
+    memset(&buf[8], 0, 4);
+
+    static const uint8_t answer[] =
+    {
+        0xc0, 0x0c,                     // Name of the question.
+        0x00, 0x01, 0x00, 0x01,         // A, IN.
+        0x00, 0x00, 0x0e, 0x10,         // TTL 1 hour.
+        0x00, 0x04                      // 4 bytes of address.
+    };
+    memcpy(&buf[len], answer, sizeof(answer));
+    len += sizeof(answer);
+    memcpy(&buf[len], net_collector, 4);
+    len += 4;
+
+    udp_receive(s, net_server, NET_DNS_PORT, buf, len);
+    dns_answers++;
+}
+
+static void udp_send(int s, const uint8_t *buf, uint16_t len)
+{
+    uint16_t port = get16(sn_reg(s, SN_DPORT));
+
+    if (port == NET_DHCP_SERVER_PORT)
+        dhcp_reply(s, buf, len);
+    else if (port == NET_DNS_PORT)
+        dns_reply(s, buf, len);
+    else
+        dropped++;
+}
+
+//
+// TCP.
+//
+static void request_done(int s)
+{
+    SimSocket *k = &socks[s];
+    SimRequest *r = k->req;
+    uint64_t cycles = sim_avr->cycle - k->start_cycle;
+
+    r->done++;
+    r->cycles_total += cycles;
+    r->bytes_total += k->bytes;
+
+    if (!r->cycles_min || (cycles < r->cycles_min))
+        r->cycles_min = cycles;
+    if (cycles > r->cycles_max)
+        r->cycles_max = cycles;
+
+    if ((k->head_len < 12) || strncmp(&k->head[8], " 200", 4))
+        r->errors++;
+}
+
+static void tcp_closed(int s)
+{
+    SimSocket *k = &socks[s];
+
+    if (k->conn == CONN_REQUEST)
+        request_done(s);
+
+    k->conn = CONN_NONE;
+    k->req = NULL;
+    sock_status(s, SN_SR_CLOSED);
+}
+
+static void tcp_connect(int s)
+{
+    SimSocket *k = &socks[s];
+
+    if (memcmp(&mem[sn_reg(s, SN_DIPR)], net_collector, 4))
+    {
+        mem[sn_reg(s, SN_IR)] |= SN_IR_TIMEOUT;
+        sock_status(s, SN_SR_CLOSED);
+        return;
+    }
+
+    k->conn = CONN_COLLECTOR;
+    k->bytes = 0;
+    memset(k->tail, 0, sizeof(k->tail));
+    sock_status(s, SN_SR_ESTABLISHED);
+}
+
+static void tcp_send(int s, const uint8_t *buf, uint16_t len)
+{
+    static const char reply[] =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Length: 0\r\n"
+        "\r\n";
+    SimSocket *k = &socks[s];
+
+    for (uint16_t i = 0; i < len; i++)
+    {
+        if (k->head_len < (sizeof(k->head) - 1))
+            k->head[k->head_len++] = buf[i];
+
+        memmove(k->tail, &k->tail[1], sizeof(k->tail) - 1);
+        k->tail[sizeof(k->tail) - 1] = buf[i];
+    }
+
+    k->bytes += len;
+
+    if ((k->conn == CONN_COLLECTOR) && !memcmp(k->tail, "0\r\n\r\n", 5))
+    {
+        uploads++;
+        upload_bytes += k->bytes;
+        k->bytes = 0;
+        memset(k->tail, 0, sizeof(k->tail));
+        sock_receive(s, (const uint8_t *)reply, sizeof(reply) - 1);
+    }
+}
+
+static void sock_send(int s)
+{
+    SimSocket *k = &socks[s];
+    uint16_t wr = get16(sn_reg(s, SN_TX_WR));
+    uint16_t len = wr - k->tx_rd;
+    uint8_t buf[W5100_BUF_SIZE];
+
+    for (uint16_t i = 0; i < len; i++)
+    {
+        buf[i] = mem[W5100_TX_BASE + s * W5100_BUF_SIZE
+                     + ((k->tx_rd + i) & W5100_BUF_MASK)];
+    }
+
+    k->tx_rd = wr;
+    put16(sn_reg(s, SN_TX_RD), wr);
+    put16(sn_reg(s, SN_TX_FSR), W5100_BUF_SIZE);
+    mem[sn_reg(s, SN_IR)] |= SN_IR_SEND_OK;
+
+    if (mem[sn_reg(s, SN_SR)] == SN_SR_UDP)
+        udp_send(s, buf, len);
+    else if (mem[sn_reg(s, SN_SR)] == SN_SR_ESTABLISHED)
+        tcp_send(s, buf, len);
+}
+
+static void sock_command(int s, uint8_t cr)
+{
+    SimSocket *k = &socks[s];
+
+    switch (cr)
+    {
+        case SN_CR_OPEN:
+            k->conn = CONN_NONE;
+            k->rx_wr = get16(sn_reg(s, SN_RX_RD));
+            k->tx_rd = get16(sn_reg(s, SN_TX_WR));
+            put16(sn_reg(s, SN_TX_RD), k->tx_rd);
+            put16(sn_reg(s, SN_TX_FSR), W5100_BUF_SIZE);
+            put16(sn_reg(s, SN_RX_RSR), 0);
+
+            if ((mem[sn_reg(s, SN_MR)] & 0x0f) == SN_MR_UDP)
+                sock_status(s, SN_SR_UDP);
+            else if ((mem[sn_reg(s, SN_MR)] & 0x0f) == SN_MR_TCP)
+                sock_status(s, SN_SR_INIT);
+            break;
+        case SN_CR_LISTEN:
+            if (mem[sn_reg(s, SN_SR)] == SN_SR_INIT)
+                sock_status(s, SN_SR_LISTEN);
+            break;
+        case SN_CR_CONNECT:
+            tcp_connect(s);
+            break;
+        case SN_CR_DISCON:
+        case SN_CR_CLOSE:
+            tcp_closed(s);
+            break;
+        case SN_CR_SEND:
+        case SN_CR_SEND_MAC:
+        case SN_CR_SEND_KEEP:
+            sock_send(s);
+            break;
+        case SN_CR_RECV:
+            put16(sn_reg(s, SN_RX_RSR), k->rx_wr - get16(sn_reg(s, SN_RX_RD)));
+            break;
+    }
+
+    // The command register reads 0 once the command is taken.
+    mem[sn_reg(s, SN_CR)] = 0;
+}
+
+static void w5100_write(uint16_t addr, uint8_t v)
+{
+    if (addr >= sizeof(mem))
+        return;
+
+    if ((addr == W5100_MR) && (v & W5100_MR_RST))
+    {
+        memset(mem, 0, sizeof(mem));
+        memset(socks, 0, sizeof(socks));
+        return;
+    }
+
+    if ((addr >= SN_BASE(0)) && (addr < SN_BASE(W5100_SOCKETS)))
+    {
+        int s = (addr - SN_BASE(0)) >> 8;
+        uint16_t reg = addr & 0xff;
+
+        if (reg == SN_IR)
+        {
+            // Cleared by writing 1.
+            mem[addr] &= ~v;
+            return;
+        }
+
+        mem[addr] = v;
+
+        if (reg == SN_CR)
+            sock_command(s, v);
+        return;
+    }
+
+    mem[addr] = v;
+}
+
+static uint8_t w5100_read(uint16_t addr)
+{
+    return (addr < sizeof(mem)) ? mem[addr] : 0;
+}
+
+static void spi_byte(avr_irq_t *, uint32_t value, void *)
+{
+    uint8_t reply;
+
+    if (!selected)
+        return;
+
+    // The chip answers 0, 1, 2 to the first three bytes of a frame.
+    reply = frame_len;
+    frame[frame_len++] = value;
+
+    if (frame_len == 4)
+    {
+        uint16_t addr = (frame[1] << 8) | frame[2];
+
+        if (frame[0] == W5100_WRITE)
+        {
+            w5100_write(addr, frame[3]);
+            reply = 3;
+        }
+        else if (frame[0] == W5100_READ)
+        {
+            reply = w5100_read(addr);
+        }
+
+        frame_len = 0;
+    }
+
+    avr_raise_irq(spi_in, reply);
+}
+
+static void ss_changed(avr_irq_t *, uint32_t value, void *)
+{
+    selected = !value;
+    frame_len = 0;
+}
+
+void sim_w5100_init(avr_t *avr)
+{
+    spi_in = avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_INPUT);
+
+    avr_irq_register_notify(
+        avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_OUTPUT),
+        spi_byte, NULL);
+    avr_irq_register_notify(
+        avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(W5100_SS_PORT), W5100_SS_BIT),
+        ss_changed, NULL);
+}
+
+//
+// Scripted requests.
+//
+int sim_requests_load(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char line[128];
+    int lineno = 0;
+
+    if (!f)
+    {
+        perror(path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f))
+    {
+        char *tok;
+        char *save;
+        SimRequest *r;
+
+        lineno++;
+
+        if (!(tok = strtok_r(line, " \t\r\n", &save)) || (tok[0] == '#'))
+            continue;
+
+        if (strcmp(tok, "get") || (request_count >= NET_MAX_REQUESTS))
+            goto fail;
+
+        r = &requests[request_count];
+        memset(r, 0, sizeof(*r));
+
+        if (!(tok = strtok_r(NULL, " \t\r\n", &save)))
+            goto fail;
+        r->next_us = strtoull(tok, NULL, 10) * 1000;
+
+        if (!(tok = strtok_r(NULL, " \t\r\n", &save))
+            || (tok[0] != '/') || (strlen(tok) >= NET_PATH_SIZE))
+            goto fail;
+        strcpy(r->path, tok);
+
+        // Once, unless repeated.
+        r->left = 1;
+
+        while ((tok = strtok_r(NULL, " \t\r\n", &save)))
+        {
+            if (!strncmp(tok, "every=", 6))
+            {
+                r->every_us = strtoull(&tok[6], NULL, 10) * 1000;
+                r->left = 0;
+            }
+            else if (!strncmp(tok, "count=", 6))
+                r->left = strtoul(&tok[6], NULL, 10);
+            else
+                goto fail;
+        }
+
+        request_count++;
+        continue;
+
+    fail:
+        fprintf(stderr, "%s:%d: Bad request line\n", path, lineno);
+        fclose(f);
+        return -1;
+    }
+
+    fclose(f);
+    return 0;
+}
+
+static void request_start(SimRequest *r)
+{
+    char buf[NET_PATH_SIZE + 64];
+    int len;
+
+    for (int s = 0; s < W5100_SOCKETS; s++)
+    {
+        SimSocket *k = &socks[s];
+
+        if ((mem[sn_reg(s, SN_SR)] != SN_SR_LISTEN)
+            || (get16(sn_reg(s, SN_PORT)) != NET_HTTP_PORT))
+            continue;
+
+        memcpy(&mem[sn_reg(s, SN_DIPR)], net_browser, 4);
+        put16(sn_reg(s, SN_DPORT), 40000 + s);
+        sock_status(s, SN_SR_ESTABLISHED);
+
+        k->conn = CONN_REQUEST;
+        k->req = r;
+        k->start_cycle = sim_avr->cycle;
+        k->bytes = 0;
+        k->head_len = 0;
+
+        len = snprintf(buf, sizeof(buf),
+                       "GET %s HTTP/1.1\r\n"
+                       "Host: 10.0.0.50\r\n"
+                       "\r\n", r->path);
+        sock_receive(s, (const uint8_t *)buf, len);
+        return;
+    }
+
+    r->refused++;
+}
+
+void sim_net_poll()
+{
+    uint64_t now = sim_us();
+
+    for (int i = 0; i < request_count; i++)
+    {
+        SimRequest *r = &requests[i];
+
+        if (!r->next_us || (now < r->next_us))
+            continue;
+
+        request_start(r);
+
+        if (r->left && !--r->left)
+            r->next_us = 0;
+        else
+            r->next_us += r->every_us ? r->every_us : 1;
+    }
+}
+
+void sim_net_report(FILE *f, FILE *json)
+{
+    fprintf(f, "DHCP acks %lu, DNS answers %lu, uploads %lu (%lu bytes), "
+               "dropped datagrams %lu\n",
+            dhcp_acks, dns_answers, uploads, upload_bytes, dropped);
+
+    if (json)
+    {
+        fprintf(json, "  \"uploads\": %lu,\n  \"upload_bytes\": %lu,\n"
+                      "  \"requests\": [",
+                uploads, upload_bytes);
+    }
+
+    for (int i = 0; i < request_count; i++)
+    {
+        SimRequest *r = &requests[i];
+        uint64_t avg = r->done ? (r->cycles_total / r->done) : 0;
+
+        fprintf(f, "GET %-20s %6lu done %4lu refused %4lu errors  "
+                   "cycles min %9llu avg %9llu max %9llu  %lu bytes avg\n",
+                r->path, r->done, r->refused, r->errors,
+                (unsigned long long)r->cycles_min,
+                (unsigned long long)avg,
+                (unsigned long long)r->cycles_max,
+                r->done ? (r->bytes_total / r->done) : 0);
+
+        if (json)
+        {
+            fprintf(json, "%s\n    {\"path\": \"%s\", \"done\": %lu, "
+                          "\"refused\": %lu, \"errors\": %lu, "
+                          "\"min\": %llu, \"avg\": %llu, \"max\": %llu}",
+                    i ? "," : "", r->path, r->done, r->refused, r->errors,
+                    (unsigned long long)r->cycles_min,
+                    (unsigned long long)avg,
+                    (unsigned long long)r->cycles_max);
+        }
+    }
+
+    if (json)
+        fprintf(json, "\n  ]");
+}
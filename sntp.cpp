@@ -0,0 +1,288 @@
+#include <Ethernet.h>
+#include <EthernetUdp.h>
+
+#include "pannan.h"
+#include "net.h"
+#include "fmt.h"
+#include "lease.h"
+#include "sntp.h"
+
+#ifdef PANNAN_SNTP
+
+#define SNTP_PORT 123
+#define SNTP_LOCAL_PORT 8123
+#define SNTP_PACKET_SIZE 48
+#define SNTP_RESOLVE_TIMEOUT 2000
+#define SNTP_REPLY_TIMEOUT 2000
+#define SNTP_RETRY_MIN 4000UL
+#define SNTP_POLL (15 * 60 * 1000UL)
+#define SNTP_STEP_LIMIT 1000        // ms, larger errors are not used for the drift.
+#define SNTP_DRIFT_MIN_INTERVAL 60000UL
+#define SNTP_PPM_MAX 5000
+#define SNTP_UNIX_OFFSET 2208988800UL // Seconds from 1900 to 1970.
+
+typedef enum sntp_state_e
+{
+    SNTP_IDLE,
+    SNTP_RESOLVE,
+    SNTP_WAIT
+} sntp_state_t;
+
+typedef struct Sntp
+{
+    sntp_state_t state;
+    unsigned long deadline;
+    unsigned long next;
+    unsigned long retry;
+    unsigned long sent;         // millis() when the request was sent.
+    EthernetUDP udp;
+    DnsQuery dns;
+    IPAddress ip;
+
+    // The clock is Unix time base_sec.base_ms at millis() == base.
+    uint8_t synced;
+    unsigned long base;
+    uint32_t base_sec;
+    uint16_t base_ms;
+    int16_t ppm;                // How much slower millis() runs.
+} Sntp;
+
+static Sntp sntp;
+
+static uint32_t sntp_read32(const uint8_t *b)
+{
+    return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16)
+         | ((uint32_t)b[2] << 8) | b[3];
+}
+
+static void sntp_put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+//
+// Milliseconds since the base, corrected for the drift. Split up so
+// it does not overflow for times far from the base.
+//
+static long sntp_elapsed(unsigned long ms)
+{
+    long d = (long)(ms - sntp.base);
+
+    return d + (d / 1000000L) * sntp.ppm
+             + ((d % 1000000L) / 1000) * sntp.ppm / 1000;
+}
+
+uint8_t sntp_synced()
+{
+    return sntp.synced;
+}
+
+uint32_t sntp_unix(unsigned long ms, uint16_t *msec)
+{
+    long d = sntp_elapsed(ms) + sntp.base_ms;
+    long sec = d / 1000;
+    long rem = d % 1000;
+
+    if (rem < 0)
+    {
+        rem += 1000;
+        sec--;
+    }
+
+    if (msec)
+        *msec = rem;
+
+    return sntp.base_sec + sec;
+}
+
+char *sntp_time2buf(char *buf, int *i, unsigned long ms)
+{
+    uint16_t msec;
+    int len = 0;
+
+    ulong2buf(buf, &len, sntp_unix(ms, &msec));
+
+    buf[len++] = '.';
+    buf[len++] = '0' + msec / 100;
+    buf[len++] = '0' + (msec / 10) % 10;
+    buf[len++] = '0' + msec % 10;
+    buf[len] = 0;
+
+    if (i)
+        (*i) += len;
+
+    return buf;
+}
+
+void sntp_print(Print &c, unsigned long ms)
+{
+    char buf[SNTP_TIME_SIZE];
+    c.print(sntp_time2buf(buf, NULL, ms));
+}
+
+static void sntp_done(unsigned long next)
+{
+    sntp.udp.stop();
+    sntp.state = SNTP_IDLE;
+    sntp.next = millis() + next;
+}
+
+static void sntp_fail()
+{
+    sntp_done(sntp.retry);
+
+    sntp.retry *= 2;
+    if (sntp.retry > SNTP_POLL)
+        sntp.retry = SNTP_POLL;
+}
+
+static void sntp_send()
+{
+    uint8_t buf[SNTP_PACKET_SIZE];
+
+    memset(buf, 0, sizeof(buf));
+    buf[0] = (4 << 3) | 3;      // Version 4, client.
+
+    // The server echoes the transmit time back as the originate time,
+    // which is how we know the reply is to this request.
+    sntp.sent = millis();
+    sntp_put32(&buf[40], sntp.sent);
+
+    if (!sntp.udp.begin(SNTP_LOCAL_PORT)
+     || !sntp.udp.beginPacket(sntp.ip, SNTP_PORT))
+    {
+        sntp_fail();
+        return;
+    }
+
+    sntp.udp.write(buf, sizeof(buf));
+
+    if (!sntp.udp.endPacket())
+    {
+        sntp_fail();
+        return;
+    }
+
+    sntp.state = SNTP_WAIT;
+    sntp.deadline = millis() + SNTP_REPLY_TIMEOUT;
+}
+
+static void sntp_set(uint32_t sec, uint16_t msec, unsigned long now)
+{
+    if (sntp.synced)
+    {
+        uint16_t local_ms;
+        long diff = (long)(sec - sntp_unix(now, &local_ms));
+        unsigned long interval = now - sntp.base;
+
+        // Only small errors over a long time say anything about the
+        // drift, anything else is a step of the clock.
+        if ((diff > -2) && (diff < 2) && (interval > SNTP_DRIFT_MIN_INTERVAL))
+        {
+            long offset = diff * 1000 + ((long)msec - local_ms);
+
+            if ((offset > -SNTP_STEP_LIMIT) && (offset < SNTP_STEP_LIMIT))
+            {
+                long ppm = sntp.ppm + (offset * 1000 / (long)(interval / 1000)) / 2;
+                sntp.ppm = constrain(ppm, -SNTP_PPM_MAX, SNTP_PPM_MAX);
+            }
+        }
+    }
+
+    sntp.base = now;
+    sntp.base_sec = sec;
+    sntp.base_ms = msec;
+    sntp.synced = 1;
+}
+
+static void sntp_receive()
+{
+    uint8_t buf[SNTP_PACKET_SIZE];
+    unsigned long now = millis();
+    uint32_t sec;
+    uint32_t msec;
+
+    if (sntp.udp.parsePacket() < SNTP_PACKET_SIZE)
+    {
+        if ((long)(now - sntp.deadline) >= 0)
+            sntp_fail();
+        return;
+    }
+
+    sntp.udp.read(buf, sizeof(buf));
+
+    // Must be a server reply to our request, from a synchronized
+    // server that is not sending a kiss-o'-death (stratum 0).
+    if (((buf[0] & 0x07) != 4)
+     || ((buf[0] >> 6) == 3)
+     || (buf[1] == 0) || (buf[1] > 15)
+     || (sntp_read32(&buf[24]) != sntp.sent)
+     || sntp_read32(&buf[28]))
+    {
+        sntp_fail();
+        return;
+    }
+
+    // Transmit time of the server plus half the round trip.
+    sec = sntp_read32(&buf[40]) - SNTP_UNIX_OFFSET;
+    msec = ((sntp_read32(&buf[44]) >> 16) * 1000UL) >> 16;
+    msec += (now - sntp.sent) / 2;
+
+    sntp_set(sec + msec / 1000, msec % 1000, now);
+
+    sntp.retry = SNTP_RETRY_MIN;
+    sntp_done(SNTP_POLL);
+}
+
+void feed_sntp(Context *ctx)
+{
+    int ret;
+
+    switch (sntp.state)
+    {
+        case SNTP_IDLE:
+            if (!sntp.retry)
+                sntp.retry = SNTP_RETRY_MIN;
+
+            if ((long)(millis() - sntp.next) < 0)
+                break;
+
+            if (net_parse_ip(ctx->settings.ntp_host, &sntp.ip) == NET_OK)
+            {
+                sntp_send();
+            }
+            else if (dns_query_start(&sntp.dns, lease_dns_server(),
+                                     ctx->settings.ntp_host) == NET_OK)
+            {
+                sntp.state = SNTP_RESOLVE;
+                sntp.deadline = millis() + SNTP_RESOLVE_TIMEOUT;
+            }
+            else
+            {
+                sntp_fail();
+            }
+            break;
+        case SNTP_RESOLVE:
+            ret = dns_query_poll(&sntp.dns, &sntp.ip, NULL);
+
+            if (ret == NET_OK)
+            {
+                sntp_send();
+            }
+            else if ((ret == NET_FAIL)
+                  || ((long)(millis() - sntp.deadline) >= 0))
+            {
+                dns_query_stop(&sntp.dns);
+                sntp_fail();
+            }
+            break;
+        case SNTP_WAIT:
+            sntp_receive();
+            break;
+    }
+}
+
+#endif // PANNAN_SNTP
@@ -0,0 +1,29 @@
+
+#ifndef __SNTP_H__
+#define __SNTP_H__
+
+#include "pannan.h"
+
+//
+// SNTP client that keeps a Unix clock on top of millis(). Each reply
+// sets the clock, and the error seen between replies is used to correct
+// for the drift of the crystal until the next one.
+//
+#ifndef SNTP_SERVER_DEFAULT
+#define SNTP_SERVER_DEFAULT "pool.ntp.org"
+#endif
+
+// Longest string from sntp_time2buf(), "4294967295.999".
+#define SNTP_TIME_SIZE 15
+
+void feed_sntp(Context *ctx);
+uint8_t sntp_synced();
+
+// Converts a millis() timestamp to Unix time.
+uint32_t sntp_unix(unsigned long ms, uint16_t *msec);
+
+// Formats a millis() timestamp as Unix seconds with 3 decimals.
+char *sntp_time2buf(char *buf, int *i, unsigned long ms);
+void sntp_print(Print &c, unsigned long ms);
+
+#endif // __SNTP_H__
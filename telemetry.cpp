@@ -0,0 +1,100 @@
+#include <Ethernet.h>
+#include <EthernetUdp.h>
+
+#include "pannan.h"
+#include "telemetry.h"
+#ifdef PANNAN_SNTP
+#include "sntp.h"
+#endif
+
+#ifdef PANNAN_TELEMETRY
+
+// The socket is only open while a datagram is sent, so it is free for
+// the rest of the time between sweeps.
+static EthernetUDP telemetry_udp;
+static uint8_t telemetry_pending;
+static uint16_t telemetry_seq;
+static unsigned long telemetry_last;
+static unsigned long telemetry_time;
+
+static uint8_t *put16(uint8_t *p, uint16_t v)
+{
+    *p++ = v >> 8;
+    *p++ = v & 0xff;
+    return p;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+    p = put16(p, v >> 16);
+    return put16(p, v & 0xffff);
+}
+
+static int telemetry_begin(Settings *settings)
+{
+    IPAddress ip(settings->telemetry_ip);
+
+    // Multicast needs the socket in multicast mode to get the right MAC.
+    if ((ip[0] >= 224) && (ip[0] <= 239))
+        return telemetry_udp.beginMulticast(ip, settings->telemetry_port);
+
+    return telemetry_udp.begin(settings->telemetry_port);
+}
+
+void telemetry_sweep(unsigned long time)
+{
+    telemetry_pending = 1;
+    telemetry_time = time;
+}
+
+void feed_telemetry(Context *ctx)
+{
+    Settings *settings = &ctx->settings;
+    uint8_t buf[TELEMETRY_HEADER_SIZE + MAX_TEMP_SENSORS * sizeof(temp_fixed_t)];
+    uint8_t *p = buf;
+    uint32_t unix_sec = 0;
+    uint16_t unix_ms = 0;
+
+    if (!telemetry_pending
+     || ((millis() - telemetry_last) < settings->telemetry_delay))
+        return;
+
+    if (!telemetry_begin(settings))
+        return;
+
+    *p++ = 'P';
+    *p++ = 'N';
+    *p++ = TELEMETRY_VERSION;
+    *p++ = settings->node_id;
+    p = put16(p, telemetry_seq++);
+    p = put32(p, telemetry_time);
+
+    #ifdef PANNAN_SNTP
+    if (sntp_synced())
+        unix_sec = sntp_unix(telemetry_time, &unix_ms);
+    #endif
+    p = put32(p, unix_sec);
+    p = put16(p, unix_ms);
+
+    *p++ = ctx->count;
+    *p++ = TEMP_FIXED_SCALE;
+
+    for (int i = 0; i < ctx->count; i++)
+    {
+        p = put16(p, temp_to_fixed(ctx->temps[i].temp));
+    }
+
+    if (telemetry_udp.beginPacket(IPAddress(settings->telemetry_ip),
+                                  settings->telemetry_port))
+    {
+        telemetry_udp.write(buf, p - buf);
+        telemetry_udp.endPacket();
+    }
+
+    telemetry_udp.stop();
+
+    telemetry_pending = 0;
+    telemetry_last = millis();
+}
+
+#endif // PANNAN_TELEMETRY
@@ -0,0 +1,28 @@
+
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include "pannan.h"
+
+//
+// Each completed sweep is sent as one UDP datagram, all values are
+// in network byte order:
+//
+//   0  'P' 'N'     magic
+//   2  uint8_t     version
+//   3  uint8_t     node id
+//   4  uint16_t    sequence number
+//   6  uint32_t    time of the sweep (millis)
+//   10 uint32_t    time of the sweep, Unix seconds (0 when not synced)
+//   14 uint16_t    milliseconds of the Unix time
+//   16 uint8_t     number of sensors
+//   17 uint8_t     fixed point scale
+//   18 int16_t     temperatures, one per sensor
+//
+#define TELEMETRY_VERSION 2
+#define TELEMETRY_HEADER_SIZE 18
+
+void telemetry_sweep(unsigned long time);
+void feed_telemetry(Context *ctx);
+
+#endif // __TELEMETRY_H__
@@ -0,0 +1,86 @@
+#include <Arduino.h>
+
+#include "thermo.h"
+
+//
+// Type K voltage every THERMO_STEP C starting at THERMO_MIN C, in
+// microvolts plus THERMO_OFFSET so that it fits in 16 bits unsigned.
+// Generated from the NIST ITS-90 reference polynomials. Between the
+// points the curve is interpolated linearly, which is off by less than
+// 0.06 C above 0 C and 0.6 C below, about what the DS2762 resolves.
+//
+#define THERMO_MIN -200
+#define THERMO_STEP 20
+#define THERMO_OFFSET 6000
+
+static const uint16_t thermo_table[] PROGMEM =
+{
+      109,   450,   859,  1331,  1862,  2446,  3080,  3757,
+     4473,  5222,  6000,  6798,  7612,  8436,  9267, 10096,
+    10920, 11735, 12540, 13340, 14138, 14940, 15747, 16561,
+    17382, 18209, 19040, 19874, 20713, 21554, 22397, 23243,
+    24091, 24941, 25792, 26644, 27497, 28350, 29203, 30055,
+    30905, 31755, 32602, 33447, 34289, 35129, 35965, 36798,
+    37628, 38453, 39275, 40093, 40908, 41718, 42524, 43326,
+    44124, 44918, 45708, 46494, 47276, 48053, 48826, 49595,
+    50359, 51119, 51873, 52623, 53367, 54105, 54838, 55565,
+    56286, 57000, 57708, 58410, 59106, 59795, 60479, 61157
+};
+
+#define THERMO_COUNT (sizeof(thermo_table) / sizeof(thermo_table[0]))
+#define THERMO_STEP_MC (THERMO_STEP * 1000L)
+
+static long thermo_uv(uint8_t k)
+{
+    return (long)pgm_read_word(&thermo_table[k]) - THERMO_OFFSET;
+}
+
+long thermo_mc_to_uv(long mc)
+{
+    long t = mc - THERMO_MIN * 1000L;
+    long k = 0;
+    long uv0;
+
+    // Outside the table the end segments are extended.
+    if (t > 0)
+    {
+        k = t / THERMO_STEP_MC;
+
+        if (k > (long)THERMO_COUNT - 2)
+            k = THERMO_COUNT - 2;
+    }
+
+    uv0 = thermo_uv(k);
+
+    return uv0 + (thermo_uv(k + 1) - uv0)
+               * (t - k * THERMO_STEP_MC) / THERMO_STEP_MC;
+}
+
+long thermo_uv_to_mc(long uv)
+{
+    uint8_t lo = 0;
+    uint8_t hi = THERMO_COUNT - 1;
+    uint8_t mid;
+    long uv0;
+
+    while ((hi - lo) > 1)
+    {
+        mid = (lo + hi) / 2;
+
+        if (thermo_uv(mid) <= uv)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    uv0 = thermo_uv(lo);
+
+    return (THERMO_MIN + lo * THERMO_STEP) * 1000L
+         + (uv - uv0) * THERMO_STEP_MC / (thermo_uv(hi) - uv0);
+}
+
+long thermo_convert(long uv, long cj_mc)
+{
+    // The thermocouple only measures the difference to the cold junction.
+    return thermo_uv_to_mc(uv + thermo_mc_to_uv(cj_mc));
+}
@@ -0,0 +1,24 @@
+
+#ifndef __THERMO_H__
+#define __THERMO_H__
+
+#include <Arduino.h>
+
+//
+// Type K thermocouple conversion, replaces kthermlib with a table that
+// is a fraction of the size.
+//
+
+// Voltage in microvolts of a temperature in millidegrees C.
+long thermo_mc_to_uv(long mc);
+
+// Temperature in millidegrees C of a voltage in microvolts.
+long thermo_uv_to_mc(long uv);
+
+//
+// Temperature of the hot junction in millidegrees C, from the measured
+// voltage and the temperature of the cold junction.
+//
+long thermo_convert(long uv, long cj_mc);
+
+#endif // __THERMO_H__